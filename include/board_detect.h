@@ -0,0 +1,18 @@
+// Camera pin profile selection: NVS-cached profile, else an SCCB probe of the known boards
+#ifndef BOARD_DETECT_H
+#define BOARD_DETECT_H
+
+#include "sensor_probe.h"
+
+// Profile to initialize the camera with. A profile cached by boardDetectRemember()
+// is returned without probing (from_cache = true); otherwise every known profile
+// is probed over SCCB. Falls back to the first profile if no sensor answers.
+const BoardProfile *boardDetect(bool *from_cache);
+
+// Cache profile in NVS after the camera came up with it (no write if unchanged)
+void boardDetectRemember(const BoardProfile *profile);
+
+// Drop the cached profile, e.g. after camera init failed with it
+void boardDetectForget();
+
+#endif
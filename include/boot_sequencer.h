@@ -0,0 +1,51 @@
+// Boot state machine: camera and WiFi come up concurrently, servers start once both are ready
+#ifndef BOOT_SEQUENCER_H
+#define BOOT_SEQUENCER_H
+
+#include <stdint.h>
+
+// No Arduino/IDF dependencies: the caller feeds events with a timestamp and
+// carries out the returned actions, so the sequence can be replayed on a host.
+
+#define BOOT_CACHED_CONNECT_TIMEOUT_MS  4000   // Cached channel/BSSID: give up and fall back to a full connect
+#define BOOT_FULL_CONNECT_TIMEOUT_MS    20000  // Full connect (driver scans all channels)
+
+enum BootEvent {
+  BOOT_EVENT_TICK,             // Nothing happened; checks deadlines
+  BOOT_EVENT_CAMERA_READY,
+  BOOT_EVENT_CAMERA_FAILED,
+  BOOT_EVENT_WIFI_CONNECTED,
+  BOOT_EVENT_WIFI_FAILED       // Definite failure (no SSID / auth rejected); only ends a cached attempt early
+};
+
+// Action bits returned by bootSequencerBegin/Handle, in the order they should be applied
+#define BOOT_ACTION_CLEAR_WIFI_CACHE  (1u << 0)
+#define BOOT_ACTION_CONNECT_CACHED    (1u << 1)
+#define BOOT_ACTION_CONNECT_FULL      (1u << 2)
+#define BOOT_ACTION_SAVE_WIFI_CACHE   (1u << 3)
+#define BOOT_ACTION_START_SERVERS     (1u << 4)
+#define BOOT_ACTION_REPORT_FAILURE    (1u << 5)
+
+enum BootWifiState { BOOT_WIFI_CACHED, BOOT_WIFI_FULL, BOOT_WIFI_UP, BOOT_WIFI_FAILED };
+enum BootCameraState { BOOT_CAMERA_PENDING, BOOT_CAMERA_UP, BOOT_CAMERA_FAILED };
+enum BootPhase { BOOT_PHASE_RUNNING, BOOT_PHASE_READY, BOOT_PHASE_FAILED };
+
+struct BootSequencer {
+  BootPhase phase;
+  BootWifiState wifi;
+  BootCameraState camera;
+  uint32_t wifi_deadline_ms;
+  bool used_wifi_cache;       // Connected on the cached channel/BSSID
+  // Timestamps in the caller's clock (ms since boot), 0 = not reached
+  uint32_t start_ms;
+  uint32_t camera_ms;
+  uint32_t wifi_ms;
+  uint32_t ready_ms;
+};
+
+uint32_t bootSequencerBegin(BootSequencer *boot, bool have_wifi_cache, uint32_t now_ms);
+uint32_t bootSequencerHandle(BootSequencer *boot, BootEvent event, uint32_t now_ms);
+
+const char *bootWifiStateName(BootWifiState state);
+
+#endif
@@ -0,0 +1,81 @@
+// Camera arbitration: one user of the sensor at a time, granted by priority class
+#ifndef CAMERA_ARBITER_H
+#define CAMERA_ARBITER_H
+
+#include <stdint.h>
+
+// No Arduino/IDF dependencies: the caller serializes the calls, blocks the waiters and
+// passes the time (us on a monotonic clock), so contention can be replayed on a host.
+
+// Highest priority first. A class is granted the camera only while no higher class
+// is waiting; holders give it back after every frame, so a snapshot waits for at
+// most the frame the stream is capturing and encoding right now.
+enum CameraClient {
+  CAMERA_CLIENT_SNAPSHOT,   // /capture, /raw, /bench/pipeline
+  CAMERA_CLIENT_TIMELAPSE,
+  CAMERA_CLIENT_STREAM,     // MJPEG, raw stream, WebSocket, RTSP, /stats
+  CAMERA_CLIENT_IDLE,       // Housekeeping (standby entry): only when nobody else wants it
+  CAMERA_CLIENT_COUNT
+};
+
+// Sensor mode as the caller knows it (framesize_t / pixformat_t, opaque here)
+struct CameraMode {
+  int framesize;
+  int pixformat;
+};
+
+// A stream-class grant within this long (or a stream waiting) makes a stream active: a
+// higher class taking the camera then remembers the stream's mode so the stream can
+// switch back
+#define CAMERA_STREAM_ACTIVE_US  (2 * 1000000LL)
+
+// Latency histogram: bucket i holds values up to 2^(i/4) ms (1 ms to ~65 s, ~19% wide;
+// the last one holds everything above)
+#define CAMERA_LATENCY_BUCKETS  65
+
+struct CameraLatencyStats {
+  uint32_t buckets[CAMERA_LATENCY_BUCKETS];
+  uint32_t count;
+  uint32_t max_ms;
+  uint64_t total_ms;
+};
+
+void cameraLatencyRecord(CameraLatencyStats *stats, uint32_t ms);
+// Upper bound of the bucket holding the p-quantile (p in 0-1), capped at max_ms; 0 if empty
+uint32_t cameraLatencyPercentile(const CameraLatencyStats *stats, float p);
+
+struct CameraArbiter {
+  int owner;                                // CameraClient, or -1 if free
+  uint16_t waiting[CAMERA_CLIENT_COUNT];
+  int64_t last_stream_us;                   // Last stream-class grant, 0 = never
+  bool restore_pending;
+  CameraMode restore_mode;                  // Stream mode before a higher class took over
+  uint32_t grants[CAMERA_CLIENT_COUNT];
+  uint32_t preemptions;                     // Higher-class grants while a stream was active
+  uint32_t restores;                        // Stream switched back to its mode afterwards
+  CameraLatencyStats wait[CAMERA_CLIENT_COUNT];  // Request -> grant
+  CameraLatencyStats snapshot[2];           // Snapshot request -> image ready, [1] = stream active
+};
+
+void cameraArbiterInit(CameraArbiter *arb);
+
+// Grant the camera to client if it is free and no higher class is waiting. current is
+// the sensor mode right now (NULL if the camera is down).
+bool cameraArbiterTryAcquire(CameraArbiter *arb, CameraClient client, const CameraMode *current, int64_t now_us);
+
+// Register / unregister a blocked waiter (between a failed TryAcquire and the grant)
+void cameraArbiterWaitBegin(CameraArbiter *arb, CameraClient client);
+void cameraArbiterWaitEnd(CameraArbiter *arb, CameraClient client);
+
+// Give the camera back. Returns the highest class with waiters (to be woken), or -1.
+int cameraArbiterRelease(CameraArbiter *arb);
+
+// For a stream-class holder: the mode to switch back to after a higher class changed
+// it. True (once) if it differs from current.
+bool cameraArbiterTakeRestore(CameraArbiter *arb, const CameraMode *current, CameraMode *out);
+
+bool cameraArbiterStreamActive(const CameraArbiter *arb, int64_t now_us);
+
+const char *cameraClientName(CameraClient client);
+
+#endif
@@ -0,0 +1,54 @@
+// Idle standby: sensor and XCLK stopped between requests, frame buffers kept
+#ifndef CAMERA_STANDBY_H
+#define CAMERA_STANDBY_H
+
+#include <stdint.h>
+#include "driver/ledc.h"
+
+// OV2640 COM2 (sensor bank register 0x09), bit 4: standby with register contents
+// kept. esp32-camera's set_reg() selects the sensor bank with bit 8 of the address.
+#define OV2640_REG_COM2      0x109
+#define OV2640_COM2_STANDBY  0x10
+
+// How the first frame after a stop was obtained
+enum CameraStart {
+  CAMERA_START_COLD,  // esp_camera_init(): power-up, probe, register load, buffers, AEC
+  CAMERA_START_WARM,  // Resume from standby: clock and standby bit only
+  CAMERA_START_COUNT
+};
+
+// First-frame latency per start kind
+struct CameraStartStats {
+  uint32_t count;
+  uint32_t last_ms;
+  uint32_t min_ms;
+  uint32_t max_ms;
+  uint64_t total_ms;
+};
+
+// xclk_timer: the LEDC timer the camera was configured with (camera_config_t.ledc_timer).
+// idle_timeout_ms of 0 disables standby.
+void cameraStandbyInit(ledc_timer_t xclk_timer, uint32_t idle_timeout_ms);
+
+// The camera is about to be used: stamps activity and resumes it if it is in standby.
+// Returns esp_timer_get_time() at the start of the resume, or 0 if it was running.
+int64_t cameraStandbyWake();
+
+// Call periodically: enters standby after idle_timeout_ms without a wake. Returns
+// true if it did.
+bool cameraStandbyPoll();
+
+// Before esp_camera_init(): un-pauses the clock timer if needed (a timer reconfigured
+// while paused stays paused); the re-initialized sensor comes up running
+void cameraStandbyReset();
+
+void cameraStandbyRecordStart(CameraStart start, uint32_t ms);
+void cameraStandbyStartStats(CameraStart start, CameraStartStats *out);
+const char *cameraStartName(CameraStart start);
+
+bool cameraInStandby();
+uint32_t cameraStandbyEntries();
+// Time spent in standby since boot, including the current period
+uint64_t cameraStandbyTotalMs();
+
+#endif
@@ -0,0 +1,60 @@
+// Latest encoded frame, shared between the capture and stream handlers
+#ifndef FRAME_CACHE_H
+#define FRAME_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_camera.h"
+#include "jpeg_encoder.h"
+
+// Reference-counted JPEG frame. Never modify a published frame; hold a
+// reference while sending and drop it with frameCacheRelease().
+struct CachedFrame {
+  uint8_t *buf;
+  size_t len;
+  uint8_t *alloc;        // Allocation buf lives in (buf itself unless published with headroom)
+  size_t alloc_len;      // Its size, as tagged MEM_TAG_CACHE: headroom + len
+  size_t prefix_len;     // Multipart boundary + part headers stored right before buf, 0 if none
+  uint16_t width;
+  uint16_t height;
+  framesize_t framesize;
+  int quality;
+  bool grayscale;        // Single-component (luma only) JPEG
+  JpegImageStats *stats; // From the encode pass; NULL for hardware JPEG and grayscale
+  uint32_t seq;          // Increases by one for every published frame
+  int64_t timestamp_us;  // esp_timer_get_time() at publish
+  int refs;
+};
+
+// Make buf the latest frame. With take_ownership the cache frees buf (with free())
+// once the last reference is dropped, otherwise buf is copied. stats (malloc()ed, may
+// be NULL) is freed with the frame. Returns the new frame with one reference held for the
+// caller, or NULL on allocation failure (buf and stats are then still owned by the caller).
+CachedFrame *frameCachePublish(uint8_t *buf, size_t len, bool take_ownership,
+                               uint16_t width, uint16_t height,
+                               framesize_t framesize, int quality, bool grayscale,
+                               JpegImageStats *stats);
+
+// Publish a stream part: alloc holds the JPEG at alloc + headroom, preceded by
+// prefix_len bytes of boundary and part headers, so the whole part is
+// buf - prefix_len .. buf + len. The cache always takes ownership of alloc (freed with
+// free()) and its headroom + len bytes, tagged MEM_TAG_ENCODE until then. Same return
+// and ownership-on-failure rules as frameCachePublish().
+CachedFrame *frameCachePublishPart(uint8_t *alloc, size_t headroom, size_t prefix_len, size_t len,
+                                   uint16_t width, uint16_t height,
+                                   framesize_t framesize, int quality, bool grayscale,
+                                   JpegImageStats *stats);
+
+// Release the cache's reference to the latest frame (e.g. to free PSRAM before a
+// camera reinit). Frames still being sent stay alive until released; seq is kept.
+void frameCacheDrop();
+
+// Latest frame with a reference held for the caller, or NULL if none yet
+CachedFrame *frameCacheAcquire();
+void frameCacheRelease(CachedFrame *frame);
+
+// Strong ETag for a frame: sequence number plus the settings it was encoded with
+// ("f<seq>-<framesize>-<quality>", "g" appended for grayscale)
+void frameCacheETag(const CachedFrame *frame, char *out, size_t out_len);
+
+#endif
@@ -0,0 +1,95 @@
+// Baseline JPEG tables and entropy-coding helpers shared by the requantizer and the encoder
+#ifndef JPEG_BITSTREAM_H
+#define JPEG_BITSTREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Zig-zag position -> natural (row-major) index
+extern const uint8_t ZIGZAG[64];
+
+// Quantization tables (ITU T.81 Annex K.1), natural order
+extern const uint8_t STD_LUMA_QT[64];
+extern const uint8_t STD_CHROMA_QT[64];
+
+// IJG quality 1-100 (higher = better, the scale of frame2jpg() and the software
+// encoder) -> percent the standard tables are scaled by: 50 -> 100, 75 -> 50, 10 -> 500
+int jpegQualityScale(int quality);
+
+// Standard Huffman tables (ITU T.81 Annex K.3)
+extern const uint8_t STD_DC_LUMA_BITS[16];
+extern const uint8_t STD_DC_LUMA_VALS[12];
+extern const uint8_t STD_DC_CHROMA_BITS[16];
+extern const uint8_t STD_DC_CHROMA_VALS[12];
+extern const uint8_t STD_AC_LUMA_BITS[16];
+extern const uint8_t STD_AC_LUMA_VALS[162];
+extern const uint8_t STD_AC_CHROMA_BITS[16];
+extern const uint8_t STD_AC_CHROMA_VALS[162];
+
+// Encoder side: code and length per symbol
+struct HuffEncTable {
+  uint16_t code[256];
+  uint8_t size[256];
+};
+
+// Growable output buffer with JPEG byte stuffing
+struct BitWriter {
+  uint8_t *buf;
+  size_t len;
+  size_t cap;
+  uint32_t acc;
+  int bits;
+  bool oom;
+};
+
+void buildEncTable(HuffEncTable *t, const uint8_t *bits, const uint8_t *vals);
+
+// Grow the buffer (realloc); on failure sets oom and stops accumulating bits
+bool bwGrow(BitWriter *bw, size_t extra);
+
+static inline bool bwReserve(BitWriter *bw, size_t extra) {
+  if (!bw->oom && bw->len + extra <= bw->cap) return true;
+  return bwGrow(bw, extra);
+}
+
+void bwBytes(BitWriter *bw, const uint8_t *data, size_t n);
+void bwByte(BitWriter *bw, uint8_t b);
+void bwWord(BitWriter *bw, uint16_t w);
+// DHT table body: class/id byte, 16 counts, symbols
+void writeHuffTable(BitWriter *bw, uint8_t cls_id, const uint8_t *bits, const uint8_t *vals);
+// Pad the last byte with 1-bits and write out everything accumulated
+void bwFlush(BitWriter *bw);
+
+static inline void bwPut(BitWriter *bw, uint32_t code, int size) {
+  bw->acc |= (code & ((1u << size) - 1)) << (32 - bw->bits - size);
+  bw->bits += size;
+  if (bw->bits >= 16) {
+    // Worst case 2 bytes + 2 stuffing bytes
+    if (!bwReserve(bw, 4)) {
+      bw->acc = 0;  // out of memory: drop bits, the result is discarded
+      bw->bits = 0;
+      return;
+    }
+    while (bw->bits >= 8) {
+      uint8_t b = (uint8_t)(bw->acc >> 24);
+      bw->buf[bw->len++] = b;
+      if (b == 0xFF) bw->buf[bw->len++] = 0x00;
+      bw->acc <<= 8;
+      bw->bits -= 8;
+    }
+  }
+}
+
+static inline int bitLength(int v) {
+  unsigned a = v < 0 ? -v : v;
+  return a ? 32 - __builtin_clz(a) : 0;
+}
+
+static inline void encodeValue(BitWriter *bw, const HuffEncTable *t, int run, int v) {
+  int s = bitLength(v);
+  int sym = (run << 4) | s;
+  bwPut(bw, t->code[sym], t->size[sym]);
+  if (s) bwPut(bw, (uint32_t)(v < 0 ? v - 1 : v), s);
+}
+
+#endif
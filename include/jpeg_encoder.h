@@ -0,0 +1,45 @@
+// Software baseline JPEG encoder for sensor formats frame2jpg() handles poorly
+#ifndef JPEG_ENCODER_H
+#define JPEG_ENCODER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Luma at or below / at or above these counts as crushed shadows / blown highlights
+#define JPEG_STATS_CLIP_LOW   4
+#define JPEG_STATS_CLIP_HIGH  251
+
+// Image statistics gathered while encoding, from the luma rows the DCT reads anyway
+// (no second pass over the frame buffer). Sampled on every second row and column.
+struct JpegImageStats {
+  uint32_t histogram[256];  // Luma of the sampled pixels
+  uint32_t samples;         // Sum of the histogram, about width * height / 4
+  uint16_t width;
+  uint16_t height;
+  float mean;               // Luma 0-255
+  float clipped_low;        // Share of samples <= JPEG_STATS_CLIP_LOW
+  float clipped_high;       // Share of samples >= JPEG_STATS_CLIP_HIGH
+  float sharpness;          // Variance of the 4-neighbour luma Laplacian; higher = more
+                            // in focus (compare frames of the same scene and size)
+};
+
+// Encode an interleaved YUV422 (Y0 U Y1 V) frame as a 4:2:0 JFIF with the standard
+// tables. Y goes straight to the DCT and chroma is only averaged over row pairs
+// (already halved horizontally by the sensor) - no colour conversion at all.
+// width must be even. quality is 1-100 (higher = better), the same scale as frame2jpg().
+// stats, if given, is filled for the frame.
+//
+// On success *out is a malloc()ed buffer the caller must free(). The JPEG starts
+// headroom bytes into it (left for the caller, e.g. a protocol header sent in the
+// same write); *out_len counts the JPEG only.
+bool jpegEncodeYuyv(const uint8_t *yuyv, int width, int height, int quality,
+                    uint8_t **out, size_t *out_len, JpegImageStats *stats = NULL,
+                    size_t headroom = 0);
+
+// Same for big-endian RGB565 (as the sensor sends it): converted to YCbCr while the
+// MCU rows are loaded, chroma averaged over 2x2 pixels. width must be even.
+bool jpegEncodeRgb565(const uint8_t *rgb565, int width, int height, int quality,
+                      uint8_t **out, size_t *out_len, JpegImageStats *stats = NULL,
+                      size_t headroom = 0);
+
+#endif
@@ -0,0 +1,32 @@
+// Coefficient-domain JPEG requantization
+#ifndef JPEG_REQUANT_H
+#define JPEG_REQUANT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Re-encode a baseline JPEG with every quantization table scaled by
+// scale_num/scale_den (must be >= 1). The entropy-coded data is Huffman-decoded,
+// the DCT coefficients are requantized in place and re-encoded with the standard
+// Huffman tables - no IDCT, no colour conversion. Restart markers are dropped.
+//
+// On success *out is a malloc()ed buffer the caller must free().
+// Returns false (and leaves *out NULL) for progressive/12-bit/multi-scan input,
+// 16-bit quantization tables with a step above 255, or if the bitstream is corrupt.
+bool jpegRequantize(const uint8_t *src, size_t src_len,
+                    int scale_num, int scale_den,
+                    uint8_t **out, size_t *out_len);
+
+// IJG-equivalent quality (1-100, higher = better) of a JPEG, from how far its luma
+// quantization table is scaled from the standard one. 0 if it has no luma table.
+// Hardware frames aren't IJG-built, so this is the nearest equivalent.
+int jpegEstimateQuality(const uint8_t *jpg, size_t len);
+
+// Requantize to IJG quality (the software encoder's q scale): the tables are scaled
+// by jpegQualityScale(quality) over the frame's own estimated scale. False (and
+// *out NULL) if the frame is already at that quality or coarser, or on the same
+// failures as jpegRequantize().
+bool jpegRequantizeToQuality(const uint8_t *src, size_t src_len, int quality,
+                             uint8_t **out, size_t *out_len);
+
+#endif
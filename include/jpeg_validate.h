@@ -0,0 +1,34 @@
+// Structural check of hardware JPEG frames before they are sent
+#ifndef JPEG_VALIDATE_H
+#define JPEG_VALIDATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum JpegCheckResult {
+  JPEG_VALID,
+  JPEG_ERR_NO_SOI,      // Doesn't start with FF D8
+  JPEG_ERR_MARKER,      // Broken segment structure (bad marker, length < 2, EOI before scan)
+  JPEG_ERR_NO_SOF,      // Scan without a frame header
+  JPEG_ERR_DIMENSIONS,  // SOF size differs from the requested frame size
+  JPEG_ERR_TRUNCATED,   // A segment or the scan runs past the end: no EOI
+  JPEG_CHECK_COUNT
+};
+
+struct JpegCheck {
+  uint16_t width;   // From SOF (0 if not reached)
+  uint16_t height;
+  size_t len;       // Bytes up to and including EOI
+  size_t trailing;  // Bytes after EOI (DMA padding / garbage), safe to drop
+};
+
+// Walk SOI, the header segments, SOF and the entropy-coded data up to EOI.
+// expect_width/height of 0 skip the size check. The scan is searched for 0xFF a
+// machine word at a time, so the cost is close to one pass over memory.
+JpegCheckResult jpegValidate(const uint8_t *buf, size_t len,
+                             uint16_t expect_width, uint16_t expect_height,
+                             JpegCheck *out);
+
+const char *jpegCheckName(JpegCheckResult result);
+
+#endif
@@ -0,0 +1,69 @@
+// PSRAM budget planner for camera mode switches (pure logic, no ESP-IDF dependencies)
+#ifndef MEM_BUDGET_H
+#define MEM_BUDGET_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Bytes kept free in PSRAM for everything that isn't the camera pipeline
+#define MEM_BUDGET_PSRAM_RESERVE   (64 * 1024)
+// frame2jpg() encodes into a fixed output buffer of this size
+#define MEM_BUDGET_FRAME2JPG_OUT   (128 * 1024)
+
+enum MemPixelFormat {
+  MEM_FORMAT_JPEG,
+  MEM_FORMAT_RGB565,
+  MEM_FORMAT_YUV422,
+  MEM_FORMAT_GRAY
+};
+
+struct MemBudgetMode {
+  uint16_t width;
+  uint16_t height;
+  MemPixelFormat format;
+  uint8_t fb_count;
+};
+
+struct MemFootprint {
+  size_t fb_bytes;      // One frame buffer, sized like esp32-camera does (JPEG: w*h/5)
+  size_t camera_bytes;  // fb_bytes * fb_count, allocated by esp_camera_init()
+  size_t encode_bytes;  // Encoder/requantizer output while a frame is converted
+  size_t cache_bytes;   // Frame cache: latest frame + the one it replaces
+  size_t total_bytes;
+};
+
+// A heap region as sampled right before the switch
+struct MemRegionState {
+  size_t free_bytes;
+  size_t largest_block;
+};
+
+enum MemPlanAction {
+  MEM_PLAN_OK,           // Switch directly
+  MEM_PLAN_FLUSH_FIRST,  // Release cached frames/scratch buffers before deinit, then switch
+  MEM_PLAN_REDUCE_FB,    // Flush and switch with fb_count lowered to plan.fb_count
+  MEM_PLAN_REFUSE        // Would fail: keep the current mode
+};
+
+struct MemPlan {
+  MemPlanAction action;
+  uint8_t fb_count;        // Buffers to initialize with (target's, or fewer for REDUCE_FB)
+  MemFootprint footprint;  // Of the target at plan.fb_count
+  size_t available_bytes;  // PSRAM free once the current mode's buffers are released
+  size_t available_block;  // Largest block we can count on after the release
+};
+
+void memBudgetFootprint(const MemBudgetMode *mode, MemFootprint *out);
+
+// Plan a switch to target. current is the mode being replaced (its frame buffers are
+// freed by deinit) or NULL; flushable is what the caller can release beforehand.
+// A fit needs one frame buffer in the largest block and the whole footprint plus
+// MEM_BUDGET_PSRAM_RESERVE in the free total. Frame buffers of the current mode may
+// not coalesce with their neighbours, so only the biggest of them counts as a block.
+void memBudgetPlan(const MemBudgetMode *target, const MemBudgetMode *current,
+                   const MemRegionState *psram, size_t flushable, MemPlan *plan);
+
+const char *memPlanActionName(MemPlanAction action);
+const char *memPixelFormatName(MemPixelFormat format);
+
+#endif
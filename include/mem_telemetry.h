@@ -0,0 +1,81 @@
+// Heap/PSRAM fragmentation sampling and per-subsystem allocation accounting
+#ifndef MEM_TELEMETRY_H
+#define MEM_TELEMETRY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Who holds the memory. Buffers allocated inside esp32-camera or frame2jpg() are
+// accounted by their callers once the size is known.
+enum MemTag {
+  MEM_TAG_CAMERA,  // Frame buffers (esp_camera_init)
+  MEM_TAG_ENCODE,  // Software JPEG / requantizer output until freed or cached
+  MEM_TAG_SEND,    // Send-side scratch buffers
+  MEM_TAG_CACHE,   // Frames held by the frame cache
+  MEM_TAG_TIMELAPSE,  // Time-lapse frames staged for download
+  MEM_TAG_COUNT
+};
+
+struct MemTagStats {
+  size_t bytes;       // Currently held
+  size_t peak_bytes;
+  uint32_t allocs;
+  uint32_t failures;
+};
+
+enum MemRegion {
+  MEM_REGION_INTERNAL,
+  MEM_REGION_PSRAM,
+  MEM_REGION_COUNT
+};
+
+struct MemRegionSample {
+  size_t total_bytes;
+  size_t free_bytes;
+  size_t largest_block;
+  size_t min_free_bytes;  // Low-water mark since boot (heap_caps)
+};
+
+// Why a sample was taken; also counted per event
+enum MemEvent {
+  MEM_EVENT_PERIODIC,
+  MEM_EVENT_REINIT_BEFORE,
+  MEM_EVENT_REINIT_AFTER,
+  MEM_EVENT_REINIT_FAILED,
+  MEM_EVENT_REINIT_REFUSED,
+  MEM_EVENT_COUNT
+};
+
+struct MemSample {
+  uint32_t uptime_s;
+  MemEvent event;
+  MemRegionSample region[MEM_REGION_COUNT];
+};
+
+// Samples kept in the history ring (periodic ones every MEM_SAMPLE_PERIOD_MS)
+#define MEM_HISTORY_LEN       64
+#define MEM_SAMPLE_PERIOD_MS  10000
+
+void memTagAlloc(MemTag tag, size_t bytes);
+void memTagFree(MemTag tag, size_t bytes);
+void memTagFail(MemTag tag);
+// Ownership handover (e.g. an encoded frame given to the cache): no new allocation
+void memTagTransfer(MemTag from, MemTag to, size_t bytes);
+void memTagGet(MemTag tag, MemTagStats *out);
+const char *memTagName(MemTag tag);
+
+void memRegionSample(MemRegion region, MemRegionSample *out);
+const char *memRegionName(MemRegion region);
+// 0-100: share of free memory not usable as one block (1 - largest/free)
+unsigned memFragmentationPct(const MemRegionSample *sample);
+
+// Sample both regions into the history ring and count the event
+void memTelemetrySample(MemEvent event);
+// Smallest largest-free-block seen in any sample since boot
+size_t memTelemetryLowestBlock(MemRegion region);
+uint32_t memTelemetryEventCount(MemEvent event);
+const char *memEventName(MemEvent event);
+// Copy up to max samples, oldest first; returns the number copied
+int memTelemetryHistory(MemSample *out, int max);
+
+#endif
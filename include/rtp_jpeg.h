@@ -0,0 +1,35 @@
+// RFC 2435 RTP/JPEG payload: JPEG parsing and fragmentation, no sockets
+#ifndef RTP_JPEG_H
+#define RTP_JPEG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define RTP_JPEG_HEADER_LEN   8   // Main JPEG header
+#define RTP_JPEG_RESTART_LEN  4   // Restart marker header (types 64..127)
+#define RTP_JPEG_QTABLE_LEN   4   // Quantization table header, followed by the tables
+
+// RFC 2435 view of a baseline JPEG: everything a receiver can't rebuild itself
+struct RtpJpegInfo {
+  uint8_t type;            // 0 = 4:2:2, 1 = 4:2:0, +64 when a restart interval is present
+  uint16_t width;
+  uint16_t height;
+  uint16_t restart_interval;
+  const uint8_t *qtables;  // Luma then chroma table, 64 bytes each, zig-zag order
+  uint8_t qtable_len;      // 128 (both tables)
+  const uint8_t *scan;     // Entropy-coded data, SOS header and EOI stripped
+  size_t scan_len;
+};
+
+// Parse a JPEG into its RFC 2435 parts. Fails for grayscale, progressive, 16-bit
+// quantization tables, non-4:2:x sampling or images larger than 2040x2040.
+// qtable_storage must hold 128 bytes; info->qtables points into it.
+bool rtpJpegParse(const uint8_t *jpg, size_t len, RtpJpegInfo *info, uint8_t *qtable_storage);
+
+// Write the RTP payload (JPEG headers + scan data) of the fragment starting at
+// scan offset `offset` into out, at most max_len bytes. Returns the payload length
+// and advances *offset; the fragment is the last one (RTP marker bit) when
+// *offset == info->scan_len afterwards. Returns 0 if max_len can't hold the headers.
+size_t rtpJpegFragment(const RtpJpegInfo *info, size_t *offset, uint8_t *out, size_t max_len);
+
+#endif
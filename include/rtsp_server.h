@@ -0,0 +1,25 @@
+// RTSP server streaming MJPEG as RTP/JPEG (RFC 2435) for NVRs, ffmpeg and VLC
+#ifndef RTSP_SERVER_H
+#define RTSP_SERVER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "frame_cache.h"
+
+#define RTSP_PORT           554
+#define RTSP_MAX_SESSIONS   4
+#define RTSP_RTP_PORT       6970   // Server-side UDP port for RTP (RTCP would be +1)
+
+// Returns a frame newer than after_seq with a reference held for the RTSP task
+// (released with frameCacheRelease), or NULL if none could be produced.
+typedef CachedFrame *(*RtspFrameSource)(uint32_t after_seq);
+
+// Start the RTSP task. Each frame from source is packetized once per subscriber:
+// UDP unicast or TCP-interleaved, as negotiated in SETUP.
+// URL: rtsp://<ip>/mjpeg (any path is accepted)
+bool rtspServerStart(uint16_t port, RtspFrameSource source);
+
+// Number of sessions currently in PLAY state
+int rtspServerPlayingCount();
+
+#endif
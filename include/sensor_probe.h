@@ -0,0 +1,69 @@
+// Camera board profiles and OV2640 detection over SCCB
+#ifndef SENSOR_PROBE_H
+#define SENSOR_PROBE_H
+
+#include <stdint.h>
+
+// OV2640 answers on 7-bit SCCB address 0x30 (0x60/0x61 as 8-bit write/read)
+#define OV2640_SCCB_ADDR      0x30
+#define OV2640_REG_BANK_SEL   0xFF   // 0x01 selects the sensor register bank
+#define OV2640_REG_PIDH       0x0A   // 0x26
+#define OV2640_REG_PIDL       0x0B   // 0x41 or 0x42 depending on revision
+#define OV2640_REG_MIDH       0x1C   // 0x7F (OmniVision)
+#define OV2640_REG_MIDL       0x1D   // 0xA2
+
+// Full camera pin map of one board (-1 = not connected)
+struct BoardProfile {
+  const char *name;
+  int8_t pin_pwdn;
+  int8_t pin_reset;
+  int8_t pin_xclk;
+  int8_t pin_sccb_sda;
+  int8_t pin_sccb_scl;
+  int8_t pin_d7, pin_d6, pin_d5, pin_d4, pin_d3, pin_d2, pin_d1, pin_d0;
+  int8_t pin_vsync;
+  int8_t pin_href;
+  int8_t pin_pclk;
+};
+
+// Known ESP32-S3 camera boards, most common first. Index 0 is the GOOUUU
+// ESP32-S3-CAM this project was built for.
+extern const BoardProfile BOARD_PROFILES[];
+extern const int BOARD_PROFILE_COUNT;
+
+// SCCB access used by the probe. The firmware implements it with Wire and an
+// LEDC clock; anything else (e.g. a simulated bus) can be plugged in.
+struct SccbBus {
+  void *ctx;
+  // Whether an idle SCCB bus (pulled-up SDA and SCL) is wired to profile's pins, checked
+  // without driving any pin. Profiles of other boards fail here, before begin() drives
+  // XCLK onto what may be this board's sensor outputs (e.g. GPIO 15 is the XIAO's D0).
+  bool (*bus_present)(void *ctx, const BoardProfile *profile);
+  // Power the sensor up for profile (PWDN/RESET, XCLK) and open the bus on its SCCB pins
+  bool (*begin)(void *ctx, const BoardProfile *profile);
+  // Address-only transfer; true if a device acknowledged
+  bool (*ping)(void *ctx, uint8_t addr);
+  bool (*read_reg)(void *ctx, uint8_t addr, uint8_t reg, uint8_t *value);
+  bool (*write_reg)(void *ctx, uint8_t addr, uint8_t reg, uint8_t value);
+  // Release the pins so esp_camera_init() can claim them
+  void (*end)(void *ctx);
+};
+
+struct SensorProbeResult {
+  int profile_index;
+  uint8_t addr;
+  uint16_t pid;   // PIDH << 8 | PIDL, e.g. 0x2642
+};
+
+// Check one profile: idle bus on its SCCB pins, then (only then) XCLK and bus up, sensor
+// ACKs, manufacturer and product ID match OV2640
+bool sensorProbeProfile(const SccbBus *bus, const BoardProfile *profile, uint16_t *pid);
+
+// Try profiles in order, starting with first_index, and stop at the first OV2640
+bool sensorProbe(const SccbBus *bus, const BoardProfile *profiles, int count,
+                 int first_index, SensorProbeResult *out);
+
+// Index of the profile named name, or -1
+int boardProfileFind(const BoardProfile *profiles, int count, const char *name);
+
+#endif
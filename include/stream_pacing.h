@@ -0,0 +1,48 @@
+// Stream pacing: when a cached frame may answer a request, and the WebSocket
+// one-frame-in-flight protocol (request parsing, per-client accounting, frame header)
+#ifndef STREAM_PACING_H
+#define STREAM_PACING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// No Arduino/IDF dependencies: the caller passes the time (us on a monotonic clock)
+// and does the capturing and sending, so a slow reader can be replayed on a host.
+
+// WebSocket message = 16-byte little-endian header + JPEG:
+//   0: 'F' 'R'  2: version (1)  3: header length (16)
+//   4: u32 frame sequence  8: u32 timestamp (ms since boot)  12: u16 width  14: u16 height
+#define WS_FRAME_HEADER_LEN   16
+#define WS_FRAME_VERSION      1
+
+// A cached frame this young that the client hasn't seen yet is sent without a new capture
+#ifndef WS_FRAME_MAX_AGE_MS
+#define WS_FRAME_MAX_AGE_MS   100
+#endif
+
+// The latest frame (frame_seq, published at frame_us) may answer a client whose last
+// frame was last_seq if it is a different frame and at most max_age_ms old. Otherwise
+// a new one is captured: however long the client took to ask, it never gets a frame
+// older than that, and never the same one twice.
+bool streamFrameReusable(uint32_t frame_seq, int64_t frame_us, uint32_t last_seq,
+                         int64_t now_us, int max_age_ms);
+
+// Per WebSocket connection. The client asks for each frame with a "next" text
+// message after it has shown the previous one, so at most one frame is in flight and
+// frames produced in between are skipped instead of piling up in TCP buffers.
+struct WsSession {
+  uint32_t last_seq;  // Last frame sent on this connection, 0 = none yet
+  uint32_t frames;    // Sent
+  uint32_t skipped;   // Published between two sends on this connection, never sent here
+};
+
+// A frame request: a text message starting with "next"; anything else is ignored
+bool wsIsFrameRequest(bool is_text, const uint8_t *msg, size_t len);
+
+// frame_seq went out on this connection
+void wsSessionSent(WsSession *session, uint32_t frame_seq);
+
+void wsFrameHeader(uint8_t hdr[WS_FRAME_HEADER_LEN], uint32_t seq, uint32_t ts_ms,
+                   uint16_t width, uint16_t height);
+
+#endif
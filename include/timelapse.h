@@ -0,0 +1,107 @@
+// Time-lapse: shot schedule, PSRAM staging of the JPEGs and their tar download format
+#ifndef TIMELAPSE_H
+#define TIMELAPSE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// No Arduino/IDF dependencies: the caller passes the time (ms on a monotonic clock)
+// and does the capturing and locking, so schedules can be replayed on a host.
+
+#define TIMELAPSE_MAX_FRAMES   512   // Staged frames, whatever their size
+#define TIMELAPSE_TAR_BLOCK    512
+
+struct TimelapseConfig {
+  uint32_t interval_ms;
+  uint32_t duration_ms;  // 0 = until stopped
+  int framesize;         // framesize_t, opaque here
+  int quality;
+  uint64_t epoch_ms;     // Wall clock (Unix ms) at start, 0 = unknown (no RTC/SNTP)
+};
+
+// Shot i is due at start_ms + i * interval_ms. Slots are never shifted by a late
+// shot, so the series doesn't drift; a slot whose successor is already due when it
+// is checked is skipped (counted as missed) instead of being taken late in a burst.
+struct TimelapseSchedule {
+  TimelapseConfig config;
+  bool running;
+  uint64_t start_ms;
+  uint32_t next_slot;
+  uint32_t taken;
+  uint32_t missed;
+  uint32_t failed;        // Due but no frame (capture/encode/store failed)
+  uint64_t late_total_ms; // Capture time - due time, over the taken shots
+  uint32_t late_max_ms;
+};
+
+void timelapseStart(TimelapseSchedule *tl, const TimelapseConfig *config, uint64_t now_ms);
+void timelapseStop(TimelapseSchedule *tl);
+
+// True if a shot is due at now_ms; *due_ms is its slot time. Ends the run after the
+// last slot within duration_ms has been handed out.
+bool timelapseDue(TimelapseSchedule *tl, uint64_t now_ms, uint64_t *due_ms);
+// When the next shot is due; false if the run is over
+bool timelapseNextDue(const TimelapseSchedule *tl, uint64_t *due_ms);
+
+void timelapseShotTaken(TimelapseSchedule *tl, uint64_t due_ms, uint64_t taken_ms);
+void timelapseShotFailed(TimelapseSchedule *tl);
+
+// Wall clock for a time on the monotonic clock, 0 if the run has no epoch
+uint64_t timelapseWallMs(const TimelapseSchedule *tl, uint64_t mono_ms);
+
+// A staged JPEG. Reference-counted like CachedFrame: the store holds one reference,
+// a download holds another while it sends the frame.
+struct TimelapseFrame {
+  uint8_t *buf;
+  size_t len;
+  uint32_t seq;       // Increases by one for every stored frame, across runs
+  uint64_t due_ms;
+  uint64_t taken_ms;  // Sensor capture time, monotonic clock
+  uint64_t wall_ms;   // 0 = unknown
+  int refs;
+};
+
+// Frees a frame's JPEG; free() if NULL
+typedef void (*TimelapseFreeFn)(uint8_t *buf, size_t len);
+
+// Frames oldest first in a ring. When a new frame doesn't fit budget_bytes or the ring
+// is full, the oldest frames are evicted (counted) so the newest ones survive an
+// offline period.
+struct TimelapseStore {
+  TimelapseFrame *frames[TIMELAPSE_MAX_FRAMES];
+  uint16_t head;
+  uint16_t count;
+  size_t bytes;
+  size_t budget_bytes;
+  uint32_t last_seq;
+  uint32_t evicted;
+  TimelapseFreeFn free_buf;
+};
+
+void timelapseStoreInit(TimelapseStore *store, size_t budget_bytes, TimelapseFreeFn free_buf);
+
+// Stage buf (malloc()ed; the store takes it over). Returns the frame, or NULL if it
+// is larger than the whole budget or out of memory (buf then still belongs to the caller).
+TimelapseFrame *timelapseStoreAdd(TimelapseStore *store, uint8_t *buf, size_t len,
+                                  uint64_t due_ms, uint64_t taken_ms, uint64_t wall_ms);
+
+// Oldest frame with seq > after_seq, with a reference held for the caller, or NULL
+TimelapseFrame *timelapseStoreAcquire(TimelapseStore *store, uint32_t after_seq);
+void timelapseStoreRelease(TimelapseStore *store, TimelapseFrame *frame);
+
+// Drop staged frames with seq <= through_seq (e.g. after a download). Returns how many.
+uint32_t timelapseStoreDiscard(TimelapseStore *store, uint32_t through_seq);
+
+// seq of the oldest / newest staged frame, 0 if empty
+uint32_t timelapseStoreFirstSeq(const TimelapseStore *store);
+uint32_t timelapseStoreLastSeq(const TimelapseStore *store);
+
+// Download as a tar stream: per frame a header block, the JPEG and zero padding to the
+// next block; two zero blocks end the archive. Names sort in capture order:
+// "<seq>_<UTC date-time>.jpg", or "<seq>_<ms since boot>ms.jpg" without an epoch.
+// The tar mtime is the wall clock in seconds (0 without an epoch).
+void timelapseFrameName(const TimelapseFrame *frame, char *out, size_t out_len);
+void timelapseTarHeader(uint8_t *block, const char *name, size_t size, uint64_t mtime_s);
+size_t timelapseTarPadding(size_t size);
+
+#endif
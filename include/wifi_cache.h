@@ -0,0 +1,21 @@
+// Last good WiFi association (channel + BSSID) in NVS, for connecting without a scan
+#ifndef WIFI_CACHE_H
+#define WIFI_CACHE_H
+
+#include <stdint.h>
+
+struct WifiCache {
+  int32_t channel;
+  uint8_t bssid[6];
+};
+
+// Load the cached association for ssid. Fails if nothing is stored or it was
+// stored for a different SSID (config.h changed).
+bool wifiCacheLoad(const char *ssid, WifiCache *out);
+
+// Store channel/BSSID for ssid. Skips the flash write when nothing changed.
+void wifiCacheSave(const char *ssid, int32_t channel, const uint8_t *bssid);
+
+void wifiCacheClear();
+
+#endif
@@ -0,0 +1,137 @@
+#include "board_detect.h"
+
+#include <Arduino.h>
+#include <Wire.h>
+#include <Preferences.h>
+#include "esp_timer.h"
+
+#define BOARD_DETECT_NAMESPACE   "camera"
+#define SCCB_PROBE_CLOCK_HZ      100000
+#define SCCB_PROBE_XCLK_HZ       20000000
+#define SCCB_PROBE_XCLK_CHANNEL  0      // Same LEDC channel/timer esp_camera_init() takes over afterwards
+#define SCCB_PROBE_SETTLE_MS     5      // OV2640 needs a few ms of XCLK before SCCB answers
+#define SCCB_PROBE_IDLE_US       50     // Internal pull-downs vs. the bus pull-ups: settled well before this
+
+// SccbBus on Arduino Wire; the sensor only answers with XCLK running and PWDN released
+
+static int8_t probe_xclk_pin = -1;
+
+// An SCCB bus idles high through the camera module's pull-ups (a few kOhm), which win
+// over the ~45 kOhm internal pull-downs; unconnected pins read low. Inputs only: nothing
+// is driven on a profile that may belong to another board.
+static bool wire_bus_present(void *ctx, const BoardProfile *p) {
+  pinMode(p->pin_sccb_sda, INPUT_PULLDOWN);
+  pinMode(p->pin_sccb_scl, INPUT_PULLDOWN);
+  delayMicroseconds(SCCB_PROBE_IDLE_US);
+  bool present = digitalRead(p->pin_sccb_sda) == HIGH && digitalRead(p->pin_sccb_scl) == HIGH;
+  pinMode(p->pin_sccb_sda, INPUT);
+  pinMode(p->pin_sccb_scl, INPUT);
+  return present;
+}
+
+static bool wire_begin(void *ctx, const BoardProfile *p) {
+  if (p->pin_pwdn >= 0) {
+    pinMode(p->pin_pwdn, OUTPUT);
+    digitalWrite(p->pin_pwdn, LOW);  // Active high: power up
+  }
+
+  ledcSetup(SCCB_PROBE_XCLK_CHANNEL, SCCB_PROBE_XCLK_HZ, 1);
+  ledcAttachPin(p->pin_xclk, SCCB_PROBE_XCLK_CHANNEL);
+  ledcWrite(SCCB_PROBE_XCLK_CHANNEL, 1);  // 50% duty at 1-bit resolution
+  probe_xclk_pin = p->pin_xclk;
+
+  if (p->pin_reset >= 0) {
+    pinMode(p->pin_reset, OUTPUT);
+    digitalWrite(p->pin_reset, LOW);
+    delay(SCCB_PROBE_SETTLE_MS);
+    digitalWrite(p->pin_reset, HIGH);
+  }
+  delay(SCCB_PROBE_SETTLE_MS);
+
+  return Wire.begin(p->pin_sccb_sda, p->pin_sccb_scl, SCCB_PROBE_CLOCK_HZ);
+}
+
+static bool wire_ping(void *ctx, uint8_t addr) {
+  Wire.beginTransmission(addr);
+  return Wire.endTransmission() == 0;
+}
+
+// SCCB has no repeated start: write the register address with a stop, then read
+static bool wire_read_reg(void *ctx, uint8_t addr, uint8_t reg, uint8_t *value) {
+  Wire.beginTransmission(addr);
+  Wire.write(reg);
+  if (Wire.endTransmission(true) != 0) return false;
+  if (Wire.requestFrom(addr, (uint8_t)1) != 1) return false;
+  *value = Wire.read();
+  return true;
+}
+
+static bool wire_write_reg(void *ctx, uint8_t addr, uint8_t reg, uint8_t value) {
+  Wire.beginTransmission(addr);
+  Wire.write(reg);
+  Wire.write(value);
+  return Wire.endTransmission() == 0;
+}
+
+static void wire_end(void *ctx) {
+  Wire.end();
+  if (probe_xclk_pin >= 0) {
+    ledcDetachPin(probe_xclk_pin);
+    probe_xclk_pin = -1;
+  }
+}
+
+static const SccbBus wire_bus = {
+  NULL, wire_bus_present, wire_begin, wire_ping, wire_read_reg, wire_write_reg, wire_end
+};
+
+static int load_cached_profile() {
+  Preferences prefs;
+  if (!prefs.begin(BOARD_DETECT_NAMESPACE, true)) return -1;
+  char name[32] = {0};
+  prefs.getString("profile", name, sizeof(name));
+  prefs.end();
+  return boardProfileFind(BOARD_PROFILES, BOARD_PROFILE_COUNT, name);
+}
+
+const BoardProfile *boardDetect(bool *from_cache) {
+  int cached = load_cached_profile();
+  if (cached >= 0) {
+    printf("[PROBE] Using cached board profile '%s'\n", BOARD_PROFILES[cached].name);
+    if (from_cache) *from_cache = true;
+    return &BOARD_PROFILES[cached];
+  }
+  if (from_cache) *from_cache = false;
+
+  int64_t start = esp_timer_get_time();
+  SensorProbeResult result;
+  if (!sensorProbe(&wire_bus, BOARD_PROFILES, BOARD_PROFILE_COUNT, 0, &result)) {
+    printf("[PROBE] No OV2640 found on %d board profiles (%lld ms), trying '%s'\n",
+           BOARD_PROFILE_COUNT, (esp_timer_get_time() - start) / 1000, BOARD_PROFILES[0].name);
+    Serial.println("⚠️  Camera sensor not found on any known pin map");
+    return &BOARD_PROFILES[0];
+  }
+
+  const BoardProfile *profile = &BOARD_PROFILES[result.profile_index];
+  printf("[PROBE] OV2640 (PID 0x%04X) at 0x%02X with profile '%s' in %lld ms\n",
+         result.pid, result.addr, profile->name, (esp_timer_get_time() - start) / 1000);
+  Serial.printf("🔍 Camera found: board profile '%s' (SDA=%d, SCL=%d)\n",
+                profile->name, profile->pin_sccb_sda, profile->pin_sccb_scl);
+  return profile;
+}
+
+void boardDetectRemember(const BoardProfile *profile) {
+  if (load_cached_profile() == profile - BOARD_PROFILES) return;  // Unchanged, spare the flash
+
+  Preferences prefs;
+  if (!prefs.begin(BOARD_DETECT_NAMESPACE, false)) return;
+  prefs.putString("profile", profile->name);
+  prefs.end();
+}
+
+void boardDetectForget() {
+  Preferences prefs;
+  if (!prefs.begin(BOARD_DETECT_NAMESPACE, false)) return;
+  prefs.remove("profile");
+  prefs.end();
+}
@@ -0,0 +1,89 @@
+#include "boot_sequencer.h"
+
+#include <string.h>
+
+// Wrap-safe "now is at or past deadline"
+static bool deadlinePassed(uint32_t now_ms, uint32_t deadline_ms) {
+  return (int32_t)(now_ms - deadline_ms) >= 0;
+}
+
+uint32_t bootSequencerBegin(BootSequencer *boot, bool have_wifi_cache, uint32_t now_ms) {
+  memset(boot, 0, sizeof(*boot));
+  boot->phase = BOOT_PHASE_RUNNING;
+  boot->camera = BOOT_CAMERA_PENDING;
+  boot->start_ms = now_ms;
+
+  if (have_wifi_cache) {
+    boot->wifi = BOOT_WIFI_CACHED;
+    boot->wifi_deadline_ms = now_ms + BOOT_CACHED_CONNECT_TIMEOUT_MS;
+    return BOOT_ACTION_CONNECT_CACHED;
+  }
+  boot->wifi = BOOT_WIFI_FULL;
+  boot->wifi_deadline_ms = now_ms + BOOT_FULL_CONNECT_TIMEOUT_MS;
+  return BOOT_ACTION_CONNECT_FULL;
+}
+
+uint32_t bootSequencerHandle(BootSequencer *boot, BootEvent event, uint32_t now_ms) {
+  if (boot->phase != BOOT_PHASE_RUNNING) return 0;
+
+  uint32_t actions = 0;
+  bool connecting = boot->wifi == BOOT_WIFI_CACHED || boot->wifi == BOOT_WIFI_FULL;
+
+  switch (event) {
+    case BOOT_EVENT_CAMERA_READY:
+      if (boot->camera == BOOT_CAMERA_PENDING) {
+        boot->camera = BOOT_CAMERA_UP;
+        boot->camera_ms = now_ms;
+      }
+      break;
+    case BOOT_EVENT_CAMERA_FAILED:
+      if (boot->camera == BOOT_CAMERA_PENDING) boot->camera = BOOT_CAMERA_FAILED;
+      break;
+    case BOOT_EVENT_WIFI_CONNECTED:
+      if (connecting) {
+        boot->used_wifi_cache = boot->wifi == BOOT_WIFI_CACHED;
+        boot->wifi = BOOT_WIFI_UP;
+        boot->wifi_ms = now_ms;
+        actions |= BOOT_ACTION_SAVE_WIFI_CACHE;
+      }
+      break;
+    case BOOT_EVENT_WIFI_FAILED:
+      // A stale cache fails fast (wrong channel -> NO_SSID); a full connect keeps
+      // retrying until its deadline since the AP may just be rate limiting us
+      if (boot->wifi == BOOT_WIFI_CACHED) boot->wifi_deadline_ms = now_ms;
+      break;
+    case BOOT_EVENT_TICK:
+      break;
+  }
+
+  if ((boot->wifi == BOOT_WIFI_CACHED || boot->wifi == BOOT_WIFI_FULL) &&
+      deadlinePassed(now_ms, boot->wifi_deadline_ms)) {
+    if (boot->wifi == BOOT_WIFI_CACHED) {
+      boot->wifi = BOOT_WIFI_FULL;
+      boot->wifi_deadline_ms = now_ms + BOOT_FULL_CONNECT_TIMEOUT_MS;
+      actions |= BOOT_ACTION_CLEAR_WIFI_CACHE | BOOT_ACTION_CONNECT_FULL;
+    } else {
+      boot->wifi = BOOT_WIFI_FAILED;
+    }
+  }
+
+  if (boot->camera == BOOT_CAMERA_FAILED || boot->wifi == BOOT_WIFI_FAILED) {
+    boot->phase = BOOT_PHASE_FAILED;
+    actions |= BOOT_ACTION_REPORT_FAILURE;
+  } else if (boot->camera == BOOT_CAMERA_UP && boot->wifi == BOOT_WIFI_UP) {
+    boot->phase = BOOT_PHASE_READY;
+    boot->ready_ms = now_ms;
+    actions |= BOOT_ACTION_START_SERVERS;
+  }
+  return actions;
+}
+
+const char *bootWifiStateName(BootWifiState state) {
+  switch (state) {
+    case BOOT_WIFI_CACHED: return "connecting (cached channel/BSSID)";
+    case BOOT_WIFI_FULL:   return "connecting (full)";
+    case BOOT_WIFI_UP:     return "connected";
+    case BOOT_WIFI_FAILED: return "failed";
+  }
+  return "?";
+}
@@ -0,0 +1,106 @@
+#include "camera_arbiter.h"
+
+#include <math.h>
+#include <string.h>
+
+// Smallest i with 2^(i/4) >= ms
+static int latencyBucket(uint32_t ms) {
+  if (ms <= 1) return 0;
+  int i = (int)ceilf(4.0f * log2f((float)ms));
+  while (i > 0 && powf(2.0f, (i - 1) / 4.0f) >= (float)ms) i--;  // float rounding at exact powers
+  return i < CAMERA_LATENCY_BUCKETS ? i : CAMERA_LATENCY_BUCKETS - 1;
+}
+
+void cameraLatencyRecord(CameraLatencyStats *stats, uint32_t ms) {
+  stats->buckets[latencyBucket(ms)]++;
+  stats->count++;
+  stats->total_ms += ms;
+  if (ms > stats->max_ms) stats->max_ms = ms;
+}
+
+uint32_t cameraLatencyPercentile(const CameraLatencyStats *stats, float p) {
+  if (!stats->count) return 0;
+  uint32_t rank = (uint32_t)ceilf(p * stats->count);
+  if (rank < 1) rank = 1;
+  uint32_t seen = 0;
+  for (int i = 0; i < CAMERA_LATENCY_BUCKETS; i++) {
+    seen += stats->buckets[i];
+    if (seen >= rank) {
+      if (i == CAMERA_LATENCY_BUCKETS - 1) return stats->max_ms;  // Open-ended top bucket
+      uint32_t bound = (uint32_t)ceilf(powf(2.0f, i / 4.0f));
+      return bound < stats->max_ms ? bound : stats->max_ms;
+    }
+  }
+  return stats->max_ms;
+}
+
+void cameraArbiterInit(CameraArbiter *arb) {
+  memset(arb, 0, sizeof(*arb));
+  arb->owner = -1;
+}
+
+bool cameraArbiterStreamActive(const CameraArbiter *arb, int64_t now_us) {
+  if (arb->waiting[CAMERA_CLIENT_STREAM]) return true;
+  return arb->last_stream_us && now_us - arb->last_stream_us < CAMERA_STREAM_ACTIVE_US;
+}
+
+bool cameraArbiterTryAcquire(CameraArbiter *arb, CameraClient client, const CameraMode *current, int64_t now_us) {
+  if (arb->owner >= 0) return false;
+  for (int c = 0; c < client; c++) {
+    if (arb->waiting[c]) return false;
+  }
+
+  if (client == CAMERA_CLIENT_STREAM) {
+    // A stream starting after a quiet period has its own mode; nothing to go back to
+    if (!cameraArbiterStreamActive(arb, now_us)) arb->restore_pending = false;
+    arb->last_stream_us = now_us;
+  } else if (client < CAMERA_CLIENT_STREAM && cameraArbiterStreamActive(arb, now_us)) {
+    // Keep the first displaced mode: back-to-back snapshots mustn't record their own
+    if (!arb->restore_pending && current) {
+      arb->restore_mode = *current;
+      arb->restore_pending = true;
+    }
+    arb->preemptions++;
+  }
+  arb->owner = client;
+  arb->grants[client]++;
+  return true;
+}
+
+void cameraArbiterWaitBegin(CameraArbiter *arb, CameraClient client) {
+  arb->waiting[client]++;
+}
+
+void cameraArbiterWaitEnd(CameraArbiter *arb, CameraClient client) {
+  if (arb->waiting[client]) arb->waiting[client]--;
+}
+
+int cameraArbiterRelease(CameraArbiter *arb) {
+  arb->owner = -1;
+  for (int c = 0; c < CAMERA_CLIENT_COUNT; c++) {
+    if (arb->waiting[c]) return c;
+  }
+  return -1;
+}
+
+bool cameraArbiterTakeRestore(CameraArbiter *arb, const CameraMode *current, CameraMode *out) {
+  if (!arb->restore_pending) return false;
+  arb->restore_pending = false;
+  if (current && current->framesize == arb->restore_mode.framesize &&
+      current->pixformat == arb->restore_mode.pixformat) {
+    return false;
+  }
+  *out = arb->restore_mode;
+  arb->restores++;
+  return true;
+}
+
+const char *cameraClientName(CameraClient client) {
+  switch (client) {
+    case CAMERA_CLIENT_SNAPSHOT:  return "snapshot";
+    case CAMERA_CLIENT_TIMELAPSE: return "timelapse";
+    case CAMERA_CLIENT_STREAM:    return "stream";
+    case CAMERA_CLIENT_IDLE:      return "idle";
+    default:                      return "unknown";
+  }
+}
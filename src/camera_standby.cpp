@@ -0,0 +1,150 @@
+#include "camera_standby.h"
+
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_camera.h"
+#include "esp_timer.h"
+
+// esp32-camera runs XCLK from a high-speed LEDC timer where there are any (ESP32),
+// otherwise from a low-speed one
+#ifdef SOC_LEDC_SUPPORT_HS_MODE
+#define XCLK_SPEED_MODE  LEDC_HIGH_SPEED_MODE
+#else
+#define XCLK_SPEED_MODE  LEDC_LOW_SPEED_MODE
+#endif
+
+// SCCB only answers with XCLK running; give it a moment after the resume, as the probe does
+#define STANDBY_CLOCK_SETTLE_MS  5
+
+// Transitions talk to the sensor over SCCB, so they're serialized with a mutex
+// rather than a critical section
+static SemaphoreHandle_t s_lock = NULL;
+static ledc_timer_t s_timer = LEDC_TIMER_0;
+static uint32_t s_timeout_ms = 0;
+static bool s_standby = false;
+static int64_t s_last_use_us = 0;
+static int64_t s_standby_since_us = 0;
+static uint64_t s_standby_total_us = 0;
+static uint32_t s_entries = 0;
+static CameraStartStats s_start[CAMERA_START_COUNT];
+
+void cameraStandbyInit(ledc_timer_t xclk_timer, uint32_t idle_timeout_ms) {
+  if (!s_lock) s_lock = xSemaphoreCreateMutex();
+  s_timer = xclk_timer;
+  s_timeout_ms = idle_timeout_ms;
+  s_last_use_us = esp_timer_get_time();
+}
+
+static void lock() {
+  if (s_lock) xSemaphoreTake(s_lock, portMAX_DELAY);
+}
+
+static void unlock() {
+  if (s_lock) xSemaphoreGive(s_lock);
+}
+
+int64_t cameraStandbyWake() {
+  lock();
+  int64_t now = esp_timer_get_time();
+  s_last_use_us = now;
+  if (!s_standby) {
+    unlock();
+    return 0;
+  }
+
+  // Clock first: the sensor needs it to take the SCCB write
+  ledc_timer_resume(XCLK_SPEED_MODE, s_timer);
+  vTaskDelay(pdMS_TO_TICKS(STANDBY_CLOCK_SETTLE_MS));
+  sensor_t *s = esp_camera_sensor_get();
+  if (!s || s->set_reg(s, OV2640_REG_COM2, OV2640_COM2_STANDBY, 0) != 0) {
+    printf("[STANDBY] WARNING: clearing COM2 standby failed\n");
+  }
+  s_standby = false;
+  s_standby_total_us += now - s_standby_since_us;
+  printf("[STANDBY] Resumed after %u s idle\n", (unsigned)((now - s_standby_since_us) / 1000000));
+  unlock();
+  return now;
+}
+
+bool cameraStandbyPoll() {
+  if (!s_timeout_ms) return false;
+  lock();
+  int64_t now = esp_timer_get_time();
+  if (s_standby || now - s_last_use_us < (int64_t)s_timeout_ms * 1000) {
+    unlock();
+    return false;
+  }
+
+  sensor_t *s = esp_camera_sensor_get();
+  if (!s || s->set_reg(s, OV2640_REG_COM2, OV2640_COM2_STANDBY, OV2640_COM2_STANDBY) != 0) {
+    if (s) printf("[STANDBY] WARNING: setting COM2 standby failed, camera stays up\n");
+    s_last_use_us = now;  // Try again after another timeout, not every poll
+    unlock();
+    return false;
+  }
+  // Sensor first: it needs the clock for the SCCB write
+  ledc_timer_pause(XCLK_SPEED_MODE, s_timer);
+  s_standby = true;
+  s_standby_since_us = now;
+  s_entries++;
+  printf("[STANDBY] Camera idle for %u s: sensor standby, XCLK paused\n", (unsigned)(s_timeout_ms / 1000));
+  unlock();
+  return true;
+}
+
+void cameraStandbyReset() {
+  lock();
+  int64_t now = esp_timer_get_time();
+  if (s_standby) {
+    ledc_timer_resume(XCLK_SPEED_MODE, s_timer);
+    s_standby_total_us += now - s_standby_since_us;
+    s_standby = false;
+  }
+  s_last_use_us = now;
+  unlock();
+}
+
+void cameraStandbyRecordStart(CameraStart start, uint32_t ms) {
+  lock();
+  CameraStartStats &st = s_start[start];
+  if (st.count == 0 || ms < st.min_ms) st.min_ms = ms;
+  if (ms > st.max_ms) st.max_ms = ms;
+  st.last_ms = ms;
+  st.total_ms += ms;
+  st.count++;
+  unlock();
+}
+
+void cameraStandbyStartStats(CameraStart start, CameraStartStats *out) {
+  lock();
+  *out = s_start[start];
+  unlock();
+}
+
+const char *cameraStartName(CameraStart start) {
+  return start == CAMERA_START_WARM ? "warm" : "cold";
+}
+
+bool cameraInStandby() {
+  lock();
+  bool standby = s_standby;
+  unlock();
+  return standby;
+}
+
+uint32_t cameraStandbyEntries() {
+  lock();
+  uint32_t entries = s_entries;
+  unlock();
+  return entries;
+}
+
+uint64_t cameraStandbyTotalMs() {
+  lock();
+  uint64_t total = s_standby_total_us;
+  if (s_standby) total += esp_timer_get_time() - s_standby_since_us;
+  unlock();
+  return total / 1000;
+}
@@ -0,0 +1,120 @@
+#include "frame_cache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_timer.h"
+#include "mem_telemetry.h"
+
+// The critical section only covers pointer swaps and refcounts; buffers are
+// allocated and freed outside of it
+static portMUX_TYPE s_mux = portMUX_INITIALIZER_UNLOCKED;
+static CachedFrame *s_latest = NULL;
+static uint32_t s_seq = 0;
+
+static void destroyFrame(CachedFrame *frame) {
+  memTagFree(MEM_TAG_CACHE, frame->alloc_len);
+  free(frame->alloc);
+  free(frame->stats);
+  free(frame);
+}
+
+// Fill in the rest of a frame whose buffer is set up and make it the latest
+static CachedFrame *publishFrame(CachedFrame *frame, size_t len,
+                                 uint16_t width, uint16_t height,
+                                 framesize_t framesize, int quality, bool grayscale,
+                                 JpegImageStats *stats) {
+  frame->len = len;
+  frame->width = width;
+  frame->height = height;
+  frame->framesize = framesize;
+  frame->quality = quality;
+  frame->grayscale = grayscale;
+  frame->stats = stats;
+  frame->timestamp_us = esp_timer_get_time();
+  frame->refs = 2;  // cache + caller
+
+  taskENTER_CRITICAL(&s_mux);
+  frame->seq = ++s_seq;
+  CachedFrame *old = s_latest;
+  s_latest = frame;
+  bool drop_old = old && --old->refs == 0;
+  taskEXIT_CRITICAL(&s_mux);
+
+  if (drop_old) destroyFrame(old);
+  return frame;
+}
+
+CachedFrame *frameCachePublish(uint8_t *buf, size_t len, bool take_ownership,
+                               uint16_t width, uint16_t height,
+                               framesize_t framesize, int quality, bool grayscale,
+                               JpegImageStats *stats) {
+  CachedFrame *frame = (CachedFrame *)calloc(1, sizeof(CachedFrame));
+  if (!frame) return NULL;
+
+  if (take_ownership) {
+    frame->buf = buf;
+  } else {
+    frame->buf = (uint8_t *)malloc(len);  // PSRAM for anything but tiny frames
+    if (!frame->buf) {
+      free(frame);
+      return NULL;
+    }
+    memcpy(frame->buf, buf, len);
+  }
+  if (take_ownership) {
+    memTagTransfer(MEM_TAG_ENCODE, MEM_TAG_CACHE, len);  // encoder output handed over
+  } else {
+    memTagAlloc(MEM_TAG_CACHE, len);
+  }
+  frame->alloc = frame->buf;
+  frame->alloc_len = len;
+  return publishFrame(frame, len, width, height, framesize, quality, grayscale, stats);
+}
+
+CachedFrame *frameCachePublishPart(uint8_t *alloc, size_t headroom, size_t prefix_len, size_t len,
+                                   uint16_t width, uint16_t height,
+                                   framesize_t framesize, int quality, bool grayscale,
+                                   JpegImageStats *stats) {
+  CachedFrame *frame = (CachedFrame *)calloc(1, sizeof(CachedFrame));
+  if (!frame) return NULL;
+
+  frame->alloc = alloc;
+  frame->buf = alloc + headroom;
+  frame->alloc_len = headroom + len;
+  frame->prefix_len = prefix_len;
+  memTagTransfer(MEM_TAG_ENCODE, MEM_TAG_CACHE, frame->alloc_len);
+  return publishFrame(frame, len, width, height, framesize, quality, grayscale, stats);
+}
+
+void frameCacheDrop() {
+  taskENTER_CRITICAL(&s_mux);
+  CachedFrame *old = s_latest;
+  s_latest = NULL;
+  bool drop_old = old && --old->refs == 0;
+  taskEXIT_CRITICAL(&s_mux);
+
+  if (drop_old) destroyFrame(old);
+}
+
+CachedFrame *frameCacheAcquire() {
+  taskENTER_CRITICAL(&s_mux);
+  CachedFrame *frame = s_latest;
+  if (frame) frame->refs++;
+  taskEXIT_CRITICAL(&s_mux);
+  return frame;
+}
+
+void frameCacheRelease(CachedFrame *frame) {
+  if (!frame) return;
+  taskENTER_CRITICAL(&s_mux);
+  bool drop = --frame->refs == 0;
+  taskEXIT_CRITICAL(&s_mux);
+  if (drop) destroyFrame(frame);
+}
+
+void frameCacheETag(const CachedFrame *frame, char *out, size_t out_len) {
+  snprintf(out, out_len, "\"f%u-%d-%d%s\"", (unsigned)frame->seq, (int)frame->framesize, frame->quality,
+           frame->grayscale ? "g" : "");
+}
@@ -0,0 +1,402 @@
+#include "jpeg_encoder.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include "jpeg_bitstream.h"
+#ifdef ESP_PLATFORM
+#include "esp_heap_caps.h"
+#endif
+
+// AAN DCT output scale per row/column: cos(k*pi/16) * sqrt(2), 1 for k = 0
+static const float AAN_SCALE[8] = {
+  1.0f, 1.387039845f, 1.306562965f, 1.175875602f,
+  1.0f, 0.785694958f, 0.541196100f, 0.275899379f
+};
+
+struct JpegEncoder {
+  BitWriter bw;
+  HuffEncTable dc[2], ac[2];
+  uint8_t qt[2][64];      // Natural order, as written to DQT (zig-zagged there)
+  float recip[2][64];     // 1 / (q * AAN scale * 8): quantization folded into the DCT scaling
+  int dc_pred[3];
+};
+
+// Source rows for one MCU row (16 luma lines) as planar 4:2:0; stride is the
+// MCU-padded width, pixels past the image edge repeat the last column/row
+typedef void (*McuRowLoader)(const uint8_t *src, int width, int height, int y0,
+                             uint8_t *y, uint8_t *cb, uint8_t *cr, int stride);
+
+static void *allocInternal(size_t size) {
+#ifdef ESP_PLATFORM
+  void *p = heap_caps_malloc(size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+  if (p) return p;
+#endif
+  return malloc(size);
+}
+
+static void setQuality(JpegEncoder *enc, int quality) {
+  int scale = jpegQualityScale(quality);
+  for (int t = 0; t < 2; t++) {
+    const uint8_t *base = t == 0 ? STD_LUMA_QT : STD_CHROMA_QT;
+    for (int i = 0; i < 64; i++) {
+      int q = (base[i] * scale + 50) / 100;
+      if (q < 1) q = 1;
+      if (q > 255) q = 255;
+      enc->qt[t][i] = (uint8_t)q;
+      enc->recip[t][i] = 1.0f / (q * AAN_SCALE[i >> 3] * AAN_SCALE[i & 7] * 8.0f);
+    }
+  }
+}
+
+// One pass of the AAN float DCT (as libjpeg jfdctflt) over 8 values spaced by step
+static inline void fdct8(float *d, int step) {
+  float tmp0 = d[0] + d[7 * step], tmp7 = d[0] - d[7 * step];
+  float tmp1 = d[step] + d[6 * step], tmp6 = d[step] - d[6 * step];
+  float tmp2 = d[2 * step] + d[5 * step], tmp5 = d[2 * step] - d[5 * step];
+  float tmp3 = d[3 * step] + d[4 * step], tmp4 = d[3 * step] - d[4 * step];
+
+  float tmp10 = tmp0 + tmp3, tmp13 = tmp0 - tmp3;
+  float tmp11 = tmp1 + tmp2, tmp12 = tmp1 - tmp2;
+  d[0] = tmp10 + tmp11;
+  d[4 * step] = tmp10 - tmp11;
+  float z1 = (tmp12 + tmp13) * 0.707106781f;
+  d[2 * step] = tmp13 + z1;
+  d[6 * step] = tmp13 - z1;
+
+  tmp10 = tmp4 + tmp5;
+  tmp11 = tmp5 + tmp6;
+  tmp12 = tmp6 + tmp7;
+  float z5 = (tmp10 - tmp12) * 0.382683433f;
+  float z2 = 0.541196100f * tmp10 + z5;
+  float z4 = 1.306562965f * tmp12 + z5;
+  float z3 = tmp11 * 0.707106781f;
+  float z11 = tmp7 + z3, z13 = tmp7 - z3;
+  d[5 * step] = z13 + z2;
+  d[3 * step] = z13 - z2;
+  d[step] = z11 + z4;
+  d[7 * step] = z11 - z4;
+}
+
+static void encodeBlock(JpegEncoder *enc, const uint8_t *pixels, int stride, int table, int *dc_pred) {
+  float blk[64];
+  for (int r = 0; r < 8; r++) {
+    const uint8_t *p = pixels + r * stride;
+    for (int c = 0; c < 8; c++) blk[r * 8 + c] = (float)p[c] - 128.0f;
+  }
+  for (int r = 0; r < 8; r++) fdct8(blk + r * 8, 1);
+  for (int c = 0; c < 8; c++) fdct8(blk + c, 8);
+
+  const float *recip = enc->recip[table];
+  int coef[64];
+  for (int k = 0; k < 64; k++) {
+    int n = ZIGZAG[k];
+    coef[k] = (int)(blk[n] * recip[n] + 16384.5f) - 16384;  // round half up without a branch
+  }
+
+  BitWriter *bw = &enc->bw;
+  int diff = coef[0] - *dc_pred;
+  *dc_pred = coef[0];
+  encodeValue(bw, &enc->dc[table], 0, diff);
+
+  const HuffEncTable *ac = &enc->ac[table];
+  int run = 0;
+  for (int k = 1; k < 64; k++) {
+    if (coef[k] == 0) {
+      run++;
+      continue;
+    }
+    while (run > 15) {
+      bwPut(bw, ac->code[0xF0], ac->size[0xF0]);  // ZRL
+      run -= 16;
+    }
+    encodeValue(bw, ac, run, coef[k]);
+    run = 0;
+  }
+  if (run) bwPut(bw, ac->code[0x00], ac->size[0x00]);  // EOB
+}
+
+static void writeHeaders(JpegEncoder *enc, int width, int height) {
+  BitWriter *bw = &enc->bw;
+  static const uint8_t JFIF_APP0[18] = {
+    0xFF, 0xE0, 0x00, 0x10, 'J', 'F', 'I', 'F', 0x00, 0x01, 0x01, 0x00, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00
+  };
+  bwWord(bw, 0xFFD8);
+  bwBytes(bw, JFIF_APP0, sizeof(JFIF_APP0));
+
+  bwWord(bw, 0xFFDB);
+  bwWord(bw, 2 + 2 * 65);
+  for (int t = 0; t < 2; t++) {
+    bwByte(bw, (uint8_t)t);
+    for (int k = 0; k < 64; k++) bwByte(bw, enc->qt[t][ZIGZAG[k]]);
+  }
+
+  // SOF0: Y 2x2 on table 0, Cb/Cr 1x1 on table 1
+  static const uint8_t COMPONENTS[9] = {1, 0x22, 0, 2, 0x11, 1, 3, 0x11, 1};
+  bwWord(bw, 0xFFC0);
+  bwWord(bw, 8 + 3 * 3);
+  bwByte(bw, 8);
+  bwWord(bw, (uint16_t)height);
+  bwWord(bw, (uint16_t)width);
+  bwByte(bw, 3);
+  bwBytes(bw, COMPONENTS, sizeof(COMPONENTS));
+
+  bwWord(bw, 0xFFC4);
+  bwWord(bw, 2 + (17 + 12) * 2 + (17 + 162) * 2);
+  writeHuffTable(bw, 0x00, STD_DC_LUMA_BITS, STD_DC_LUMA_VALS);
+  writeHuffTable(bw, 0x10, STD_AC_LUMA_BITS, STD_AC_LUMA_VALS);
+  writeHuffTable(bw, 0x01, STD_DC_CHROMA_BITS, STD_DC_CHROMA_VALS);
+  writeHuffTable(bw, 0x11, STD_AC_CHROMA_BITS, STD_AC_CHROMA_VALS);
+
+  static const uint8_t SOS[14] = {0xFF, 0xDA, 0x00, 0x0C, 3, 1, 0x00, 2, 0x11, 3, 0x11, 0, 63, 0};
+  bwBytes(bw, SOS, sizeof(SOS));
+}
+
+// Running sums behind JpegImageStats
+struct StatsAccum {
+  JpegImageStats *out;
+  uint8_t *prev;     // Last luma row of the previous MCU row: the Laplacian's upper neighbour
+  int64_t lap_sum;
+  uint64_t lap_sq;
+  uint32_t lap_n;
+};
+
+// Histogram and Laplacian on every second row and column (a quarter of the pixels is
+// plenty for exposure and focus, and the DCT stays the dominant cost), over the luma
+// rows just loaded for the DCT: internal RAM, still in cache
+static void accumulateStats(StatsAccum *acc, const uint8_t *y, int stride, int width, int height, int y0) {
+  int rows = height - y0 < 16 ? height - y0 : 16;
+  uint32_t *hist = acc->out->histogram;
+
+  // y0 is a multiple of 16, so even r is an even image row
+  for (int r = 0; r < rows; r += 2) {
+    const uint8_t *c = y + r * stride;
+    for (int x = 0; x < width; x += 2) hist[c[x]]++;
+
+    // The first and last image rows have no neighbour above/below
+    int row = y0 + r;
+    if (row == 0 || row == height - 1) continue;
+    const uint8_t *up = r ? c - stride : acc->prev;
+    const uint8_t *down = c + stride;
+    int32_t sum = 0;
+    uint64_t sq = 0;
+    int n = 0;
+    for (int x = 2; x < width - 1; x += 2) {
+      int l = 4 * c[x] - c[x - 1] - c[x + 1] - up[x] - down[x];
+      sum += l;
+      sq += (uint32_t)(l * l);
+      n++;
+    }
+    acc->lap_sum += sum;
+    acc->lap_sq += sq;
+    acc->lap_n += n;
+  }
+  if (rows == 16) memcpy(acc->prev, y + 15 * stride, width);
+}
+
+static void finishStats(StatsAccum *acc, int width, int height) {
+  JpegImageStats *s = acc->out;
+  uint64_t sum = 0;
+  uint32_t samples = 0, low = 0, high = 0;
+  for (int i = 0; i < 256; i++) {
+    samples += s->histogram[i];
+    sum += (uint64_t)i * s->histogram[i];
+    if (i <= JPEG_STATS_CLIP_LOW) low += s->histogram[i];
+    if (i >= JPEG_STATS_CLIP_HIGH) high += s->histogram[i];
+  }
+  s->width = (uint16_t)width;
+  s->height = (uint16_t)height;
+  s->samples = samples;
+  s->mean = (float)sum / samples;
+  s->clipped_low = (float)low / samples;
+  s->clipped_high = (float)high / samples;
+  s->sharpness = 0;
+  if (acc->lap_n) {
+    double mean = (double)acc->lap_sum / acc->lap_n;
+    s->sharpness = (float)((double)acc->lap_sq / acc->lap_n - mean * mean);
+  }
+}
+
+static bool encode420(const uint8_t *src, int width, int height, int quality, McuRowLoader load,
+                      uint8_t **out, size_t *out_len, JpegImageStats *stats, size_t headroom) {
+  *out = NULL;
+  *out_len = 0;
+  if (!src || width <= 0 || height <= 0 || width > 65535 || height > 65535) return false;
+
+  int mcu_cols = (width + 15) / 16;
+  int mcu_rows = (height + 15) / 16;
+  int stride = mcu_cols * 16;
+
+  // Huffman tables are a few KB; keep them off the caller's (httpd task) stack
+  JpegEncoder *enc = (JpegEncoder *)calloc(1, sizeof(JpegEncoder));
+  // One MCU row of planar pixels, small enough for internal RAM: 24 bytes per column
+  // (plus the carried-over luma row for the stats)
+  uint8_t *rows = (uint8_t *)allocInternal((size_t)stride * (stats ? 25 : 24));
+  if (!enc || !rows) {
+    free(enc);
+    free(rows);
+    return false;
+  }
+  uint8_t *y = rows;
+  uint8_t *cb = y + stride * 16;
+  uint8_t *cr = cb + (stride / 2) * 8;
+
+  StatsAccum acc;
+  memset(&acc, 0, sizeof(acc));
+  if (stats) {
+    memset(stats, 0, sizeof(*stats));
+    acc.out = stats;
+    acc.prev = rows + stride * 24;
+  }
+
+  buildEncTable(&enc->dc[0], STD_DC_LUMA_BITS, STD_DC_LUMA_VALS);
+  buildEncTable(&enc->ac[0], STD_AC_LUMA_BITS, STD_AC_LUMA_VALS);
+  buildEncTable(&enc->dc[1], STD_DC_CHROMA_BITS, STD_DC_CHROMA_VALS);
+  buildEncTable(&enc->ac[1], STD_AC_CHROMA_BITS, STD_AC_CHROMA_VALS);
+  setQuality(enc, quality);
+
+  bwReserve(&enc->bw, headroom + 1024 + (size_t)width * height / 8);  // Typical frame without regrowing
+  enc->bw.len = headroom;
+  writeHeaders(enc, width, height);
+
+  for (int my = 0; my < mcu_rows && !enc->bw.oom; my++) {
+    load(src, width, height, my * 16, y, cb, cr, stride);
+    if (stats) accumulateStats(&acc, y, stride, width, height, my * 16);
+    for (int mx = 0; mx < mcu_cols; mx++) {
+      const uint8_t *yb = y + mx * 16;
+      encodeBlock(enc, yb, stride, 0, &enc->dc_pred[0]);
+      encodeBlock(enc, yb + 8, stride, 0, &enc->dc_pred[0]);
+      encodeBlock(enc, yb + 8 * stride, stride, 0, &enc->dc_pred[0]);
+      encodeBlock(enc, yb + 8 * stride + 8, stride, 0, &enc->dc_pred[0]);
+      encodeBlock(enc, cb + mx * 8, stride / 2, 1, &enc->dc_pred[1]);
+      encodeBlock(enc, cr + mx * 8, stride / 2, 1, &enc->dc_pred[2]);
+    }
+  }
+
+  bwFlush(&enc->bw);
+  bwWord(&enc->bw, 0xFFD9);
+  free(rows);
+
+  bool ok = !enc->bw.oom;
+  if (ok) {
+    *out = enc->bw.buf;
+    *out_len = enc->bw.len - headroom;
+    if (stats) finishStats(&acc, width, height);
+  } else {
+    free(enc->bw.buf);
+  }
+  free(enc);
+  return ok;
+}
+
+// Pad a plane row from column `from` to `stride` with its last pixel
+static inline void padRow(uint8_t *row, int from, int stride) {
+  if (from > 0 && from < stride) memset(row + from, row[from - 1], stride - from);
+}
+
+static void loadYuyvRows(const uint8_t *src, int width, int height, int y0,
+                         uint8_t *y, uint8_t *cb, uint8_t *cr, int stride) {
+  size_t src_stride = (size_t)width * 2;
+  int pairs = width / 2;
+
+  for (int r = 0; r < 16; r++) {
+    int sy = y0 + r < height ? y0 + r : height - 1;
+    const uint8_t *s = src + sy * src_stride;
+    uint8_t *d = y + r * stride;
+    for (int i = 0; i < pairs; i++) {
+      uint32_t w;
+      memcpy(&w, s + i * 4, 4);  // Y0 U Y1 V in one 32-bit load
+      d[2 * i] = (uint8_t)w;
+      d[2 * i + 1] = (uint8_t)(w >> 16);
+    }
+    padRow(d, width, stride);
+  }
+
+  // 4:2:2 -> 4:2:0: average chroma of each row pair
+  int cstride = stride / 2;
+  for (int r = 0; r < 8; r++) {
+    int sa = y0 + 2 * r < height ? y0 + 2 * r : height - 1;
+    int sb = y0 + 2 * r + 1 < height ? y0 + 2 * r + 1 : height - 1;
+    const uint8_t *a = src + sa * src_stride;
+    const uint8_t *b = src + sb * src_stride;
+    uint8_t *dcb = cb + r * cstride;
+    uint8_t *dcr = cr + r * cstride;
+    for (int i = 0; i < pairs; i++) {
+      uint32_t wa, wb;
+      memcpy(&wa, a + i * 4, 4);
+      memcpy(&wb, b + i * 4, 4);
+      dcb[i] = (uint8_t)((((wa >> 8) & 0xFF) + ((wb >> 8) & 0xFF) + 1) >> 1);
+      dcr[i] = (uint8_t)(((wa >> 24) + (wb >> 24) + 1) >> 1);
+    }
+    padRow(dcb, pairs, cstride);
+    padRow(dcr, pairs, cstride);
+  }
+}
+
+// RGB565, high byte first, expanded to 8 bits per channel
+static inline void rgb565At(const uint8_t *p, int *r, int *g, int *b) {
+  int v = (p[0] << 8) | p[1];
+  *r = ((v >> 11) << 3) | (v >> 13);
+  *g = (((v >> 5) & 0x3F) << 2) | ((v >> 9) & 0x03);
+  *b = ((v & 0x1F) << 3) | ((v >> 2) & 0x07);
+}
+
+static inline uint8_t clampByte(int v) {
+  return v < 0 ? 0 : (v > 255 ? 255 : (uint8_t)v);
+}
+
+// JFIF (full range) YCbCr in 8.8 fixed point; chroma from the sum of a 2x2 block
+static void loadRgb565Rows(const uint8_t *src, int width, int height, int y0,
+                           uint8_t *y, uint8_t *cb, uint8_t *cr, int stride) {
+  size_t src_stride = (size_t)width * 2;
+  int pairs = width / 2;
+  int cstride = stride / 2;
+
+  for (int r = 0; r < 8; r++) {
+    int sa = y0 + 2 * r < height ? y0 + 2 * r : height - 1;
+    int sb = y0 + 2 * r + 1 < height ? y0 + 2 * r + 1 : height - 1;
+    const uint8_t *rows[2] = { src + sa * src_stride, src + sb * src_stride };
+    uint8_t *dy[2] = { y + 2 * r * stride, y + (2 * r + 1) * stride };
+    uint8_t *dcb = cb + r * cstride;
+    uint8_t *dcr = cr + r * cstride;
+    for (int i = 0; i < pairs; i++) {
+      int rs = 0, gs = 0, bs = 0;
+      for (int k = 0; k < 2; k++) {
+        int r0, g0, b0, r1, g1, b1;
+        rgb565At(rows[k] + i * 4, &r0, &g0, &b0);
+        rgb565At(rows[k] + i * 4 + 2, &r1, &g1, &b1);
+        dy[k][2 * i] = (uint8_t)((77 * r0 + 150 * g0 + 29 * b0 + 128) >> 8);
+        dy[k][2 * i + 1] = (uint8_t)((77 * r1 + 150 * g1 + 29 * b1 + 128) >> 8);
+        rs += r0 + r1;
+        gs += g0 + g1;
+        bs += b0 + b1;
+      }
+      // Sums of four pixels: >> 10 is >> 8 plus the average; the 128 offset keeps it positive
+      dcb[i] = clampByte((-43 * rs - 85 * gs + 128 * bs + (128 << 10) + 512) >> 10);
+      dcr[i] = clampByte((128 * rs - 107 * gs - 21 * bs + (128 << 10) + 512) >> 10);
+    }
+    padRow(dy[0], width, stride);
+    padRow(dy[1], width, stride);
+    padRow(dcb, pairs, cstride);
+    padRow(dcr, pairs, cstride);
+  }
+}
+
+bool jpegEncodeYuyv(const uint8_t *yuyv, int width, int height, int quality,
+                    uint8_t **out, size_t *out_len, JpegImageStats *stats, size_t headroom) {
+  if (width & 1) {
+    *out = NULL;
+    *out_len = 0;
+    return false;
+  }
+  return encode420(yuyv, width, height, quality, loadYuyvRows, out, out_len, stats, headroom);
+}
+
+bool jpegEncodeRgb565(const uint8_t *rgb565, int width, int height, int quality,
+                      uint8_t **out, size_t *out_len, JpegImageStats *stats, size_t headroom) {
+  if (width & 1) {
+    *out = NULL;
+    *out_len = 0;
+    return false;
+  }
+  return encode420(rgb565, width, height, quality, loadRgb565Rows, out, out_len, stats, headroom);
+}
@@ -0,0 +1,515 @@
+#include "jpeg_requant.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include "jpeg_bitstream.h"
+
+#define HUFF_LOOKAHEAD 9
+
+// Decoder side of one DHT table
+struct HuffDecTable {
+  bool defined;
+  uint16_t lookup[1 << HUFF_LOOKAHEAD];  // (code length << 8) | symbol, 0 = slow path
+  int32_t maxcode[18];
+  int32_t valoffset[17];
+  uint8_t vals[256];
+};
+
+struct Component {
+  uint8_t id;
+  uint8_t h, v;
+  uint8_t tq;
+  uint8_t td, ta;     // DC/AC table selectors from SOS
+  int dc_pred_in;     // DC predictor in source quantization
+  int dc_pred_out;    // DC predictor in output quantization
+};
+
+// Entropy-coded segment reader; handles FF00 stuffing and stops at markers
+struct BitReader {
+  const uint8_t *p;
+  const uint8_t *end;
+  uint32_t acc;
+  int bits;
+  uint8_t marker;     // marker found in the stream (0 = none yet)
+  int overrun;        // zero bytes fed past marker/end
+};
+
+static void buildDecTable(HuffDecTable *t, const uint8_t *bits, const uint8_t *vals, int nvals) {
+  memset(t, 0, sizeof(*t));
+  t->defined = true;
+  memcpy(t->vals, vals, nvals);
+
+  int code = 0, k = 0;
+  for (int len = 1; len <= 16; len++) {
+    t->valoffset[len] = k - code;
+    for (int i = 0; i < bits[len - 1]; i++) {
+      if (len <= HUFF_LOOKAHEAD) {
+        int shift = HUFF_LOOKAHEAD - len;
+        for (int fill = 0; fill < (1 << shift); fill++) {
+          t->lookup[(code << shift) | fill] = (uint16_t)((len << 8) | vals[k]);
+        }
+      }
+      code++;
+      k++;
+    }
+    t->maxcode[len] = bits[len - 1] ? code - 1 : -1;
+    code <<= 1;
+  }
+  t->maxcode[17] = 0x7fffffff;  // sentinel: invalid code
+}
+
+static inline void brFill(BitReader *br) {
+  while (br->bits <= 24) {
+    uint32_t byte = 0;
+    if (br->marker == 0 && br->p < br->end) {
+      byte = *br->p++;
+      if (byte == 0xFF) {
+        uint8_t next = br->p < br->end ? *br->p : 0xD9;
+        if (next == 0x00) {
+          br->p++;
+        } else {
+          br->marker = next;
+          br->p--;  // leave the marker for the caller
+          byte = 0;
+          br->overrun++;
+        }
+      }
+    } else {
+      br->overrun++;
+    }
+    br->acc |= byte << (24 - br->bits);
+    br->bits += 8;
+  }
+}
+
+static inline int brGet(BitReader *br, int n) {
+  if (n == 0) return 0;
+  if (br->bits < n) brFill(br);
+  int v = (int)(br->acc >> (32 - n));
+  br->acc <<= n;
+  br->bits -= n;
+  return v;
+}
+
+static inline int extendSign(int v, int s) {
+  return v < (1 << (s - 1)) ? v - (1 << s) + 1 : v;
+}
+
+static inline int brDecode(BitReader *br, const HuffDecTable *t) {
+  if (br->bits < 16) brFill(br);
+  uint16_t e = t->lookup[br->acc >> (32 - HUFF_LOOKAHEAD)];
+  if (e) {
+    int len = e >> 8;
+    br->acc <<= len;
+    br->bits -= len;
+    return e & 0xFF;
+  }
+  // Slow path for codes longer than the lookahead
+  int len = HUFF_LOOKAHEAD + 1;
+  int code = (int)(br->acc >> (32 - len));
+  while (len <= 16 && code > t->maxcode[len]) {
+    len++;
+    code = (int)(br->acc >> (32 - len));
+  }
+  if (len > 16) return -1;
+  br->acc <<= len;
+  br->bits -= len;
+  return t->vals[(code + t->valoffset[len]) & 0xFF];
+}
+
+// Round-to-nearest c * qo / qn
+static inline int requant(int c, int qo, int qn) {
+  if (qo == qn) return c;
+  int n = c * qo;
+  return n >= 0 ? (n + qn / 2) / qn : -((-n + qn / 2) / qn);
+}
+
+bool jpegRequantize(const uint8_t *src, size_t src_len,
+                    int scale_num, int scale_den,
+                    uint8_t **out, size_t *out_len) {
+  *out = NULL;
+  *out_len = 0;
+  if (!src || src_len < 4 || src[0] != 0xFF || src[1] != 0xD8) return false;
+  if (scale_den <= 0 || scale_num < scale_den) return false;
+
+  // Tables are large-ish; keep them off the httpd task stack
+  struct State {
+    uint16_t qt_in[4][64];
+    uint16_t qt_out[4][64];
+    bool qt_defined[4];
+    HuffDecTable dc[4], ac[4];
+    HuffEncTable enc_dc[2], enc_ac[2];
+    Component comp[4];
+  };
+  State *st = (State *)calloc(1, sizeof(State));
+  if (!st) return false;
+
+  int width = 0, height = 0, ncomp = 0;
+  int restart_interval = 0;
+  bool have_sof = false;
+  uint8_t scan_comp[4];
+  int scan_ncomp = 0;
+  const uint8_t *p = src + 2;
+  const uint8_t *end = src + src_len;
+  const uint8_t *scan_start = NULL;
+  bool ok = true;
+
+  // --- Parse headers up to the first SOS ---
+  while (ok && !scan_start) {
+    while (p < end && *p != 0xFF) p++;   // tolerate garbage between segments
+    while (p < end && *p == 0xFF) p++;   // fill bytes
+    if (p + 3 > end) { ok = false; break; }
+    uint8_t m = *p++;
+    if (m == 0xD8 || (m >= 0xD0 && m <= 0xD7) || m == 0x01) continue;  // standalone
+    if (m == 0xD9) { ok = false; break; }
+    int seg_len = (p[0] << 8) | p[1];
+    if (seg_len < 2 || p + seg_len > end) { ok = false; break; }
+    const uint8_t *seg = p + 2;
+    const uint8_t *seg_end = p + seg_len;
+    p = seg_end;
+
+    switch (m) {
+      case 0xDB: {  // DQT
+        while (seg < seg_end) {
+          int pq = seg[0] >> 4, tq = seg[0] & 0x0F;
+          seg++;
+          if (tq > 3 || seg + 64 * (pq + 1) > seg_end) { ok = false; break; }
+          for (int i = 0; i < 64; i++) {
+            st->qt_in[tq][i] = pq ? (uint16_t)((seg[2 * i] << 8) | seg[2 * i + 1]) : seg[i];
+            if (st->qt_in[tq][i] == 0) st->qt_in[tq][i] = 1;
+          }
+          st->qt_defined[tq] = true;
+          seg += 64 * (pq + 1);
+        }
+        break;
+      }
+      case 0xC0:
+      case 0xC1: {  // Baseline / extended sequential Huffman
+        if (seg_len < 8 || seg[0] != 8) { ok = false; break; }
+        height = (seg[1] << 8) | seg[2];
+        width = (seg[3] << 8) | seg[4];
+        ncomp = seg[5];
+        if (ncomp < 1 || ncomp > 4 || seg_len < 8 + 3 * ncomp || width == 0 || height == 0) { ok = false; break; }
+        for (int i = 0; i < ncomp; i++) {
+          st->comp[i].id = seg[6 + 3 * i];
+          st->comp[i].h = seg[7 + 3 * i] >> 4;
+          st->comp[i].v = seg[7 + 3 * i] & 0x0F;
+          st->comp[i].tq = seg[8 + 3 * i] & 0x03;
+          if (st->comp[i].h < 1 || st->comp[i].h > 4 || st->comp[i].v < 1 || st->comp[i].v > 4) ok = false;
+        }
+        have_sof = true;
+        break;
+      }
+      case 0xC4: {  // DHT
+        while (ok && seg < seg_end) {
+          int tc = seg[0] >> 4, th = seg[0] & 0x0F;
+          if (th > 3 || tc > 1 || seg + 17 > seg_end) { ok = false; break; }
+          int n = 0;
+          for (int i = 0; i < 16; i++) n += seg[1 + i];
+          if (n > 256 || seg + 17 + n > seg_end) { ok = false; break; }
+          buildDecTable(tc ? &st->ac[th] : &st->dc[th], seg + 1, seg + 17, n);
+          seg += 17 + n;
+        }
+        break;
+      }
+      case 0xDD:  // DRI
+        if (seg_len != 4) { ok = false; break; }
+        restart_interval = (seg[0] << 8) | seg[1];
+        break;
+      case 0xDA: {  // SOS
+        if (!have_sof) { ok = false; break; }
+        scan_ncomp = seg[0];
+        if (scan_ncomp < 1 || scan_ncomp > ncomp || seg_len != 6 + 2 * scan_ncomp) { ok = false; break; }
+        for (int i = 0; i < scan_ncomp; i++) {
+          int idx = -1;
+          for (int c = 0; c < ncomp; c++) {
+            if (st->comp[c].id == seg[1 + 2 * i]) idx = c;
+          }
+          if (idx < 0) { ok = false; break; }
+          scan_comp[i] = (uint8_t)idx;
+          st->comp[idx].td = seg[2 + 2 * i] >> 4;
+          st->comp[idx].ta = seg[2 + 2 * i] & 0x0F;
+        }
+        scan_start = seg_end;
+        break;
+      }
+      default:
+        // Progressive, lossless and arithmetic-coded frames are not handled
+        if (m >= 0xC2 && m <= 0xCF && m != 0xC4 && m != 0xC8 && m != 0xCC) ok = false;
+        break;  // APPn, COM etc. are dropped
+    }
+  }
+
+  // Only a single scan containing every component is supported (the OV2640 and
+  // every baseline encoder we care about produce exactly that)
+  if (ok && scan_ncomp != ncomp) ok = false;
+  for (int i = 0; ok && i < ncomp; i++) {
+    Component *c = &st->comp[i];
+    if (!st->qt_defined[c->tq] || c->td > 3 || c->ta > 3 ||
+        !st->dc[c->td].defined || !st->ac[c->ta].defined) {
+      ok = false;
+    }
+  }
+  if (!ok) {
+    free(st);
+    return false;
+  }
+
+  // --- Scaled quantization tables ---
+  // The output tables are 8-bit: an input step above 255 would come out finer than
+  // it went in, so such frames are refused and the caller sends the original.
+  for (int t = 0; ok && t < 4; t++) {
+    if (!st->qt_defined[t]) continue;
+    for (int i = 0; i < 64; i++) {
+      if (st->qt_in[t][i] > 255) {
+        ok = false;
+        break;
+      }
+      int q = (st->qt_in[t][i] * scale_num + scale_den / 2) / scale_den;
+      if (q > 255) q = 255;
+      if (q < st->qt_in[t][i]) q = st->qt_in[t][i];
+      st->qt_out[t][i] = (uint16_t)q;
+    }
+  }
+  if (!ok) {
+    free(st);
+    return false;
+  }
+  buildEncTable(&st->enc_dc[0], STD_DC_LUMA_BITS, STD_DC_LUMA_VALS);
+  buildEncTable(&st->enc_ac[0], STD_AC_LUMA_BITS, STD_AC_LUMA_VALS);
+  buildEncTable(&st->enc_dc[1], STD_DC_CHROMA_BITS, STD_DC_CHROMA_VALS);
+  buildEncTable(&st->enc_ac[1], STD_AC_CHROMA_BITS, STD_AC_CHROMA_VALS);
+
+  // --- Output headers ---
+  BitWriter bw;
+  memset(&bw, 0, sizeof(bw));
+  bwReserve(&bw, src_len);
+
+  static const uint8_t JFIF_APP0[] = {
+    0xFF, 0xD8, 0xFF, 0xE0, 0x00, 0x10, 'J', 'F', 'I', 'F', 0x00,
+    0x01, 0x01, 0x00, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00
+  };
+  bwBytes(&bw, JFIF_APP0, sizeof(JFIF_APP0));
+
+  for (int t = 0; t < 4; t++) {
+    if (!st->qt_defined[t]) continue;
+    bwWord(&bw, 0xFFDB);
+    bwWord(&bw, 2 + 65);
+    bwByte(&bw, (uint8_t)t);
+    for (int i = 0; i < 64; i++) bwByte(&bw, (uint8_t)st->qt_out[t][i]);
+  }
+
+  bwWord(&bw, 0xFFC0);
+  bwWord(&bw, (uint16_t)(8 + 3 * ncomp));
+  bwByte(&bw, 8);
+  bwWord(&bw, (uint16_t)height);
+  bwWord(&bw, (uint16_t)width);
+  bwByte(&bw, (uint8_t)ncomp);
+  for (int i = 0; i < ncomp; i++) {
+    bwByte(&bw, st->comp[i].id);
+    bwByte(&bw, (uint8_t)((st->comp[i].h << 4) | st->comp[i].v));
+    bwByte(&bw, st->comp[i].tq);
+  }
+
+  bwWord(&bw, 0xFFC4);
+  bwWord(&bw, 2 + 4 * 17 + 12 + 12 + 162 + 162);
+  writeHuffTable(&bw, 0x00, STD_DC_LUMA_BITS, STD_DC_LUMA_VALS);
+  writeHuffTable(&bw, 0x10, STD_AC_LUMA_BITS, STD_AC_LUMA_VALS);
+  writeHuffTable(&bw, 0x01, STD_DC_CHROMA_BITS, STD_DC_CHROMA_VALS);
+  writeHuffTable(&bw, 0x11, STD_AC_CHROMA_BITS, STD_AC_CHROMA_VALS);
+
+  bwWord(&bw, 0xFFDA);
+  bwWord(&bw, (uint16_t)(6 + 2 * ncomp));
+  bwByte(&bw, (uint8_t)ncomp);
+  for (int i = 0; i < ncomp; i++) {
+    bwByte(&bw, st->comp[scan_comp[i]].id);
+    bwByte(&bw, scan_comp[i] == 0 ? 0x00 : 0x11);
+  }
+  bwByte(&bw, 0);
+  bwByte(&bw, 63);
+  bwByte(&bw, 0);
+
+  // --- Transcode entropy-coded data block by block ---
+  int hmax = 1, vmax = 1;
+  for (int i = 0; i < ncomp; i++) {
+    if (st->comp[i].h > hmax) hmax = st->comp[i].h;
+    if (st->comp[i].v > vmax) vmax = st->comp[i].v;
+  }
+  int mcus_x, mcus_y;
+  if (ncomp == 1) {
+    // Non-interleaved scan: one block per MCU, sized by the component itself
+    mcus_x = (width * st->comp[0].h / hmax + 7) / 8;
+    mcus_y = (height * st->comp[0].v / vmax + 7) / 8;
+  } else {
+    mcus_x = (width + 8 * hmax - 1) / (8 * hmax);
+    mcus_y = (height + 8 * vmax - 1) / (8 * vmax);
+  }
+  long total_mcus = (long)mcus_x * mcus_y;
+
+  BitReader br;
+  memset(&br, 0, sizeof(br));
+  br.p = scan_start;
+  br.end = end;
+
+  int restarts_left = restart_interval;
+  int next_rst = 0;
+
+  for (long mcu = 0; ok && mcu < total_mcus; mcu++) {
+    if (restart_interval) {
+      if (restarts_left == 0) {
+        // Expect RSTn: drop buffered bits, consume the marker, reset predictors
+        br.acc = 0;
+        br.bits = 0;
+        if (br.marker == 0) {
+          while (br.p + 1 < br.end && !(br.p[0] == 0xFF && br.p[1] != 0x00)) br.p++;
+          if (br.p + 1 < br.end) br.marker = br.p[1];
+        }
+        if (br.marker != 0xD0 + next_rst) { ok = false; break; }
+        br.p += 2;
+        br.marker = 0;
+        br.overrun = 0;
+        next_rst = (next_rst + 1) & 7;
+        restarts_left = restart_interval;
+        for (int i = 0; i < ncomp; i++) {
+          st->comp[i].dc_pred_in = 0;
+        }
+      }
+      restarts_left--;
+    }
+
+    for (int si = 0; ok && si < scan_ncomp; si++) {
+      int ci = scan_comp[si];
+      Component *c = &st->comp[ci];
+      int nblocks = ncomp == 1 ? 1 : c->h * c->v;
+      const HuffDecTable *dct = &st->dc[c->td];
+      const HuffDecTable *act = &st->ac[c->ta];
+      const HuffEncTable *edc = &st->enc_dc[ci == 0 ? 0 : 1];
+      const HuffEncTable *eac = &st->enc_ac[ci == 0 ? 0 : 1];
+      const uint16_t *qi = st->qt_in[c->tq];
+      const uint16_t *qo = st->qt_out[c->tq];
+
+      for (int b = 0; b < nblocks; b++) {
+        // DC
+        int s = brDecode(&br, dct);
+        if (s < 0 || s > 11) { ok = false; break; }
+        int diff = s ? extendSign(brGet(&br, s), s) : 0;
+        c->dc_pred_in += diff;
+        int dc = requant(c->dc_pred_in, qi[0], qo[0]);
+        encodeValue(&bw, edc, 0, dc - c->dc_pred_out);
+        c->dc_pred_out = dc;
+
+        // AC: decode, requantize and re-emit run/level pairs on the fly.
+        // Runs are recomputed from positions since requantization can zero out
+        // coefficients and merge runs.
+        int last = 0;  // zigzag index of the last non-zero coefficient written
+        for (int k = 1; k < 64;) {
+          int rs = brDecode(&br, act);
+          if (rs < 0) { ok = false; break; }
+          int r = rs >> 4;
+          s = rs & 0x0F;
+          if (s == 0) {
+            if (r != 15) break;  // EOB
+            k += 16;             // ZRL
+            continue;
+          }
+          k += r;
+          if (k > 63) { ok = false; break; }
+          int v = requant(extendSign(brGet(&br, s), s), qi[k], qo[k]);
+          if (v != 0) {
+            int run = k - last - 1;
+            while (run > 15) {
+              encodeValue(&bw, eac, 15, 0);  // ZRL
+              run -= 16;
+            }
+            encodeValue(&bw, eac, run, v);
+            last = k;
+          }
+          k++;
+        }
+        if (!ok) break;
+        if (last < 63) encodeValue(&bw, eac, 0, 0);  // EOB
+      }
+      if (br.overrun > 64) ok = false;  // ran far past the end of the data
+    }
+  }
+
+  if (ok) {
+    bwFlush(&bw);
+    bwWord(&bw, 0xFFD9);
+  }
+  free(st);
+
+  if (!ok || bw.oom) {
+    free(bw.buf);
+    return false;
+  }
+  *out = bw.buf;
+  *out_len = bw.len;
+  return true;
+}
+
+// Sum of the entries of the first luma (id 0) table and of the standard table over
+// the same entries. Entries clamped at 1 or 255 say little about the scale and are
+// skipped unless nothing else is left.
+static bool lumaTableSums(const uint8_t *jpg, size_t len, int32_t *sum, int32_t *sum_std) {
+  if (!jpg || len < 4 || jpg[0] != 0xFF || jpg[1] != 0xD8) return false;
+  size_t pos = 2;
+  while (pos + 4 <= len && jpg[pos] == 0xFF && jpg[pos + 1] != 0xDA) {
+    size_t seg_len = (jpg[pos + 2] << 8) | jpg[pos + 3];
+    if (seg_len < 2 || pos + 2 + seg_len > len) return false;
+    if (jpg[pos + 1] == 0xDB) {
+      const uint8_t *seg = jpg + pos + 4;
+      const uint8_t *seg_end = jpg + pos + 2 + seg_len;
+      while (seg < seg_end) {
+        int pq = seg[0] >> 4, tq = seg[0] & 0x0F;
+        if (seg + 1 + 64 * (pq + 1) > seg_end) return false;
+        if (tq == 0) {
+          // File order is zig-zag
+          *sum = *sum_std = 0;
+          int32_t all = 0, all_std = 0;
+          for (int i = 0; i < 64; i++) {
+            int q = pq ? (seg[1 + 2 * i] << 8) | seg[2 + 2 * i] : seg[1 + i];
+            all += q;
+            all_std += STD_LUMA_QT[ZIGZAG[i]];
+            if (q > 1 && q < 255) {
+              *sum += q;
+              *sum_std += STD_LUMA_QT[ZIGZAG[i]];
+            }
+          }
+          if (*sum_std == 0) {
+            *sum = all;
+            *sum_std = all_std;
+          }
+          return true;
+        }
+        seg += 1 + 64 * (pq + 1);
+      }
+    }
+    pos += 2 + seg_len;
+  }
+  return false;
+}
+
+int jpegEstimateQuality(const uint8_t *jpg, size_t len) {
+  int32_t sum, sum_std;
+  if (!lumaTableSums(jpg, len, &sum, &sum_std)) return 0;
+  // Invert jpegQualityScale(): scale <= 100 is 200 - 2q, above it 5000 / q
+  int32_t scale = (sum * 100 + sum_std / 2) / sum_std;
+  int quality = scale <= 100 ? (int)((200 - scale + 1) / 2) : (int)((5000 + scale / 2) / scale);
+  if (quality < 1) quality = 1;
+  if (quality > 100) quality = 100;
+  return quality;
+}
+
+bool jpegRequantizeToQuality(const uint8_t *src, size_t src_len, int quality,
+                             uint8_t **out, size_t *out_len) {
+  *out = NULL;
+  *out_len = 0;
+  int32_t sum, sum_std;
+  if (!lumaTableSums(src, src_len, &sum, &sum_std)) return false;
+  // target / source scale = jpegQualityScale(quality) / (100 * sum / sum_std)
+  int32_t num = jpegQualityScale(quality) * sum_std;
+  int32_t den = 100 * sum;
+  if (num <= den) return false;  // Not coarser than the frame already is
+  return jpegRequantize(src, src_len, num, den, out, out_len);
+}
@@ -0,0 +1,98 @@
+#include "jpeg_validate.h"
+
+#include <string.h>
+
+// Word-at-a-time 0xFF search: 32-bit loads on the ESP32-S3, 64-bit on a host
+typedef uintptr_t jword_t;
+#define JWORD_ONES   ((jword_t)-1 / 0xFF)  // 0x0101...01
+#define JWORD_HIGHS  (JWORD_ONES * 0x80)   // 0x8080...80
+
+// Offset of the first 0xFF at or after pos, or len if there is none
+static size_t findFF(const uint8_t *buf, size_t pos, size_t len) {
+  while (pos + sizeof(jword_t) <= len) {
+    jword_t w;
+    memcpy(&w, buf + pos, sizeof(w));  // Unaligned-safe, a single load on both targets
+    jword_t v = ~w;                    // 0xFF bytes become zero bytes
+    if ((v - JWORD_ONES) & ~v & JWORD_HIGHS) break;
+    pos += sizeof(jword_t);
+  }
+  while (pos < len && buf[pos] != 0xFF) pos++;
+  return pos;
+}
+
+static inline bool isSof(uint8_t m) {
+  return m >= 0xC0 && m <= 0xCF && m != 0xC4 && m != 0xC8 && m != 0xCC;
+}
+
+JpegCheckResult jpegValidate(const uint8_t *buf, size_t len,
+                             uint16_t expect_width, uint16_t expect_height,
+                             JpegCheck *out) {
+  memset(out, 0, sizeof(*out));
+  if (!buf || len < 4 || buf[0] != 0xFF || buf[1] != 0xD8) return JPEG_ERR_NO_SOI;
+
+  bool have_sof = false;
+  size_t pos = 2;
+  for (;;) {
+    if (pos >= len) return JPEG_ERR_TRUNCATED;
+    if (buf[pos] != 0xFF) return JPEG_ERR_MARKER;
+    while (pos < len && buf[pos] == 0xFF) pos++;  // Fill bytes
+    if (pos >= len) return JPEG_ERR_TRUNCATED;
+    uint8_t marker = buf[pos++];
+
+    if (marker == 0x01) continue;  // TEM: no length
+    if (marker == 0x00 || marker == 0xD8 || marker == 0xD9 || (marker >= 0xD0 && marker <= 0xD7)) {
+      return JPEG_ERR_MARKER;  // Stuffing, SOI, EOI or RSTn outside a scan
+    }
+
+    if (pos + 2 > len) return JPEG_ERR_TRUNCATED;
+    size_t seg_len = ((size_t)buf[pos] << 8) | buf[pos + 1];
+    if (seg_len < 2) return JPEG_ERR_MARKER;
+    if (pos + seg_len > len) return JPEG_ERR_TRUNCATED;
+
+    if (isSof(marker)) {
+      if (seg_len < 8) return JPEG_ERR_MARKER;
+      out->height = (uint16_t)((buf[pos + 3] << 8) | buf[pos + 4]);
+      out->width = (uint16_t)((buf[pos + 5] << 8) | buf[pos + 6]);
+      have_sof = true;
+      if ((expect_width && out->width != expect_width) || (expect_height && out->height != expect_height)) {
+        return JPEG_ERR_DIMENSIONS;
+      }
+    }
+    pos += seg_len;
+    if (marker != 0xDA) continue;
+
+    // Entropy-coded data: 0xFF is followed by 0x00 (stuffing), RSTn or fill bytes;
+    // anything else is the marker that ends the scan
+    if (!have_sof) return JPEG_ERR_NO_SOF;
+    for (;;) {
+      pos = findFF(buf, pos, len);
+      if (pos + 1 >= len) return JPEG_ERR_TRUNCATED;
+      uint8_t next = buf[pos + 1];
+      if (next == 0x00 || (next >= 0xD0 && next <= 0xD7)) {
+        pos += 2;
+      } else if (next == 0xFF) {
+        pos++;
+      } else {
+        break;
+      }
+    }
+    if (buf[pos + 1] == 0xD9) {
+      out->len = pos + 2;
+      out->trailing = len - out->len;
+      return JPEG_VALID;
+    }
+    // Another segment follows the scan (multi-scan JPEG): keep walking
+  }
+}
+
+const char *jpegCheckName(JpegCheckResult result) {
+  switch (result) {
+    case JPEG_VALID:          return "valid";
+    case JPEG_ERR_NO_SOI:     return "no_soi";
+    case JPEG_ERR_MARKER:     return "bad_marker";
+    case JPEG_ERR_NO_SOF:     return "no_sof";
+    case JPEG_ERR_DIMENSIONS: return "dimensions";
+    case JPEG_ERR_TRUNCATED:  return "truncated";
+    default:                  return "unknown";
+  }
+}
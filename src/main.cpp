@@ -7,44 +7,173 @@
 #include "config.h"
 #include "esp_system.h"
 #include "esp_task_wdt.h"
+#include <stdarg.h>          // va_list for chunk_printf()
+#include <math.h>            // isfinite() for query parameters
 #include "img_converters.h"  // For frame2jpg() software JPEG encoder
+#include "lwip/sockets.h"    // TCP_NODELAY for /bench/net
+#include "jpeg_requant.h"    // Coefficient-domain requantization of hardware JPEG
+#include "jpeg_encoder.h"    // Native YUV422 -> JPEG (no RGB round trip)
+#include "jpeg_validate.h"   // Drop truncated/corrupt hardware JPEG before sending
+#include "index_html_gz.h"   // Generated from web/index.html by tools/embed_web.py
+#include "frame_cache.h"     // Latest encoded frame + sequence number for ETags
+#include "rtsp_server.h"     // RTSP/RTP MJPEG (RFC 2435) for NVRs
+#include "boot_sequencer.h"  // Concurrent camera/WiFi bring-up
+#include "wifi_cache.h"      // Cached channel/BSSID for scan-free reconnects
+#include "board_detect.h"    // Camera pin map: NVS cache or SCCB probe
+#include "mem_budget.h"      // PSRAM footprint of camera modes, checked before reinit
+#include "mem_telemetry.h"   // Heap fragmentation samples + tagged allocation counters
+#include "camera_standby.h"  // Sensor standby + paused XCLK while nobody uses the camera
+#include "timelapse.h"       // On-device time-lapse schedule + PSRAM staging
+#include "camera_arbiter.h"  // One camera user at a time: snapshot > timelapse > stream
+#include "stream_pacing.h"   // Cached frame reuse + WebSocket one-frame-in-flight pacing
 
 // WiFi credentials from config.h
 const char* ssid = WIFI_SSID;
 const char* password = WIFI_PASSWORD;
 
-// Camera pins for GOOUUU ESP32-S3-CAM (verified working configuration)
-#define CAM_PIN_PWDN    -1
-#define CAM_PIN_RESET   -1
-#define CAM_PIN_XCLK    15
-#define CAM_PIN_SIOD    4
-#define CAM_PIN_SIOC    5
-
-#define CAM_PIN_D7      16
-#define CAM_PIN_D6      17
-#define CAM_PIN_D5      18
-#define CAM_PIN_D4      12
-#define CAM_PIN_D3      10
-#define CAM_PIN_D2      8
-#define CAM_PIN_D1      9
-#define CAM_PIN_D0      11
-#define CAM_PIN_VSYNC   6
-#define CAM_PIN_HREF    7
-#define CAM_PIN_PCLK    13
+// Camera pins: board profile found by the SCCB probe (or cached in NVS) at boot.
+// Defaults to the GOOUUU ESP32-S3-CAM map (see BOARD_PROFILES in sensor_probe.cpp)
+static const BoardProfile *camera_profile = &BOARD_PROFILES[0];
 
 httpd_handle_t camera_httpd = NULL;
 httpd_handle_t stream_httpd = NULL;
 
-// Forward declaration of camera initialization function
+// Frame buffers per camera mode: two so capture and encode overlap, one when the
+// budget planner finds PSRAM too fragmented for two
+#define CAMERA_FB_COUNT  2
+
+// Seconds without a capture before the sensor goes into standby (0 = never).
+// Override in config.h.
+#ifndef CAMERA_IDLE_TIMEOUT_S
+#define CAMERA_IDLE_TIMEOUT_S  60
+#endif
+// After a warm resume: frames completed before it are stale and the first one after
+// it may be torn (clock stopped mid-frame), so drop that many more, at most MAX in all
+#define CAMERA_WARM_SKIP_FRAMES  1
+#define CAMERA_WARM_MAX_DROP     4
+
+// Forward declaration of camera initialization functions
+bool initCamera(framesize_t framesize, pixformat_t pixformat, int fb_count = CAMERA_FB_COUNT);
 bool initCamera(framesize_t framesize = FRAMESIZE_SVGA);
 
+// millis() of the first successful capture since boot (time-to-first-frame)
+static uint32_t first_frame_ms = 0;
+
+// Raw sensor format for software-encoded colour (≤SVGA). YUV422 goes straight into
+// jpegEncodeYuyv(); RGB565 makes the sensor convert to RGB only for the encoder to
+// convert back to YCbCr. Define as PIXFORMAT_RGB565 in config.h to get the old path.
+#ifndef SOFT_JPEG_PIXFORMAT
+#define SOFT_JPEG_PIXFORMAT  PIXFORMAT_YUV422
+#endif
+
 // Helper function to determine if resolution should use RGB565 or JPEG mode
 bool shouldUseRGB565Mode(framesize_t fs) {
   // RGB565 mode: Safe for resolutions ≤ SVGA (800x600)
   // JPEG mode: Required for XGA+ (high res) due to buffer size
+  // (YUV422 has the same 2 bytes/pixel, so the same limit applies)
   return (fs <= FRAMESIZE_SVGA);
 }
 
+// Sensor output format: luma-only at any resolution when grayscale is requested
+// (half the bytes of RGB565, no colour conversion), otherwise the dual-mode rule
+pixformat_t sensorPixformatFor(framesize_t fs, bool grayscale) {
+  if (grayscale) return PIXFORMAT_GRAYSCALE;
+  return shouldUseRGB565Mode(fs) ? SOFT_JPEG_PIXFORMAT : PIXFORMAT_JPEG;
+}
+
+static bool isSoftJpegFormat(pixformat_t format) {
+  return format == PIXFORMAT_YUV422 || format == PIXFORMAT_RGB565 || format == PIXFORMAT_GRAYSCALE;
+}
+
+static const char *pixformatName(pixformat_t format) {
+  switch (format) {
+    case PIXFORMAT_YUV422:    return "yuv422";
+    case PIXFORMAT_RGB565:    return "rgb565";
+    case PIXFORMAT_GRAYSCALE: return "gray";
+    case PIXFORMAT_JPEG:      return "jpeg";
+    default:                  return "other";
+  }
+}
+
+// Colour formats go through the native encoder, which also fills JpegImageStats
+static bool hasFusedStats(pixformat_t format) {
+  return format == PIXFORMAT_YUV422 || format == PIXFORMAT_RGB565;
+}
+
+// Stats buffer for encodeFrame(), handed to the frame cache with the JPEG; NULL for
+// grayscale (frame2jpg() only) or when out of memory
+static JpegImageStats *allocStats(pixformat_t format) {
+  return hasFusedStats(format) ? (JpegImageStats *)malloc(sizeof(JpegImageStats)) : NULL;
+}
+
+// Software JPEG for a raw frame buffer: YUV422 and RGB565 through the native encoder
+// (filling stats, if given, in the same pass), grayscale through frame2jpg(). Same
+// quality scale for both; *out must be free()d.
+// headroom, if given, is the number of free bytes wanted in front of the JPEG and is
+// set to what was left (0 from frame2jpg()); the JPEG starts at *out + *headroom.
+// Output (headroom included) is tagged MEM_TAG_ENCODE until freed with freeEncoded() or
+// given to the cache.
+static bool encodeFrame(camera_fb_t *fb, int quality, uint8_t **out, size_t *out_len,
+                        JpegImageStats *stats = NULL, size_t *headroom = NULL) {
+  size_t room = headroom ? *headroom : 0;
+  bool ok;
+  if (fb->format == PIXFORMAT_YUV422) {
+    ok = jpegEncodeYuyv(fb->buf, fb->width, fb->height, quality, out, out_len, stats, room);
+  } else if (fb->format == PIXFORMAT_RGB565) {
+    ok = jpegEncodeRgb565(fb->buf, fb->width, fb->height, quality, out, out_len, stats, room);
+  } else {
+    ok = frame2jpg(fb, quality, out, out_len);
+    room = 0;
+  }
+  if (headroom) *headroom = room;
+  if (ok) {
+    memTagAlloc(MEM_TAG_ENCODE, room + *out_len);
+  } else {
+    memTagFail(MEM_TAG_ENCODE);
+  }
+  return ok;
+}
+
+// Hardware JPEG requantized to IJG quality (the encodeFrame() scale), tagged like
+// encodeFrame()'s output. False if the frame is already at that quality or coarser.
+static bool requantizeFrame(const uint8_t *src, size_t src_len, int quality,
+                            uint8_t **out, size_t *out_len) {
+  bool ok = jpegRequantizeToQuality(src, src_len, quality, out, out_len);
+  if (ok) memTagAlloc(MEM_TAG_ENCODE, *out_len);
+  return ok;
+}
+
+static void freeEncoded(uint8_t *buf, size_t len) {
+  memTagFree(MEM_TAG_ENCODE, len);
+  free(buf);
+}
+
+static int camera_fb_count = 0;       // Buffers of the running camera (0 = down)
+static size_t camera_mem_bytes = 0;   // Their planned footprint, tagged MEM_TAG_CAMERA
+
+static MemPixelFormat memFormatFor(pixformat_t format) {
+  switch (format) {
+    case PIXFORMAT_RGB565:    return MEM_FORMAT_RGB565;
+    case PIXFORMAT_YUV422:    return MEM_FORMAT_YUV422;
+    case PIXFORMAT_GRAYSCALE: return MEM_FORMAT_GRAY;
+    default:                  return MEM_FORMAT_JPEG;
+  }
+}
+
+static void cameraMemMode(framesize_t fs, pixformat_t format, int fb_count, MemBudgetMode *out) {
+  out->width = resolution[fs].width;
+  out->height = resolution[fs].height;
+  out->format = memFormatFor(format);
+  out->fb_count = (uint8_t)fb_count;
+}
+
+static void deinitCamera() {
+  esp_camera_deinit();
+  memTagFree(MEM_TAG_CAMERA, camera_mem_bytes);
+  camera_mem_bytes = 0;
+  camera_fb_count = 0;
+}
+
 // Patch OV2640 malformed JPEG header (FF D8 FF 10 -> FF D8 FF E0)
 void patchJPEGHeader(uint8_t *buf, size_t len) {
   if (len >= 4 && buf[0] == 0xFF && buf[1] == 0xD8 && buf[2] == 0xFF && buf[3] == 0x10) {
@@ -53,115 +182,95 @@ void patchJPEGHeader(uint8_t *buf, size_t len) {
   }
 }
 
-// HTML page for camera controls
-static const char PROGMEM INDEX_HTML[] = R"rawliteral(
-<!DOCTYPE html>
-<html>
-<head>
-  <title>ESP32-S3 Camera</title>
-  <meta name="viewport" content="width=device-width, initial-scale=1">
-  <style>
-    body { font-family: Arial; text-align: center; margin: 0; background: #1a1a1a; color: #fff; }
-    .container { padding: 20px; }
-    h1 { margin: 20px 0; }
-    img { max-width: 100%; height: auto; border: 2px solid #333; border-radius: 8px; background: #000; }
-    .controls { margin: 20px; }
-    button { 
-      padding: 12px 24px; 
-      margin: 5px; 
-      font-size: 16px; 
-      cursor: pointer;
-      background: #007bff;
-      color: white;
-      border: none;
-      border-radius: 4px;
-    }
-    button:hover { background: #0056b3; }
-    button:disabled { background: #555; cursor: not-allowed; }
-    .info { 
-      background: #2a2a2a; 
-      padding: 10px; 
-      margin: 10px auto; 
-      max-width: 600px;
-      border-radius: 4px;
-    }
-    .status { color: #28a745; margin: 10px; }
-  </style>
-</head>
-<body>
-  <div class="container">
-    <h1>🎥 ESP32-S3 Camera</h1>
-    <div class="info">
-      <p id="camInfo">ESP32-S3 | OV2640 Camera | Auto-fix malformed headers | PSRAM: 8MB</p>
-      <p class="status" id="status">Ready</p>
-    </div>
-    <div>
-      <img id="stream" src="" alt="Camera feed will appear here">
-    </div>
-    <div class="controls">
-      <button onclick="capturePhoto()">📸 Capture Photo</button>
-      <button onclick="startStream()" id="btnStart">▶️ Start Stream</button>
-      <button onclick="stopStream()" id="btnStop" disabled>⏹️ Stop Stream</button>
-      <button onclick="downloadPhoto()">💾 Download</button>
-    </div>
-  </div>
-  <script>
-    let streaming = false;
-    
-    function capturePhoto() {
-      document.getElementById('status').innerText = 'Capturing... (may take 10-15 sec)';
-      const img = document.getElementById('stream');
-      const url = '/capture?t=' + new Date().getTime();
-      
-      img.onload = function() {
-        document.getElementById('status').innerText = 'Photo captured!';
-        document.getElementById('status').style.color = '#28a745';
-        setTimeout(() => {
-          document.getElementById('status').innerText = 'Ready';
-        }, 2000);
-      };
-      
-      img.onerror = function() {
-        document.getElementById('status').innerText = 'Capture failed! Try again.';
-        document.getElementById('status').style.color = '#dc3545';
-      };
-      
-      // Direct image load (simpler, more reliable)
-      img.src = url;
-    }
-    
-    function startStream() {
-      const img = document.getElementById('stream');
-      img.src = window.location.protocol + '//' + window.location.hostname + ':81/stream';
-      streaming = true;
-      document.getElementById('btnStart').disabled = true;
-      document.getElementById('btnStop').disabled = false;
-      document.getElementById('status').innerText = 'Streaming...';
-    }
-    
-    function stopStream() {
-      document.getElementById('stream').src = '';
-      streaming = false;
-      document.getElementById('btnStart').disabled = false;
-      document.getElementById('btnStop').disabled = true;
-      document.getElementById('status').innerText = 'Ready';
-    }
-    
-    function downloadPhoto() {
-      window.open('/capture?download=1', '_blank');
+// Hardware JPEG frames failing validation are returned and captured again, this
+// many attempts in total before the request gives up
+#define JPEG_CAPTURE_ATTEMPTS  3
+
+// Validation outcomes since boot, for /metrics
+static uint32_t jpeg_check_counts[JPEG_CHECK_COUNT] = {0};
+static uint32_t jpeg_trimmed_frames = 0;
+static uint32_t jpeg_trimmed_bytes = 0;
+static uint32_t jpeg_dropped_captures = 0;  // All attempts failed
+
+// esp_camera_fb_get() that first brings the sensor out of idle standby. Exposure and
+// gain registers survive standby, so there are no AEC settle frames to wait for; only
+// frames from before the resume and the first one after it are dropped. The time from
+// resume to the first usable frame is recorded as the warm start latency.
+static camera_fb_t *camera_fb_get() {
+  int64_t resumed_us = cameraStandbyWake();
+  camera_fb_t *fb = esp_camera_fb_get();
+  if (!resumed_us) return fb;
+
+  int skip = CAMERA_WARM_SKIP_FRAMES;
+  int dropped = 0;
+  while (fb && dropped < CAMERA_WARM_MAX_DROP) {
+    int64_t ts = (int64_t)fb->timestamp.tv_sec * 1000000 + fb->timestamp.tv_usec;
+    if (ts >= resumed_us && skip-- == 0) break;
+    esp_camera_fb_return(fb);
+    dropped++;
+    fb = esp_camera_fb_get();
+  }
+  if (fb) {
+    uint32_t ms = (esp_timer_get_time() - resumed_us) / 1000;
+    cameraStandbyRecordStart(CAMERA_START_WARM, ms);
+    printf("[STANDBY] Warm start: first frame in %u ms (%d dropped)\n", (unsigned)ms, dropped);
+  }
+  return fb;
+}
+
+// esp_camera_fb_get() that never hands out a corrupt hardware JPEG: the header is
+// patched, then SOI, segment structure, SOF size (against the configured frame size)
+// and EOI are checked and trailing bytes after EOI trimmed. A bad frame goes back to
+// the driver and the capture is retried. Raw formats pass through unchecked.
+static camera_fb_t *capture_frame() {
+  for (int attempt = 1; attempt <= JPEG_CAPTURE_ATTEMPTS; attempt++) {
+    camera_fb_t *fb = camera_fb_get();
+    if (!fb || fb->format != PIXFORMAT_JPEG) return fb;
+
+    patchJPEGHeader(fb->buf, fb->len);
+    JpegCheck check;
+    JpegCheckResult result = jpegValidate(fb->buf, fb->len, fb->width, fb->height, &check);
+    __atomic_add_fetch(&jpeg_check_counts[result], 1, __ATOMIC_RELAXED);
+    if (result == JPEG_VALID) {
+      if (check.trailing) {
+        __atomic_add_fetch(&jpeg_trimmed_frames, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&jpeg_trimmed_bytes, (uint32_t)check.trailing, __ATOMIC_RELAXED);
+        fb->len = check.len;  // The driver sets len again for the next frame
+      }
+      return fb;
     }
-  </script>
-</body>
-</html>
-)rawliteral";
+
+    printf("[JPEG] Dropping %u-byte frame (%ux%u expected): %s, attempt %d/%d\n",
+           fb->len, fb->width, fb->height, jpegCheckName(result), attempt, JPEG_CAPTURE_ATTEMPTS);
+    esp_camera_fb_return(fb);
+  }
+  __atomic_add_fetch(&jpeg_dropped_captures, 1, __ATOMIC_RELAXED);
+  Serial.println("❌ No valid hardware JPEG frame after retries");
+  return NULL;
+}
+
+// Web UI: web/index.html, gzipped at build time by tools/embed_web.py
+// Fresh for a week; after that browsers revalidate with If-None-Match and get a 304
+// unless a firmware update changed the page
+static const char *INDEX_CACHE_CONTROL = "public, max-age=604800";
 
 static esp_err_t index_handler(httpd_req_t *req) {
-  Serial.println("\n📄 INDEX PAGE REQUEST");
-  Serial.printf("Free heap: %u bytes\n", ESP.getFreeHeap());
-  
+  // Browser already has this build of the page: answer with headers only
+  char if_none_match[64];
+  if (httpd_req_get_hdr_value_str(req, "If-None-Match", if_none_match, sizeof(if_none_match)) == ESP_OK &&
+      (strstr(if_none_match, INDEX_HTML_GZ_ETAG) != NULL || strcmp(if_none_match, "*") == 0)) {
+    httpd_resp_set_status(req, "304 Not Modified");
+    httpd_resp_set_hdr(req, "ETag", INDEX_HTML_GZ_ETAG);
+    httpd_resp_set_hdr(req, "Cache-Control", INDEX_CACHE_CONTROL);
+    return httpd_resp_send(req, NULL, 0);
+  }
+
   httpd_resp_set_type(req, "text/html");
-  esp_err_t res = httpd_resp_send(req, INDEX_HTML, strlen(INDEX_HTML));
-  Serial.printf("📤 Index sent: %s (size=%d bytes)\n\n", res == ESP_OK ? "OK" : "FAILED", strlen(INDEX_HTML));
+  httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+  httpd_resp_set_hdr(req, "ETag", INDEX_HTML_GZ_ETAG);
+  httpd_resp_set_hdr(req, "Cache-Control", INDEX_CACHE_CONTROL);
+  esp_err_t res = httpd_resp_send(req, (const char *)INDEX_HTML_GZ, INDEX_HTML_GZ_LEN);
+  printf("[INDEX] Sent %u bytes gzip: %s\n", INDEX_HTML_GZ_LEN, res == ESP_OK ? "OK" : "FAILED");
   return res;
 }
 
@@ -187,6 +296,269 @@ static framesize_t parse_frame_size(const char *res) {
   return FRAMESIZE_SVGA; // Fallback to safe default
 }
 
+// Snapshot polling: a conditional /capture is answered from the frame cache while the
+// latest frame is younger than this (override per request with ?maxage=ms). It is
+// the staleness window of If-None-Match: once the frame is older, a new one is
+// captured and sent with 200 even if nothing in the scene changed, so a poller gets
+// at most one frame per window without a stream running.
+#ifndef SNAPSHOT_MAX_AGE_MS
+#define SNAPSHOT_MAX_AGE_MS   1000
+#endif
+// Upper bound for ?wait=ms long-polls; the port-80 worker is busy while one waits
+#define SNAPSHOT_MAX_WAIT_MS  10000
+
+static void set_capture_headers(httpd_req_t *req, bool download, const char *etag) {
+  httpd_resp_set_type(req, "image/jpeg");
+  if (download) {
+    httpd_resp_set_hdr(req, "Content-Disposition", "attachment; filename=capture.jpg");
+  } else {
+    httpd_resp_set_hdr(req, "Content-Disposition", "inline; filename=capture.jpg");
+  }
+  httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+  httpd_resp_set_hdr(req, "Access-Control-Expose-Headers", "ETag");
+  // no-cache (not no-store) so clients keep the frame and revalidate with If-None-Match
+  httpd_resp_set_hdr(req, "Cache-Control", "no-cache, must-revalidate");
+  if (etag) httpd_resp_set_hdr(req, "ETag", etag);
+}
+
+// Estimated quality of the sensor's own JPEG frames, from the last one seen (0 = none
+// yet). Hardware frames are cached with it unless requantized, so a /capture without
+// q= (or with a q at or above it) at XGA+ knows which cached frames it may reuse.
+static int hw_jpeg_quality = 0;
+
+// Answer a conditional or ?maxage= request from the frame cache. Returns true if a
+// response (200 from cache or 304) was sent, false if a fresh capture is needed.
+static bool serve_cached_snapshot(httpd_req_t *req, const char *if_none_match, int max_age_ms,
+                                  int wait_ms, framesize_t fs, int quality, bool grayscale,
+                                  bool download, esp_err_t *res) {
+  int64_t deadline = esp_timer_get_time() + (int64_t)wait_ms * 1000;
+  while (true) {
+    CachedFrame *frame = frameCacheAcquire();
+    if (!frame || frame->framesize != fs || frame->quality != quality ||
+        frame->grayscale != grayscale) {
+      frameCacheRelease(frame);
+      return false;  // nothing cached with these settings
+    }
+    char etag[32];
+    frameCacheETag(frame, etag, sizeof(etag));
+    int64_t now = esp_timer_get_time();
+    bool fresh = now - frame->timestamp_us < (int64_t)max_age_ms * 1000;
+    bool client_has_it = if_none_match && strstr(if_none_match, etag) != NULL;
+
+    if (!fresh) {
+      frameCacheRelease(frame);
+      return false;  // time for a new frame
+    }
+    if (!client_has_it) {
+      printf("[CAPTURE] Serving cached frame %u (%u bytes, %lld ms old)\n",
+             frame->seq, frame->len, (now - frame->timestamp_us) / 1000);
+      set_capture_headers(req, download, etag);
+      *res = httpd_resp_send(req, (const char *)frame->buf, frame->len);
+      frameCacheRelease(frame);
+      return true;
+    }
+    frameCacheRelease(frame);
+    if (now >= deadline) {
+      printf("[CAPTURE] 304 Not Modified (%s)\n", etag);
+      httpd_resp_set_status(req, "304 Not Modified");
+      set_capture_headers(req, download, etag);
+      *res = httpd_resp_send(req, NULL, 0);
+      return true;
+    }
+    // Long-poll: wait for a producer (stream) to publish, or for the frame to go stale
+    esp_task_wdt_reset();
+    vTaskDelay(pdMS_TO_TICKS(20));
+  }
+}
+
+// Plan an init at fs/pixformat against the PSRAM sampled now. current is the mode
+// deinit will release, NULL if the camera is down.
+static void plan_camera_mode(framesize_t fs, pixformat_t pixformat, const MemBudgetMode *current,
+                             MemPlan *plan) {
+  MemBudgetMode target;
+  cameraMemMode(fs, pixformat, CAMERA_FB_COUNT, &target);
+  MemRegionSample psram;
+  memRegionSample(MEM_REGION_PSRAM, &psram);
+  MemRegionState state = { psram.free_bytes, psram.largest_block };
+  MemTagStats cached;
+  memTagGet(MEM_TAG_CACHE, &cached);
+  memBudgetPlan(&target, current, &state, cached.bytes, plan);
+  printf("[MEM] %ux%u %s x%u needs %u KB PSRAM (fb %u KB); %u KB free, block %u KB after release: %s\n",
+         target.width, target.height, memPixelFormatName(target.format), plan->fb_count,
+         (unsigned)(plan->footprint.total_bytes / 1024), (unsigned)(plan->footprint.fb_bytes / 1024),
+         (unsigned)(plan->available_bytes / 1024), (unsigned)(plan->available_block / 1024),
+         memPlanActionName(plan->action));
+}
+
+// Reinitialize the camera if the requested resolution or pixel format differs from
+// the current one. Reinit (not set_framesize) avoids buffer reallocation crashes.
+// The PSRAM budget is planned first: a mode that cannot fit is refused while the
+// current one keeps running (false), a tight one gets the frame cache flushed or
+// fewer frame buffers. If the new mode fails to come up, SVGA colour is planned
+// and brought back the same way, and the result is still false: the caller asked
+// for a mode that isn't running.
+static bool ensure_camera_mode(framesize_t fs, pixformat_t pixformat) {
+  sensor_t *s = esp_camera_sensor_get();
+  if (s && s->status.framesize == fs && s->pixformat == pixformat) return true;
+
+  MemBudgetMode current;
+  bool running = s && camera_fb_count > 0;
+  if (running) cameraMemMode(s->status.framesize, s->pixformat, camera_fb_count, &current);
+  MemPlan plan;
+  plan_camera_mode(fs, pixformat, running ? &current : NULL, &plan);
+  if (plan.action == MEM_PLAN_REFUSE) {
+    memTelemetrySample(MEM_EVENT_REINIT_REFUSED);
+    Serial.println("   ❌ Not enough PSRAM for this mode - keeping the current one");
+    return false;
+  }
+  if (plan.action != MEM_PLAN_OK) frameCacheDrop();  // Cached JPEG goes before the camera does
+
+  printf("[CAMERA] Mode change: %d/%d -> %d/%d - REINITIALIZING CAMERA\n",
+         s ? s->status.framesize : -1, s ? s->pixformat : -1, fs, pixformat);
+  Serial.printf("   Mode: %s\n", pixformat == PIXFORMAT_GRAYSCALE ? "Grayscale (software JPEG)" :
+                               pixformat == PIXFORMAT_YUV422 ? "YUV422 (native software JPEG)" :
+                               pixformat == PIXFORMAT_RGB565 ? "RGB565 (software JPEG)" : "JPEG (hardware + patch)");
+  Serial.printf("   Deinitializing camera...\n");
+
+  memTelemetrySample(MEM_EVENT_REINIT_BEFORE);
+
+  // Deinitialize current camera
+  deinitCamera();
+  vTaskDelay(pdMS_TO_TICKS(500));  // Increased delay for proper cleanup
+
+  // Feed watchdog during reinit
+  esp_task_wdt_reset();
+
+  // Reinitialize with new mode
+  Serial.printf("   Reinitializing at resolution %d...\n", fs);
+  if (!initCamera(fs, pixformat, plan.fb_count)) {
+    memTelemetrySample(MEM_EVENT_REINIT_FAILED);
+    printf("[CAMERA] ERROR: Failed to reinitialize camera\n");
+    Serial.println("   ❌ Camera reinit failed - attempting recovery");
+    // Recover at SVGA colour. The failed init may have left PSRAM fragmented, so the
+    // fallback is planned too and can come up with a single frame buffer.
+    pixformat_t fallback_format = sensorPixformatFor(FRAMESIZE_SVGA, false);
+    MemPlan fallback;
+    plan_camera_mode(FRAMESIZE_SVGA, fallback_format, NULL, &fallback);
+    if (fallback.action == MEM_PLAN_REFUSE) {
+      Serial.println("   ❌ Not enough PSRAM for SVGA either - camera is down");
+      return false;
+    }
+    if (fallback.action != MEM_PLAN_OK) frameCacheDrop();
+    if (initCamera(FRAMESIZE_SVGA, fallback_format, fallback.fb_count)) {
+      Serial.printf("   ⚠️ Recovered at SVGA with %u frame buffer(s)\n", fallback.fb_count);
+    } else {
+      Serial.println("   ❌ SVGA recovery failed - camera is down");
+    }
+    return false;
+  }
+  memTelemetrySample(MEM_EVENT_REINIT_AFTER);
+  Serial.println("   ✅ Camera reinitialized successfully");
+  // Additional delay after successful reinit
+  vTaskDelay(pdMS_TO_TICKS(200));
+  return true;
+}
+
+// Every sensor user (anything that reinitializes the camera or holds a frame buffer)
+// does so between camera_acquire() and camera_release(), by priority class. Without it a
+// reinit for one request freed the frame buffers another task was still capturing
+// into or sending from, and standby could pause XCLK under a capture.
+static CameraArbiter camera_arbiter;
+static SemaphoreHandle_t camera_arbiter_lock = NULL;
+static EventGroupHandle_t camera_arbiter_wake = NULL;  // One bit per class
+// Blocked waiters look again at least this often (a wake-up may go to a same-class sibling)
+#define CAMERA_ARBITER_RECHECK_MS  100
+
+static void camera_arbiter_init() {
+  cameraArbiterInit(&camera_arbiter);
+  camera_arbiter_lock = xSemaphoreCreateMutex();
+  camera_arbiter_wake = xEventGroupCreate();
+}
+
+// Only valid while nobody holds the camera (a holder may be reinitializing it)
+static bool current_camera_mode(CameraMode *out) {
+  sensor_t *s = esp_camera_sensor_get();
+  if (!s || camera_fb_count == 0) return false;
+  out->framesize = s->status.framesize;
+  out->pixformat = s->pixformat;
+  return true;
+}
+
+static bool camera_try_grant(CameraClient client) {
+  CameraMode current;
+  bool have_mode = camera_arbiter.owner < 0 && current_camera_mode(&current);
+  return cameraArbiterTryAcquire(&camera_arbiter, client, have_mode ? &current : NULL,
+                                 esp_timer_get_time());
+}
+
+// Block until client holds the camera. Returns whether a stream was active when the
+// request came in (for the snapshot latency split).
+static bool camera_acquire(CameraClient client) {
+  if (!camera_arbiter_lock) return false;
+  int64_t start = esp_timer_get_time();
+  bool waiting = false;
+  bool stream_active = false;
+  for (;;) {
+    xSemaphoreTake(camera_arbiter_lock, portMAX_DELAY);
+    if (!waiting) stream_active = cameraArbiterStreamActive(&camera_arbiter, start);
+    bool granted = camera_try_grant(client);
+    if (granted) {
+      if (waiting) cameraArbiterWaitEnd(&camera_arbiter, client);
+      cameraLatencyRecord(&camera_arbiter.wait[client], (esp_timer_get_time() - start) / 1000);
+    } else if (!waiting) {
+      cameraArbiterWaitBegin(&camera_arbiter, client);
+      waiting = true;
+    }
+    xSemaphoreGive(camera_arbiter_lock);
+    if (granted) return stream_active;
+    xEventGroupWaitBits(camera_arbiter_wake, 1 << client, pdTRUE, pdFALSE,
+                        pdMS_TO_TICKS(CAMERA_ARBITER_RECHECK_MS));
+  }
+}
+
+// Take the camera only if it is free and nobody is waiting (housekeeping)
+static bool camera_try_acquire(CameraClient client) {
+  if (!camera_arbiter_lock) return false;
+  xSemaphoreTake(camera_arbiter_lock, portMAX_DELAY);
+  bool granted = camera_arbiter.owner < 0 && !camera_arbiter.waiting[client] && camera_try_grant(client);
+  xSemaphoreGive(camera_arbiter_lock);
+  return granted;
+}
+
+static void camera_release() {
+  if (!camera_arbiter_lock) return;
+  xSemaphoreTake(camera_arbiter_lock, portMAX_DELAY);
+  int next = cameraArbiterRelease(&camera_arbiter);
+  xSemaphoreGive(camera_arbiter_lock);
+  if (next >= 0) xEventGroupSetBits(camera_arbiter_wake, 1 << next);
+}
+
+// Stream-class acquire: if a snapshot or time-lapse shot switched the sensor away
+// from the stream's mode, switch back before the next stream frame
+static void camera_acquire_stream() {
+  if (!camera_arbiter_lock) return;
+  camera_acquire(CAMERA_CLIENT_STREAM);
+  CameraMode current, back;
+  xSemaphoreTake(camera_arbiter_lock, portMAX_DELAY);
+  bool have_mode = current_camera_mode(&current);
+  bool restore = cameraArbiterTakeRestore(&camera_arbiter, have_mode ? &current : NULL, &back);
+  xSemaphoreGive(camera_arbiter_lock);
+  if (restore) {
+    printf("[ARBITER] Stream resumes at its mode %d/%d\n", back.framesize, back.pixformat);
+    ensure_camera_mode((framesize_t)back.framesize, (pixformat_t)back.pixformat);
+  }
+}
+
+// Snapshot latency: request -> image ready to send (the send depends on the client's link)
+static void camera_record_snapshot(int64_t start_us, bool stream_active) {
+  if (!camera_arbiter_lock) return;
+  uint32_t ms = (esp_timer_get_time() - start_us) / 1000;
+  xSemaphoreTake(camera_arbiter_lock, portMAX_DELAY);
+  cameraLatencyRecord(&camera_arbiter.snapshot[stream_active ? 1 : 0], ms);
+  xSemaphoreGive(camera_arbiter_lock);
+  printf("[ARBITER] Snapshot ready in %u ms%s\n", (unsigned)ms, stream_active ? " (stream active)" : "");
+}
+
 static esp_err_t capture_handler(httpd_req_t *req) {
   printf("[CAPTURE] Request received\n");
   Serial.println("\n========================================");
@@ -199,8 +571,16 @@ static esp_err_t capture_handler(httpd_req_t *req) {
   // Parse query before capture to allow dynamic quality/resolution control
   char query[128];
   bool download = false;
+  // q is IJG quality 1-100 (higher = better, the frame2jpg() scale) on every path:
+  // software encoders use it directly, hardware JPEG frames are requantized to it
+  // when it is below the frame's own (estimated) quality and sent as-is otherwise.
   int quality = 12; // Default JPEG quality for software encoder
+  bool quality_requested = false;
   framesize_t desired_fs = FRAMESIZE_VGA; // default fallback
+  int max_age_ms = 0;  // 0 = always capture a fresh frame
+  int wait_ms = 0;
+  bool grayscale = false;  // Luma-only sensor mode, single-component JPEG
+  bool raw = false;        // With grayscale: uncompressed luma as PGM
   
   printf("[CAPTURE] Parsing query string...\n");
   if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
@@ -211,52 +591,74 @@ static esp_err_t capture_handler(httpd_req_t *req) {
     }
     if (httpd_query_key_value(query, "q", param, sizeof(param)) == ESP_OK) {
       int qv = atoi(param);
-      if (qv >= 10 && qv <= 63) quality = qv;
+      if (qv >= 1 && qv <= 100) {
+        quality = qv;
+        quality_requested = true;
+      }
       printf("[CAPTURE] Quality set to: %d\n", quality);
     }
     if (httpd_query_key_value(query, "res", param, sizeof(param)) == ESP_OK) {
       desired_fs = parse_frame_size(param);
       printf("[CAPTURE] Resolution requested: %d\n", desired_fs);
     }
+    if (httpd_query_key_value(query, "gray", param, sizeof(param)) == ESP_OK) {
+      grayscale = strcmp(param, "1") == 0;
+    }
+    if (httpd_query_key_value(query, "raw", param, sizeof(param)) == ESP_OK) {
+      raw = grayscale && strcmp(param, "1") == 0;
+    }
+    if (httpd_query_key_value(query, "maxage", param, sizeof(param)) == ESP_OK) {
+      max_age_ms = atoi(param);
+      if (max_age_ms < 0) max_age_ms = 0;
+    }
+    if (httpd_query_key_value(query, "wait", param, sizeof(param)) == ESP_OK) {
+      wait_ms = atoi(param);
+      if (wait_ms < 0) wait_ms = 0;
+      if (wait_ms > SNAPSHOT_MAX_WAIT_MS) wait_ms = SNAPSHOT_MAX_WAIT_MS;
+    }
   }
 
-  // Apply sensor changes if requested (resolution)
-  // Reinitialize camera with new resolution to avoid buffer reallocation crashes
-  sensor_t *s = esp_camera_sensor_get();
-  if (s && desired_fs != s->status.framesize) {
-    printf("[CAPTURE] Resolution change: %d -> %d - REINITIALIZING CAMERA\n", s->status.framesize, desired_fs);
-    Serial.printf("   Mode: %s\n", shouldUseRGB565Mode(desired_fs) ? "RGB565 (software JPEG)" : "JPEG (hardware + patch)");
-    Serial.printf("   Deinitializing camera...\n");
-    
-    // Deinitialize current camera
-    esp_camera_deinit();
-    vTaskDelay(pdMS_TO_TICKS(500));  // Increased delay for proper cleanup
-    
-    // Feed watchdog during reinit
-    esp_task_wdt_reset();
-    
-    // Reinitialize with new resolution
-    Serial.printf("   Reinitializing at resolution %d...\n", desired_fs);
-    if (!initCamera(desired_fs)) {
-      printf("[CAPTURE] ERROR: Failed to reinitialize camera\n");
-      Serial.println("   ❌ Camera reinit failed - attempting recovery");
-      // Try to recover with default SVGA
-      if (!initCamera(FRAMESIZE_SVGA)) {
-        const char *msg = "Camera reinitialization failed";
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, msg);
-        return ESP_FAIL;
-      }
-    } else {
-      Serial.println("   ✅ Camera reinitialized successfully");
-      // Additional delay after successful reinit
-      vTaskDelay(pdMS_TO_TICKS(200));
+  pixformat_t desired_format = sensorPixformatFor(desired_fs, grayscale);
+
+  // Conditional polling: If-None-Match (ETag = frame sequence + settings) gets a 304
+  // while no newer frame exists and the client's frame is within the staleness window
+  // (?maxage=, default SNAPSHOT_MAX_AGE_MS), without touching the sensor or encoder.
+  // "Newer" is by time, not content: past the window the next request captures.
+  char if_none_match[64];
+  bool conditional = httpd_req_get_hdr_value_str(req, "If-None-Match", if_none_match,
+                                                 sizeof(if_none_match)) == ESP_OK;
+  if (conditional && max_age_ms == 0) max_age_ms = SNAPSHOT_MAX_AGE_MS;
+  if (max_age_ms > 0 && !raw) {
+    // Hardware frames are cached at the sensor's quality unless requantized to q
+    int cached_quality = quality;
+    if (desired_format == PIXFORMAT_JPEG && !(quality_requested && quality < hw_jpeg_quality)) {
+      cached_quality = hw_jpeg_quality;
+    }
+    esp_err_t cached_res = ESP_OK;
+    if (serve_cached_snapshot(req, conditional ? if_none_match : NULL, max_age_ms, wait_ms,
+                              desired_fs, cached_quality, grayscale, download, &cached_res)) {
+      return cached_res;
     }
   }
 
+  // Snapshots outrank streams and time-lapse: wait at most for the frame in progress.
+  // Held until fb goes back; a stream restores its own mode afterwards.
+  int64_t snapshot_start = esp_timer_get_time();
+  bool stream_active = camera_acquire(CAMERA_CLIENT_SNAPSHOT);
+
+  // Apply sensor changes if requested (resolution, grayscale)
+  if (!ensure_camera_mode(desired_fs, desired_format)) {
+    camera_release();
+    const char *msg = "Camera reinitialization failed";
+    httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, msg);
+    return ESP_FAIL;
+  }
+
   printf("[CAPTURE] Acquiring frame buffer...\n");
-  camera_fb_t *fb = esp_camera_fb_get();
+  camera_fb_t *fb = capture_frame();
   if (!fb) {
-    printf("[CAPTURE] ERROR: esp_camera_fb_get() returned NULL\n");
+    camera_release();
+    printf("[CAPTURE] ERROR: no frame from the camera\n");
     Serial.println("❌ Camera capture failed!");
     const char *msg = "Camera capture failed";
     httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, msg);
@@ -269,49 +671,73 @@ static esp_err_t capture_handler(httpd_req_t *req) {
   Serial.printf("   Size: %u bytes\n", fb->len);
   Serial.printf("   Width: %d\n", fb->width);
   Serial.printf("   Height: %d\n", fb->height);
-  Serial.printf("   Format: %d (RGB565=%d, JPEG=%d)\n", fb->format, PIXFORMAT_RGB565, PIXFORMAT_JPEG);
+  Serial.printf("   Format: %s\n", pixformatName(fb->format));
   Serial.printf("   Timestamp: %lld\n", fb->timestamp.tv_sec);
+
+  if (raw && fb->format == PIXFORMAT_GRAYSCALE) {
+    // Raw luma: PGM header + the frame buffer as-is, no encode and no copy
+    char pgm_header[32];
+    int hlen = snprintf(pgm_header, sizeof(pgm_header), "P5\n%u %u\n255\n", fb->width, fb->height);
+    httpd_resp_set_type(req, "image/x-portable-graymap");
+    httpd_resp_set_hdr(req, "Content-Disposition", download ? "attachment; filename=capture.pgm"
+                                                             : "inline; filename=capture.pgm");
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+    unsigned long send_start = millis();
+    esp_err_t res = httpd_resp_send_chunk(req, pgm_header, hlen);
+    if (res == ESP_OK) res = httpd_resp_send_chunk(req, (const char *)fb->buf, fb->len);
+    if (res == ESP_OK) res = httpd_resp_send_chunk(req, NULL, 0);
+    printf("[CAPTURE] Raw luma %ux%u (%u bytes) sent in %lu ms, status=%d\n",
+           fb->width, fb->height, fb->len, millis() - send_start, res);
+    esp_camera_fb_return(fb);
+    camera_release();
+    return res;
+  }
   
   // Handle both RGB565 and JPEG modes
   uint8_t *jpg_buf = NULL;
   size_t jpg_len = 0;
+  JpegImageStats *stats = NULL;
   unsigned long convert_start = millis();
   bool needs_free = false;
   
-  if (fb->format == PIXFORMAT_RGB565) {
-    // RGB565 mode: Convert to JPEG using software encoder
-    printf("[CAPTURE] Converting RGB565 to JPEG with quality=%d...\n", quality);
-    Serial.println("   🔧 Converting RGB565 -> JPEG with software encoder");
+  if (isSoftJpegFormat(fb->format)) {
+    // YUV422 mode: native encoder, sensor YCbCr goes straight to the DCT
+    // RGB565 mode: native encoder, converted to YCbCr while loading each MCU row
+    // Grayscale: frame2jpg(), single component (no colour conversion, no chroma blocks)
+    const char *src_name = fb->format == PIXFORMAT_GRAYSCALE ? "Grayscale" :
+                           fb->format == PIXFORMAT_YUV422 ? "YUV422" : "RGB565";
+    printf("[CAPTURE] Converting %s to JPEG with quality=%d...\n", src_name, quality);
+    Serial.printf("   🔧 Converting %s -> JPEG with software encoder\n", src_name);
     
     // Keep watchdog happy during conversion
     esp_task_wdt_reset();
     
-    // Clamp quality to valid range (10-63 for ESP32)
-    if (quality < 10) quality = 10;
-    if (quality > 63) quality = 63;
-    
-    bool converted = frame2jpg(fb, quality, &jpg_buf, &jpg_len);
+    stats = allocStats(fb->format);
+    bool converted = encodeFrame(fb, quality, &jpg_buf, &jpg_len, stats);
     unsigned long convert_time = millis() - convert_start;
     needs_free = true;
     
     if (!converted || jpg_buf == NULL || jpg_len == 0) {
-      printf("[CAPTURE] ERROR: frame2jpg() failed - converted=%d, buf=%p, len=%u\n", 
-             converted, jpg_buf, jpg_len);
-      Serial.println("   ❌ RGB565 -> JPEG conversion failed!");
+      printf("[CAPTURE] ERROR: %s JPEG encode failed - converted=%d, buf=%p, len=%u\n", 
+             src_name, converted, jpg_buf, jpg_len);
+      Serial.printf("   ❌ %s -> JPEG conversion failed!\n", src_name);
       esp_camera_fb_return(fb);
+      camera_release();
       if (jpg_buf) free(jpg_buf);
+      free(stats);
       const char *msg = "JPEG encoding failed";
       httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, msg);
       return ESP_FAIL;
     }
     
-    printf("[CAPTURE] Conversion successful: %u bytes RGB565 -> %u bytes JPEG (%.1f%% compression) in %lu ms\n",
-           fb->len, jpg_len, (100.0 * jpg_len / fb->len), convert_time);
+    printf("[CAPTURE] Conversion successful: %u bytes %s -> %u bytes JPEG (%.1f%% compression) in %lu ms\n",
+           fb->len, src_name, jpg_len, (100.0 * jpg_len / fb->len), convert_time);
     Serial.printf("   ✅ Conversion OK: %u -> %u bytes (%.1f%%) in %lu ms\n",
                   fb->len, jpg_len, (100.0 * jpg_len / fb->len), convert_time);
   } 
   else if (fb->format == PIXFORMAT_JPEG) {
-    // JPEG mode: Use hardware JPEG directly, patch header if needed
+    // JPEG mode: Use hardware JPEG directly (patched and validated by capture_frame)
     printf("[CAPTURE] Hardware JPEG mode - using direct JPEG output\n");
     Serial.println("   📸 Hardware JPEG encoder output");
     
@@ -319,9 +745,29 @@ static esp_err_t capture_handler(httpd_req_t *req) {
     jpg_len = fb->len;
     needs_free = false;
     
-    // Patch malformed OV2640 JPEG header (FF D8 FF 10 -> FF D8 FF E0)
-    patchJPEGHeader(jpg_buf, jpg_len);
-    
+    // Hardware quality is fixed at init; a lower q is applied by requantizing
+    // the DCT coefficients of this frame instead of reconfiguring the sensor
+    int hw_quality = jpegEstimateQuality(jpg_buf, jpg_len);
+    hw_jpeg_quality = hw_quality;
+    if (quality_requested && quality < hw_quality) {
+      printf("[CAPTURE] Requantizing hardware JPEG: q %d -> %d\n", hw_quality, quality);
+      uint8_t *rq_buf = NULL;
+      size_t rq_len = 0;
+      bool requantized = requantizeFrame(jpg_buf, jpg_len, quality, &rq_buf, &rq_len);
+      if (requantized && rq_len < jpg_len) {
+        printf("[CAPTURE] Requantized: %u -> %u bytes (%.1f%%) in %lu ms\n",
+               jpg_len, rq_len, (100.0 * rq_len / jpg_len), millis() - convert_start);
+        Serial.printf("   🔧 Requantized: %u -> %u bytes\n", jpg_len, rq_len);
+        jpg_buf = rq_buf;
+        jpg_len = rq_len;
+        needs_free = true;
+      } else {
+        printf("[CAPTURE] Requantization skipped - sending hardware JPEG as-is\n");
+        if (requantized) freeEncoded(rq_buf, rq_len);
+      }
+    }
+    if (!needs_free) quality = hw_quality;  // Cached as what it is: the sensor's frame
+
     unsigned long convert_time = millis() - convert_start;
     printf("[CAPTURE] Hardware JPEG: %u bytes in %lu ms\n", jpg_len, convert_time);
     Serial.printf("   ✅ Hardware JPEG: %u bytes\n", jpg_len);
@@ -330,29 +776,34 @@ static esp_err_t capture_handler(httpd_req_t *req) {
     printf("[CAPTURE] ERROR: Unexpected format=%d\n", fb->format);
     Serial.printf("❌ Unexpected frame buffer format: %d\n", fb->format);
     esp_camera_fb_return(fb);
+    camera_release();
     const char *msg = "Unexpected camera format";
     httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, msg);
     return ESP_FAIL;
   }
   
+  // Publish to the frame cache so conditional polls and ?maxage= requests can reuse it.
+  // Software JPEG buffers are handed over; hardware JPEG is copied so fb can go back early.
+  CachedFrame *frame = frameCachePublish(jpg_buf, jpg_len, needs_free, fb->width, fb->height,
+                                         desired_fs, quality, fb->format == PIXFORMAT_GRAYSCALE, stats);
+  if (!frame) free(stats);
+  char etag[32] = "";
+  if (frame) {
+    frameCacheETag(frame, etag, sizeof(etag));
+    jpg_buf = frame->buf;
+    needs_free = false;  // owned by the cache now
+    esp_camera_fb_return(fb);
+    fb = NULL;
+    camera_release();
+  }
+  camera_record_snapshot(snapshot_start, stream_active);
+
   // Set headers
   printf("[CAPTURE] Setting HTTP headers...\n");
-  Serial.println("\n📡 Setting HTTP headers:");
-  httpd_resp_set_type(req, "image/jpeg");
-  Serial.println("   Content-Type: image/jpeg");
-  
-  if (download) {
-    httpd_resp_set_hdr(req, "Content-Disposition", "attachment; filename=capture.jpg");
-    Serial.println("   Content-Disposition: attachment");
-  } else {
-    httpd_resp_set_hdr(req, "Content-Disposition", "inline; filename=capture.jpg");
-    Serial.println("   Content-Disposition: inline");
-  }
-  
-  httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
-  httpd_resp_set_hdr(req, "Cache-Control", "no-cache, no-store, must-revalidate");
+  set_capture_headers(req, download, frame ? etag : NULL);
   httpd_resp_set_hdr(req, "Pragma", "no-cache");
   httpd_resp_set_hdr(req, "Expires", "0");
+  Serial.printf("   Content-Type: image/jpeg, %s, ETag: %s\n", download ? "attachment" : "inline", etag);
   
   printf("[CAPTURE] Sending %u bytes JPEG to client...\n", jpg_len);
   Serial.printf("\n📤 Sending %u bytes to client...\n", jpg_len);
@@ -364,12 +815,17 @@ static esp_err_t capture_handler(httpd_req_t *req) {
   unsigned long send_time = millis() - send_start;
   
   // Free resources - CRITICAL: Must free in correct order!
+  // Cached frame: drop our reference, the cache frees it once superseded
   // For hardware JPEG: jpg_buf points to fb->buf, so DON'T free jpg_buf separately
   // For software JPEG: jpg_buf is separately allocated, must free it first
+  frameCacheRelease(frame);
   if (needs_free && jpg_buf) {
-    free(jpg_buf);  // Free software-encoded JPEG buffer
+    freeEncoded(jpg_buf, jpg_len);  // Free software-encoded JPEG buffer
+  }
+  if (fb) {
+    esp_camera_fb_return(fb);  // Return frame buffer AFTER send completes
+    camera_release();
   }
-  esp_camera_fb_return(fb);  // Return frame buffer AFTER send completes
   
   printf("[CAPTURE] Complete: status=%d, send_time=%lu ms", res, send_time);
   if (send_time > 0) {
@@ -391,127 +847,1528 @@ static esp_err_t capture_handler(httpd_req_t *req) {
   if (send_time > 0) {
     Serial.printf("   Throughput: %.2f KB/s\n", (jpg_len / 1024.0) / (send_time / 1000.0));
   }
-  Serial.println("========================================\n");
-  return res;
+  Serial.println("========================================\n");
+  return res;
+}
+
+// Software JPEG quality used for streamed frames (MJPEG and WebSocket)
+#define STREAM_JPEG_QUALITY   12
+// Bytes kept free in front of every streamed JPEG for its multipart boundary and part
+// headers (about 160 with the stats headers), so /stream sends a part in one write
+#define STREAM_PART_HEADROOM  256
+
+static const char* _STREAM_CONTENT_TYPE = "multipart/x-mixed-replace;boundary=frame";
+static const char* _STREAM_BOUNDARY = "\r\n--frame\r\n";
+static const char* _STREAM_PART = "Content-Type: image/jpeg\r\nContent-Length: %u\r\n\r\n";
+// Software-encoded frames also carry their exposure/focus stats (see /stats)
+static const char* _STREAM_PART_STATS = "Content-Type: image/jpeg\r\nContent-Length: %u\r\n"
+                                        "X-Luma-Mean: %.1f\r\nX-Clipped-Low: %.4f\r\n"
+                                        "X-Clipped-High: %.4f\r\nX-Sharpness: %.1f\r\n\r\n";
+
+// Boundary + part headers for a JPEG of len bytes. Returns the length, or 0 if it
+// doesn't fit out_len.
+static size_t format_stream_part(char *out, size_t out_len, size_t len, const JpegImageStats *st) {
+  int blen = snprintf(out, out_len, "%s", _STREAM_BOUNDARY);
+  int hlen = st ? snprintf(out + blen, out_len - blen, _STREAM_PART_STATS, (unsigned)len, st->mean,
+                           st->clipped_low, st->clipped_high, st->sharpness)
+                : snprintf(out + blen, out_len - blen, _STREAM_PART, (unsigned)len);
+  if (hlen < 0 || (size_t)(blen + hlen) >= out_len) return 0;
+  return blen + hlen;
+}
+
+// Write the part prefix right-aligned into the headroom in front of the JPEG at
+// alloc + headroom. Returns its length (0 if it didn't fit: sent separately then).
+static size_t write_stream_prefix(uint8_t *alloc, size_t headroom, size_t len, const JpegImageStats *st) {
+  char prefix[STREAM_PART_HEADROOM];
+  size_t plen = format_stream_part(prefix, sizeof(prefix), len, st);
+  if (!plen || plen > headroom) return 0;
+  memcpy(alloc + headroom - plen, prefix, plen);
+  return plen;
+}
+
+// Capture one frame at the current sensor settings, encode it to JPEG if needed and
+// publish it to the frame cache. Returns the frame with a reference held for the
+// caller (drop it with frameCacheRelease), or NULL on failure.
+static CachedFrame *produce_stream_frame() {
+  camera_acquire_stream();  // Held for capture + encode only, not while sending
+  camera_fb_t *fb = capture_frame();
+  if (!fb) {
+    camera_release();
+    printf("[STREAM] ERROR: capture failed\n");
+    return NULL;
+  }
+
+  uint16_t width = fb->width;
+  uint16_t height = fb->height;
+  sensor_t *s = esp_camera_sensor_get();
+  framesize_t fs = s ? s->status.framesize : FRAMESIZE_SVGA;
+  CachedFrame *frame = NULL;
+
+  bool grayscale = fb->format == PIXFORMAT_GRAYSCALE;
+  if (isSoftJpegFormat(fb->format)) {
+    // Encode YUV422/RGB565/luma; the frame buffer goes back as soon as we're done
+    uint8_t *jpg_buf = NULL;
+    size_t jpg_len = 0;
+    size_t headroom = STREAM_PART_HEADROOM;
+    JpegImageStats *stats = allocStats(fb->format);
+    bool converted = encodeFrame(fb, STREAM_JPEG_QUALITY, &jpg_buf, &jpg_len, stats, &headroom);
+    esp_camera_fb_return(fb);
+    camera_release();
+    if (!converted || !jpg_buf) {
+      printf("[STREAM] ERROR: software JPEG encode failed\n");
+      if (jpg_buf) free(jpg_buf);
+      free(stats);
+      return NULL;
+    }
+    // Part headers go in before publishing: published frames are read-only
+    size_t prefix_len = write_stream_prefix(jpg_buf, headroom, jpg_len, stats);
+    frame = frameCachePublishPart(jpg_buf, headroom, prefix_len, jpg_len, width, height, fs,
+                                  STREAM_JPEG_QUALITY, grayscale, stats);
+    if (!frame) {
+      freeEncoded(jpg_buf, headroom + jpg_len);
+      free(stats);
+    }
+  } else {
+    // Hardware JPEG (XGA+ mode, validated): copied into the cache, behind the headroom.
+    // Published with the quality of its own tables (the sensor's), not the soft encoder's.
+    size_t jpg_len = fb->len;
+    size_t part_len = STREAM_PART_HEADROOM + jpg_len;
+    uint8_t *part = (uint8_t *)malloc(part_len);
+    if (part) {
+      memcpy(part + STREAM_PART_HEADROOM, fb->buf, jpg_len);
+      memTagAlloc(MEM_TAG_ENCODE, part_len);
+      hw_jpeg_quality = jpegEstimateQuality(fb->buf, jpg_len);
+      size_t prefix_len = write_stream_prefix(part, STREAM_PART_HEADROOM, jpg_len, NULL);
+      frame = frameCachePublishPart(part, STREAM_PART_HEADROOM, prefix_len, jpg_len, width, height, fs,
+                                    hw_jpeg_quality, false, NULL);
+      if (!frame) freeEncoded(part, part_len);
+    } else {
+      memTagFail(MEM_TAG_ENCODE);
+    }
+    esp_camera_fb_return(fb);
+    camera_release();
+  }
+
+  if (!frame) printf("[STREAM] ERROR: out of memory publishing frame\n");
+  return frame;
+}
+
+// Newest frame not yet sent to a subscriber that last got after_seq: a cached frame
+// younger than max_age_ms is shared (one encode for every WebSocket/RTSP client),
+// otherwise a new one is produced. Reference held for the caller.
+static CachedFrame *acquire_fresh_stream_frame(uint32_t after_seq, int max_age_ms) {
+  CachedFrame *frame = frameCacheAcquire();
+  if (frame && streamFrameReusable(frame->seq, frame->timestamp_us, after_seq, esp_timer_get_time(), max_age_ms)) {
+    return frame;
+  }
+  frameCacheRelease(frame);
+  return produce_stream_frame();
+}
+
+// Raw socket write of a whole buffer, bypassing chunked encoding. httpd_send() may
+// take less than asked (lwIP send buffer full), so keep going until it is all out.
+static esp_err_t send_all(httpd_req_t *req, const char *buf, size_t len) {
+  while (len > 0) {
+    int sent = httpd_send(req, buf, len);
+    if (sent <= 0) return ESP_FAIL;  // HTTPD_SOCK_ERR_*
+    buf += sent;
+    len -= sent;
+  }
+  return ESP_OK;
+}
+
+// MJPEG over multipart/x-mixed-replace. By default the response is written raw: the
+// body is not chunked and ends when the connection closes, and every part (boundary,
+// headers, JPEG) goes out in one send from the frame's own buffer, see
+// STREAM_PART_HEADROOM. ?chunked=1 keeps the old three-chunks-per-frame path for
+// comparison (tools/stream_bench.py).
+static esp_err_t stream_handler(httpd_req_t *req) {
+  esp_err_t res = ESP_OK;
+  char part_buf[STREAM_PART_HEADROOM];
+
+  Serial.println("🎥 Stream request received");
+
+  // ?gray=1 streams luma-only at the current resolution; without it a grayscale
+  // sensor mode left over from a capture is switched back to colour
+  char query[48];
+  char param[8];
+  bool has_query = httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK;
+  bool grayscale = has_query && httpd_query_key_value(query, "gray", param, sizeof(param)) == ESP_OK &&
+                   strcmp(param, "1") == 0;
+  bool chunked = has_query && httpd_query_key_value(query, "chunked", param, sizeof(param)) == ESP_OK &&
+                 strcmp(param, "1") == 0;
+  camera_acquire_stream();
+  sensor_t *s = esp_camera_sensor_get();
+  framesize_t fs = s ? s->status.framesize : FRAMESIZE_SVGA;
+  bool mode_ok = ensure_camera_mode(fs, sensorPixformatFor(fs, grayscale));
+  camera_release();
+  if (!mode_ok) {
+    Serial.println("❌ Stream: camera mode change failed");
+    return ESP_FAIL;
+  }
+
+  if (chunked) {
+    res = httpd_resp_set_type(req, _STREAM_CONTENT_TYPE);
+    if (res != ESP_OK) {
+      Serial.printf("❌ Failed to set stream content type: %d\n", res);
+      return res;
+    }
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+    httpd_resp_set_hdr(req, "X-Framerate", "60");
+  } else {
+    // One write per part: nothing left for Nagle to hold back
+    int one = 1;
+    setsockopt(httpd_req_to_sockfd(req), IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    int hlen = snprintf(part_buf, sizeof(part_buf),
+                        "HTTP/1.1 200 OK\r\nContent-Type: %s\r\n"
+                        "Access-Control-Allow-Origin: *\r\nX-Framerate: 60\r\n"
+                        "Connection: close\r\n\r\n", _STREAM_CONTENT_TYPE);
+    res = send_all(req, part_buf, hlen);
+  }
+  printf("[STREAM] Started (%s)\n", chunked ? "chunked, 3 sends per frame" : "raw, 1 send per frame");
+
+  int frame_count = 0;
+  unsigned long start_time = millis();
+  unsigned long last_report_time = start_time;
+  int last_report_count = 0;
+  
+  while (res == ESP_OK) {
+    esp_task_wdt_reset(); // keep watchdog happy during long stream
+    
+    // Published frames are also seen by snapshot polls (If-None-Match / ?wait=)
+    CachedFrame *frame = produce_stream_frame();
+    if (!frame) {
+      Serial.println("❌ Stream: Camera capture failed");
+      res = ESP_FAIL;
+      break;
+    }
+
+    unsigned long now = millis();
+    if (now - last_report_time >= 2000) { // report every ~2s
+      float fps = (frame_count - last_report_count) * 1000.0f / (now - last_report_time);
+      printf("[STREAM] Frame %d: %u bytes JPEG, %.1f fps, Heap: %u\n", 
+             frame_count, frame->len, fps, ESP.getFreeHeap());
+      Serial.printf("📹 Frame %d: %u bytes, %.1f fps, Heap: %u\n", 
+                    frame_count, frame->len, fps, ESP.getFreeHeap());
+      last_report_time = now;
+      last_report_count = frame_count;
+    }
+
+    if (chunked) {
+      res = httpd_resp_send_chunk(req, _STREAM_BOUNDARY, strlen(_STREAM_BOUNDARY));
+      if (res == ESP_OK) {
+        const JpegImageStats *st = frame->stats;
+        size_t hlen = st ? snprintf(part_buf, sizeof(part_buf), _STREAM_PART_STATS, frame->len, st->mean,
+                                    st->clipped_low, st->clipped_high, st->sharpness)
+                         : snprintf(part_buf, sizeof(part_buf), _STREAM_PART, frame->len);
+        res = httpd_resp_send_chunk(req, part_buf, hlen);
+      }
+      if (res == ESP_OK) {
+        res = httpd_resp_send_chunk(req, (const char *)frame->buf, frame->len);
+      }
+    } else if (frame->prefix_len) {
+      // Boundary and headers were written in front of the JPEG when it was published
+      res = send_all(req, (const char *)frame->buf - frame->prefix_len, frame->prefix_len + frame->len);
+    } else {
+      // No headroom (frame2jpg() output): prefix from the stack, then the JPEG
+      size_t plen = format_stream_part(part_buf, sizeof(part_buf), frame->len, frame->stats);
+      res = plen ? send_all(req, part_buf, plen) : ESP_FAIL;
+      if (res == ESP_OK) res = send_all(req, (const char *)frame->buf, frame->len);
+    }
+    
+    // Clean up: drop our reference, the cache frees the frame once superseded
+    frameCacheRelease(frame);
+    
+    if (res != ESP_OK) {
+      printf("[STREAM] Send failed at frame %d, error: %d\n", frame_count, res);
+      Serial.printf("❌ Stream send failed at frame %d, error: %d\n", frame_count, res);
+      break;
+    }
+    
+    frame_count++;
+    if (WiFi.status() != WL_CONNECTED) {
+      Serial.println("⚠️  WiFi lost during stream, stopping.");
+      break;
+    }
+    yield();
+  }
+  
+  Serial.println("🛑 Stream ended");
+  // A raw response has no end marker: the body ends with the connection
+  if (!chunked) httpd_sess_trigger_close(req->handle, httpd_req_to_sockfd(req));
+  return res;
+}
+
+// Raw frames for downstream processing (/raw on port 80, /raw/stream on port 81): the
+// sensor's frame buffer as-is, no JPEG and no copy. Each frame is a 32-byte
+// little-endian header followed by height * stride bytes of pixels:
+//   0: 'R' 'W'  2: version (1)  3: header length (32)
+//   4: u16 width  6: u16 height  8: u32 stride (bytes per row)
+//   12: u8 format (RAW_FORMAT_*)  13: u8 bytes per pixel  14: u16 reserved (0)
+//   16: u32 frame sequence  20: u32 payload length  24: u64 capture time (us since boot)
+// RGB565 pixels are big-endian as the OV2640 sends them; YUV422 is Y0 U Y1 V.
+#define RAW_FRAME_HEADER_LEN  32
+#define RAW_FORMAT_RGB565     1
+#define RAW_FORMAT_YUV422     2
+#define RAW_FORMAT_GRAY       3
+// Pixels go out straight from fb->buf in slices this large (one send each)
+#define RAW_SEND_CHUNK        (64 * 1024)
+
+static uint32_t raw_frame_seq = 0;  // shared by /raw and /raw/stream (different server tasks)
+
+static int raw_format_code(pixformat_t format) {
+  switch (format) {
+    case PIXFORMAT_RGB565:    return RAW_FORMAT_RGB565;
+    case PIXFORMAT_YUV422:    return RAW_FORMAT_YUV422;
+    case PIXFORMAT_GRAYSCALE: return RAW_FORMAT_GRAY;
+    default:                  return 0;
+  }
+}
+
+static void put_le(uint8_t *p, uint64_t value, int bytes) {
+  for (int i = 0; i < bytes; i++) p[i] = (uint8_t)(value >> (8 * i));
+}
+
+static size_t fill_raw_header(uint8_t *hdr, const camera_fb_t *fb, uint32_t seq) {
+  uint8_t bpp = fb->format == PIXFORMAT_GRAYSCALE ? 1 : 2;
+  uint64_t ts_us = (uint64_t)fb->timestamp.tv_sec * 1000000 + fb->timestamp.tv_usec;
+  memset(hdr, 0, RAW_FRAME_HEADER_LEN);
+  hdr[0] = 'R';
+  hdr[1] = 'W';
+  hdr[2] = 1;
+  hdr[3] = RAW_FRAME_HEADER_LEN;
+  put_le(hdr + 4, fb->width, 2);
+  put_le(hdr + 6, fb->height, 2);
+  put_le(hdr + 8, (uint32_t)fb->width * bpp, 4);
+  hdr[12] = (uint8_t)raw_format_code(fb->format);
+  hdr[13] = bpp;
+  put_le(hdr + 16, seq, 4);
+  put_le(hdr + 20, fb->len, 4);
+  put_le(hdr + 24, ts_us, 8);
+  return RAW_FRAME_HEADER_LEN;
+}
+
+// Put the sensor into the mode a raw request asks for: fmt=rgb565|yuv422|gray
+// (default yuv422) at res= (default: current resolution). Colour is 2 bytes/pixel and
+// limited to SVGA like the software JPEG modes. Sends the error response on failure.
+static esp_err_t prepare_raw_mode(httpd_req_t *req) {
+  char query[64];
+  char fmt[8] = "yuv422";
+  char res[16];
+  bool have_query = httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK;
+  if (have_query) httpd_query_key_value(query, "fmt", fmt, sizeof(fmt));
+  bool have_res = have_query && httpd_query_key_value(query, "res", res, sizeof(res)) == ESP_OK;
+
+  pixformat_t format;
+  if (strcasecmp(fmt, "rgb565") == 0) {
+    format = PIXFORMAT_RGB565;
+  } else if (strcasecmp(fmt, "yuv422") == 0) {
+    format = PIXFORMAT_YUV422;
+  } else if (strcasecmp(fmt, "gray") == 0) {
+    format = PIXFORMAT_GRAYSCALE;
+  } else {
+    httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "fmt must be rgb565, yuv422 or gray");
+    return ESP_FAIL;
+  }
+
+  sensor_t *s = esp_camera_sensor_get();
+  framesize_t fs = have_res ? parse_frame_size(res) : (s ? s->status.framesize : FRAMESIZE_SVGA);
+  if (format != PIXFORMAT_GRAYSCALE && !shouldUseRGB565Mode(fs)) {
+    httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Raw colour frames are limited to SVGA (use fmt=gray)");
+    return ESP_FAIL;
+  }
+  if (!ensure_camera_mode(fs, format)) {
+    httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Camera reinitialization failed");
+    return ESP_FAIL;
+  }
+  return ESP_OK;
+}
+
+// Header + pixels as response chunks. The caller returns fb as soon as this returns:
+// the frame is held exactly as long as the socket needs its bytes.
+static esp_err_t send_raw_frame(httpd_req_t *req, camera_fb_t *fb, uint32_t seq) {
+  uint8_t hdr[RAW_FRAME_HEADER_LEN];
+  esp_err_t res = httpd_resp_send_chunk(req, (const char *)hdr, fill_raw_header(hdr, fb, seq));
+  for (size_t off = 0; res == ESP_OK && off < fb->len; off += RAW_SEND_CHUNK) {
+    size_t n = fb->len - off < RAW_SEND_CHUNK ? fb->len - off : RAW_SEND_CHUNK;
+    res = httpd_resp_send_chunk(req, (const char *)fb->buf + off, n);
+    esp_task_wdt_reset();
+  }
+  return res;
+}
+
+// Capture a raw frame, or NULL if the sensor is down or in a non-raw mode
+// (e.g. the stream switched it back to hardware JPEG in between)
+static camera_fb_t *get_raw_frame() {
+  camera_fb_t *fb = camera_fb_get();
+  if (fb && !raw_format_code(fb->format)) {
+    esp_camera_fb_return(fb);
+    return NULL;
+  }
+  return fb;
+}
+
+static esp_err_t raw_handler(httpd_req_t *req) {
+  // Snapshot class, held until fb goes back: the frame is sent straight from it
+  camera_acquire(CAMERA_CLIENT_SNAPSHOT);
+  if (prepare_raw_mode(req) != ESP_OK) {
+    camera_release();
+    return ESP_FAIL;
+  }
+
+  camera_fb_t *fb = get_raw_frame();
+  if (!fb) {
+    camera_release();
+    httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Camera capture failed");
+    return ESP_FAIL;
+  }
+
+  httpd_resp_set_type(req, "application/octet-stream");
+  httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+  httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+  uint32_t seq = __atomic_add_fetch(&raw_frame_seq, 1, __ATOMIC_RELAXED);
+  unsigned long send_start = millis();
+  esp_err_t res = send_raw_frame(req, fb, seq);
+  printf("[RAW] %s %ux%u (%u bytes) sent in %lu ms, status=%d\n", pixformatName(fb->format),
+         fb->width, fb->height, fb->len, millis() - send_start, res);
+  esp_camera_fb_return(fb);
+  camera_release();
+  if (res == ESP_OK) res = httpd_resp_send_chunk(req, NULL, 0);
+  return res;
+}
+
+// Continuous raw frames as multipart/x-mixed-replace, one header + pixels per part.
+// Meant for processing boxes on the LAN: TCP_NODELAY, no encode, newest frame each time.
+static esp_err_t raw_stream_handler(httpd_req_t *req) {
+  static const char *RAW_STREAM_BOUNDARY = "\r\n--rawframe\r\n";
+  static const char *RAW_STREAM_PART = "Content-Type: application/octet-stream\r\nContent-Length: %u\r\n\r\n";
+
+  camera_acquire_stream();
+  esp_err_t prepared = prepare_raw_mode(req);
+  camera_release();
+  if (prepared != ESP_OK) return ESP_FAIL;
+
+  int one = 1;
+  setsockopt(httpd_req_to_sockfd(req), IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  httpd_resp_set_type(req, "multipart/x-mixed-replace;boundary=rawframe");
+  httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+  Serial.println("🎥 Raw stream started");
+
+  esp_err_t res = ESP_OK;
+  int frame_count = 0;
+  unsigned long last_report_time = millis();
+  int last_report_count = 0;
+  while (res == ESP_OK) {
+    // Held while the frame is sent (zero-copy from fb), given back between frames
+    camera_acquire_stream();
+    camera_fb_t *fb = get_raw_frame();
+    if (!fb) {
+      camera_release();
+      printf("[RAW] Stream: capture failed or camera left raw mode\n");
+      res = ESP_FAIL;
+      break;
+    }
+
+    char part[96];
+    int plen = snprintf(part, sizeof(part), RAW_STREAM_PART, (unsigned)(RAW_FRAME_HEADER_LEN + fb->len));
+    res = httpd_resp_send_chunk(req, RAW_STREAM_BOUNDARY, strlen(RAW_STREAM_BOUNDARY));
+    if (res == ESP_OK) res = httpd_resp_send_chunk(req, part, plen);
+    if (res == ESP_OK) res = send_raw_frame(req, fb, __atomic_add_fetch(&raw_frame_seq, 1, __ATOMIC_RELAXED));
+    size_t len = fb->len;
+    esp_camera_fb_return(fb);
+    camera_release();
+    frame_count++;
+
+    unsigned long now = millis();
+    if (now - last_report_time >= 2000) {
+      float fps = (frame_count - last_report_count) * 1000.0f / (now - last_report_time);
+      printf("[RAW] Stream frame %d: %u bytes, %.1f fps (%.0f kbit/s)\n",
+             frame_count, (unsigned)len, fps, fps * len * 8 / 1000);
+      last_report_time = now;
+      last_report_count = frame_count;
+    }
+    if (WiFi.status() != WL_CONNECTED) break;
+    yield();
+  }
+
+  printf("[RAW] Stream ended after %d frames, status=%d\n", frame_count, res);
+  Serial.println("🛑 Raw stream ended");
+  return res;
+}
+
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+// WebSocket stream (ws://<ip>:81/ws): one binary message per frame, sent only when the
+// client asks for it with "next" (protocol and pacing in stream_pacing.h, replayed
+// with a slow reader by test/test_stream_pacing).
+static esp_err_t ws_send_frame(httpd_req_t *req, const CachedFrame *frame) {
+  uint8_t hdr[WS_FRAME_HEADER_LEN];
+  wsFrameHeader(hdr, frame->seq, (uint32_t)(frame->timestamp_us / 1000), frame->width, frame->height);
+
+  // Header and JPEG go out as two fragments of one message - no copy into a joint buffer
+  httpd_ws_frame_t pkt;
+  memset(&pkt, 0, sizeof(pkt));
+  pkt.type = HTTPD_WS_TYPE_BINARY;
+  pkt.fragmented = true;
+  pkt.final = false;
+  pkt.payload = hdr;
+  pkt.len = sizeof(hdr);
+  esp_err_t res = httpd_ws_send_frame(req, &pkt);
+  if (res != ESP_OK) return res;
+
+  pkt.type = HTTPD_WS_TYPE_CONTINUE;
+  pkt.final = true;
+  pkt.payload = frame->buf;
+  pkt.len = frame->len;
+  return httpd_ws_send_frame(req, &pkt);
+}
+
+static esp_err_t ws_stream_handler(httpd_req_t *req) {
+  if (req->method == HTTP_GET) {
+    printf("[WS] Client connected (fd %d)\n", httpd_req_to_sockfd(req));
+    return ESP_OK;  // handshake done, wait for "next"
+  }
+
+  WsSession *session = (WsSession *)req->sess_ctx;
+  if (!session) {
+    session = (WsSession *)calloc(1, sizeof(WsSession));
+    if (!session) return ESP_ERR_NO_MEM;
+    req->sess_ctx = session;
+    req->free_ctx = free;
+  }
+
+  // Read the request message ("next"); anything but text is ignored
+  httpd_ws_frame_t pkt;
+  uint8_t msg[32];
+  memset(&pkt, 0, sizeof(pkt));
+  esp_err_t res = httpd_ws_recv_frame(req, &pkt, 0);  // length only
+  if (res != ESP_OK) return res;
+  if (pkt.len >= sizeof(msg)) return ESP_FAIL;
+  pkt.payload = msg;
+  res = httpd_ws_recv_frame(req, &pkt, sizeof(msg) - 1);
+  if (res != ESP_OK) return res;
+  if (!wsIsFrameRequest(pkt.type == HTTPD_WS_TYPE_TEXT, msg, pkt.len)) return ESP_OK;
+
+  esp_task_wdt_reset();
+
+  // Newest frame the client hasn't seen: reuse a fresh one (e.g. produced for another
+  // client), otherwise capture now. Older frames are never sent.
+  CachedFrame *frame = acquire_fresh_stream_frame(session->last_seq, WS_FRAME_MAX_AGE_MS);
+  if (!frame) return ESP_FAIL;  // closes the socket; the page falls back to MJPEG
+
+  res = ws_send_frame(req, frame);
+  if (res == ESP_OK) {
+    wsSessionSent(session, frame->seq);
+    if (session->frames % 100 == 0) {
+      printf("[WS] fd %d: %u frames (%u skipped), last %u bytes\n", httpd_req_to_sockfd(req),
+             session->frames, session->skipped, frame->len);
+    }
+  } else {
+    printf("[WS] Send failed: %d\n", res);
+  }
+  frameCacheRelease(frame);
+  return res;
+}
+#endif
+
+// RTSP subscribers share frames with the HTTP/WebSocket streams when those run
+#define RTSP_FRAME_MAX_AGE_MS 100
+
+static CachedFrame *rtsp_frame_source(uint32_t after_seq) {
+  return acquire_fresh_stream_frame(after_seq, RTSP_FRAME_MAX_AGE_MS);
+}
+
+// Benchmarks to tell link limits from camera limits:
+//   /bench/net?bytes=&chunk=    synthetic data through the same chunked send path as /stream
+//   /bench/net?last=1           JSON summary of the previous /bench/net run (server side)
+//   /bench/pipeline?frames=&q=  capture + encode only, nothing is sent
+//   /bench/pipeline?compare=1   frame2jpg() vs native RGB565 vs YUV422 at every ≤SVGA size
+#define BENCH_NET_DEFAULT_BYTES        (4 * 1024 * 1024)
+#define BENCH_NET_MAX_BYTES            (64 * 1024 * 1024)
+#define BENCH_NET_DEFAULT_CHUNK        4096
+#define BENCH_NET_MIN_CHUNK            256
+#define BENCH_NET_MAX_CHUNK            65536
+#define BENCH_PIPELINE_DEFAULT_FRAMES  20
+#define BENCH_PIPELINE_MAX_FRAMES      200
+
+struct BenchNetResult {
+  size_t bytes_requested;
+  size_t bytes_sent;
+  size_t chunk;
+  bool nodelay;
+  uint32_t elapsed_ms;
+  uint32_t max_stall_ms;  // Slowest single send: where the link (or lwIP buffers) pushed back
+  esp_err_t status;
+};
+
+static BenchNetResult bench_net_last = {};
+static uint8_t *bench_net_buf = NULL;  // BENCH_NET_MAX_CHUNK of pattern in PSRAM like frame buffers; kept once allocated
+
+static int query_int(const char *query, const char *key, int def, int min_value, int max_value) {
+  char param[16];
+  if (!query || httpd_query_key_value(query, key, param, sizeof(param)) != ESP_OK) return def;
+  int value = atoi(param);
+  if (value < min_value) value = min_value;
+  if (value > max_value) value = max_value;
+  return value;
+}
+
+static const char *wifi_phy_name() {
+  uint8_t protocol = 0;
+  if (esp_wifi_get_protocol(WIFI_IF_STA, &protocol) != ESP_OK) return "unknown";
+  if (protocol & WIFI_PROTOCOL_11N) return "11b/g/n";
+  if (protocol & WIFI_PROTOCOL_11G) return "11b/g";
+  return "11b";
+}
+
+static esp_err_t send_bench_json(httpd_req_t *req, const char *json) {
+  httpd_resp_set_type(req, "application/json");
+  httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+  httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+  return httpd_resp_sendstr(req, json);
+}
+
+static esp_err_t bench_net_handler(httpd_req_t *req) {
+  char query[96];
+  bool have_query = httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK;
+  const char *q = have_query ? query : NULL;
+
+  char json[384];
+  if (query_int(q, "last", 0, 0, 1)) {
+    const BenchNetResult &r = bench_net_last;
+    snprintf(json, sizeof(json),
+             "{\"bytes\":%u,\"sent\":%u,\"chunk\":%u,\"nodelay\":%s,\"elapsed_ms\":%u,"
+             "\"kbps\":%u,\"max_stall_ms\":%u,\"ok\":%s,\"phy\":\"%s\",\"rssi\":%d,\"channel\":%d}",
+             (unsigned)r.bytes_requested, (unsigned)r.bytes_sent, (unsigned)r.chunk,
+             r.nodelay ? "true" : "false", (unsigned)r.elapsed_ms,
+             r.elapsed_ms ? (unsigned)((uint64_t)r.bytes_sent * 8 / r.elapsed_ms) : 0,
+             (unsigned)r.max_stall_ms, r.status == ESP_OK ? "true" : "false",
+             wifi_phy_name(), (int)WiFi.RSSI(), (int)WiFi.channel());
+    return send_bench_json(req, json);
+  }
+
+  size_t total = query_int(q, "bytes", BENCH_NET_DEFAULT_BYTES, 1, BENCH_NET_MAX_BYTES);
+  size_t chunk = query_int(q, "chunk", BENCH_NET_DEFAULT_CHUNK, BENCH_NET_MIN_CHUNK, BENCH_NET_MAX_CHUNK);
+  bool nodelay = query_int(q, "nodelay", 0, 0, 1);
+
+  if (!bench_net_buf) {
+    bench_net_buf = (uint8_t *)ps_malloc(BENCH_NET_MAX_CHUNK);
+    if (!bench_net_buf) {
+      memTagFail(MEM_TAG_SEND);
+      httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+      return ESP_FAIL;
+    }
+    memTagAlloc(MEM_TAG_SEND, BENCH_NET_MAX_CHUNK);
+    for (size_t i = 0; i < BENCH_NET_MAX_CHUNK; i++) bench_net_buf[i] = (uint8_t)(i * 31 + (i >> 8));
+  }
+
+  if (nodelay) {
+    int one = 1;
+    setsockopt(httpd_req_to_sockfd(req), IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  }
+
+  printf("[BENCH] net: %u bytes in %u-byte chunks%s\n", (unsigned)total, (unsigned)chunk,
+         nodelay ? ", TCP_NODELAY" : "");
+  httpd_resp_set_type(req, "application/octet-stream");
+  httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+  httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+
+  BenchNetResult r = {};
+  r.bytes_requested = total;
+  r.chunk = chunk;
+  r.nodelay = nodelay;
+  r.status = ESP_OK;
+  int64_t start = esp_timer_get_time();
+  while (r.bytes_sent < total) {
+    size_t n = total - r.bytes_sent < chunk ? total - r.bytes_sent : chunk;
+    int64_t t0 = esp_timer_get_time();
+    r.status = httpd_resp_send_chunk(req, (const char *)bench_net_buf, n);
+    uint32_t stall_ms = (esp_timer_get_time() - t0) / 1000;
+    if (stall_ms > r.max_stall_ms) r.max_stall_ms = stall_ms;
+    if (r.status != ESP_OK) break;
+    r.bytes_sent += n;
+  }
+  r.elapsed_ms = (esp_timer_get_time() - start) / 1000;
+  if (r.status == ESP_OK) r.status = httpd_resp_send_chunk(req, NULL, 0);
+  bench_net_last = r;
+
+  printf("[BENCH] net: %u/%u bytes in %u ms = %u kbit/s, max stall %u ms, PHY %s, RSSI %d\n",
+         (unsigned)r.bytes_sent, (unsigned)total, (unsigned)r.elapsed_ms,
+         r.elapsed_ms ? (unsigned)((uint64_t)r.bytes_sent * 8 / r.elapsed_ms) : 0,
+         (unsigned)r.max_stall_ms, wifi_phy_name(), (int)WiFi.RSSI());
+  return r.status;
+}
+
+struct BenchPipelineResult {
+  int done;
+  int failures;
+  int width;
+  int height;
+  pixformat_t format;
+  int quality;
+  bool stats;  // Fused image stats computed (software colour formats only)
+  bool frame2jpg;  // RGB565 through frame2jpg(), the encoder before the native one
+  uint32_t capture_us, capture_max_us;
+  uint32_t encode_us, encode_max_us;
+  uint64_t jpeg_bytes;
+  uint32_t elapsed_ms;
+};
+
+// Capture + encode frames at the current sensor mode, nothing is sent. Without
+// requested_quality this mirrors the stream: software JPEG at STREAM_JPEG_QUALITY,
+// hardware JPEG as-is. With it, it mirrors /capture?q=, including requantization.
+// with_stats=false leaves out the fused image stats to measure what they cost.
+// use_frame2jpg encodes RGB565 frames with frame2jpg() (no stats) as the baseline
+// the native encoder is measured against.
+static void run_pipeline_bench(int frames, int requested_quality, bool with_stats, bool use_frame2jpg,
+                               BenchPipelineResult *r) {
+  int quality = requested_quality ? requested_quality : STREAM_JPEG_QUALITY;
+  memset(r, 0, sizeof(*r));
+  r->format = PIXFORMAT_JPEG;
+  r->quality = quality;
+  JpegImageStats *stats = with_stats && !use_frame2jpg ? (JpegImageStats *)malloc(sizeof(JpegImageStats)) : NULL;
+
+  int64_t start = esp_timer_get_time();
+  for (int i = 0; i < frames; i++) {
+    esp_task_wdt_reset();
+    int64_t t0 = esp_timer_get_time();
+    camera_fb_t *fb = capture_frame();
+    int64_t t1 = esp_timer_get_time();
+    if (!fb) {
+      r->failures++;
+      continue;
+    }
+    r->width = fb->width;
+    r->height = fb->height;
+    r->format = fb->format;
+    r->stats = stats && hasFusedStats(fb->format);
+    r->frame2jpg = use_frame2jpg && fb->format == PIXFORMAT_RGB565;
+
+    size_t len = 0;
+    if (r->frame2jpg) {
+      uint8_t *jpg = NULL;
+      if (frame2jpg(fb, quality, &jpg, &len)) {
+        free(jpg);
+      } else {
+        len = 0;
+      }
+    } else if (isSoftJpegFormat(fb->format)) {
+      uint8_t *jpg = NULL;
+      if (encodeFrame(fb, quality, &jpg, &len, stats)) {
+        freeEncoded(jpg, len);
+      } else {
+        len = 0;
+      }
+    } else if (fb->format == PIXFORMAT_JPEG) {
+      // Same work as /capture: requantize if q is below the frame's own quality
+      // (patch + validation are part of the capture stage)
+      len = fb->len;
+      r->quality = jpegEstimateQuality(fb->buf, fb->len);
+      if (requested_quality && requested_quality < r->quality) {
+        uint8_t *rq = NULL;
+        size_t rq_len = 0;
+        if (requantizeFrame(fb->buf, fb->len, quality, &rq, &rq_len)) {
+          len = rq_len;
+          r->quality = quality;
+          freeEncoded(rq, rq_len);
+        }
+      }
+    }
+    int64_t t2 = esp_timer_get_time();
+    esp_camera_fb_return(fb);
+
+    if (len == 0) {
+      r->failures++;
+      continue;
+    }
+    uint32_t c = t1 - t0, e = t2 - t1;
+    r->capture_us += c;
+    r->encode_us += e;
+    if (c > r->capture_max_us) r->capture_max_us = c;
+    if (e > r->encode_max_us) r->encode_max_us = e;
+    r->jpeg_bytes += len;
+    r->done++;
+  }
+  r->elapsed_ms = (esp_timer_get_time() - start) / 1000;
+  free(stats);
+}
+
+static float bench_avg_ms(uint32_t total_us, int n) {
+  return n ? total_us / 1000.0f / n : 0;
+}
+
+// Software colour paths compared by /bench/pipeline?compare=1, at every ≤SVGA size:
+// frame2jpg() is the RGB565 baseline the native encoder replaced
+struct BenchCompareMode {
+  const char *name;
+  pixformat_t format;
+  bool frame2jpg;
+};
+static const BenchCompareMode BENCH_COMPARE_MODES[] = {
+  { "frame2jpg", PIXFORMAT_RGB565, true },
+  { "rgb565",    PIXFORMAT_RGB565, false },
+  { "yuv422",    PIXFORMAT_YUV422, false },
+};
+static const framesize_t BENCH_COMPARE_SIZES[] = {
+  FRAMESIZE_96X96, FRAMESIZE_QQVGA, FRAMESIZE_QCIF, FRAMESIZE_HQVGA, FRAMESIZE_240X240,
+  FRAMESIZE_QVGA, FRAMESIZE_CIF, FRAMESIZE_HVGA, FRAMESIZE_VGA, FRAMESIZE_SVGA
+};
+#define BENCH_COMPARE_DEFAULT_FRAMES  5
+
+// RGB565 -> frame2jpg() and jpegEncodeRgb565() against YUV422 -> jpegEncodeYuyv(), one
+// JSON row per resolution and mode, streamed as each run finishes (takes a while: two
+// reinits per resolution). The previous sensor mode is restored afterwards.
+static esp_err_t bench_pipeline_compare(httpd_req_t *req, int frames, int requested_quality, bool with_stats) {
+  sensor_t *s = esp_camera_sensor_get();
+  framesize_t prev_fs = s ? s->status.framesize : FRAMESIZE_SVGA;
+  pixformat_t prev_format = s ? s->pixformat : sensorPixformatFor(prev_fs, false);
+
+  httpd_resp_set_type(req, "application/json");
+  httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+  httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+
+  printf("[BENCH] pipeline compare: %d frames per mode\n", frames);
+  esp_err_t res = httpd_resp_send_chunk(req, "{\"results\":[", HTTPD_RESP_USE_STRLEN);
+  bool first = true;
+  for (size_t i = 0; i < sizeof(BENCH_COMPARE_SIZES) / sizeof(BENCH_COMPARE_SIZES[0]) && res == ESP_OK; i++) {
+    for (size_t m = 0; m < sizeof(BENCH_COMPARE_MODES) / sizeof(BENCH_COMPARE_MODES[0]) && res == ESP_OK; m++) {
+      const BenchCompareMode *mode = &BENCH_COMPARE_MODES[m];
+      char row[288];
+      if (!ensure_camera_mode(BENCH_COMPARE_SIZES[i], mode->format)) {
+        snprintf(row, sizeof(row), "%s{\"framesize\":%d,\"mode\":\"%s\",\"error\":\"camera init failed\"}",
+                 first ? "" : ",", BENCH_COMPARE_SIZES[i], mode->name);
+      } else {
+        BenchPipelineResult r;
+        run_pipeline_bench(frames, requested_quality, with_stats, mode->frame2jpg, &r);
+        float fps = r.elapsed_ms ? r.done * 1000.0f / r.elapsed_ms : 0;
+        snprintf(row, sizeof(row),
+                 "%s{\"width\":%d,\"height\":%d,\"mode\":\"%s\",\"stats\":%s,\"frames\":%d,\"failures\":%d,"
+                 "\"capture_ms\":%.1f,\"encode_ms\":%.1f,\"encode_max_ms\":%.1f,\"fps\":%.2f,\"avg_jpeg_bytes\":%u}",
+                 first ? "" : ",", r.width, r.height, r.frame2jpg ? "frame2jpg" : pixformatName(r.format),
+                 r.stats ? "true" : "false",
+                 r.done, r.failures,
+                 bench_avg_ms(r.capture_us, r.done), bench_avg_ms(r.encode_us, r.done),
+                 r.encode_max_us / 1000.0f, fps, r.done ? (unsigned)(r.jpeg_bytes / r.done) : 0);
+      }
+      printf("[BENCH] pipeline compare: %s\n", row + (first ? 0 : 1));
+      first = false;
+      res = httpd_resp_send_chunk(req, row, HTTPD_RESP_USE_STRLEN);
+    }
+  }
+  if (res == ESP_OK) res = httpd_resp_send_chunk(req, "]}", HTTPD_RESP_USE_STRLEN);
+  if (res == ESP_OK) res = httpd_resp_send_chunk(req, NULL, 0);
+
+  ensure_camera_mode(prev_fs, prev_format);
+  return res;
+}
+
+static esp_err_t bench_pipeline_run(httpd_req_t *req) {
+  char query[96];
+  bool have_query = httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK;
+  const char *q = have_query ? query : NULL;
+  int requested_quality = query_int(q, "q", 0, 1, 100);
+  bool with_stats = query_int(q, "stats", 1, 0, 1);  // stats=0: encode without the fused stats
+
+  if (query_int(q, "compare", 0, 0, 1)) {
+    int frames = query_int(q, "frames", BENCH_COMPARE_DEFAULT_FRAMES, 1, BENCH_PIPELINE_MAX_FRAMES);
+    return bench_pipeline_compare(req, frames, requested_quality, with_stats);
+  }
+  int frames = query_int(q, "frames", BENCH_PIPELINE_DEFAULT_FRAMES, 1, BENCH_PIPELINE_MAX_FRAMES);
+
+  // res= / gray= / mode= switch the sensor first; otherwise the current mode is measured.
+  // mode=frame2jpg|rgb565|yuv422 picks the software colour path (≤SVGA only)
+  char param[16];
+  char mode[12];
+  bool have_res = q && httpd_query_key_value(q, "res", param, sizeof(param)) == ESP_OK;
+  bool have_gray = q && query_int(q, "gray", -1, -1, 1) >= 0;
+  bool have_mode = q && httpd_query_key_value(q, "mode", mode, sizeof(mode)) == ESP_OK;
+  if (have_res || have_gray || have_mode) {
+    sensor_t *s = esp_camera_sensor_get();
+    framesize_t fs = have_res ? parse_frame_size(param) : (s ? s->status.framesize : FRAMESIZE_SVGA);
+    bool grayscale = have_gray ? query_int(q, "gray", 0, 0, 1) : (s && s->pixformat == PIXFORMAT_GRAYSCALE);
+    pixformat_t format = sensorPixformatFor(fs, grayscale);
+    if (have_mode && format != PIXFORMAT_JPEG && !grayscale) {
+      if (strcasecmp(mode, "rgb565") == 0 || strcasecmp(mode, "frame2jpg") == 0) format = PIXFORMAT_RGB565;
+      if (strcasecmp(mode, "yuv422") == 0) format = PIXFORMAT_YUV422;
+    }
+    if (!ensure_camera_mode(fs, format)) {
+      httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Camera reinitialization failed");
+      return ESP_FAIL;
+    }
+  }
+
+  printf("[BENCH] pipeline: %d frames, q=%d\n", frames, requested_quality ? requested_quality : STREAM_JPEG_QUALITY);
+  BenchPipelineResult r;
+  run_pipeline_bench(frames, requested_quality, with_stats, have_mode && strcasecmp(mode, "frame2jpg") == 0, &r);
+
+  float fps = r.elapsed_ms ? r.done * 1000.0f / r.elapsed_ms : 0;
+  uint32_t avg_bytes = r.done ? r.jpeg_bytes / r.done : 0;
+  char json[512];
+  snprintf(json, sizeof(json),
+           "{\"frames\":%d,\"failures\":%d,\"width\":%d,\"height\":%d,\"format\":\"%s\",\"encoder\":\"%s\","
+           "\"quality\":%d,\"stats\":%s,"
+           "\"capture_ms\":{\"avg\":%.1f,\"max\":%.1f},\"encode_ms\":{\"avg\":%.1f,\"max\":%.1f},"
+           "\"elapsed_ms\":%u,\"fps\":%.2f,\"avg_jpeg_bytes\":%u,\"required_kbps\":%u,"
+           "\"phy\":\"%s\",\"rssi\":%d,\"channel\":%d}",
+           r.done, r.failures, r.width, r.height, pixformatName(r.format),
+           r.frame2jpg ? "frame2jpg" : (isSoftJpegFormat(r.format) ? "native" : "hardware"), r.quality,
+           r.stats ? "true" : "false",
+           bench_avg_ms(r.capture_us, r.done), r.capture_max_us / 1000.0f,
+           bench_avg_ms(r.encode_us, r.done), r.encode_max_us / 1000.0f,
+           (unsigned)r.elapsed_ms, fps, (unsigned)avg_bytes, (unsigned)(avg_bytes * 8 * fps / 1000),
+           wifi_phy_name(), (int)WiFi.RSSI(), (int)WiFi.channel());
+  printf("[BENCH] pipeline: %s\n", json);
+  return send_bench_json(req, json);
+}
+
+// The camera is held for the whole run, snapshot class: streams pause instead of
+// switching the sensor under the measurement
+static esp_err_t bench_pipeline_handler(httpd_req_t *req) {
+  camera_acquire(CAMERA_CLIENT_SNAPSHOT);
+  esp_err_t res = bench_pipeline_run(req);
+  camera_release();
+  return res;
+}
+
+// Time-lapse: a task takes the shots on the schedule (so they stay on time while WiFi
+// is down and nobody is connected) and stages the JPEGs in PSRAM until they are
+// downloaded as one tar. Staged frames beyond this budget evict the oldest ones.
+#ifndef TIMELAPSE_STAGE_BYTES
+#define TIMELAPSE_STAGE_BYTES     (2 * 1024 * 1024)
+#endif
+#define TIMELAPSE_MIN_INTERVAL_MS 500
+#define TIMELAPSE_MAX_INTERVAL_MS (24 * 3600 * 1000)
+// The task checks for start/stop this often while nothing is scheduled sooner
+#define TIMELAPSE_IDLE_POLL_MS    1000
+
+// Schedule and store are pure logic; this mutex covers every access to them
+static SemaphoreHandle_t timelapse_lock = NULL;
+static TaskHandle_t timelapse_task_handle = NULL;
+static TimelapseSchedule timelapse_schedule;
+static TimelapseStore timelapse_store;
+
+// A run in progress or frames not yet downloaded (both live only in RAM)
+static bool timelapse_busy() {
+  if (!timelapse_lock) return false;
+  xSemaphoreTake(timelapse_lock, portMAX_DELAY);
+  bool busy = timelapse_schedule.running || timelapse_store.count > 0;
+  xSemaphoreGive(timelapse_lock);
+  return busy;
+}
+
+static void timelapse_free(uint8_t *buf, size_t len) {
+  memTagFree(MEM_TAG_TIMELAPSE, len);
+  free(buf);
+}
+
+// One shot at the run's mode: software JPEG at its quality, hardware JPEG copied
+// (or requantized when q is coarser than the sensor's, like /capture). The result is
+// tagged MEM_TAG_ENCODE; *taken_ms is the sensor's capture time.
+static bool timelapse_capture(const TimelapseConfig *config, uint8_t **out, size_t *out_len, uint64_t *taken_ms) {
+  framesize_t fs = (framesize_t)config->framesize;
+  camera_acquire(CAMERA_CLIENT_TIMELAPSE);
+  if (!ensure_camera_mode(fs, sensorPixformatFor(fs, false))) {
+    camera_release();
+    return false;
+  }
+  camera_fb_t *fb = capture_frame();
+  if (!fb) {
+    camera_release();
+    return false;
+  }
+  *taken_ms = ((int64_t)fb->timestamp.tv_sec * 1000000 + fb->timestamp.tv_usec) / 1000;
+
+  bool ok = false;
+  if (isSoftJpegFormat(fb->format)) {
+    ok = encodeFrame(fb, config->quality, out, out_len);
+  } else {
+    ok = requantizeFrame(fb->buf, fb->len, config->quality, out, out_len);
+    if (!ok) {
+      *out = (uint8_t *)malloc(fb->len);
+      ok = *out != NULL;
+      if (ok) {
+        memcpy(*out, fb->buf, fb->len);
+        *out_len = fb->len;
+        memTagAlloc(MEM_TAG_ENCODE, fb->len);
+      } else {
+        memTagFail(MEM_TAG_ENCODE);
+      }
+    }
+  }
+  esp_camera_fb_return(fb);
+  camera_release();
+  return ok;
+}
+
+static void timelapse_shot(const TimelapseConfig *config, uint64_t due_ms) {
+  uint8_t *jpg = NULL;
+  size_t len = 0;
+  uint64_t taken_ms = due_ms;
+  bool captured = timelapse_capture(config, &jpg, &len, &taken_ms);
+
+  xSemaphoreTake(timelapse_lock, portMAX_DELAY);
+  TimelapseFrame *frame = NULL;
+  if (captured) {
+    frame = timelapseStoreAdd(&timelapse_store, jpg, len, due_ms, taken_ms,
+                              timelapseWallMs(&timelapse_schedule, taken_ms));
+  }
+  if (frame) {
+    memTagTransfer(MEM_TAG_ENCODE, MEM_TAG_TIMELAPSE, len);
+    timelapseShotTaken(&timelapse_schedule, due_ms, taken_ms);
+  } else {
+    timelapseShotFailed(&timelapse_schedule);
+  }
+  uint32_t seq = frame ? frame->seq : 0;
+  unsigned staged = timelapse_store.count;
+  size_t staged_bytes = timelapse_store.bytes;
+  xSemaphoreGive(timelapse_lock);
+
+  if (frame) {
+    printf("[TIMELAPSE] Frame %u: %u bytes, %d ms after its slot; %u staged (%u KB)\n", (unsigned)seq,
+           (unsigned)len, (int)(taken_ms - due_ms), staged, (unsigned)(staged_bytes / 1024));
+  } else {
+    printf("[TIMELAPSE] ERROR: shot for slot at %llu ms %s\n", (unsigned long long)due_ms,
+           captured ? "could not be staged" : "failed");
+    if (jpg) freeEncoded(jpg, len);
+  }
+}
+
+// Sleeps until the next slot (absolute, so a slow shot doesn't shift the ones after
+// it) or until started/stopped
+static void timelapse_task(void *arg) {
+  for (;;) {
+    uint64_t now = esp_timer_get_time() / 1000;
+    uint64_t due = 0;
+    uint64_t next = 0;
+    xSemaphoreTake(timelapse_lock, portMAX_DELAY);
+    bool shoot = timelapseDue(&timelapse_schedule, now, &due);
+    TimelapseConfig config = timelapse_schedule.config;
+    bool running = timelapseNextDue(&timelapse_schedule, &next);
+    xSemaphoreGive(timelapse_lock);
+
+    if (shoot) {
+      timelapse_shot(&config, due);
+      continue;
+    }
+    uint32_t wait_ms = TIMELAPSE_IDLE_POLL_MS;
+    if (running && next > now && next - now < wait_ms) wait_ms = next - now;
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(wait_ms) > 0 ? pdMS_TO_TICKS(wait_ms) : 1);
+  }
 }
 
-static esp_err_t stream_handler(httpd_req_t *req) {
-  camera_fb_t *fb = NULL;
-  esp_err_t res = ESP_OK;
-  size_t _jpg_buf_len = 0;
-  uint8_t *_jpg_buf = NULL;
-  char part_buf[128];
+static bool timelapse_begin() {
+  if (timelapse_task_handle) return true;
+  timelapse_lock = xSemaphoreCreateMutex();
+  if (!timelapse_lock) return false;
+  timelapseStoreInit(&timelapse_store, TIMELAPSE_STAGE_BYTES, timelapse_free);
+  return xTaskCreatePinnedToCore(timelapse_task, "timelapse", 8192, NULL, 5, &timelapse_task_handle, 1) == pdPASS;
+}
 
-  static const char* _STREAM_CONTENT_TYPE = "multipart/x-mixed-replace;boundary=frame";
-  static const char* _STREAM_BOUNDARY = "\r\n--frame\r\n";
-  static const char* _STREAM_PART = "Content-Type: image/jpeg\r\nContent-Length: %u\r\n\r\n";
+// /timelapse: status as JSON, plus control:
+//   ?start=1&interval=10&duration=3600&res=svga&q=12&epoch=<unix s>   (seconds; interval may
+//   be fractional, 0.5 s to 24 h; duration 0 = until stopped, at most 30 days; epoch
+//   timestamps the frames in UTC)
+//   ?stop=1
+// A new run keeps frames staged by earlier ones.
+static esp_err_t timelapse_handler(httpd_req_t *req) {
+  char query[160];
+  char param[24];
+  bool have_query = httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK;
+  const char *q = have_query ? query : NULL;
 
-  Serial.println("🎥 Stream request received");
-  
-  res = httpd_resp_set_type(req, _STREAM_CONTENT_TYPE);
-  if (res != ESP_OK) {
-    Serial.printf("❌ Failed to set stream content type: %d\n", res);
-    return res;
+  if (query_int(q, "start", 0, 0, 1)) {
+    TimelapseConfig config = {};
+    double interval_s = 10;
+    if (httpd_query_key_value(query, "interval", param, sizeof(param)) == ESP_OK) interval_s = atof(param);
+    if (!isfinite(interval_s)) {
+      httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "interval must be a number of seconds");
+      return ESP_FAIL;
+    }
+    if (interval_s * 1000 < TIMELAPSE_MIN_INTERVAL_MS) interval_s = TIMELAPSE_MIN_INTERVAL_MS / 1000.0;
+    if (interval_s * 1000 > TIMELAPSE_MAX_INTERVAL_MS) interval_s = TIMELAPSE_MAX_INTERVAL_MS / 1000.0;
+    config.interval_ms = (uint32_t)(interval_s * 1000);
+    config.duration_ms = (uint32_t)query_int(q, "duration", 0, 0, 30 * 24 * 3600) * 1000;
+    config.framesize = httpd_query_key_value(query, "res", param, sizeof(param)) == ESP_OK
+                         ? parse_frame_size(param) : FRAMESIZE_SVGA;
+    config.quality = query_int(q, "q", 12, 1, 100);
+    if (httpd_query_key_value(query, "epoch", param, sizeof(param)) == ESP_OK) {
+      config.epoch_ms = strtoull(param, NULL, 10) * 1000;
+    }
+    if (!timelapse_begin()) {
+      httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Cannot start time-lapse task");
+      return ESP_FAIL;
+    }
+    xSemaphoreTake(timelapse_lock, portMAX_DELAY);
+    timelapseStart(&timelapse_schedule, &config, esp_timer_get_time() / 1000);
+    xSemaphoreGive(timelapse_lock);
+    xTaskNotifyGive(timelapse_task_handle);
+    printf("[TIMELAPSE] Started: every %u ms for %u s at %ux%u, q=%d%s\n", (unsigned)config.interval_ms,
+           (unsigned)(config.duration_ms / 1000), resolution[config.framesize].width,
+           resolution[config.framesize].height, config.quality, config.epoch_ms ? ", wall clock set" : "");
+  } else if (query_int(q, "stop", 0, 0, 1) && timelapse_lock) {
+    xSemaphoreTake(timelapse_lock, portMAX_DELAY);
+    timelapseStop(&timelapse_schedule);
+    xSemaphoreGive(timelapse_lock);
+    printf("[TIMELAPSE] Stopped\n");
   }
-  
+
+  TimelapseSchedule tl = {};
+  unsigned staged = 0;
+  size_t staged_bytes = 0;
+  uint32_t first_seq = 0, last_seq = 0, evicted = 0;
+  uint64_t next_due = 0;
+  bool have_next = false;
+  if (timelapse_lock) {
+    xSemaphoreTake(timelapse_lock, portMAX_DELAY);
+    tl = timelapse_schedule;
+    have_next = timelapseNextDue(&timelapse_schedule, &next_due);
+    staged = timelapse_store.count;
+    staged_bytes = timelapse_store.bytes;
+    first_seq = timelapseStoreFirstSeq(&timelapse_store);
+    last_seq = timelapseStoreLastSeq(&timelapse_store);
+    evicted = timelapse_store.evicted;
+    xSemaphoreGive(timelapse_lock);
+  }
+  int64_t now_ms = esp_timer_get_time() / 1000;
+
+  char json[640];
+  snprintf(json, sizeof(json),
+           "{\"running\":%s,\"interval_ms\":%u,\"duration_s\":%u,\"width\":%u,\"height\":%u,\"quality\":%d,"
+           "\"wall_clock\":%s,\"elapsed_s\":%u,\"next_in_ms\":%d,"
+           "\"taken\":%u,\"missed\":%u,\"failed\":%u,\"late_ms\":{\"avg\":%.1f,\"max\":%u},"
+           "\"staged\":%u,\"staged_bytes\":%u,\"budget_bytes\":%u,\"first_seq\":%u,\"last_seq\":%u,\"evicted\":%u}",
+           tl.running ? "true" : "false", (unsigned)tl.config.interval_ms, (unsigned)(tl.config.duration_ms / 1000),
+           tl.start_ms ? resolution[tl.config.framesize].width : 0,
+           tl.start_ms ? resolution[tl.config.framesize].height : 0, tl.config.quality,
+           tl.config.epoch_ms ? "true" : "false",
+           tl.start_ms ? (unsigned)((now_ms - tl.start_ms) / 1000) : 0,
+           have_next ? (int)((int64_t)next_due - now_ms) : -1,
+           (unsigned)tl.taken, (unsigned)tl.missed, (unsigned)tl.failed,
+           tl.taken ? (double)tl.late_total_ms / tl.taken : 0.0, (unsigned)tl.late_max_ms,
+           staged, (unsigned)staged_bytes, (unsigned)TIMELAPSE_STAGE_BYTES, (unsigned)first_seq,
+           (unsigned)last_seq, (unsigned)evicted);
+  httpd_resp_set_type(req, "application/json");
   httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
-  httpd_resp_set_hdr(req, "X-Framerate", "60");
+  httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+  return httpd_resp_send(req, json, HTTPD_RESP_USE_STRLEN);
+}
 
-  int frame_count = 0;
-  unsigned long start_time = millis();
-  unsigned long last_report_time = start_time;
-  int last_report_count = 0;
-  
-  while (true) {
-    esp_task_wdt_reset(); // keep watchdog happy during long stream
-    
-    fb = esp_camera_fb_get();
-    if (!fb) {
-      printf("[STREAM] ERROR: esp_camera_fb_get() failed\n");
-      Serial.println("❌ Stream: Camera capture failed");
-      res = ESP_FAIL;
+// /timelapse/download: the staged frames as one tar (see timelapseFrameName() for the
+// names; each carries its capture time). ?after=<seq> skips frames already fetched,
+// ?clear=1 discards the sent frames once the whole archive went out. The last seq
+// included is in X-Timelapse-Last-Seq. Frames are sent straight from PSRAM.
+static esp_err_t timelapse_download_handler(httpd_req_t *req) {
+  char query[48];
+  bool have_query = httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK;
+  const char *q = have_query ? query : NULL;
+  uint32_t after = (uint32_t)query_int(q, "after", 0, 0, INT32_MAX);
+  bool clear = query_int(q, "clear", 0, 0, 1);
+
+  uint32_t last = 0;
+  if (timelapse_lock) {
+    xSemaphoreTake(timelapse_lock, portMAX_DELAY);
+    last = timelapseStoreLastSeq(&timelapse_store);
+    xSemaphoreGive(timelapse_lock);
+  }
+  char last_hdr[12];
+  snprintf(last_hdr, sizeof(last_hdr), "%u", (unsigned)last);
+  httpd_resp_set_type(req, "application/x-tar");
+  httpd_resp_set_hdr(req, "Content-Disposition", "attachment; filename=timelapse.tar");
+  httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+  httpd_resp_set_hdr(req, "Access-Control-Expose-Headers", "X-Timelapse-Last-Seq");
+  httpd_resp_set_hdr(req, "X-Timelapse-Last-Seq", last_hdr);
+
+  uint8_t *block = (uint8_t *)malloc(TIMELAPSE_TAR_BLOCK);
+  if (!block) {
+    httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+    return ESP_FAIL;
+  }
+  static const uint8_t zeros[TIMELAPSE_TAR_BLOCK] = {0};  // Padding and the end-of-archive blocks
+  esp_err_t res = ESP_OK;
+  unsigned frames = 0;
+  size_t bytes = 0;
+  uint32_t seq = after;
+  unsigned long start = millis();
+  while (res == ESP_OK && seq < last) {
+    xSemaphoreTake(timelapse_lock, portMAX_DELAY);
+    TimelapseFrame *frame = timelapseStoreAcquire(&timelapse_store, seq);
+    xSemaphoreGive(timelapse_lock);
+    if (!frame || frame->seq > last) {
+      if (frame) {
+        xSemaphoreTake(timelapse_lock, portMAX_DELAY);
+        timelapseStoreRelease(&timelapse_store, frame);
+        xSemaphoreGive(timelapse_lock);
+      }
       break;
     }
 
-    // Convert RGB565 to JPEG
-    if (fb->format == PIXFORMAT_RGB565) {
-      bool converted = frame2jpg(fb, 12, &_jpg_buf, &_jpg_buf_len);
-      if (!converted || !_jpg_buf) {
-        printf("[STREAM] ERROR: frame2jpg() failed\n");
-        esp_camera_fb_return(fb);
-        res = ESP_FAIL;
-        break;
-      }
-      // Return RGB565 buffer, we now have JPEG in _jpg_buf
-      esp_camera_fb_return(fb);
-      fb = NULL;
+    char name[64];
+    timelapseFrameName(frame, name, sizeof(name));
+    timelapseTarHeader(block, name, frame->len, frame->wall_ms / 1000);
+    res = httpd_resp_send_chunk(req, (const char *)block, TIMELAPSE_TAR_BLOCK);
+    if (res == ESP_OK) res = httpd_resp_send_chunk(req, (const char *)frame->buf, frame->len);
+    size_t pad = timelapseTarPadding(frame->len);
+    if (res == ESP_OK && pad) res = httpd_resp_send_chunk(req, (const char *)zeros, pad);
+    esp_task_wdt_reset();
+    seq = frame->seq;
+    frames++;
+    bytes += frame->len;
+
+    xSemaphoreTake(timelapse_lock, portMAX_DELAY);
+    timelapseStoreRelease(&timelapse_store, frame);
+    xSemaphoreGive(timelapse_lock);
+  }
+  free(block);
+  if (res == ESP_OK) res = httpd_resp_send_chunk(req, (const char *)zeros, TIMELAPSE_TAR_BLOCK);
+  if (res == ESP_OK) res = httpd_resp_send_chunk(req, (const char *)zeros, TIMELAPSE_TAR_BLOCK);
+  if (res == ESP_OK) res = httpd_resp_send_chunk(req, NULL, 0);
+
+  unsigned discarded = 0;
+  if (res == ESP_OK && clear && timelapse_lock) {
+    xSemaphoreTake(timelapse_lock, portMAX_DELAY);
+    discarded = timelapseStoreDiscard(&timelapse_store, seq);
+    xSemaphoreGive(timelapse_lock);
+  }
+  printf("[TIMELAPSE] Download: %u frames (%u KB) up to seq %u in %lu ms, %u discarded, status=%d\n",
+         frames, (unsigned)(bytes / 1024), (unsigned)seq, millis() - start, discarded, res);
+  return res;
+}
+
+// Buffered chunked response for line-oriented text (metrics): lines are collected
+// and sent in ~1 KB chunks instead of one small send each
+struct ChunkWriter {
+  httpd_req_t *req;
+  char buf[1024];
+  size_t len;
+  esp_err_t res;
+};
+
+static void chunk_flush(ChunkWriter *w) {
+  if (w->len && w->res == ESP_OK) w->res = httpd_resp_send_chunk(w->req, w->buf, w->len);
+  w->len = 0;
+}
+
+static void chunk_printf(ChunkWriter *w, const char *fmt, ...) {
+  char line[192];
+  va_list args;
+  va_start(args, fmt);
+  int n = vsnprintf(line, sizeof(line), fmt, args);
+  va_end(args);
+  if (n <= 0) return;
+  if ((size_t)n >= sizeof(line)) n = sizeof(line) - 1;
+  if (w->len + n > sizeof(w->buf)) chunk_flush(w);
+  memcpy(w->buf + w->len, line, n);
+  w->len += n;
+}
+
+// Every resolution the camera can run at, for the /metrics?plan=1 table
+static const framesize_t CAMERA_FRAMESIZES[] = {
+  FRAMESIZE_96X96, FRAMESIZE_QQVGA, FRAMESIZE_QCIF, FRAMESIZE_HQVGA, FRAMESIZE_240X240,
+  FRAMESIZE_QVGA, FRAMESIZE_CIF, FRAMESIZE_HVGA, FRAMESIZE_VGA, FRAMESIZE_SVGA,
+  FRAMESIZE_XGA, FRAMESIZE_HD, FRAMESIZE_SXGA, FRAMESIZE_UXGA
+};
+
+// Budget plan for switching to every (framesize, format, fb_count) the firmware
+// uses, against the PSRAM state right now
+static void write_memory_plan(ChunkWriter *w) {
+  sensor_t *s = esp_camera_sensor_get();
+  bool running = s && camera_fb_count > 0;
+  MemBudgetMode current;
+  if (running) cameraMemMode(s->status.framesize, s->pixformat, camera_fb_count, &current);
+  MemRegionSample psram;
+  memRegionSample(MEM_REGION_PSRAM, &psram);
+  MemRegionState state = { psram.free_bytes, psram.largest_block };
+  MemTagStats cached;
+  memTagGet(MEM_TAG_CACHE, &cached);
+
+  chunk_printf(w, "{\"psram_free\":%u,\"psram_largest_block\":%u,\"flushable\":%u,\"plans\":[",
+               (unsigned)psram.free_bytes, (unsigned)psram.largest_block, (unsigned)cached.bytes);
+  bool first = true;
+  for (size_t i = 0; i < sizeof(CAMERA_FRAMESIZES) / sizeof(CAMERA_FRAMESIZES[0]); i++) {
+    framesize_t fs = CAMERA_FRAMESIZES[i];
+    pixformat_t formats[3];
+    int nformats = 0;
+    if (shouldUseRGB565Mode(fs)) {
+      formats[nformats++] = PIXFORMAT_YUV422;
+      formats[nformats++] = PIXFORMAT_RGB565;
     } else {
-      // Fallback for JPEG mode (shouldn't happen)
-      _jpg_buf_len = fb->len;
-      _jpg_buf = fb->buf;
+      formats[nformats++] = PIXFORMAT_JPEG;
     }
+    formats[nformats++] = PIXFORMAT_GRAYSCALE;
 
-    unsigned long now = millis();
-    if (now - last_report_time >= 2000) { // report every ~2s
-      float fps = (frame_count - last_report_count) * 1000.0f / (now - last_report_time);
-      printf("[STREAM] Frame %d: %u bytes JPEG, %.1f fps, Heap: %u\n", 
-             frame_count, _jpg_buf_len, fps, ESP.getFreeHeap());
-      Serial.printf("📹 Frame %d: %u bytes, %.1f fps, Heap: %u\n", 
-                    frame_count, _jpg_buf_len, fps, ESP.getFreeHeap());
-      last_report_time = now;
-      last_report_count = frame_count;
+    for (int f = 0; f < nformats; f++) {
+      for (int fb_count = 1; fb_count <= CAMERA_FB_COUNT; fb_count++) {
+        MemBudgetMode target;
+        MemPlan plan;
+        cameraMemMode(fs, formats[f], fb_count, &target);
+        memBudgetPlan(&target, running ? &current : NULL, &state, cached.bytes, &plan);
+        chunk_printf(w, "%s{\"width\":%u,\"height\":%u,\"format\":\"%s\",\"fb_count\":%d,"
+                        "\"fb_bytes\":%u,\"total_bytes\":%u,\"plan\":\"%s\",\"plan_fb_count\":%u}",
+                     first ? "" : ",", target.width, target.height, memPixelFormatName(target.format),
+                     fb_count, (unsigned)plan.footprint.fb_bytes, (unsigned)plan.footprint.total_bytes,
+                     memPlanActionName(plan.action), plan.fb_count);
+        first = false;
+      }
     }
+  }
+  chunk_printf(w, "]}");
+}
 
-    if (res == ESP_OK) {
-      res = httpd_resp_send_chunk(req, _STREAM_BOUNDARY, strlen(_STREAM_BOUNDARY));
-    }
-    if (res == ESP_OK) {
-      size_t hlen = snprintf(part_buf, sizeof(part_buf), _STREAM_PART, _jpg_buf_len);
-      res = httpd_resp_send_chunk(req, part_buf, hlen);
+static void write_memory_history(ChunkWriter *w) {
+  static MemSample history[MEM_HISTORY_LEN];  // 4.6 KB: too big for the httpd stack
+  int n = memTelemetryHistory(history, MEM_HISTORY_LEN);
+  chunk_printf(w, "{\"period_ms\":%d,\"samples\":[", MEM_SAMPLE_PERIOD_MS);
+  for (int i = 0; i < n; i++) {
+    const MemSample &m = history[i];
+    const MemRegionSample &in = m.region[MEM_REGION_INTERNAL];
+    const MemRegionSample &ps = m.region[MEM_REGION_PSRAM];
+    chunk_printf(w, "%s{\"uptime_s\":%u,\"event\":\"%s\",\"internal\":[%u,%u],\"psram\":[%u,%u]}",
+                 i ? "," : "", (unsigned)m.uptime_s, memEventName(m.event),
+                 (unsigned)in.free_bytes, (unsigned)in.largest_block,
+                 (unsigned)ps.free_bytes, (unsigned)ps.largest_block);
+  }
+  chunk_printf(w, "]}");
+}
+
+// Prometheus text format; ?plan=1 / ?history=1 return the budget table / sample ring as JSON
+// Quantiles (histogram bucket bounds), sum and count of a latency series, in
+// Prometheus summary form
+static void chunk_latency(ChunkWriter *w, const char *metric, const char *label, const char *value,
+                          const CameraLatencyStats *stats) {
+  static const float QUANTILES[] = {0.5f, 0.9f, 0.99f};
+  for (size_t i = 0; i < sizeof(QUANTILES) / sizeof(QUANTILES[0]); i++)
+    chunk_printf(w, "%s{%s=\"%s\",quantile=\"%g\"} %u\n", metric, label, value, QUANTILES[i],
+                 (unsigned)cameraLatencyPercentile(stats, QUANTILES[i]));
+  chunk_printf(w, "%s_sum{%s=\"%s\"} %llu\n", metric, label, value, (unsigned long long)stats->total_ms);
+  chunk_printf(w, "%s_count{%s=\"%s\"} %u\n", metric, label, value, (unsigned)stats->count);
+}
+
+static esp_err_t metrics_handler(httpd_req_t *req) {
+  char query[32];
+  bool have_query = httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK;
+  const char *q = have_query ? query : NULL;
+  bool plan = query_int(q, "plan", 0, 0, 1);
+  bool history = query_int(q, "history", 0, 0, 1);
+
+  httpd_resp_set_type(req, plan || history ? "application/json" : "text/plain; version=0.0.4");
+  httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+  httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+
+  ChunkWriter *w = (ChunkWriter *)malloc(sizeof(ChunkWriter));
+  if (!w) {
+    httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+    return ESP_FAIL;
+  }
+  w->req = req;
+  w->len = 0;
+  w->res = ESP_OK;
+
+  if (plan) {
+    write_memory_plan(w);
+  } else if (history) {
+    write_memory_history(w);
+  } else {
+    MemRegionSample regions[MEM_REGION_COUNT];
+    for (int r = 0; r < MEM_REGION_COUNT; r++) memRegionSample((MemRegion)r, &regions[r]);
+
+    chunk_printf(w, "# TYPE camera_uptime_seconds counter\ncamera_uptime_seconds %u\n",
+                 (unsigned)(esp_timer_get_time() / 1000000));
+    chunk_printf(w, "# TYPE camera_heap_total_bytes gauge\n");
+    for (int r = 0; r < MEM_REGION_COUNT; r++)
+      chunk_printf(w, "camera_heap_total_bytes{region=\"%s\"} %u\n", memRegionName((MemRegion)r), (unsigned)regions[r].total_bytes);
+    chunk_printf(w, "# TYPE camera_heap_free_bytes gauge\n");
+    for (int r = 0; r < MEM_REGION_COUNT; r++)
+      chunk_printf(w, "camera_heap_free_bytes{region=\"%s\"} %u\n", memRegionName((MemRegion)r), (unsigned)regions[r].free_bytes);
+    chunk_printf(w, "# TYPE camera_heap_min_free_bytes gauge\n");
+    for (int r = 0; r < MEM_REGION_COUNT; r++)
+      chunk_printf(w, "camera_heap_min_free_bytes{region=\"%s\"} %u\n", memRegionName((MemRegion)r), (unsigned)regions[r].min_free_bytes);
+    chunk_printf(w, "# TYPE camera_heap_largest_free_block_bytes gauge\n");
+    for (int r = 0; r < MEM_REGION_COUNT; r++)
+      chunk_printf(w, "camera_heap_largest_free_block_bytes{region=\"%s\"} %u\n", memRegionName((MemRegion)r), (unsigned)regions[r].largest_block);
+    chunk_printf(w, "# TYPE camera_heap_lowest_largest_free_block_bytes gauge\n");
+    for (int r = 0; r < MEM_REGION_COUNT; r++)
+      chunk_printf(w, "camera_heap_lowest_largest_free_block_bytes{region=\"%s\"} %u\n", memRegionName((MemRegion)r),
+                   (unsigned)memTelemetryLowestBlock((MemRegion)r));
+    chunk_printf(w, "# TYPE camera_heap_fragmentation_percent gauge\n");
+    for (int r = 0; r < MEM_REGION_COUNT; r++)
+      chunk_printf(w, "camera_heap_fragmentation_percent{region=\"%s\"} %u\n", memRegionName((MemRegion)r), memFragmentationPct(&regions[r]));
+
+    MemTagStats tags[MEM_TAG_COUNT];
+    for (int t = 0; t < MEM_TAG_COUNT; t++) memTagGet((MemTag)t, &tags[t]);
+    chunk_printf(w, "# TYPE camera_mem_tag_bytes gauge\n");
+    for (int t = 0; t < MEM_TAG_COUNT; t++)
+      chunk_printf(w, "camera_mem_tag_bytes{tag=\"%s\"} %u\n", memTagName((MemTag)t), (unsigned)tags[t].bytes);
+    chunk_printf(w, "# TYPE camera_mem_tag_peak_bytes gauge\n");
+    for (int t = 0; t < MEM_TAG_COUNT; t++)
+      chunk_printf(w, "camera_mem_tag_peak_bytes{tag=\"%s\"} %u\n", memTagName((MemTag)t), (unsigned)tags[t].peak_bytes);
+    chunk_printf(w, "# TYPE camera_mem_tag_allocs_total counter\n");
+    for (int t = 0; t < MEM_TAG_COUNT; t++)
+      chunk_printf(w, "camera_mem_tag_allocs_total{tag=\"%s\"} %u\n", memTagName((MemTag)t), (unsigned)tags[t].allocs);
+    chunk_printf(w, "# TYPE camera_mem_tag_failures_total counter\n");
+    for (int t = 0; t < MEM_TAG_COUNT; t++)
+      chunk_printf(w, "camera_mem_tag_failures_total{tag=\"%s\"} %u\n", memTagName((MemTag)t), (unsigned)tags[t].failures);
+
+    chunk_printf(w, "# TYPE camera_mem_events_total counter\n");
+    for (int e = 0; e < MEM_EVENT_COUNT; e++)
+      chunk_printf(w, "camera_mem_events_total{event=\"%s\"} %u\n", memEventName((MemEvent)e),
+                   (unsigned)memTelemetryEventCount((MemEvent)e));
+    chunk_printf(w, "# TYPE camera_fb_count gauge\ncamera_fb_count %d\n", camera_fb_count);
+
+    chunk_printf(w, "# TYPE camera_jpeg_frames_total counter\n");
+    for (int r = 0; r < JPEG_CHECK_COUNT; r++)
+      chunk_printf(w, "camera_jpeg_frames_total{result=\"%s\"} %u\n", jpegCheckName((JpegCheckResult)r),
+                   (unsigned)__atomic_load_n(&jpeg_check_counts[r], __ATOMIC_RELAXED));
+    chunk_printf(w, "# TYPE camera_jpeg_trimmed_frames_total counter\ncamera_jpeg_trimmed_frames_total %u\n",
+                 (unsigned)__atomic_load_n(&jpeg_trimmed_frames, __ATOMIC_RELAXED));
+    chunk_printf(w, "# TYPE camera_jpeg_trimmed_bytes_total counter\ncamera_jpeg_trimmed_bytes_total %u\n",
+                 (unsigned)__atomic_load_n(&jpeg_trimmed_bytes, __ATOMIC_RELAXED));
+    chunk_printf(w, "# TYPE camera_jpeg_dropped_captures_total counter\ncamera_jpeg_dropped_captures_total %u\n",
+                 (unsigned)__atomic_load_n(&jpeg_dropped_captures, __ATOMIC_RELAXED));
+
+    chunk_printf(w, "# TYPE camera_standby gauge\ncamera_standby %d\n", cameraInStandby() ? 1 : 0);
+    chunk_printf(w, "# TYPE camera_standby_entries_total counter\ncamera_standby_entries_total %u\n",
+                 (unsigned)cameraStandbyEntries());
+    chunk_printf(w, "# TYPE camera_standby_seconds_total counter\ncamera_standby_seconds_total %.1f\n",
+                 cameraStandbyTotalMs() / 1000.0);
+    CameraStartStats starts[CAMERA_START_COUNT];
+    for (int k = 0; k < CAMERA_START_COUNT; k++) cameraStandbyStartStats((CameraStart)k, &starts[k]);
+    chunk_printf(w, "# TYPE camera_start_total counter\n");
+    for (int k = 0; k < CAMERA_START_COUNT; k++)
+      chunk_printf(w, "camera_start_total{start=\"%s\"} %u\n", cameraStartName((CameraStart)k), (unsigned)starts[k].count);
+    chunk_printf(w, "# TYPE camera_first_frame_ms gauge\n");
+    for (int k = 0; k < CAMERA_START_COUNT; k++) {
+      const CameraStartStats &st = starts[k];
+      if (!st.count) continue;
+      const char *name = cameraStartName((CameraStart)k);
+      chunk_printf(w, "camera_first_frame_ms{start=\"%s\",stat=\"last\"} %u\n", name, (unsigned)st.last_ms);
+      chunk_printf(w, "camera_first_frame_ms{start=\"%s\",stat=\"min\"} %u\n", name, (unsigned)st.min_ms);
+      chunk_printf(w, "camera_first_frame_ms{start=\"%s\",stat=\"avg\"} %u\n", name, (unsigned)(st.total_ms / st.count));
+      chunk_printf(w, "camera_first_frame_ms{start=\"%s\",stat=\"max\"} %u\n", name, (unsigned)st.max_ms);
     }
-    if (res == ESP_OK) {
-      res = httpd_resp_send_chunk(req, (const char *)_jpg_buf, _jpg_buf_len);
+
+    if (timelapse_lock) {
+      xSemaphoreTake(timelapse_lock, portMAX_DELAY);
+      TimelapseSchedule tl = timelapse_schedule;
+      unsigned staged = timelapse_store.count;
+      size_t staged_bytes = timelapse_store.bytes;
+      uint32_t evicted = timelapse_store.evicted;
+      xSemaphoreGive(timelapse_lock);
+      chunk_printf(w, "# TYPE camera_timelapse_running gauge\ncamera_timelapse_running %d\n", tl.running ? 1 : 0);
+      chunk_printf(w, "# TYPE camera_timelapse_shots_total counter\n");
+      chunk_printf(w, "camera_timelapse_shots_total{result=\"taken\"} %u\n", (unsigned)tl.taken);
+      chunk_printf(w, "camera_timelapse_shots_total{result=\"missed\"} %u\n", (unsigned)tl.missed);
+      chunk_printf(w, "camera_timelapse_shots_total{result=\"failed\"} %u\n", (unsigned)tl.failed);
+      chunk_printf(w, "# TYPE camera_timelapse_late_ms_max gauge\ncamera_timelapse_late_ms_max %u\n",
+                   (unsigned)tl.late_max_ms);
+      chunk_printf(w, "# TYPE camera_timelapse_staged_frames gauge\ncamera_timelapse_staged_frames %u\n", staged);
+      chunk_printf(w, "# TYPE camera_timelapse_staged_bytes gauge\ncamera_timelapse_staged_bytes %u\n",
+                   (unsigned)staged_bytes);
+      chunk_printf(w, "# TYPE camera_timelapse_evicted_total counter\ncamera_timelapse_evicted_total %u\n",
+                   (unsigned)evicted);
     }
-    
-    // Clean up: free JPEG buffer (from frame2jpg) and frame buffer if still held
-    if (_jpg_buf && fb == NULL) {
-      // We converted RGB565->JPEG, so free the JPEG buffer
-      free(_jpg_buf);
-      _jpg_buf = NULL;
-    }
-    if (fb) {
-      // Still holding frame buffer (fallback JPEG mode)
-      esp_camera_fb_return(fb);
-      fb = NULL;
+
+    // Camera arbitration: copied out under the lock (too big for this task's stack)
+    CameraArbiter *arb = camera_arbiter_lock ? (CameraArbiter *)malloc(sizeof(CameraArbiter)) : NULL;
+    if (arb) {
+      xSemaphoreTake(camera_arbiter_lock, portMAX_DELAY);
+      *arb = camera_arbiter;
+      xSemaphoreGive(camera_arbiter_lock);
+      chunk_printf(w, "# TYPE camera_arbiter_grants_total counter\n");
+      for (int c = 0; c < CAMERA_CLIENT_COUNT; c++)
+        chunk_printf(w, "camera_arbiter_grants_total{client=\"%s\"} %u\n", cameraClientName((CameraClient)c),
+                     (unsigned)arb->grants[c]);
+      chunk_printf(w, "# TYPE camera_arbiter_preemptions_total counter\ncamera_arbiter_preemptions_total %u\n",
+                   (unsigned)arb->preemptions);
+      chunk_printf(w, "# TYPE camera_arbiter_restores_total counter\ncamera_arbiter_restores_total %u\n",
+                   (unsigned)arb->restores);
+      chunk_printf(w, "# TYPE camera_arbiter_wait_ms summary\n");
+      for (int c = 0; c < CAMERA_CLIENT_COUNT; c++)
+        chunk_latency(w, "camera_arbiter_wait_ms", "client", cameraClientName((CameraClient)c), &arb->wait[c]);
+      chunk_printf(w, "# TYPE camera_snapshot_latency_ms summary\n");
+      chunk_latency(w, "camera_snapshot_latency_ms", "stream", "idle", &arb->snapshot[0]);
+      chunk_latency(w, "camera_snapshot_latency_ms", "stream", "active", &arb->snapshot[1]);
+      free(arb);
     }
-    
-    if (res != ESP_OK) {
-      printf("[STREAM] Send failed at frame %d, error: %d\n", frame_count, res);
-      Serial.printf("❌ Stream send failed at frame %d, error: %d\n", frame_count, res);
-      if (_jpg_buf) {
-        free(_jpg_buf);
-        _jpg_buf = NULL;
-      }
-      if (fb) {
-        esp_camera_fb_return(fb);
-        fb = NULL;
-      }
-      break;
+
+    // Image stats of the latest cached frame, if it was software-encoded
+    CachedFrame *frame = frameCacheAcquire();
+    if (frame && frame->stats) {
+      const JpegImageStats *st = frame->stats;
+      chunk_printf(w, "# TYPE camera_frame_luma_mean gauge\ncamera_frame_luma_mean %.2f\n", st->mean);
+      chunk_printf(w, "# TYPE camera_frame_clipped_ratio gauge\n");
+      chunk_printf(w, "camera_frame_clipped_ratio{side=\"low\"} %.5f\n", st->clipped_low);
+      chunk_printf(w, "camera_frame_clipped_ratio{side=\"high\"} %.5f\n", st->clipped_high);
+      chunk_printf(w, "# TYPE camera_frame_sharpness gauge\ncamera_frame_sharpness %.1f\n", st->sharpness);
     }
-    
-    frame_count++;
-    if (WiFi.status() != WL_CONNECTED) {
-      Serial.println("⚠️  WiFi lost during stream, stopping.");
-      if (fb) {
-        esp_camera_fb_return(fb);
-        fb = NULL;
+    frameCacheRelease(frame);
+  }
+
+  chunk_flush(w);
+  esp_err_t res = w->res;
+  free(w);
+  if (res == ESP_OK) res = httpd_resp_send_chunk(req, NULL, 0);
+  return res;
+}
+
+// /stats reuses a cached frame up to this old, otherwise it captures a new one
+#define STATS_MAX_AGE_MS  1000
+
+// Exposure/focus stats of the latest frame as JSON, computed in its encode pass (see
+// JpegImageStats); ?hist=1 adds the 256-bin luma histogram. While a stream runs this
+// is its current frame, otherwise one is captured at the current sensor mode. Only
+// software-encoded colour frames (≤SVGA) have stats.
+static esp_err_t stats_handler(httpd_req_t *req) {
+  char query[32];
+  bool have_query = httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK;
+  bool hist = query_int(have_query ? query : NULL, "hist", 0, 0, 1);
+
+  CachedFrame *frame = acquire_fresh_stream_frame(0, STATS_MAX_AGE_MS);
+  if (!frame) {
+    httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Camera capture failed");
+    return ESP_FAIL;
+  }
+  ChunkWriter *w = (ChunkWriter *)malloc(sizeof(ChunkWriter));
+  if (!w) {
+    frameCacheRelease(frame);
+    httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+    return ESP_FAIL;
+  }
+  w->req = req;
+  w->len = 0;
+  w->res = ESP_OK;
+
+  httpd_resp_set_type(req, "application/json");
+  httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+  httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+
+  chunk_printf(w, "{\"seq\":%u,\"age_ms\":%u,\"width\":%u,\"height\":%u,\"quality\":%d",
+               (unsigned)frame->seq, (unsigned)((esp_timer_get_time() - frame->timestamp_us) / 1000),
+               frame->width, frame->height, frame->quality);
+  const JpegImageStats *st = frame->stats;
+  if (!st) {
+    chunk_printf(w, ",\"available\":false,\"reason\":\"%s\"}",
+                 frame->grayscale ? "grayscale frame" : "hardware JPEG frame");
+  } else {
+    chunk_printf(w, ",\"available\":true,\"samples\":%u,\"mean\":%.2f,\"clipped_low\":%.5f,"
+                 "\"clipped_high\":%.5f,\"sharpness\":%.1f",
+                 (unsigned)st->samples, st->mean, st->clipped_low, st->clipped_high, st->sharpness);
+    if (hist) {
+      chunk_printf(w, ",\"histogram\":[");
+      for (int i = 0; i < 256; i += 8) {
+        char line[96];
+        int n = 0;
+        for (int j = i; j < i + 8; j++) n += snprintf(line + n, sizeof(line) - n, "%s%u", j ? "," : "", (unsigned)st->histogram[j]);
+        chunk_printf(w, "%s", line);
       }
-      break;
+      chunk_printf(w, "]");
     }
-    yield();
+    chunk_printf(w, "}");
   }
-  
-  Serial.println("🛑 Stream ended");
+  frameCacheRelease(frame);
+
+  chunk_flush(w);
+  esp_err_t res = w->res;
+  free(w);
+  if (res == ESP_OK) res = httpd_resp_send_chunk(req, NULL, 0);
   return res;
 }
 
@@ -527,7 +2384,7 @@ void startCameraServer() {
   config.recv_wait_timeout = 120;   // 2 minutes for large uploads
   config.send_wait_timeout = 120;   // 2 minutes for slow downloads
   config.max_resp_headers = 8;
-  config.max_uri_handlers = 8;
+  config.max_uri_handlers = 10;
   config.backlog_conn = 5;
   config.stack_size = 8192;
 
@@ -545,10 +2402,66 @@ void startCameraServer() {
     .user_ctx  = NULL
   };
 
+  httpd_uri_t bench_net_uri = {
+    .uri       = "/bench/net",
+    .method    = HTTP_GET,
+    .handler   = bench_net_handler,
+    .user_ctx  = NULL
+  };
+
+  httpd_uri_t bench_pipeline_uri = {
+    .uri       = "/bench/pipeline",
+    .method    = HTTP_GET,
+    .handler   = bench_pipeline_handler,
+    .user_ctx  = NULL
+  };
+
+  httpd_uri_t metrics_uri = {
+    .uri       = "/metrics",
+    .method    = HTTP_GET,
+    .handler   = metrics_handler,
+    .user_ctx  = NULL
+  };
+
+  httpd_uri_t raw_uri = {
+    .uri       = "/raw",
+    .method    = HTTP_GET,
+    .handler   = raw_handler,
+    .user_ctx  = NULL
+  };
+
+  httpd_uri_t stats_uri = {
+    .uri       = "/stats",
+    .method    = HTTP_GET,
+    .handler   = stats_handler,
+    .user_ctx  = NULL
+  };
+
+  httpd_uri_t timelapse_uri = {
+    .uri       = "/timelapse",
+    .method    = HTTP_GET,
+    .handler   = timelapse_handler,
+    .user_ctx  = NULL
+  };
+
+  httpd_uri_t timelapse_download_uri = {
+    .uri       = "/timelapse/download",
+    .method    = HTTP_GET,
+    .handler   = timelapse_download_handler,
+    .user_ctx  = NULL
+  };
+
   Serial.println("  Starting main HTTP server (port 80)...");
   if (httpd_start(&camera_httpd, &config) == ESP_OK) {
     httpd_register_uri_handler(camera_httpd, &index_uri);
     httpd_register_uri_handler(camera_httpd, &capture_uri);
+    httpd_register_uri_handler(camera_httpd, &bench_net_uri);
+    httpd_register_uri_handler(camera_httpd, &bench_pipeline_uri);
+    httpd_register_uri_handler(camera_httpd, &raw_uri);
+    httpd_register_uri_handler(camera_httpd, &metrics_uri);
+    httpd_register_uri_handler(camera_httpd, &stats_uri);
+    httpd_register_uri_handler(camera_httpd, &timelapse_uri);
+    httpd_register_uri_handler(camera_httpd, &timelapse_download_uri);
     Serial.println("  ✅ Main server started");
   } else {
     Serial.println("  ❌ Failed to start main server");
@@ -563,52 +2476,97 @@ void startCameraServer() {
     .user_ctx  = NULL
   };
 
+  httpd_uri_t raw_stream_uri = {
+    .uri       = "/raw/stream",
+    .method    = HTTP_GET,
+    .handler   = raw_stream_handler,
+    .user_ctx  = NULL
+  };
+
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+  httpd_uri_t ws_uri = {
+    .uri       = "/ws",
+    .method    = HTTP_GET,
+    .handler   = ws_stream_handler,
+    .user_ctx  = NULL,
+    .is_websocket = true
+  };
+#endif
+
   Serial.println("  Starting stream server (port 81)...");
   if (httpd_start(&stream_httpd, &config) == ESP_OK) {
     httpd_register_uri_handler(stream_httpd, &stream_uri);
+    httpd_register_uri_handler(stream_httpd, &raw_stream_uri);
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+    httpd_register_uri_handler(stream_httpd, &ws_uri);
+#endif
     Serial.println("  ✅ Stream server started");
   } else {
     Serial.println("  ❌ Failed to start stream server");
   }
+
+  Serial.printf("  Starting RTSP server (port %d)...\n", RTSP_PORT);
+  if (rtspServerStart(RTSP_PORT, rtsp_frame_source)) {
+    Serial.println("  ✅ RTSP server started");
+  } else {
+    Serial.println("  ❌ Failed to start RTSP server");
+  }
 }
 
 bool initCamera(framesize_t framesize) {
+  return initCamera(framesize, sensorPixformatFor(framesize, false));
+}
+
+bool initCamera(framesize_t framesize, pixformat_t pixformat, int fb_count) {
   Serial.printf("\n📷 Initializing camera at resolution %d...\n", framesize);
   
   camera_config_t config;
   config.ledc_channel = LEDC_CHANNEL_0;
   config.ledc_timer = LEDC_TIMER_0;
-  config.pin_d0 = CAM_PIN_D0;
-  config.pin_d1 = CAM_PIN_D1;
-  config.pin_d2 = CAM_PIN_D2;
-  config.pin_d3 = CAM_PIN_D3;
-  config.pin_d4 = CAM_PIN_D4;
-  config.pin_d5 = CAM_PIN_D5;
-  config.pin_d6 = CAM_PIN_D6;
-  config.pin_d7 = CAM_PIN_D7;
-  config.pin_xclk = CAM_PIN_XCLK;
-  config.pin_pclk = CAM_PIN_PCLK;
-  config.pin_vsync = CAM_PIN_VSYNC;
-  config.pin_href = CAM_PIN_HREF;
-  config.pin_sccb_sda = CAM_PIN_SIOD;
-  config.pin_sccb_scl = CAM_PIN_SIOC;
-  config.pin_pwdn = CAM_PIN_PWDN;
-  config.pin_reset = CAM_PIN_RESET;
+  config.pin_d0 = camera_profile->pin_d0;
+  config.pin_d1 = camera_profile->pin_d1;
+  config.pin_d2 = camera_profile->pin_d2;
+  config.pin_d3 = camera_profile->pin_d3;
+  config.pin_d4 = camera_profile->pin_d4;
+  config.pin_d5 = camera_profile->pin_d5;
+  config.pin_d6 = camera_profile->pin_d6;
+  config.pin_d7 = camera_profile->pin_d7;
+  config.pin_xclk = camera_profile->pin_xclk;
+  config.pin_pclk = camera_profile->pin_pclk;
+  config.pin_vsync = camera_profile->pin_vsync;
+  config.pin_href = camera_profile->pin_href;
+  config.pin_sccb_sda = camera_profile->pin_sccb_sda;
+  config.pin_sccb_scl = camera_profile->pin_sccb_scl;
+  config.pin_pwdn = camera_profile->pin_pwdn;
+  config.pin_reset = camera_profile->pin_reset;
   config.xclk_freq_hz = 20000000;
   
   // Dual-mode system:
-  // RGB565 (≤SVGA): Software JPEG encoding, bypasses OV2640 bugs, larger buffers
+  // YUV422 / RGB565 (≤SVGA): Software JPEG encoding, bypasses OV2640 bugs, larger buffers
   // JPEG (XGA+): Hardware JPEG encoding, small buffers, header patch required
-  if (shouldUseRGB565Mode(framesize)) {
+  // GRAYSCALE (any): Luma only, single-component software JPEG or raw
+  if (pixformat == PIXFORMAT_GRAYSCALE) {
+    config.pixel_format = PIXFORMAT_GRAYSCALE;
+    config.jpeg_quality = 12;  // Used by software encoder
+    config.fb_count = fb_count;  // 1 byte/pixel: UXGA is 1.9 MB per buffer
+    Serial.printf("  Mode: Grayscale + Software JPEG\n");
+    Serial.printf("  Reason: luma-only requested\n");
+  } else if (pixformat == PIXFORMAT_YUV422) {
+    config.pixel_format = PIXFORMAT_YUV422;
+    config.jpeg_quality = 12;  // Used by software encoder
+    config.fb_count = fb_count;  // Same 2 bytes/pixel as RGB565
+    Serial.printf("  Mode: YUV422 + Native Software JPEG\n");
+    Serial.printf("  Reason: ≤SVGA, no RGB round trip before encoding\n");
+  } else if (pixformat == PIXFORMAT_RGB565) {
     config.pixel_format = PIXFORMAT_RGB565;
     config.jpeg_quality = 12;  // Used by software encoder
-    config.fb_count = 2;       // Dual buffering for large RGB565 frames
+    config.fb_count = fb_count;  // Dual buffering for large RGB565 frames
     Serial.printf("  Mode: RGB565 + Software JPEG\n");
     Serial.printf("  Reason: ≤SVGA, reliable software encoding\n");
   } else {
     config.pixel_format = PIXFORMAT_JPEG;
     config.jpeg_quality = 6;   // Hardware JPEG quality (lower=better, 0-63, use 6 for high quality)
-    config.fb_count = 2;       // Dual buffering for stability
+    config.fb_count = fb_count;  // Dual buffering for stability
     Serial.printf("  Mode: Hardware JPEG + Header Patch\n");
     Serial.printf("  Reason: XGA+, high resolution needs hardware encoder\n");
   }
@@ -621,11 +2579,23 @@ bool initCamera(framesize_t framesize) {
   Serial.printf("  JPEG Quality: %d\n", config.jpeg_quality);
   Serial.printf("  Frame Buffers: %d (PSRAM)\n", config.fb_count);
 
+  // Time to the test frame below is the cold start latency (vs. a warm standby resume)
+  cameraStandbyReset();
+  int64_t init_start = esp_timer_get_time();
   esp_err_t err = esp_camera_init(&config);
   if (err != ESP_OK) {
+    memTagFail(MEM_TAG_CAMERA);
     Serial.printf("❌ Camera init failed with error 0x%x\n", err);
     return false;
   }
+
+  MemBudgetMode mode;
+  MemFootprint footprint;
+  cameraMemMode(framesize, config.pixel_format, config.fb_count, &mode);
+  memBudgetFootprint(&mode, &footprint);
+  camera_mem_bytes = footprint.camera_bytes;
+  camera_fb_count = config.fb_count;
+  memTagAlloc(MEM_TAG_CAMERA, camera_mem_bytes);
   
   Serial.println("✅ Camera initialized successfully");
   
@@ -667,7 +2637,11 @@ bool initCamera(framesize_t framesize) {
   Serial.println("🧪 Testing initial capture...");
   camera_fb_t *fb = esp_camera_fb_get();
   if (fb) {
-    Serial.printf("✅ Test capture OK: %u bytes, %dx%d\n", fb->len, fb->width, fb->height);
+    if (!first_frame_ms) first_frame_ms = millis();
+    uint32_t cold_ms = (esp_timer_get_time() - init_start) / 1000;
+    cameraStandbyRecordStart(CAMERA_START_COLD, cold_ms);
+    Serial.printf("✅ Test capture OK: %u bytes, %dx%d (cold start %u ms)\n", fb->len, fb->width, fb->height,
+                  (unsigned)cold_ms);
     esp_camera_fb_return(fb);
   } else {
     Serial.println("⚠️  Test capture failed");
@@ -676,11 +2650,138 @@ bool initCamera(framesize_t framesize) {
   return true;
 }
 
+// Boot sequencing: the camera initializes on its own task while this task
+// drives WiFi, connecting straight to the cached channel/BSSID when there is one
+#define BOOT_POLL_MS  20
+
+static BootSequencer boot_state;
+static QueueHandle_t boot_events = NULL;
+
+static void camera_boot_task(void *arg) {
+  bool from_cache = false;
+  camera_profile = boardDetect(&from_cache);
+  bool ok = initCamera();
+  if (!ok && from_cache) {
+    // Cached pin map no longer works (module moved to another board): probe again
+    printf("[BOOT] Camera init failed with cached profile '%s', probing\n", camera_profile->name);
+    boardDetectForget();
+    camera_profile = boardDetect(NULL);
+    ok = initCamera();
+  }
+  if (ok) boardDetectRemember(camera_profile);
+
+  BootEvent event = ok ? BOOT_EVENT_CAMERA_READY : BOOT_EVENT_CAMERA_FAILED;
+  xQueueSend(boot_events, &event, portMAX_DELAY);
+  vTaskDelete(NULL);
+}
+
+// Translate WiFi status into a boot event
+static BootEvent poll_wifi_event() {
+  switch (WiFi.status()) {
+    case WL_CONNECTED:      return BOOT_EVENT_WIFI_CONNECTED;
+    case WL_NO_SSID_AVAIL:
+    case WL_CONNECT_FAILED: return BOOT_EVENT_WIFI_FAILED;
+    default:                return BOOT_EVENT_TICK;
+  }
+}
+
+static void report_boot_failure() {
+  if (boot_state.camera == BOOT_CAMERA_FAILED) {
+    printf("ERROR: Camera init failed!\n");
+    Serial.println("❌ Camera initialization failed!");
+    return;
+  }
+
+  printf("ERROR: WiFi connection failed - status: %d\n", WiFi.status());
+  Serial.println("\n\n❌ WiFi connection failed!");
+  Serial.print("Final status: ");
+  wl_status_t status = WiFi.status();
+  switch(status) {
+    case WL_NO_SSID_AVAIL:   Serial.println("NO_SSID - Network not found! Check SSID name."); break;
+    case WL_CONNECT_FAILED:  Serial.println("CONNECT_FAILED - Wrong password or network security issue!"); break;
+    case WL_DISCONNECTED:    Serial.println("DISCONNECTED - Cannot associate with network!"); break;
+    default:                 Serial.printf("UNKNOWN (%d)\n", status); break;
+  }
+  Serial.println("\nTroubleshooting:");
+  Serial.println("1. Verify SSID and password in config.h");
+  Serial.println("2. Ensure WiFi is 2.4GHz (ESP32 doesn't support 5GHz)");
+  Serial.println("3. Check if router has MAC filtering enabled");
+  Serial.println("4. Try moving ESP32 closer to router");
+  Serial.println("5. Check power supply - use external 5V/2A if needed");
+}
+
+static void report_boot_ready() {
+  Serial.println("\n\n✅ WiFi connected!");
+  Serial.printf("IP Address: http://%s\n", WiFi.localIP().toString().c_str());
+  Serial.printf("Stream URL: http://%s:81/stream\n", WiFi.localIP().toString().c_str());
+  Serial.printf("RTSP URL: rtsp://%s/mjpeg\n", WiFi.localIP().toString().c_str());
+  Serial.printf("Signal Strength: %d dBm (channel %d)\n", WiFi.RSSI(), WiFi.channel());
+
+  Serial.println("\n================================================");
+  Serial.println("🎥 Camera Server Ready!");
+  Serial.println("================================================");
+  Serial.printf("📱 Open in browser: http://%s\n", WiFi.localIP().toString().c_str());
+  Serial.printf("⏱  First frame:  %lu ms after boot\n", (unsigned long)first_frame_ms);
+  Serial.printf("⏱  Camera ready: %lu ms after boot\n", (unsigned long)boot_state.camera_ms);
+  Serial.printf("⏱  WiFi up:      %lu ms after boot (%s)\n", (unsigned long)boot_state.wifi_ms,
+                boot_state.used_wifi_cache ? "cached channel/BSSID" : "full connect");
+  Serial.printf("⏱  Serving:      %lu ms after boot\n", (unsigned long)boot_state.ready_ms);
+  Serial.printf("Free heap after servers: %u bytes\n", ESP.getFreeHeap());
+  Serial.println("================================================\n");
+}
+
+static void runBootSequence() {
+  WifiCache cache;
+  bool have_cache = wifiCacheLoad(ssid, &cache);
+
+  boot_events = xQueueCreate(2, sizeof(BootEvent));
+  xTaskCreatePinnedToCore(camera_boot_task, "cam_boot", 6144, NULL, 5, NULL, 1);
+
+  uint32_t actions = bootSequencerBegin(&boot_state, have_cache, millis());
+  BootWifiState last_wifi = boot_state.wifi;
+  while (true) {
+    if (actions & BOOT_ACTION_CLEAR_WIFI_CACHE) {
+      printf("[BOOT] Cached association failed, clearing it\n");
+      wifiCacheClear();
+    }
+    if (actions & BOOT_ACTION_CONNECT_CACHED) {
+      printf("[BOOT] Connecting on cached channel %d\n", (int)cache.channel);
+      WiFi.begin(ssid, password, cache.channel, cache.bssid);
+    }
+    if (actions & BOOT_ACTION_CONNECT_FULL) {
+      printf("[BOOT] Connecting (full scan by driver)\n");
+      WiFi.disconnect();
+      WiFi.begin(ssid, password);
+    }
+    if (actions & BOOT_ACTION_SAVE_WIFI_CACHE) {
+      wifiCacheSave(ssid, WiFi.channel(), WiFi.BSSID());
+    }
+    if (actions & BOOT_ACTION_START_SERVERS) {
+      startCameraServer();
+      report_boot_ready();
+      break;
+    }
+    if (actions & BOOT_ACTION_REPORT_FAILURE) {
+      report_boot_failure();
+      break;
+    }
+
+    if (boot_state.wifi != last_wifi) {
+      printf("[BOOT] WiFi %s at %lu ms\n", bootWifiStateName(boot_state.wifi), millis());
+      last_wifi = boot_state.wifi;
+    }
+
+    BootEvent event;
+    if (xQueueReceive(boot_events, &event, pdMS_TO_TICKS(BOOT_POLL_MS)) != pdTRUE) {
+      event = poll_wifi_event();
+    }
+    actions = bootSequencerHandle(&boot_state, event, millis());
+  }
+}
 
 void setup() {
   Serial.begin(115200);
   Serial.setDebugOutput(true);
-  delay(3000);  // Longer delay for serial to stabilize
   
   // Use printf directly to bypass any filtering
   printf("\n\n\n================================================\n");
@@ -739,34 +2840,7 @@ void setup() {
   printf("Free Heap: %d bytes\n", ESP.getFreeHeap());
   printf("Chip ID: %llx\n", ESP.getEfuseMac());
   
-  printf("Step 8: Initializing camera...\n");
-  // Initialize camera
-  Serial.println("Initializing camera...");
-  if (!initCamera()) {
-    printf("ERROR: Camera init failed!\n");
-    Serial.println("❌ Camera initialization failed!");
-    return;
-  }
-  printf("Step 9: Camera OK\n");
-  Serial.println("✅ Camera initialized successfully!\n");
-  
-  // Test capture
-  printf("Step 10: Testing camera capture...\n");
-  Serial.println("Testing camera capture...");
-  camera_fb_t *fb = esp_camera_fb_get();
-  if (fb) {
-    printf("Step 11: Test capture OK - %d bytes\n", fb->len);
-    Serial.printf("✅ Test capture OK: %d bytes, %dx%d\n", 
-                  fb->len, fb->width, fb->height);
-    esp_camera_fb_return(fb);
-  } else {
-    printf("ERROR: Test capture failed!\n");
-    Serial.println("❌ Test capture failed!");
-    return;
-  }
-  
-  // Connect to WiFi with detailed diagnostics
-  printf("Step 12: Starting WiFi setup...\n");
+  printf("Step 8: Bringing up camera and WiFi...\n");
   Serial.println("\n================================================");
   Serial.println("📡 WiFi Configuration");
   Serial.println("================================================");
@@ -774,131 +2848,22 @@ void setup() {
   Serial.printf("Password: %s\n", password);
   Serial.printf("MAC Address: %s\n", WiFi.macAddress().c_str());
   Serial.println("================================================\n");
-  
-  printf("Step 13: Resetting WiFi...\n");
-  // Reset WiFi and configure mode
-  WiFi.disconnect(true);
-  WiFi.mode(WIFI_OFF);
-  delay(1000); // Longer delay for complete reset
-  
-  printf("Step 14: Configuring WiFi settings...\n");
-  // Configure WiFi settings BEFORE mode change (critical for Google WiFi)
+
+  // Configure WiFi settings before connecting (critical for Google WiFi)
   WiFi.persistent(false);
   WiFi.setAutoReconnect(true);
-  
   WiFi.mode(WIFI_STA);
-  
+
   // Google WiFi AUTH_EXPIRE fix: Disable power save and use max power
   WiFi.setSleep(WIFI_PS_NONE);
   WiFi.setTxPower(WIFI_POWER_19_5dBm);
-  
+
   // Use simple 802.11b/g for faster auth (avoid 802.11n negotiation delays)
   esp_wifi_set_protocol(WIFI_IF_STA, WIFI_PROTOCOL_11B | WIFI_PROTOCOL_11G);
-  
-  delay(500);
-  
-  printf("Step 15: Scanning for network...\n");
-  // Scan for network to get channel (speeds up connection)
-  Serial.println("Scanning for network...");
-  int n = WiFi.scanNetworks();
-  printf("Found %d networks\n", n);
-  int8_t target_channel = 0;
-  uint8_t *target_bssid = nullptr;
-  bool found = false;
-  
-  for (int i = 0; i < n; i++) {
-    if (WiFi.SSID(i) == String(ssid)) {
-      target_channel = WiFi.channel(i);
-      target_bssid = WiFi.BSSID(i);
-      printf("Step 16: Found network on channel %d\n", target_channel);
-      Serial.printf("Found '%s' on channel %d (RSSI: %d dBm)\n", 
-                    ssid, target_channel, WiFi.RSSI(i));
-      found = true;
-      break;
-    }
-  }
-  
-  if (!found) {
-    printf("WARNING: Network not found in scan\n");
-    Serial.println("⚠️  Network not found in scan! Trying anyway...");
-  }
-  
-  printf("Step 17: Connecting to WiFi...\n");
-  Serial.println("Starting WiFi connection...");
-  // Connect with specific channel if found (faster - skips scanning)
-  if (found && target_channel > 0) {
-    WiFi.begin(ssid, password, target_channel);
-    Serial.printf("Connecting on channel %d...\n", target_channel);
-  } else {
-    WiFi.begin(ssid, password);
-  }
-  
-  printf("Step 18: Waiting for WiFi connection...\n");
-  int attempts = 0;
-  while (WiFi.status() != WL_CONNECTED && attempts < 40) {
-    delay(500);
-    wl_status_t status = WiFi.status();
-    
-    // Print detailed status every 5 attempts
-    if (attempts % 5 == 0) {
-      printf("[Attempt %d/40] WiFi status: %d\n", attempts, status);
-      Serial.printf("\n[Attempt %d/40] Status: ", attempts);
-      switch(status) {
-        case WL_IDLE_STATUS:     Serial.print("IDLE"); break;
-        case WL_NO_SSID_AVAIL:   Serial.print("NO_SSID - Network not found!"); break;
-        case WL_SCAN_COMPLETED:  Serial.print("SCAN_COMPLETED"); break;
-        case WL_CONNECTED:       Serial.print("CONNECTED"); break;
-        case WL_CONNECT_FAILED:  Serial.print("CONNECT_FAILED - Wrong password?"); break;
-        case WL_CONNECTION_LOST: Serial.print("CONNECTION_LOST"); break;
-        case WL_DISCONNECTED:    Serial.print("DISCONNECTED"); break;
-        default:                 Serial.printf("UNKNOWN (%d)", status); break;
-      }
-      Serial.print(" ");
-    } else {
-      Serial.print(".");
-    }
-    attempts++;
-  }
-  
-  printf("Step 19: WiFi connection attempt complete\n");
-  if (WiFi.status() == WL_CONNECTED) {
-    printf("Step 20: WiFi connected! IP: %s\n", WiFi.localIP().toString().c_str());
-    Serial.println("\n\n✅ WiFi connected!");
-    Serial.printf("IP Address: http://%s\n", WiFi.localIP().toString().c_str());
-    Serial.printf("Stream URL: http://%s:81/stream\n", WiFi.localIP().toString().c_str());
-    Serial.printf("Signal Strength: %d dBm\n", WiFi.RSSI());
-    Serial.printf("Free heap after WiFi: %u bytes\n\n", ESP.getFreeHeap());
-    
-    printf("Step 21: Starting web servers...\n");
-    // Start web server
-    startCameraServer();
-    
-    printf("Step 22: Servers started!\n");
-    Serial.println("\n================================================");
-    Serial.println("🎥 Camera Server Ready!");
-    Serial.println("================================================");
-    Serial.printf("📱 Open in browser: http://%s\n", WiFi.localIP().toString().c_str());
-    Serial.printf("Free heap after servers: %u bytes\n", ESP.getFreeHeap());
-    Serial.println("================================================\n");
-    printf("Step 23: Setup complete - entering loop\n");
-  } else {
-    printf("ERROR: WiFi connection failed - status: %d\n", WiFi.status());
-    Serial.println("\n\n❌ WiFi connection failed!");
-    Serial.print("Final status: ");
-    wl_status_t status = WiFi.status();
-    switch(status) {
-      case WL_NO_SSID_AVAIL:   Serial.println("NO_SSID - Network not found! Check SSID name."); break;
-      case WL_CONNECT_FAILED:  Serial.println("CONNECT_FAILED - Wrong password or network security issue!"); break;
-      case WL_DISCONNECTED:    Serial.println("DISCONNECTED - Cannot associate with network!"); break;
-      default:                 Serial.printf("UNKNOWN (%d)\n", status); break;
-    }
-    Serial.println("\nTroubleshooting:");
-    Serial.println("1. Verify SSID and password in config.h");
-    Serial.println("2. Ensure WiFi is 2.4GHz (ESP32 doesn't support 5GHz)");
-    Serial.println("3. Check if router has MAC filtering enabled");
-    Serial.println("4. Try moving ESP32 closer to router");
-    Serial.println("5. Check power supply - use external 5V/2A if needed");
-  }
+
+  cameraStandbyInit(LEDC_TIMER_0, CAMERA_IDLE_TIMEOUT_S * 1000);
+  camera_arbiter_init();
+  runBootSequence();
 }
 
 void loop() {
@@ -911,6 +2876,20 @@ void loop() {
   
   delay(5000);
   esp_task_wdt_reset();
+
+  // Nobody captured for CAMERA_IDLE_TIMEOUT_S: sensor standby until the next request.
+  // Idle class: skipped while anyone holds or wants the camera, so XCLK never stops mid-capture
+  if (camera_try_acquire(CAMERA_CLIENT_IDLE)) {
+    cameraStandbyPoll();
+    camera_release();
+  }
+
+  // Heap/PSRAM fragmentation history for /metrics?history=1
+  static unsigned long last_mem_sample = 0;
+  if (millis() - last_mem_sample >= MEM_SAMPLE_PERIOD_MS) {
+    memTelemetrySample(MEM_EVENT_PERIODIC);
+    last_mem_sample = millis();
+  }
   
   static unsigned long last_status = 0;
   static bool was_connected = false;
@@ -960,8 +2939,11 @@ void loop() {
       Serial.printf("⚠️  WiFi disconnected! Reconnect attempt %d (backoff: %ds)\n", 
                     reconnect_attempts, backoff_delay/1000);
       
-      // Google WiFi has aggressive rate limiting - after 3-4 reconnects, do full reboot
-      if (reconnect_attempts >= 4) {
+      // Google WiFi has aggressive rate limiting - after 3-4 reconnects, do full reboot.
+      // Not while a time-lapse runs or has frames staged: a reset would lose them all
+      if (reconnect_attempts >= 4 && timelapse_busy()) {
+        if (reconnect_attempts == 4) printf("[REBOOT] Skipped: time-lapse running or frames staged\n");
+      } else if (reconnect_attempts >= 4) {
         printf("[REBOOT] Too many reconnect failures - restarting ESP32\n");
         Serial.println("🔄 Too many reconnect failures - rebooting to reset WiFi state...");
         Serial.println("(Google WiFi Pods have aggressive rate limiting)");
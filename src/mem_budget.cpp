@@ -0,0 +1,94 @@
+#include "mem_budget.h"
+
+void memBudgetFootprint(const MemBudgetMode *mode, MemFootprint *out) {
+  size_t pixels = (size_t)mode->width * mode->height;
+  size_t jpeg_estimate = pixels / 5;  // esp32-camera's JPEG buffer size, also a safe JPEG bound
+
+  switch (mode->format) {
+    case MEM_FORMAT_JPEG:
+      out->fb_bytes = jpeg_estimate;
+      out->encode_bytes = jpeg_estimate;  // Requantized copy
+      break;
+    case MEM_FORMAT_RGB565:
+    case MEM_FORMAT_YUV422:
+      out->fb_bytes = pixels * 2;
+      out->encode_bytes = pixels / 4;  // The native encoder starts at w*h/8 and doubles
+      break;
+    case MEM_FORMAT_GRAY:
+    default:
+      out->fb_bytes = pixels;
+      out->encode_bytes = MEM_BUDGET_FRAME2JPG_OUT;
+      break;
+  }
+  out->camera_bytes = out->fb_bytes * mode->fb_count;
+  out->cache_bytes = 2 * jpeg_estimate;
+  out->total_bytes = out->camera_bytes + out->encode_bytes + out->cache_bytes;
+}
+
+static bool fits(const MemFootprint *fp, size_t available, size_t block) {
+  return fp->fb_bytes <= block && fp->total_bytes + MEM_BUDGET_PSRAM_RESERVE <= available;
+}
+
+void memBudgetPlan(const MemBudgetMode *target, const MemBudgetMode *current,
+                   const MemRegionState *psram, size_t flushable, MemPlan *plan) {
+  size_t released = 0, released_block = 0;
+  if (current) {
+    MemFootprint cur;
+    memBudgetFootprint(current, &cur);
+    released = cur.camera_bytes;
+    released_block = cur.fb_bytes;
+  }
+
+  plan->available_bytes = psram->free_bytes + released;
+  plan->available_block = psram->largest_block > released_block ? psram->largest_block : released_block;
+  plan->fb_count = target->fb_count;
+  memBudgetFootprint(target, &plan->footprint);
+
+  if (fits(&plan->footprint, plan->available_bytes, plan->available_block)) {
+    plan->action = MEM_PLAN_OK;
+    return;
+  }
+
+  size_t flushed = plan->available_bytes + flushable;
+  if (fits(&plan->footprint, flushed, plan->available_block)) {
+    plan->action = MEM_PLAN_FLUSH_FIRST;
+    plan->available_bytes = flushed;
+    return;
+  }
+
+  // Fewer buffers: slower (no capture/encode overlap) but it comes up
+  MemBudgetMode reduced = *target;
+  while (reduced.fb_count > 1) {
+    reduced.fb_count--;
+    memBudgetFootprint(&reduced, &plan->footprint);
+    if (fits(&plan->footprint, flushed, plan->available_block)) {
+      plan->action = MEM_PLAN_REDUCE_FB;
+      plan->fb_count = reduced.fb_count;
+      plan->available_bytes = flushed;
+      return;
+    }
+  }
+
+  memBudgetFootprint(target, &plan->footprint);
+  plan->action = MEM_PLAN_REFUSE;
+}
+
+const char *memPlanActionName(MemPlanAction action) {
+  switch (action) {
+    case MEM_PLAN_OK:          return "ok";
+    case MEM_PLAN_FLUSH_FIRST: return "flush_first";
+    case MEM_PLAN_REDUCE_FB:   return "reduce_fb";
+    case MEM_PLAN_REFUSE:      return "refuse";
+  }
+  return "unknown";
+}
+
+const char *memPixelFormatName(MemPixelFormat format) {
+  switch (format) {
+    case MEM_FORMAT_JPEG:   return "jpeg";
+    case MEM_FORMAT_RGB565: return "rgb565";
+    case MEM_FORMAT_YUV422: return "yuv422";
+    case MEM_FORMAT_GRAY:   return "gray";
+  }
+  return "unknown";
+}
@@ -0,0 +1,139 @@
+#include "mem_telemetry.h"
+
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+
+// Counters are updated from the httpd, RTSP and camera tasks; the critical section
+// only covers the arithmetic
+static portMUX_TYPE s_mux = portMUX_INITIALIZER_UNLOCKED;
+static MemTagStats s_tags[MEM_TAG_COUNT];
+static MemSample s_history[MEM_HISTORY_LEN];
+static int s_history_next = 0;
+static int s_history_count = 0;
+static uint32_t s_events[MEM_EVENT_COUNT];
+static size_t s_lowest_block[MEM_REGION_COUNT] = {SIZE_MAX, SIZE_MAX};
+
+static const uint32_t REGION_CAPS[MEM_REGION_COUNT] = {
+  MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT,
+  MALLOC_CAP_SPIRAM
+};
+
+void memTagAlloc(MemTag tag, size_t bytes) {
+  taskENTER_CRITICAL(&s_mux);
+  MemTagStats &t = s_tags[tag];
+  t.bytes += bytes;
+  t.allocs++;
+  if (t.bytes > t.peak_bytes) t.peak_bytes = t.bytes;
+  taskEXIT_CRITICAL(&s_mux);
+}
+
+void memTagFree(MemTag tag, size_t bytes) {
+  taskENTER_CRITICAL(&s_mux);
+  MemTagStats &t = s_tags[tag];
+  t.bytes = t.bytes > bytes ? t.bytes - bytes : 0;
+  taskEXIT_CRITICAL(&s_mux);
+}
+
+void memTagFail(MemTag tag) {
+  taskENTER_CRITICAL(&s_mux);
+  s_tags[tag].failures++;
+  taskEXIT_CRITICAL(&s_mux);
+}
+
+void memTagTransfer(MemTag from, MemTag to, size_t bytes) {
+  taskENTER_CRITICAL(&s_mux);
+  MemTagStats &f = s_tags[from];
+  MemTagStats &t = s_tags[to];
+  f.bytes = f.bytes > bytes ? f.bytes - bytes : 0;
+  t.bytes += bytes;
+  if (t.bytes > t.peak_bytes) t.peak_bytes = t.bytes;
+  taskEXIT_CRITICAL(&s_mux);
+}
+
+void memTagGet(MemTag tag, MemTagStats *out) {
+  taskENTER_CRITICAL(&s_mux);
+  *out = s_tags[tag];
+  taskEXIT_CRITICAL(&s_mux);
+}
+
+const char *memTagName(MemTag tag) {
+  switch (tag) {
+    case MEM_TAG_CAMERA: return "camera";
+    case MEM_TAG_ENCODE: return "encode";
+    case MEM_TAG_SEND:   return "send";
+    case MEM_TAG_CACHE:  return "cache";
+    case MEM_TAG_TIMELAPSE: return "timelapse";
+    default:             return "unknown";
+  }
+}
+
+void memRegionSample(MemRegion region, MemRegionSample *out) {
+  multi_heap_info_t info;
+  heap_caps_get_info(&info, REGION_CAPS[region]);
+  out->total_bytes = heap_caps_get_total_size(REGION_CAPS[region]);
+  out->free_bytes = info.total_free_bytes;
+  out->largest_block = info.largest_free_block;
+  out->min_free_bytes = info.minimum_free_bytes;
+}
+
+const char *memRegionName(MemRegion region) {
+  return region == MEM_REGION_PSRAM ? "psram" : "internal";
+}
+
+unsigned memFragmentationPct(const MemRegionSample *sample) {
+  if (sample->free_bytes == 0) return 0;
+  return 100 - (unsigned)((uint64_t)sample->largest_block * 100 / sample->free_bytes);
+}
+
+void memTelemetrySample(MemEvent event) {
+  MemSample sample;
+  sample.uptime_s = (uint32_t)(esp_timer_get_time() / 1000000);
+  sample.event = event;
+  for (int r = 0; r < MEM_REGION_COUNT; r++) memRegionSample((MemRegion)r, &sample.region[r]);
+
+  taskENTER_CRITICAL(&s_mux);
+  s_history[s_history_next] = sample;
+  s_history_next = (s_history_next + 1) % MEM_HISTORY_LEN;
+  if (s_history_count < MEM_HISTORY_LEN) s_history_count++;
+  s_events[event]++;
+  for (int r = 0; r < MEM_REGION_COUNT; r++) {
+    if (sample.region[r].largest_block < s_lowest_block[r]) s_lowest_block[r] = sample.region[r].largest_block;
+  }
+  taskEXIT_CRITICAL(&s_mux);
+}
+
+size_t memTelemetryLowestBlock(MemRegion region) {
+  taskENTER_CRITICAL(&s_mux);
+  size_t lowest = s_lowest_block[region];
+  taskEXIT_CRITICAL(&s_mux);
+  return lowest == SIZE_MAX ? 0 : lowest;
+}
+
+uint32_t memTelemetryEventCount(MemEvent event) {
+  taskENTER_CRITICAL(&s_mux);
+  uint32_t count = s_events[event];
+  taskEXIT_CRITICAL(&s_mux);
+  return count;
+}
+
+const char *memEventName(MemEvent event) {
+  switch (event) {
+    case MEM_EVENT_PERIODIC:       return "periodic";
+    case MEM_EVENT_REINIT_BEFORE:  return "reinit_before";
+    case MEM_EVENT_REINIT_AFTER:   return "reinit_after";
+    case MEM_EVENT_REINIT_FAILED:  return "reinit_failed";
+    case MEM_EVENT_REINIT_REFUSED: return "reinit_refused";
+    default:                       return "unknown";
+  }
+}
+
+int memTelemetryHistory(MemSample *out, int max) {
+  taskENTER_CRITICAL(&s_mux);
+  int n = s_history_count < max ? s_history_count : max;
+  int start = (s_history_next - n + MEM_HISTORY_LEN) % MEM_HISTORY_LEN;
+  for (int i = 0; i < n; i++) out[i] = s_history[(start + i) % MEM_HISTORY_LEN];
+  taskEXIT_CRITICAL(&s_mux);
+  return n;
+}
@@ -0,0 +1,124 @@
+#include "rtp_jpeg.h"
+
+#include <string.h>
+
+bool rtpJpegParse(const uint8_t *jpg, size_t len, RtpJpegInfo *info, uint8_t *qtable_storage) {
+  memset(info, 0, sizeof(*info));
+  if (len < 4 || jpg[0] != 0xFF || jpg[1] != 0xD8) return false;
+
+  const uint8_t *qt[4] = {NULL, NULL, NULL, NULL};
+  int tq_luma = -1, tq_chroma = -1;
+  const uint8_t *p = jpg + 2;
+  const uint8_t *end = jpg + len;
+
+  while (p + 4 <= end) {
+    if (p[0] != 0xFF) return false;
+    uint8_t m = p[1];
+    if (m == 0xFF) {
+      p++;  // fill byte
+      continue;
+    }
+    int seg_len = (p[2] << 8) | p[3];
+    const uint8_t *seg = p + 4;
+    const uint8_t *seg_end = p + 2 + seg_len;
+    if (seg_len < 2 || seg_end > end) return false;
+
+    switch (m) {
+      case 0xDB:  // DQT: only 8-bit tables can be carried in-band
+        while (seg + 65 <= seg_end) {
+          if ((seg[0] >> 4) != 0 || (seg[0] & 0x0F) > 3) return false;
+          qt[seg[0] & 0x03] = seg + 1;
+          seg += 65;
+        }
+        break;
+      case 0xC0: {  // Baseline SOF: must be YCbCr with 2x1 or 2x2 luma sampling
+        if (seg_len != 17 || seg[0] != 8 || seg[5] != 3) return false;
+        info->height = (seg[1] << 8) | seg[2];
+        info->width = (seg[3] << 8) | seg[4];
+        uint8_t y_samp = seg[7];
+        if (seg[10] != 0x11 || seg[13] != 0x11) return false;
+        if (y_samp == 0x21) {
+          info->type = 0;
+        } else if (y_samp == 0x22) {
+          info->type = 1;
+        } else {
+          return false;
+        }
+        tq_luma = seg[8] & 0x03;
+        tq_chroma = seg[11] & 0x03;
+        break;
+      }
+      case 0xDD:  // DRI
+        if (seg_len != 4) return false;
+        info->restart_interval = (seg[0] << 8) | seg[1];
+        break;
+      case 0xDA: {  // SOS: the rest up to EOI is the payload
+        if (tq_luma < 0 || !qt[tq_luma] || !qt[tq_chroma]) return false;
+        const uint8_t *data = seg_end;
+        const uint8_t *eoi = end;
+        // Hardware frames can carry padding after EOI
+        while (eoi - 2 >= data && !(eoi[-2] == 0xFF && eoi[-1] == 0xD9)) eoi--;
+        if (eoi - 2 < data) return false;
+        if (info->width == 0 || info->height == 0 || info->width > 2040 || info->height > 2040) return false;
+
+        memcpy(qtable_storage, qt[tq_luma], 64);
+        memcpy(qtable_storage + 64, qt[tq_chroma], 64);
+        info->qtables = qtable_storage;
+        info->qtable_len = 128;
+        if (info->restart_interval) info->type |= 64;
+        info->scan = data;
+        info->scan_len = (eoi - 2) - data;
+        return true;
+      }
+      default:
+        // Progressive / lossless / arithmetic coding can't be carried
+        if (m >= 0xC1 && m <= 0xCF && m != 0xC4 && m != 0xC8 && m != 0xCC) return false;
+        break;  // APPn, COM, DHT (standard tables are implied by RFC 2435)
+    }
+    p = seg_end;
+  }
+  return false;
+}
+
+
+size_t rtpJpegFragment(const RtpJpegInfo *info, size_t *offset, uint8_t *out, size_t max_len) {
+  size_t off = *offset;
+  size_t header_len = RTP_JPEG_HEADER_LEN + (info->restart_interval ? RTP_JPEG_RESTART_LEN : 0) +
+                      (off == 0 ? RTP_JPEG_QTABLE_LEN + info->qtable_len : 0);
+  if (max_len <= header_len || off >= info->scan_len) return 0;
+
+  uint8_t *p = out;
+  // Main JPEG header
+  p[0] = 0;  // type-specific
+  p[1] = (uint8_t)(off >> 16);
+  p[2] = (uint8_t)(off >> 8);
+  p[3] = (uint8_t)off;
+  p[4] = info->type;
+  p[5] = 255;  // Q >= 128: quantization tables sent in-band
+  p[6] = (uint8_t)(info->width / 8);
+  p[7] = (uint8_t)(info->height / 8);
+  p += RTP_JPEG_HEADER_LEN;
+  if (info->restart_interval) {
+    // Restart marker header; F=L=1 and count 0x3FFF: fragments not restart-aligned
+    p[0] = (uint8_t)(info->restart_interval >> 8);
+    p[1] = (uint8_t)info->restart_interval;
+    p[2] = 0xFF;
+    p[3] = 0xFF;
+    p += RTP_JPEG_RESTART_LEN;
+  }
+  if (off == 0) {
+    // Quantization table header, first packet only
+    p[0] = 0;  // MBZ
+    p[1] = 0;  // 8-bit precision for both tables
+    p[2] = 0;
+    p[3] = info->qtable_len;
+    memcpy(p + RTP_JPEG_QTABLE_LEN, info->qtables, info->qtable_len);
+    p += RTP_JPEG_QTABLE_LEN + info->qtable_len;
+  }
+
+  size_t chunk = info->scan_len - off;
+  if (chunk > max_len - header_len) chunk = max_len - header_len;
+  memcpy(p, info->scan + off, chunk);
+  *offset = off + chunk;
+  return header_len + chunk;
+}
@@ -0,0 +1,365 @@
+#include "rtsp_server.h"
+#include "rtp_jpeg.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_system.h"    // esp_random()
+#include "lwip/sockets.h"
+
+#define RTSP_RECV_BUF       1024
+#define RTP_MAX_PACKET      1400   // Stay below the Wi-Fi MTU including IP/UDP headers
+#define RTP_HEADER_LEN      12
+#define RTP_PT_JPEG         26
+#define RTSP_TCP_SEND_TIMEOUT_S 2  // A TCP subscriber this far behind is dropped
+
+struct RtspSession {
+  int sock;                  // RTSP control connection, -1 = free slot
+  uint32_t id;
+  bool setup;                // SETUP succeeded: a transport is configured
+  bool playing;
+  bool tcp;                  // RTP interleaved on the RTSP connection
+  uint8_t rtp_channel;
+  struct sockaddr_in rtp_addr;  // UDP destination
+  uint16_t rtp_seq;
+  uint32_t ssrc;
+  char rx[RTSP_RECV_BUF];
+  size_t rx_len;
+};
+
+static RtspSession s_sessions[RTSP_MAX_SESSIONS];
+static int s_listen_sock = -1;
+static int s_udp_sock = -1;
+static uint16_t s_port = RTSP_PORT;
+static RtspFrameSource s_source = NULL;
+static volatile int s_playing = 0;
+
+static void closeSession(RtspSession *sess) {
+  if (sess->sock < 0) return;
+  printf("[RTSP] Session %08x closed\n", (unsigned)sess->id);
+  close(sess->sock);
+  if (sess->playing) s_playing--;
+  sess->sock = -1;
+  sess->playing = false;
+}
+
+// Send one RTP packet (header is written here) to every playing subscriber.
+// payload points RTP_HEADER_LEN + 4 bytes into a buffer reserved for the headers.
+static void sendRtpPacket(uint8_t *pkt, size_t payload_len, bool marker, uint32_t rtp_ts) {
+  uint8_t *rtp = pkt + 4;
+  for (int i = 0; i < RTSP_MAX_SESSIONS; i++) {
+    RtspSession *sess = &s_sessions[i];
+    if (sess->sock < 0 || !sess->playing) continue;
+
+    rtp[0] = 0x80;  // V=2
+    rtp[1] = (marker ? 0x80 : 0x00) | RTP_PT_JPEG;
+    rtp[2] = (uint8_t)(sess->rtp_seq >> 8);
+    rtp[3] = (uint8_t)sess->rtp_seq;
+    rtp[4] = (uint8_t)(rtp_ts >> 24);
+    rtp[5] = (uint8_t)(rtp_ts >> 16);
+    rtp[6] = (uint8_t)(rtp_ts >> 8);
+    rtp[7] = (uint8_t)rtp_ts;
+    rtp[8] = (uint8_t)(sess->ssrc >> 24);
+    rtp[9] = (uint8_t)(sess->ssrc >> 16);
+    rtp[10] = (uint8_t)(sess->ssrc >> 8);
+    rtp[11] = (uint8_t)sess->ssrc;
+    sess->rtp_seq++;
+
+    size_t rtp_len = RTP_HEADER_LEN + payload_len;
+    if (sess->tcp) {
+      // RFC 2326 10.12 interleaved frame: '$', channel, 16-bit length
+      pkt[0] = '$';
+      pkt[1] = sess->rtp_channel;
+      pkt[2] = (uint8_t)(rtp_len >> 8);
+      pkt[3] = (uint8_t)rtp_len;
+      if (send(sess->sock, pkt, rtp_len + 4, 0) != (int)(rtp_len + 4)) {
+        printf("[RTSP] TCP subscriber too slow or gone\n");
+        closeSession(sess);
+      }
+    } else {
+      sendto(s_udp_sock, rtp, rtp_len, 0, (struct sockaddr *)&sess->rtp_addr, sizeof(sess->rtp_addr));
+    }
+  }
+}
+
+// Packetize one frame per RFC 2435 and fan it out to all subscribers
+static bool sendFrame(const CachedFrame *frame) {
+  static uint8_t pkt[4 + RTP_MAX_PACKET];
+  uint8_t qtables[128];
+  RtpJpegInfo info;
+  if (!rtpJpegParse(frame->buf, frame->len, &info, qtables)) return false;
+
+  uint32_t rtp_ts = (uint32_t)(frame->timestamp_us * 9 / 100);  // 90 kHz clock
+  size_t offset = 0;
+  while (offset < info.scan_len) {
+    size_t payload_len = rtpJpegFragment(&info, &offset, pkt + 4 + RTP_HEADER_LEN,
+                                         RTP_MAX_PACKET - RTP_HEADER_LEN);
+    if (payload_len == 0) return false;
+    sendRtpPacket(pkt, payload_len, offset == info.scan_len, rtp_ts);
+  }
+  return true;
+}
+
+static const char *headerValue(const char *req, const char *name, char *out, size_t out_len) {
+  size_t name_len = strlen(name);
+  for (const char *line = strstr(req, "\r\n"); line; line = strstr(line + 2, "\r\n")) {
+    const char *h = line + 2;
+    if (strncasecmp(h, name, name_len) == 0 && h[name_len] == ':') {
+      h += name_len + 1;
+      while (*h == ' ') h++;
+      size_t n = strcspn(h, "\r\n");
+      if (n >= out_len) n = out_len - 1;
+      memcpy(out, h, n);
+      out[n] = 0;
+      return out;
+    }
+  }
+  return NULL;
+}
+
+static void sendReply(RtspSession *sess, const char *status, const char *cseq,
+                      const char *extra_headers, const char *body) {
+  char reply[768];
+  int n = snprintf(reply, sizeof(reply),
+                   "RTSP/1.0 %s\r\nCSeq: %s\r\nServer: ESP32-S3-CAM\r\n%s",
+                   status, cseq, extra_headers ? extra_headers : "");
+  if (body) {
+    n += snprintf(reply + n, sizeof(reply) - n, "Content-Length: %u\r\n\r\n%s",
+                  (unsigned)strlen(body), body);
+  } else {
+    n += snprintf(reply + n, sizeof(reply) - n, "\r\n");
+  }
+  if (n > (int)sizeof(reply)) n = sizeof(reply);
+  send(sess->sock, reply, n, 0);
+}
+
+static void handleRequest(RtspSession *sess, char *req) {
+  char method[16] = "", url[128] = "", cseq[16] = "0", transport[160], hdrs[320];
+  int fields = sscanf(req, "%15s %127s", method, url);
+  headerValue(req, "CSeq", cseq, sizeof(cseq));
+  printf("[RTSP] %s %s (CSeq %s)\n", method, url, cseq);
+  if (fields < 2) {
+    sendReply(sess, "400 Bad Request", cseq, NULL, NULL);
+    return;
+  }
+
+  if (strcmp(method, "OPTIONS") == 0) {
+    sendReply(sess, "200 OK", cseq,
+              "Public: OPTIONS, DESCRIBE, SETUP, PLAY, TEARDOWN, GET_PARAMETER\r\n", NULL);
+  } else if (strcmp(method, "DESCRIBE") == 0) {
+    struct sockaddr_in local;
+    socklen_t local_len = sizeof(local);
+    getsockname(sess->sock, (struct sockaddr *)&local, &local_len);
+    char ip[16];
+    inet_ntoa_r(local.sin_addr, ip, sizeof(ip));
+
+    char sdp[256];
+    snprintf(sdp, sizeof(sdp),
+             "v=0\r\n"
+             "o=- %u 1 IN IP4 %s\r\n"
+             "s=ESP32-S3 Camera\r\n"
+             "c=IN IP4 0.0.0.0\r\n"
+             "t=0 0\r\n"
+             "m=video 0 RTP/AVP %d\r\n"
+             "a=control:track1\r\n",
+             (unsigned)sess->id, ip, RTP_PT_JPEG);
+    const char *base = url[strlen(url) - 1] == '/' ? "" : "/";
+    snprintf(hdrs, sizeof(hdrs), "Content-Base: %s%s\r\nContent-Type: application/sdp\r\n", url, base);
+    sendReply(sess, "200 OK", cseq, hdrs, sdp);
+  } else if (strcmp(method, "SETUP") == 0) {
+    if (!headerValue(req, "Transport", transport, sizeof(transport))) {
+      sendReply(sess, "461 Unsupported Transport", cseq, NULL, NULL);
+      return;
+    }
+    const char *interleaved = strstr(transport, "interleaved=");
+    if (strstr(transport, "RTP/AVP/TCP") || interleaved) {
+      int ch = interleaved ? atoi(interleaved + 12) : 0;
+      sess->tcp = true;
+      sess->rtp_channel = (uint8_t)ch;
+      snprintf(hdrs, sizeof(hdrs),
+               "Transport: RTP/AVP/TCP;unicast;interleaved=%d-%d;ssrc=%08X\r\n"
+               "Session: %08X;timeout=60\r\n",
+               ch, ch + 1, (unsigned)sess->ssrc, (unsigned)sess->id);
+    } else {
+      const char *cp = strstr(transport, "client_port=");
+      if (!cp) {
+        sendReply(sess, "461 Unsupported Transport", cseq, NULL, NULL);
+        return;
+      }
+      int rtp_port = atoi(cp + 12);
+      socklen_t peer_len = sizeof(sess->rtp_addr);
+      getpeername(sess->sock, (struct sockaddr *)&sess->rtp_addr, &peer_len);
+      sess->rtp_addr.sin_port = htons(rtp_port);
+      sess->tcp = false;
+      snprintf(hdrs, sizeof(hdrs),
+               "Transport: RTP/AVP;unicast;client_port=%d-%d;server_port=%d-%d;ssrc=%08X\r\n"
+               "Session: %08X;timeout=60\r\n",
+               rtp_port, rtp_port + 1, RTSP_RTP_PORT, RTSP_RTP_PORT + 1,
+               (unsigned)sess->ssrc, (unsigned)sess->id);
+    }
+    sess->setup = true;
+    sendReply(sess, "200 OK", cseq, hdrs, NULL);
+  } else if (strcmp(method, "PLAY") == 0) {
+    if (!sess->setup) {
+      // No transport yet: there is nowhere to send RTP
+      sendReply(sess, "455 Method Not Valid in This State", cseq, NULL, NULL);
+      return;
+    }
+    if (!sess->playing) {
+      sess->playing = true;
+      s_playing++;
+    }
+    snprintf(hdrs, sizeof(hdrs), "Session: %08X\r\nRange: npt=0.000-\r\n", (unsigned)sess->id);
+    sendReply(sess, "200 OK", cseq, hdrs, NULL);
+    printf("[RTSP] Session %08x playing over %s\n", (unsigned)sess->id, sess->tcp ? "TCP" : "UDP");
+  } else if (strcmp(method, "TEARDOWN") == 0) {
+    snprintf(hdrs, sizeof(hdrs), "Session: %08X\r\n", (unsigned)sess->id);
+    sendReply(sess, "200 OK", cseq, hdrs, NULL);
+    closeSession(sess);
+  } else if (strcmp(method, "GET_PARAMETER") == 0 || strcmp(method, "SET_PARAMETER") == 0) {
+    snprintf(hdrs, sizeof(hdrs), "Session: %08X\r\n", (unsigned)sess->id);
+    sendReply(sess, "200 OK", cseq, hdrs, NULL);  // keep-alive
+  } else {
+    sendReply(sess, "405 Method Not Allowed", cseq, NULL, NULL);
+  }
+}
+
+// Consume complete requests from the receive buffer; skips interleaved RTCP from clients
+static void processInput(RtspSession *sess) {
+  while (sess->sock >= 0 && sess->rx_len > 0) {
+    if (sess->rx[0] == '$') {
+      if (sess->rx_len < 4) return;
+      size_t frame_len = 4 + (((uint8_t)sess->rx[2] << 8) | (uint8_t)sess->rx[3]);
+      if (sess->rx_len < frame_len) {
+        if (frame_len > sizeof(sess->rx)) sess->rx_len = 0;  // can't buffer it, resync
+        return;
+      }
+      memmove(sess->rx, sess->rx + frame_len, sess->rx_len - frame_len);
+      sess->rx_len -= frame_len;
+      continue;
+    }
+    sess->rx[sess->rx_len] = 0;
+    char *end = strstr(sess->rx, "\r\n\r\n");
+    if (!end) {
+      if (sess->rx_len >= sizeof(sess->rx) - 1) sess->rx_len = 0;  // oversized request
+      return;
+    }
+    size_t req_len = end + 4 - sess->rx;
+    end[2] = 0;  // keep the last header's CRLF for headerValue()
+    handleRequest(sess, sess->rx);
+    if (sess->sock < 0) return;
+    memmove(sess->rx, sess->rx + req_len, sess->rx_len - req_len);
+    sess->rx_len -= req_len;
+  }
+}
+
+static void acceptClient() {
+  struct sockaddr_in peer;
+  socklen_t peer_len = sizeof(peer);
+  int sock = accept(s_listen_sock, (struct sockaddr *)&peer, &peer_len);
+  if (sock < 0) return;
+
+  for (int i = 0; i < RTSP_MAX_SESSIONS; i++) {
+    RtspSession *sess = &s_sessions[i];
+    if (sess->sock >= 0) continue;
+    memset(sess, 0, sizeof(*sess));
+    sess->sock = sock;
+    sess->id = esp_random();
+    sess->ssrc = esp_random();
+    sess->rtp_seq = (uint16_t)esp_random();
+
+    struct timeval tv = {RTSP_TCP_SEND_TIMEOUT_S, 0};
+    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    int one = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    printf("[RTSP] Client connected from %s (session %08x)\n", inet_ntoa(peer.sin_addr), (unsigned)sess->id);
+    return;
+  }
+  printf("[RTSP] Rejecting client: %d sessions active\n", RTSP_MAX_SESSIONS);
+  close(sock);
+}
+
+static void rtspTask(void *arg) {
+  uint32_t last_seq = 0;
+
+  while (true) {
+    fd_set fds;
+    FD_ZERO(&fds);
+    FD_SET(s_listen_sock, &fds);
+    int max_fd = s_listen_sock;
+    for (int i = 0; i < RTSP_MAX_SESSIONS; i++) {
+      if (s_sessions[i].sock >= 0) {
+        FD_SET(s_sessions[i].sock, &fds);
+        if (s_sessions[i].sock > max_fd) max_fd = s_sessions[i].sock;
+      }
+    }
+
+    // Idle: block on the sockets. Playing: only poll them between frames.
+    struct timeval tv = {0, s_playing > 0 ? 0 : 200000};
+    if (select(max_fd + 1, &fds, NULL, NULL, &tv) > 0) {
+      if (FD_ISSET(s_listen_sock, &fds)) acceptClient();
+      for (int i = 0; i < RTSP_MAX_SESSIONS; i++) {
+        RtspSession *sess = &s_sessions[i];
+        if (sess->sock < 0 || !FD_ISSET(sess->sock, &fds)) continue;
+        int n = recv(sess->sock, sess->rx + sess->rx_len, sizeof(sess->rx) - 1 - sess->rx_len, 0);
+        if (n <= 0) {
+          closeSession(sess);
+          continue;
+        }
+        sess->rx_len += n;
+        processInput(sess);
+      }
+    }
+
+    if (s_playing > 0) {
+      // One encode for all subscribers
+      CachedFrame *frame = s_source(last_seq);
+      if (frame) {
+        if (frame->seq != last_seq) {
+          if (!sendFrame(frame)) {
+            printf("[RTSP] Frame %u can't be carried as RFC 2435 payload\n", (unsigned)frame->seq);
+          }
+          last_seq = frame->seq;
+        }
+        frameCacheRelease(frame);
+      }
+      vTaskDelay(1);
+    }
+  }
+}
+
+bool rtspServerStart(uint16_t port, RtspFrameSource source) {
+  for (int i = 0; i < RTSP_MAX_SESSIONS; i++) s_sessions[i].sock = -1;
+  s_port = port;
+  s_source = source;
+
+  s_listen_sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+  s_udp_sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if (s_listen_sock < 0 || s_udp_sock < 0) return false;
+
+  int one = 1;
+  setsockopt(s_listen_sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(s_port);
+  if (bind(s_listen_sock, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+      listen(s_listen_sock, 2) < 0) {
+    close(s_listen_sock);
+    s_listen_sock = -1;
+    return false;
+  }
+
+  addr.sin_port = htons(RTSP_RTP_PORT);
+  bind(s_udp_sock, (struct sockaddr *)&addr, sizeof(addr));
+
+  return xTaskCreatePinnedToCore(rtspTask, "rtsp", 6144, NULL, 5, NULL, 1) == pdPASS;
+}
+
+int rtspServerPlayingCount() {
+  return s_playing;
+}
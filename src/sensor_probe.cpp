@@ -0,0 +1,59 @@
+#include "sensor_probe.h"
+
+#include <string.h>
+
+// Pin maps from the esp32-camera CameraWebServer example (camera_pins.h) for
+// S3 boards; only boards without GPIO 26-37 (flash/octal PSRAM) are listed
+const BoardProfile BOARD_PROFILES[] = {
+  // name                  pwdn rst xclk sda scl   d7  d6  d5  d4  d3  d2  d1  d0  vsync href pclk
+  { "goouuu-s3-cam",        -1, -1, 15,   4,  5,   16, 17, 18, 12, 10,  8,  9, 11,   6,   7,  13 },  // Also ESP32-S3-EYE
+  { "xiao-esp32s3-sense",   -1, -1, 10,  40, 39,   48, 11, 12, 14, 16, 18, 17, 15,  38,  47,  13 },
+  { "esp32s3-cam-lcd",      -1, -1, 40,  17, 18,   39, 41, 42, 12,  3, 14, 47, 13,  21,  38,  11 },
+  { "dfrobot-firebeetle2",  -1, -1, 45,   1,  2,   48, 46,  8,  7,  4, 41, 40, 39,   6,  42,   5 },
+};
+const int BOARD_PROFILE_COUNT = sizeof(BOARD_PROFILES) / sizeof(BOARD_PROFILES[0]);
+
+bool sensorProbeProfile(const SccbBus *bus, const BoardProfile *profile, uint16_t *pid) {
+  if (!bus->bus_present(bus->ctx, profile)) return false;
+  if (!bus->begin(bus->ctx, profile)) return false;
+
+  bool found = false;
+  uint8_t pidh = 0, pidl = 0, midh = 0, midl = 0;
+  if (bus->ping(bus->ctx, OV2640_SCCB_ADDR) &&
+      bus->write_reg(bus->ctx, OV2640_SCCB_ADDR, OV2640_REG_BANK_SEL, 0x01) &&
+      bus->read_reg(bus->ctx, OV2640_SCCB_ADDR, OV2640_REG_MIDH, &midh) &&
+      bus->read_reg(bus->ctx, OV2640_SCCB_ADDR, OV2640_REG_MIDL, &midl) &&
+      bus->read_reg(bus->ctx, OV2640_SCCB_ADDR, OV2640_REG_PIDH, &pidh) &&
+      bus->read_reg(bus->ctx, OV2640_SCCB_ADDR, OV2640_REG_PIDL, &pidl)) {
+    found = midh == 0x7F && midl == 0xA2 && pidh == 0x26;
+  }
+  bus->end(bus->ctx);
+
+  if (found && pid) *pid = (uint16_t)(pidh << 8 | pidl);
+  return found;
+}
+
+bool sensorProbe(const SccbBus *bus, const BoardProfile *profiles, int count,
+                 int first_index, SensorProbeResult *out) {
+  if (first_index < 0 || first_index >= count) first_index = 0;
+
+  for (int n = 0; n < count; n++) {
+    int i = (first_index + n) % count;
+    uint16_t pid = 0;
+    if (sensorProbeProfile(bus, &profiles[i], &pid)) {
+      out->profile_index = i;
+      out->addr = OV2640_SCCB_ADDR;
+      out->pid = pid;
+      return true;
+    }
+  }
+  return false;
+}
+
+int boardProfileFind(const BoardProfile *profiles, int count, const char *name) {
+  if (!name) return -1;
+  for (int i = 0; i < count; i++) {
+    if (strcmp(profiles[i].name, name) == 0) return i;
+  }
+  return -1;
+}
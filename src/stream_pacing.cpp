@@ -0,0 +1,35 @@
+#include "stream_pacing.h"
+
+#include <string.h>
+
+bool streamFrameReusable(uint32_t frame_seq, int64_t frame_us, uint32_t last_seq,
+                         int64_t now_us, int max_age_ms) {
+  return frame_seq != last_seq && now_us - frame_us <= (int64_t)max_age_ms * 1000;
+}
+
+bool wsIsFrameRequest(bool is_text, const uint8_t *msg, size_t len) {
+  return is_text && msg && len >= 4 && memcmp(msg, "next", 4) == 0;
+}
+
+void wsSessionSent(WsSession *session, uint32_t frame_seq) {
+  // Sequence numbers only grow (wrapping); the first frame skips nothing
+  if (session->frames > 0) session->skipped += frame_seq - session->last_seq - 1;
+  session->last_seq = frame_seq;
+  session->frames++;
+}
+
+void wsFrameHeader(uint8_t hdr[WS_FRAME_HEADER_LEN], uint32_t seq, uint32_t ts_ms,
+                   uint16_t width, uint16_t height) {
+  hdr[0] = 'F';
+  hdr[1] = 'R';
+  hdr[2] = WS_FRAME_VERSION;
+  hdr[3] = WS_FRAME_HEADER_LEN;
+  for (int i = 0; i < 4; i++) {
+    hdr[4 + i] = (uint8_t)(seq >> (8 * i));
+    hdr[8 + i] = (uint8_t)(ts_ms >> (8 * i));
+  }
+  hdr[12] = (uint8_t)width;
+  hdr[13] = (uint8_t)(width >> 8);
+  hdr[14] = (uint8_t)height;
+  hdr[15] = (uint8_t)(height >> 8);
+}
@@ -0,0 +1,201 @@
+#include "timelapse.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Last slot within the duration (slot 0 is taken at start)
+static uint64_t lastSlot(const TimelapseSchedule *tl) {
+  if (!tl->config.duration_ms) return UINT32_MAX;
+  return tl->config.duration_ms / tl->config.interval_ms;
+}
+
+static uint64_t slotTime(const TimelapseSchedule *tl, uint64_t slot) {
+  return tl->start_ms + slot * tl->config.interval_ms;
+}
+
+void timelapseStart(TimelapseSchedule *tl, const TimelapseConfig *config, uint64_t now_ms) {
+  memset(tl, 0, sizeof(*tl));
+  tl->config = *config;
+  if (tl->config.interval_ms == 0) tl->config.interval_ms = 1;
+  tl->start_ms = now_ms;
+  tl->running = true;
+}
+
+void timelapseStop(TimelapseSchedule *tl) {
+  tl->running = false;
+}
+
+bool timelapseDue(TimelapseSchedule *tl, uint64_t now_ms, uint64_t *due_ms) {
+  if (!tl->running) return false;
+  uint64_t due = slotTime(tl, tl->next_slot);
+  if (now_ms < due) return false;
+
+  // Latest slot that has started; the ones before it passed while a shot (or a
+  // camera reinit) was still busy
+  uint64_t slot = tl->next_slot + (now_ms - due) / tl->config.interval_ms;
+  uint64_t last = lastSlot(tl);
+  if (slot > last) {
+    tl->missed += (uint32_t)(last + 1 - tl->next_slot);
+    tl->running = false;
+    return false;
+  }
+  tl->missed += (uint32_t)(slot - tl->next_slot);
+  tl->next_slot = (uint32_t)(slot + 1);
+  if (tl->next_slot > last) tl->running = false;
+  *due_ms = slotTime(tl, slot);
+  return true;
+}
+
+bool timelapseNextDue(const TimelapseSchedule *tl, uint64_t *due_ms) {
+  if (!tl->running) return false;
+  *due_ms = slotTime(tl, tl->next_slot);
+  return true;
+}
+
+void timelapseShotTaken(TimelapseSchedule *tl, uint64_t due_ms, uint64_t taken_ms) {
+  uint32_t late = taken_ms > due_ms ? (uint32_t)(taken_ms - due_ms) : 0;
+  tl->taken++;
+  tl->late_total_ms += late;
+  if (late > tl->late_max_ms) tl->late_max_ms = late;
+}
+
+void timelapseShotFailed(TimelapseSchedule *tl) {
+  tl->failed++;
+}
+
+uint64_t timelapseWallMs(const TimelapseSchedule *tl, uint64_t mono_ms) {
+  if (!tl->config.epoch_ms) return 0;
+  return tl->config.epoch_ms + (mono_ms - tl->start_ms);
+}
+
+void timelapseStoreInit(TimelapseStore *store, size_t budget_bytes, TimelapseFreeFn free_buf) {
+  memset(store, 0, sizeof(*store));
+  store->budget_bytes = budget_bytes;
+  store->free_buf = free_buf;
+}
+
+static TimelapseFrame *frameAt(const TimelapseStore *store, int i) {
+  return store->frames[(store->head + i) % TIMELAPSE_MAX_FRAMES];
+}
+
+static void dropRef(TimelapseStore *store, TimelapseFrame *frame) {
+  if (--frame->refs > 0) return;
+  if (store->free_buf) {
+    store->free_buf(frame->buf, frame->len);
+  } else {
+    free(frame->buf);
+  }
+  free(frame);
+}
+
+// Unlink the oldest frame; a download still sending it keeps it alive
+static void removeOldest(TimelapseStore *store) {
+  TimelapseFrame *frame = frameAt(store, 0);
+  store->head = (store->head + 1) % TIMELAPSE_MAX_FRAMES;
+  store->count--;
+  store->bytes -= frame->len;
+  dropRef(store, frame);
+}
+
+TimelapseFrame *timelapseStoreAdd(TimelapseStore *store, uint8_t *buf, size_t len,
+                                  uint64_t due_ms, uint64_t taken_ms, uint64_t wall_ms) {
+  if (len > store->budget_bytes) return NULL;
+  TimelapseFrame *frame = (TimelapseFrame *)calloc(1, sizeof(TimelapseFrame));
+  if (!frame) return NULL;
+
+  while (store->count && (store->count == TIMELAPSE_MAX_FRAMES || store->bytes + len > store->budget_bytes)) {
+    removeOldest(store);
+    store->evicted++;
+  }
+  frame->buf = buf;
+  frame->len = len;
+  frame->seq = ++store->last_seq;
+  frame->due_ms = due_ms;
+  frame->taken_ms = taken_ms;
+  frame->wall_ms = wall_ms;
+  frame->refs = 1;  // store
+  store->frames[(store->head + store->count) % TIMELAPSE_MAX_FRAMES] = frame;
+  store->count++;
+  store->bytes += len;
+  return frame;
+}
+
+TimelapseFrame *timelapseStoreAcquire(TimelapseStore *store, uint32_t after_seq) {
+  for (int i = 0; i < store->count; i++) {
+    TimelapseFrame *frame = frameAt(store, i);
+    if (frame->seq > after_seq) {
+      frame->refs++;
+      return frame;
+    }
+  }
+  return NULL;
+}
+
+void timelapseStoreRelease(TimelapseStore *store, TimelapseFrame *frame) {
+  if (frame) dropRef(store, frame);
+}
+
+uint32_t timelapseStoreDiscard(TimelapseStore *store, uint32_t through_seq) {
+  uint32_t dropped = 0;
+  while (store->count && frameAt(store, 0)->seq <= through_seq) {
+    removeOldest(store);
+    dropped++;
+  }
+  return dropped;
+}
+
+uint32_t timelapseStoreFirstSeq(const TimelapseStore *store) {
+  return store->count ? frameAt(store, 0)->seq : 0;
+}
+
+uint32_t timelapseStoreLastSeq(const TimelapseStore *store) {
+  return store->count ? frameAt(store, store->count - 1)->seq : 0;
+}
+
+void timelapseFrameName(const TimelapseFrame *frame, char *out, size_t out_len) {
+  if (!frame->wall_ms) {
+    snprintf(out, out_len, "%06u_%llums.jpg", (unsigned)frame->seq, (unsigned long long)frame->taken_ms);
+    return;
+  }
+  time_t secs = (time_t)(frame->wall_ms / 1000);
+  struct tm utc;
+  gmtime_r(&secs, &utc);
+  snprintf(out, out_len, "%06u_%04d%02d%02d-%02d%02d%02d.%03u.jpg", (unsigned)frame->seq,
+           utc.tm_year + 1900, utc.tm_mon + 1, utc.tm_mday, utc.tm_hour, utc.tm_min, utc.tm_sec,
+           (unsigned)(frame->wall_ms % 1000));
+}
+
+// Octal field, NUL-terminated, zero-padded to fill width
+static void tarOctal(uint8_t *field, size_t width, uint64_t value) {
+  field[width - 1] = 0;
+  for (int i = (int)width - 2; i >= 0; i--) {
+    field[i] = '0' + (value & 7);
+    value >>= 3;
+  }
+}
+
+// POSIX ustar header for a regular file
+void timelapseTarHeader(uint8_t *block, const char *name, size_t size, uint64_t mtime_s) {
+  memset(block, 0, TIMELAPSE_TAR_BLOCK);
+  strncpy((char *)block, name, 99);
+  tarOctal(block + 100, 8, 0644);     // mode
+  tarOctal(block + 108, 8, 0);        // uid
+  tarOctal(block + 116, 8, 0);        // gid
+  tarOctal(block + 124, 12, size);
+  tarOctal(block + 136, 12, mtime_s);
+  block[156] = '0';                   // Regular file
+  memcpy(block + 257, "ustar", 6);    // Magic, NUL included
+  memcpy(block + 263, "00", 2);       // Version
+
+  // Checksum: byte sum with the checksum field counted as spaces
+  memset(block + 148, ' ', 8);
+  unsigned sum = 0;
+  for (int i = 0; i < TIMELAPSE_TAR_BLOCK; i++) sum += block[i];
+  tarOctal(block + 148, 7, sum);      // Six digits + NUL, the space after it stays
+}
+
+size_t timelapseTarPadding(size_t size) {
+  return (TIMELAPSE_TAR_BLOCK - size % TIMELAPSE_TAR_BLOCK) % TIMELAPSE_TAR_BLOCK;
+}
@@ -0,0 +1,47 @@
+#include "wifi_cache.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <Preferences.h>
+
+#define WIFI_CACHE_NAMESPACE "wifi_cache"
+
+bool wifiCacheLoad(const char *ssid, WifiCache *out) {
+  Preferences prefs;
+  if (!prefs.begin(WIFI_CACHE_NAMESPACE, true)) return false;  // Namespace doesn't exist yet
+
+  char stored_ssid[33] = {0};
+  bool ok = prefs.getString("ssid", stored_ssid, sizeof(stored_ssid)) > 0 &&
+            strcmp(stored_ssid, ssid) == 0 &&
+            prefs.getBytes("bssid", out->bssid, sizeof(out->bssid)) == sizeof(out->bssid);
+  out->channel = prefs.getInt("channel", 0);
+  prefs.end();
+
+  return ok && out->channel >= 1 && out->channel <= 14;
+}
+
+void wifiCacheSave(const char *ssid, int32_t channel, const uint8_t *bssid) {
+  if (!bssid || channel < 1 || channel > 14) return;
+
+  WifiCache current;
+  if (wifiCacheLoad(ssid, &current) && current.channel == channel &&
+      memcmp(current.bssid, bssid, sizeof(current.bssid)) == 0) {
+    return;  // Unchanged, spare the flash
+  }
+
+  Preferences prefs;
+  if (!prefs.begin(WIFI_CACHE_NAMESPACE, false)) return;
+  prefs.putString("ssid", ssid);
+  prefs.putInt("channel", channel);
+  prefs.putBytes("bssid", bssid, 6);
+  prefs.end();
+  printf("[WIFI] Cached channel %d, BSSID %02X:%02X:%02X:%02X:%02X:%02X\n", (int)channel,
+         bssid[0], bssid[1], bssid[2], bssid[3], bssid[4], bssid[5]);
+}
+
+void wifiCacheClear() {
+  Preferences prefs;
+  if (!prefs.begin(WIFI_CACHE_NAMESPACE, false)) return;
+  prefs.clear();
+  prefs.end();
+}
@@ -0,0 +1,67 @@
+// Shared fixture of the JPEG suites: deterministic synthetic sensor frames, JPEGs
+// from the software encoder and header segment lookup. Include after <unity.h>.
+#ifndef JPEG_FIXTURE_H
+#define JPEG_FIXTURE_H
+
+#include <stdlib.h>
+#include <string.h>
+#include "jpeg_encoder.h"
+
+static uint32_t fixture_lcg_state = 1;
+
+// Deterministic 0..range-1 (same sequence on every run and host)
+static inline uint32_t nextRandom(uint32_t range) {
+  fixture_lcg_state = fixture_lcg_state * 1664525u + 1013904223u;
+  return (fixture_lcg_state >> 8) % range;
+}
+
+struct Jpeg {
+  uint8_t *buf;  // malloc()ed
+  size_t len;
+};
+
+// Gradients plus noise in the sensor's byte order (YUYV, or big-endian RGB565).
+// More noise = more non-zero AC coefficients, a longer scan and more 0xFF bytes to stuff.
+static inline uint8_t *syntheticFrame(int width, int height, int noise, bool rgb565) {
+  uint8_t *px = (uint8_t *)malloc((size_t)width * height * 2);
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      uint8_t *p = px + ((size_t)y * width + x) * 2;
+      int n = nextRandom(noise);
+      if (rgb565) {
+        uint16_t v = (uint16_t)((((x * 31 / width) & 31) << 11) | (((y * 63 / height + n) & 63) << 5) |
+                                ((x ^ y) & 31));
+        p[0] = (uint8_t)(v >> 8);
+        p[1] = (uint8_t)v;
+      } else {
+        p[0] = (uint8_t)((x * 255 / width + n) & 0xFF);                // Y
+        p[1] = (uint8_t)((x & 1) ? (y * 255 / height) : (x ^ y) * 7);  // U / V
+      }
+    }
+  }
+  return px;
+}
+
+// syntheticFrame() through the software encoder
+static inline Jpeg encodeSynthetic(int width, int height, int noise, int quality, bool rgb565 = false) {
+  uint8_t *px = syntheticFrame(width, height, noise, rgb565);
+  Jpeg jpg;
+  bool ok = rgb565 ? jpegEncodeRgb565(px, width, height, quality, &jpg.buf, &jpg.len)
+                   : jpegEncodeYuyv(px, width, height, quality, &jpg.buf, &jpg.len);
+  free(px);
+  TEST_ASSERT_TRUE(ok);
+  return jpg;
+}
+
+// Offset of marker m among the header segments (before the scan), or 0
+static inline size_t findSegment(const uint8_t *buf, size_t len, uint8_t m) {
+  size_t pos = 2;
+  while (pos + 4 <= len && buf[pos] == 0xFF) {
+    if (buf[pos + 1] == m) return pos;
+    if (buf[pos + 1] == 0xDA) break;
+    pos += 2 + ((buf[pos + 2] << 8) | buf[pos + 3]);
+  }
+  return 0;
+}
+
+#endif
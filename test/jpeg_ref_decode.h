@@ -0,0 +1,193 @@
+// Reference baseline decoder for the JPEG suites, written from T.81 independently of
+// src/: interleaved 3-component scans without restarts, to quantized coefficients and
+// (refPlane()) back to pixels with a float IDCT. Include after <unity.h>.
+#ifndef JPEG_REF_DECODE_H
+#define JPEG_REF_DECODE_H
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct RefHuff {
+  uint8_t bits[16];
+  uint8_t vals[256];
+};
+
+struct RefDecode {
+  int width, height, ncomp;
+  int h[3], v[3], tq[3], td[3], ta[3];
+  uint16_t qt[4][64];
+  RefHuff dc[4], ac[4];
+  int16_t *coef;  // Quantized coefficients, 64 per block in scan order, DC absolute
+  int blocks;
+};
+
+struct RefBits {
+  const uint8_t *p, *end;
+  uint32_t acc;
+  int n;
+};
+
+static inline int refBit(RefBits *b) {
+  if (b->n == 0) {
+    uint8_t byte = 0;
+    if (b->p < b->end) {
+      byte = *b->p++;
+      if (byte == 0xFF) {
+        TEST_ASSERT_EQUAL_HEX8(0x00, *b->p);  // Only stuffing inside the scan
+        b->p++;
+      }
+    }
+    b->acc = byte;
+    b->n = 8;
+  }
+  return (b->acc >> --b->n) & 1;
+}
+
+static inline int refReceive(RefBits *b, int s) {
+  int v = 0;
+  for (int i = 0; i < s; i++) v = (v << 1) | refBit(b);
+  return s && v < (1 << (s - 1)) ? v - (1 << s) + 1 : v;
+}
+
+// Canonical Huffman decode one bit at a time (JPEG F.2.2.3)
+static inline int refDecodeSymbol(RefBits *b, const RefHuff *t) {
+  int code = 0, first = 0, index = 0;
+  for (int len = 1; len <= 16; len++) {
+    code |= refBit(b);
+    int count = t->bits[len - 1];
+    if (code - first < count) return t->vals[index + code - first];
+    index += count;
+    first = (first + count) << 1;
+    code <<= 1;
+  }
+  TEST_FAIL_MESSAGE("bad Huffman code");
+  return 0;
+}
+
+static inline void refDecode(const uint8_t *buf, size_t len, RefDecode *d) {
+  memset(d, 0, sizeof(*d));
+  size_t pos = 2;
+  while (pos + 4 <= len) {
+    TEST_ASSERT_EQUAL_HEX8(0xFF, buf[pos]);
+    uint8_t m = buf[pos + 1];
+    size_t seg_len = (buf[pos + 2] << 8) | buf[pos + 3];
+    const uint8_t *seg = buf + pos + 4;
+    const uint8_t *seg_end = buf + pos + 2 + seg_len;
+    if (m == 0xDB) {
+      while (seg < seg_end) {
+        int pq = seg[0] >> 4, tq = seg[0] & 3;
+        seg++;
+        for (int i = 0; i < 64; i++) d->qt[tq][i] = pq ? (seg[2 * i] << 8) | seg[2 * i + 1] : seg[i];
+        seg += 64 * (pq + 1);
+      }
+    } else if (m == 0xC4) {
+      while (seg < seg_end) {
+        RefHuff *t = (seg[0] >> 4) ? &d->ac[seg[0] & 3] : &d->dc[seg[0] & 3];
+        memcpy(t->bits, seg + 1, 16);
+        int n = 0;
+        for (int i = 0; i < 16; i++) n += t->bits[i];
+        memcpy(t->vals, seg + 17, n);
+        seg += 17 + n;
+      }
+    } else if (m == 0xC0) {
+      d->height = (seg[1] << 8) | seg[2];
+      d->width = (seg[3] << 8) | seg[4];
+      d->ncomp = seg[5];
+      TEST_ASSERT_EQUAL_INT(3, d->ncomp);
+      for (int i = 0; i < 3; i++) {
+        d->h[i] = seg[7 + 3 * i] >> 4;
+        d->v[i] = seg[7 + 3 * i] & 15;
+        d->tq[i] = seg[8 + 3 * i];
+      }
+    } else if (m == 0xDD) {
+      TEST_FAIL_MESSAGE("reference decoder doesn't handle restarts");
+    } else if (m == 0xDA) {
+      for (int i = 0; i < 3; i++) {
+        d->td[i] = seg[2 + 2 * i] >> 4;
+        d->ta[i] = seg[2 + 2 * i] & 15;
+      }
+      pos += 2 + seg_len;
+      break;
+    }
+    pos += 2 + seg_len;
+  }
+
+  int mcu_w = 8 * d->h[0], mcu_h = 8 * d->v[0];
+  int mcus = ((d->width + mcu_w - 1) / mcu_w) * ((d->height + mcu_h - 1) / mcu_h);
+  int per_mcu = d->h[0] * d->v[0] + d->h[1] * d->v[1] + d->h[2] * d->v[2];
+  d->blocks = mcus * per_mcu;
+  d->coef = (int16_t *)calloc((size_t)d->blocks * 64, sizeof(int16_t));
+
+  RefBits b = {buf + pos, buf + len - 2, 0, 0};
+  int pred[3] = {0, 0, 0};
+  int16_t *blk = d->coef;
+  for (int mcu = 0; mcu < mcus; mcu++) {
+    for (int c = 0; c < 3; c++) {
+      for (int n = 0; n < d->h[c] * d->v[c]; n++, blk += 64) {
+        int s = refDecodeSymbol(&b, &d->dc[d->td[c]]);
+        pred[c] += refReceive(&b, s);
+        blk[0] = (int16_t)pred[c];
+        for (int k = 1; k < 64;) {
+          int rs = refDecodeSymbol(&b, &d->ac[d->ta[c]]);
+          if (rs == 0x00) break;  // EOB
+          k += rs >> 4;
+          if ((rs & 15) == 0) {   // ZRL
+            k++;
+            continue;
+          }
+          TEST_ASSERT_LESS_THAN(64, k);
+          blk[k++] = (int16_t)refReceive(&b, rs & 15);
+        }
+      }
+    }
+  }
+  TEST_ASSERT_TRUE(b.p == b.end);  // Whole scan consumed, EOI next
+}
+
+// Zig-zag position -> natural index (T.81 figure A.6)
+static const uint8_t REF_ZIGZAG[64] = {
+   0,  1,  8, 16,  9,  2,  3, 10, 17, 24, 32, 25, 18, 11,  4,  5,
+  12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13,  6,  7, 14, 21, 28,
+  35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+  58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63
+};
+
+// Component c of a refDecode() as a malloc()ed plane of *plane_w x *plane_h samples
+// (whole blocks, so padded up to the MCU grid): dequantized, IDCT (A.3.3), +128, clamped
+static inline uint8_t *refPlane(const RefDecode *d, int c, int *plane_w, int *plane_h) {
+  int mcu_cols = (d->width + 8 * d->h[0] - 1) / (8 * d->h[0]);
+  int mcu_rows = (d->height + 8 * d->v[0] - 1) / (8 * d->v[0]);
+  int per_mcu = d->h[0] * d->v[0] + d->h[1] * d->v[1] + d->h[2] * d->v[2];
+  int first = 0;
+  for (int i = 0; i < c; i++) first += d->h[i] * d->v[i];
+  *plane_w = mcu_cols * 8 * d->h[c];
+  *plane_h = mcu_rows * 8 * d->v[c];
+  uint8_t *plane = (uint8_t *)malloc((size_t)*plane_w * *plane_h);
+
+  for (int mcu = 0; mcu < mcu_cols * mcu_rows; mcu++) {
+    for (int n = 0; n < d->h[c] * d->v[c]; n++) {
+      const int16_t *blk = d->coef + ((size_t)mcu * per_mcu + first + n) * 64;
+      double f[64] = {};
+      for (int k = 0; k < 64; k++) f[REF_ZIGZAG[k]] = blk[k] * d->qt[d->tq[c]][k];
+      int bx = (mcu % mcu_cols) * d->h[c] + n % d->h[c];
+      int by = (mcu / mcu_cols) * d->v[c] + n / d->h[c];
+      for (int y = 0; y < 8; y++) {
+        for (int x = 0; x < 8; x++) {
+          double sum = 0;
+          for (int v = 0; v < 8; v++) {
+            for (int u = 0; u < 8; u++) {
+              double cu = u ? 1 : M_SQRT1_2, cv = v ? 1 : M_SQRT1_2;
+              sum += cu * cv * f[v * 8 + u] * cos((2 * x + 1) * u * M_PI / 16) * cos((2 * y + 1) * v * M_PI / 16);
+            }
+          }
+          long px = lround(sum / 4 + 128);
+          plane[(size_t)(by * 8 + y) * *plane_w + bx * 8 + x] = (uint8_t)(px < 0 ? 0 : (px > 255 ? 255 : px));
+        }
+      }
+    }
+  }
+  return plane;
+}
+
+#endif
@@ -0,0 +1,136 @@
+// Boot state machine replayed with simulated camera/WiFi events and a ms clock
+#include <unity.h>
+
+#include "boot_sequencer.h"
+
+static BootSequencer boot;
+
+void setUp(void) {}
+void tearDown(void) {}
+
+// Ticks every 20 ms (BOOT_POLL_MS) from..to, inclusive; returns the OR of the actions
+static uint32_t tickUntil(uint32_t from_ms, uint32_t to_ms) {
+  uint32_t actions = 0;
+  for (uint32_t t = from_ms; (int32_t)(to_ms - t) >= 0; t += 20) actions |= bootSequencerHandle(&boot, BOOT_EVENT_TICK, t);
+  return actions;
+}
+
+static void test_cached_connect_camera_first(void) {
+  TEST_ASSERT_EQUAL_HEX32(BOOT_ACTION_CONNECT_CACHED, bootSequencerBegin(&boot, true, 100));
+  TEST_ASSERT_EQUAL_HEX32(0, tickUntil(120, 500));
+  TEST_ASSERT_EQUAL_HEX32(0, bootSequencerHandle(&boot, BOOT_EVENT_CAMERA_READY, 612));
+  TEST_ASSERT_EQUAL_INT(BOOT_PHASE_RUNNING, boot.phase);
+  TEST_ASSERT_EQUAL_HEX32(BOOT_ACTION_SAVE_WIFI_CACHE | BOOT_ACTION_START_SERVERS,
+                          bootSequencerHandle(&boot, BOOT_EVENT_WIFI_CONNECTED, 1034));
+  TEST_ASSERT_EQUAL_INT(BOOT_PHASE_READY, boot.phase);
+  TEST_ASSERT_TRUE(boot.used_wifi_cache);
+  TEST_ASSERT_EQUAL_UINT32(100, boot.start_ms);
+  TEST_ASSERT_EQUAL_UINT32(612, boot.camera_ms);
+  TEST_ASSERT_EQUAL_UINT32(1034, boot.wifi_ms);
+  TEST_ASSERT_EQUAL_UINT32(1034, boot.ready_ms);
+
+  // Done: later events change nothing
+  TEST_ASSERT_EQUAL_HEX32(0, bootSequencerHandle(&boot, BOOT_EVENT_CAMERA_FAILED, 2000));
+  TEST_ASSERT_EQUAL_HEX32(0, tickUntil(2000, 30000));
+  TEST_ASSERT_EQUAL_INT(BOOT_PHASE_READY, boot.phase);
+}
+
+static void test_full_connect_camera_last(void) {
+  TEST_ASSERT_EQUAL_HEX32(BOOT_ACTION_CONNECT_FULL, bootSequencerBegin(&boot, false, 0));
+  TEST_ASSERT_EQUAL_HEX32(BOOT_ACTION_SAVE_WIFI_CACHE, bootSequencerHandle(&boot, BOOT_EVENT_WIFI_CONNECTED, 3000));
+  TEST_ASSERT_EQUAL_INT(BOOT_WIFI_UP, boot.wifi);
+  TEST_ASSERT_FALSE(boot.used_wifi_cache);
+  TEST_ASSERT_EQUAL_HEX32(0, tickUntil(3020, 3480));
+  TEST_ASSERT_EQUAL_HEX32(BOOT_ACTION_START_SERVERS, bootSequencerHandle(&boot, BOOT_EVENT_CAMERA_READY, 3500));
+  TEST_ASSERT_EQUAL_UINT32(3000, boot.wifi_ms);
+  TEST_ASSERT_EQUAL_UINT32(3500, boot.ready_ms);
+}
+
+static void test_stale_cache_fails_fast(void) {
+  bootSequencerBegin(&boot, true, 0);
+  bootSequencerHandle(&boot, BOOT_EVENT_CAMERA_READY, 200);
+  // Router moved channel: NO_SSID on the cached one, cache cleared, full connect
+  TEST_ASSERT_EQUAL_HEX32(BOOT_ACTION_CLEAR_WIFI_CACHE | BOOT_ACTION_CONNECT_FULL,
+                          bootSequencerHandle(&boot, BOOT_EVENT_WIFI_FAILED, 300));
+  TEST_ASSERT_EQUAL_INT(BOOT_WIFI_FULL, boot.wifi);
+  TEST_ASSERT_EQUAL_UINT32(300 + BOOT_FULL_CONNECT_TIMEOUT_MS, boot.wifi_deadline_ms);
+
+  // During the full connect a failure report doesn't end it early
+  TEST_ASSERT_EQUAL_HEX32(0, bootSequencerHandle(&boot, BOOT_EVENT_WIFI_FAILED, 1000));
+  TEST_ASSERT_EQUAL_HEX32(0, tickUntil(1000, 5000));
+  TEST_ASSERT_EQUAL_HEX32(BOOT_ACTION_SAVE_WIFI_CACHE | BOOT_ACTION_START_SERVERS,
+                          bootSequencerHandle(&boot, BOOT_EVENT_WIFI_CONNECTED, 5200));
+  TEST_ASSERT_FALSE(boot.used_wifi_cache);
+}
+
+static void test_silent_cache_times_out(void) {
+  bootSequencerBegin(&boot, true, 0);
+  TEST_ASSERT_EQUAL_HEX32(0, tickUntil(20, BOOT_CACHED_CONNECT_TIMEOUT_MS - 20));
+  TEST_ASSERT_EQUAL_HEX32(BOOT_ACTION_CLEAR_WIFI_CACHE | BOOT_ACTION_CONNECT_FULL,
+                          bootSequencerHandle(&boot, BOOT_EVENT_TICK, BOOT_CACHED_CONNECT_TIMEOUT_MS));
+  // Only once
+  TEST_ASSERT_EQUAL_HEX32(0, bootSequencerHandle(&boot, BOOT_EVENT_TICK, BOOT_CACHED_CONNECT_TIMEOUT_MS + 20));
+  bootSequencerHandle(&boot, BOOT_EVENT_WIFI_CONNECTED, 9000);
+  TEST_ASSERT_EQUAL_HEX32(BOOT_ACTION_START_SERVERS, bootSequencerHandle(&boot, BOOT_EVENT_CAMERA_READY, 9100));
+}
+
+static void test_full_connect_timeout_fails(void) {
+  bootSequencerBegin(&boot, true, 0);
+  bootSequencerHandle(&boot, BOOT_EVENT_CAMERA_READY, 500);
+  uint32_t actions = tickUntil(20, BOOT_CACHED_CONNECT_TIMEOUT_MS + BOOT_FULL_CONNECT_TIMEOUT_MS - 20);
+  TEST_ASSERT_EQUAL_HEX32(BOOT_ACTION_CLEAR_WIFI_CACHE | BOOT_ACTION_CONNECT_FULL, actions);
+  TEST_ASSERT_EQUAL_HEX32(BOOT_ACTION_REPORT_FAILURE,
+                          bootSequencerHandle(&boot, BOOT_EVENT_TICK,
+                                              BOOT_CACHED_CONNECT_TIMEOUT_MS + BOOT_FULL_CONNECT_TIMEOUT_MS));
+  TEST_ASSERT_EQUAL_INT(BOOT_PHASE_FAILED, boot.phase);
+  TEST_ASSERT_EQUAL_INT(BOOT_WIFI_FAILED, boot.wifi);
+  TEST_ASSERT_EQUAL_HEX32(0, bootSequencerHandle(&boot, BOOT_EVENT_WIFI_CONNECTED, 30000));
+}
+
+static void test_camera_failure(void) {
+  // While WiFi is still connecting: reported at once
+  bootSequencerBegin(&boot, true, 0);
+  TEST_ASSERT_EQUAL_HEX32(BOOT_ACTION_REPORT_FAILURE, bootSequencerHandle(&boot, BOOT_EVENT_CAMERA_FAILED, 800));
+  TEST_ASSERT_EQUAL_INT(BOOT_PHASE_FAILED, boot.phase);
+  TEST_ASSERT_EQUAL_INT(BOOT_CAMERA_FAILED, boot.camera);
+  TEST_ASSERT_EQUAL_HEX32(0, bootSequencerHandle(&boot, BOOT_EVENT_WIFI_CONNECTED, 1000));
+
+  // After WiFi is up: the cache is still saved, servers never start
+  bootSequencerBegin(&boot, true, 0);
+  TEST_ASSERT_EQUAL_HEX32(BOOT_ACTION_SAVE_WIFI_CACHE, bootSequencerHandle(&boot, BOOT_EVENT_WIFI_CONNECTED, 900));
+  TEST_ASSERT_EQUAL_HEX32(BOOT_ACTION_REPORT_FAILURE, bootSequencerHandle(&boot, BOOT_EVENT_CAMERA_FAILED, 1500));
+  TEST_ASSERT_EQUAL_UINT32(0, boot.ready_ms);
+}
+
+static void test_duplicate_events(void) {
+  bootSequencerBegin(&boot, false, 0);
+  bootSequencerHandle(&boot, BOOT_EVENT_CAMERA_READY, 400);
+  bootSequencerHandle(&boot, BOOT_EVENT_CAMERA_READY, 700);
+  TEST_ASSERT_EQUAL_UINT32(400, boot.camera_ms);
+  // A late failure report for a camera that came up is ignored
+  TEST_ASSERT_EQUAL_HEX32(0, bootSequencerHandle(&boot, BOOT_EVENT_CAMERA_FAILED, 800));
+  TEST_ASSERT_EQUAL_INT(BOOT_CAMERA_UP, boot.camera);
+}
+
+static void test_millis_wraparound(void) {
+  uint32_t start = 0xFFFFFFFFu - 1000;  // ~49.7 days of uptime, e.g. after a soft restart loop
+  bootSequencerBegin(&boot, true, start);
+  // The deadline wraps past zero; it must neither fire early nor never
+  TEST_ASSERT_EQUAL_HEX32(0, tickUntil(start + 20, start + BOOT_CACHED_CONNECT_TIMEOUT_MS - 20));
+  TEST_ASSERT_EQUAL_HEX32(BOOT_ACTION_CLEAR_WIFI_CACHE | BOOT_ACTION_CONNECT_FULL,
+                          bootSequencerHandle(&boot, BOOT_EVENT_TICK, start + BOOT_CACHED_CONNECT_TIMEOUT_MS));
+  TEST_ASSERT_EQUAL_STRING("connecting (full)", bootWifiStateName(boot.wifi));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_cached_connect_camera_first);
+  RUN_TEST(test_full_connect_camera_last);
+  RUN_TEST(test_stale_cache_fails_fast);
+  RUN_TEST(test_silent_cache_times_out);
+  RUN_TEST(test_full_connect_timeout_fails);
+  RUN_TEST(test_camera_failure);
+  RUN_TEST(test_duplicate_events);
+  RUN_TEST(test_millis_wraparound);
+  return UNITY_END();
+}
@@ -0,0 +1,301 @@
+// Camera arbitration replayed on a simulated us clock: snapshot latency with and
+// without a stream, stream mode restore, latency histogram quantiles
+#include <unity.h>
+
+#include <stdio.h>
+#include <string.h>
+#include "camera_arbiter.h"
+
+#define STREAM_FRAME_US  80000    // Capture + encode, camera held
+#define STREAM_SEND_US   30000    // Sent after the camera is given back
+#define SNAPSHOT_US      250000   // Capture + encode at the snapshot's mode
+#define REINIT_US        700000   // Mode switch
+#define REPLAY_US        (600LL * 1000000)
+
+static const CameraMode STREAM_MODE = {6, 1};     // VGA, YUV422
+static const CameraMode SNAPSHOT_MODE = {13, 4};  // UXGA, JPEG
+
+static bool sameMode(const CameraMode &a, const CameraMode &b) {
+  return a.framesize == b.framesize && a.pixformat == b.pixformat;
+}
+
+// Deterministic pseudo-random gaps so a failure replays the same way
+static uint32_t lcg_state;
+static uint32_t nextRandom(uint32_t range) {
+  lcg_state = lcg_state * 1664525u + 1013904223u;
+  return (lcg_state >> 8) % range;
+}
+
+struct ReplayResult {
+  uint32_t snapshots;
+  int64_t max_snapshot_wait_us;
+  int64_t max_stream_hold_us;
+  uint32_t stream_frames;
+  uint32_t stream_frames_off_mode;  // Stream frames captured at a mode other than its own
+  uint32_t p50_ms, p99_ms;
+  uint32_t preemptions, restores;
+};
+
+// One stream client (optional) plus a snapshot client that polls again 0.3-1.3 s
+// after each response, both driven through the arbiter as main.cpp does.
+static void replay(bool streaming, ReplayResult *r) {
+  CameraArbiter arb;
+  cameraArbiterInit(&arb);
+  memset(r, 0, sizeof(*r));
+  lcg_state = streaming ? 7 : 3;
+
+  CameraMode mode = STREAM_MODE;
+  int64_t now = 0;
+  int64_t hold_until = 0;                 // Valid while arb.owner >= 0
+  int64_t stream_wants_at = streaming ? 0 : -1;  // -1 = not asking (or already waiting)
+  bool stream_waiting = false;
+  int64_t snapshot_at = 500000;            // Next request, or its arrival while it waits
+  bool snapshot_waiting = false;
+
+  while (now < REPLAY_US) {
+    // Next event: the holder finishes, the snapshot client asks, or the stream asks
+    int64_t next = INT64_MAX;
+    if (arb.owner >= 0) next = hold_until;
+    if (!snapshot_waiting && arb.owner != CAMERA_CLIENT_SNAPSHOT && snapshot_at < next) next = snapshot_at;
+    if (stream_wants_at >= 0 && stream_wants_at < next) next = stream_wants_at;
+    now = next;
+
+    int wake = -1;
+    if (arb.owner >= 0 && now == hold_until) {
+      int owner = arb.owner;
+      wake = cameraArbiterRelease(&arb);
+      if (owner == CAMERA_CLIENT_STREAM) {
+        stream_wants_at = now + STREAM_SEND_US;
+      } else {
+        cameraLatencyRecord(&arb.snapshot[streaming ? 1 : 0], (uint32_t)((now - snapshot_at) / 1000));
+        r->snapshots++;
+        snapshot_at = now + 300000 + nextRandom(1000000);
+      }
+    }
+
+    // Snapshot request (new, or woken after waiting)
+    bool snapshot_asks = arb.owner != CAMERA_CLIENT_SNAPSHOT &&
+                         ((snapshot_waiting && wake == CAMERA_CLIENT_SNAPSHOT) ||
+                          (!snapshot_waiting && now == snapshot_at));
+    if (snapshot_asks) {
+      if (cameraArbiterTryAcquire(&arb, CAMERA_CLIENT_SNAPSHOT, &mode, now)) {
+        if (snapshot_waiting) cameraArbiterWaitEnd(&arb, CAMERA_CLIENT_SNAPSHOT);
+        snapshot_waiting = false;
+        int64_t waited = now - snapshot_at;
+        if (waited > r->max_snapshot_wait_us) r->max_snapshot_wait_us = waited;
+        hold_until = now + SNAPSHOT_US + (sameMode(mode, SNAPSHOT_MODE) ? 0 : REINIT_US);
+        mode = SNAPSHOT_MODE;
+        continue;
+      }
+      if (!snapshot_waiting) cameraArbiterWaitBegin(&arb, CAMERA_CLIENT_SNAPSHOT);
+      snapshot_waiting = true;
+    }
+
+    // Stream frame request (new, or woken after waiting)
+    bool stream_asks = (stream_waiting && wake == CAMERA_CLIENT_STREAM) || now == stream_wants_at;
+    if (stream_asks && arb.owner < 0) {
+      if (cameraArbiterTryAcquire(&arb, CAMERA_CLIENT_STREAM, &mode, now)) {
+        if (stream_waiting) cameraArbiterWaitEnd(&arb, CAMERA_CLIENT_STREAM);
+        stream_waiting = false;
+        stream_wants_at = -1;
+        int64_t hold = STREAM_FRAME_US;
+        CameraMode back;
+        if (cameraArbiterTakeRestore(&arb, &mode, &back)) {
+          mode = back;
+          hold += REINIT_US;
+        }
+        if (!sameMode(mode, STREAM_MODE)) r->stream_frames_off_mode++;
+        if (hold > r->max_stream_hold_us) r->max_stream_hold_us = hold;
+        r->stream_frames++;
+        hold_until = now + hold;
+        continue;
+      }
+    }
+    if (stream_asks && !stream_waiting) {
+      cameraArbiterWaitBegin(&arb, CAMERA_CLIENT_STREAM);
+      stream_waiting = true;
+      stream_wants_at = -1;
+    }
+  }
+
+  const CameraLatencyStats *lat = &arb.snapshot[streaming ? 1 : 0];
+  r->p50_ms = cameraLatencyPercentile(lat, 0.5f);
+  r->p99_ms = cameraLatencyPercentile(lat, 0.99f);
+  r->preemptions = arb.preemptions;
+  r->restores = arb.restores;
+
+  char line[160];
+  snprintf(line, sizeof(line), "%s: %u snapshots, p50 %u ms, p99 %u ms, max wait %lld ms, %u stream frames",
+           streaming ? "stream active" : "idle", (unsigned)r->snapshots, (unsigned)r->p50_ms,
+           (unsigned)r->p99_ms, (long long)(r->max_snapshot_wait_us / 1000), (unsigned)r->stream_frames);
+  TEST_MESSAGE(line);
+}
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static void test_snapshot_idle(void) {
+  ReplayResult r;
+  replay(false, &r);
+  TEST_ASSERT_GREATER_THAN_UINT32(300, r.snapshots);
+  TEST_ASSERT_EQUAL_INT64(0, r.max_snapshot_wait_us);
+  TEST_ASSERT_EQUAL_UINT32(0, r.preemptions);
+  // Only the first snapshot switches mode; the rest are capture + encode
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(SNAPSHOT_US / 1000 + 60, r.p99_ms);
+}
+
+static void test_snapshot_preempts_stream(void) {
+  ReplayResult idle, active;
+  replay(false, &idle);
+  replay(true, &active);
+  TEST_ASSERT_GREATER_THAN_UINT32(300, active.snapshots);
+  TEST_ASSERT_GREATER_THAN_UINT32(500, active.stream_frames);
+
+  // A snapshot waits for at most the stream frame in progress, never a queue of them
+  TEST_ASSERT_GREATER_THAN(0, active.max_snapshot_wait_us);
+  TEST_ASSERT_LESS_OR_EQUAL(active.max_stream_hold_us, active.max_snapshot_wait_us);
+  TEST_ASSERT_LESS_OR_EQUAL(STREAM_FRAME_US + REINIT_US, active.max_stream_hold_us);
+
+  // Every snapshot displaced the stream, which came back at its own mode
+  TEST_ASSERT_EQUAL_UINT32(active.snapshots, active.preemptions);
+  TEST_ASSERT_GREATER_OR_EQUAL_UINT32(active.snapshots - 1, active.restores);
+  TEST_ASSERT_EQUAL_UINT32(0, active.stream_frames_off_mode);
+
+  // p99 with a stream: the snapshot's own mode switch plus at most one stream frame
+  // (with its switch back) on top of the idle case
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(idle.p99_ms + (REINIT_US + STREAM_FRAME_US + REINIT_US) / 1000 * 6 / 5,
+                                   active.p99_ms);
+}
+
+static void test_priority_order(void) {
+  CameraArbiter arb;
+  cameraArbiterInit(&arb);
+  TEST_ASSERT_TRUE(cameraArbiterTryAcquire(&arb, CAMERA_CLIENT_STREAM, &STREAM_MODE, 1000));
+  TEST_ASSERT_FALSE(cameraArbiterTryAcquire(&arb, CAMERA_CLIENT_SNAPSHOT, &STREAM_MODE, 2000));
+  cameraArbiterWaitBegin(&arb, CAMERA_CLIENT_TIMELAPSE);
+  cameraArbiterWaitBegin(&arb, CAMERA_CLIENT_SNAPSHOT);
+
+  // Release wakes the highest class; lower classes can't jump in while it waits
+  TEST_ASSERT_EQUAL_INT(CAMERA_CLIENT_SNAPSHOT, cameraArbiterRelease(&arb));
+  TEST_ASSERT_FALSE(cameraArbiterTryAcquire(&arb, CAMERA_CLIENT_STREAM, &STREAM_MODE, 3000));
+  TEST_ASSERT_FALSE(cameraArbiterTryAcquire(&arb, CAMERA_CLIENT_TIMELAPSE, &STREAM_MODE, 3000));
+  TEST_ASSERT_TRUE(cameraArbiterTryAcquire(&arb, CAMERA_CLIENT_SNAPSHOT, &STREAM_MODE, 3000));
+  cameraArbiterWaitEnd(&arb, CAMERA_CLIENT_SNAPSHOT);
+
+  TEST_ASSERT_EQUAL_INT(CAMERA_CLIENT_TIMELAPSE, cameraArbiterRelease(&arb));
+  TEST_ASSERT_FALSE(cameraArbiterTryAcquire(&arb, CAMERA_CLIENT_IDLE, NULL, 4000));
+  TEST_ASSERT_TRUE(cameraArbiterTryAcquire(&arb, CAMERA_CLIENT_TIMELAPSE, &SNAPSHOT_MODE, 4000));
+  cameraArbiterWaitEnd(&arb, CAMERA_CLIENT_TIMELAPSE);
+  TEST_ASSERT_EQUAL_INT(-1, cameraArbiterRelease(&arb));
+  TEST_ASSERT_TRUE(cameraArbiterTryAcquire(&arb, CAMERA_CLIENT_IDLE, NULL, 5000));
+  TEST_ASSERT_EQUAL_UINT32(1, arb.grants[CAMERA_CLIENT_IDLE]);
+}
+
+static void test_restore_first_displaced_mode_once(void) {
+  const CameraMode timelapse_mode = {10, 4};
+  CameraArbiter arb;
+  cameraArbiterInit(&arb);
+  CameraMode back = {-1, -1};
+
+  TEST_ASSERT_TRUE(cameraArbiterTryAcquire(&arb, CAMERA_CLIENT_STREAM, &STREAM_MODE, 1000000));
+  cameraArbiterRelease(&arb);
+
+  // Snapshot, then a time-lapse shot, back to back: the stream's mode is the one kept
+  TEST_ASSERT_TRUE(cameraArbiterTryAcquire(&arb, CAMERA_CLIENT_SNAPSHOT, &STREAM_MODE, 1100000));
+  cameraArbiterRelease(&arb);
+  TEST_ASSERT_TRUE(cameraArbiterTryAcquire(&arb, CAMERA_CLIENT_TIMELAPSE, &SNAPSHOT_MODE, 1500000));
+  cameraArbiterRelease(&arb);
+  TEST_ASSERT_EQUAL_UINT32(2, arb.preemptions);
+
+  TEST_ASSERT_TRUE(cameraArbiterTryAcquire(&arb, CAMERA_CLIENT_STREAM, &timelapse_mode, 1600000));
+  TEST_ASSERT_TRUE(cameraArbiterTakeRestore(&arb, &timelapse_mode, &back));
+  TEST_ASSERT_EQUAL_INT(STREAM_MODE.framesize, back.framesize);
+  TEST_ASSERT_EQUAL_INT(STREAM_MODE.pixformat, back.pixformat);
+  TEST_ASSERT_FALSE(cameraArbiterTakeRestore(&arb, &timelapse_mode, &back));
+  cameraArbiterRelease(&arb);
+  TEST_ASSERT_EQUAL_UINT32(1, arb.restores);
+
+  // A snapshot at the stream's own mode: nothing to switch back
+  TEST_ASSERT_TRUE(cameraArbiterTryAcquire(&arb, CAMERA_CLIENT_SNAPSHOT, &STREAM_MODE, 1700000));
+  cameraArbiterRelease(&arb);
+  TEST_ASSERT_TRUE(cameraArbiterTryAcquire(&arb, CAMERA_CLIENT_STREAM, &STREAM_MODE, 1800000));
+  TEST_ASSERT_FALSE(cameraArbiterTakeRestore(&arb, &STREAM_MODE, &back));
+  cameraArbiterRelease(&arb);
+  TEST_ASSERT_EQUAL_UINT32(1, arb.restores);
+}
+
+static void test_no_restore_without_active_stream(void) {
+  CameraArbiter arb;
+  cameraArbiterInit(&arb);
+  CameraMode back;
+
+  TEST_ASSERT_TRUE(cameraArbiterTryAcquire(&arb, CAMERA_CLIENT_STREAM, &STREAM_MODE, 1000000));
+  cameraArbiterRelease(&arb);
+  // The stream stopped: a snapshot later than CAMERA_STREAM_ACTIVE_US displaces nothing
+  int64_t later = 1000000 + CAMERA_STREAM_ACTIVE_US;
+  TEST_ASSERT_FALSE(cameraArbiterStreamActive(&arb, later));
+  TEST_ASSERT_TRUE(cameraArbiterTryAcquire(&arb, CAMERA_CLIENT_SNAPSHOT, &STREAM_MODE, later));
+  cameraArbiterRelease(&arb);
+  TEST_ASSERT_EQUAL_UINT32(0, arb.preemptions);
+  TEST_ASSERT_TRUE(cameraArbiterTryAcquire(&arb, CAMERA_CLIENT_STREAM, &SNAPSHOT_MODE, later + 1000));
+  TEST_ASSERT_FALSE(cameraArbiterTakeRestore(&arb, &SNAPSHOT_MODE, &back));
+  cameraArbiterRelease(&arb);
+
+  // A stream waiting counts as active even without a recent grant
+  cameraArbiterWaitBegin(&arb, CAMERA_CLIENT_STREAM);
+  TEST_ASSERT_TRUE(cameraArbiterStreamActive(&arb, later + 10 * CAMERA_STREAM_ACTIVE_US));
+}
+
+static void test_latency_bucket_bounds(void) {
+  // p-quantile of {v, far outlier} at p=0.5 is v's bucket bound: at least v and less
+  // than one bucket (2^(1/4)) above it
+  for (uint32_t v = 1; v <= 55000; v += (v < 1000 ? 1 : 97)) {  // Below the top bucket
+    CameraLatencyStats stats = {};
+    cameraLatencyRecord(&stats, v);
+    cameraLatencyRecord(&stats, 1000000);
+    uint32_t bound = cameraLatencyPercentile(&stats, 0.5f);
+    TEST_ASSERT_GREATER_OR_EQUAL_UINT32(v, bound);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(v * 1.1893f + 1, bound);
+  }
+
+  CameraLatencyStats stats = {};
+  TEST_ASSERT_EQUAL_UINT32(0, cameraLatencyPercentile(&stats, 0.99f));
+  cameraLatencyRecord(&stats, 0);
+  TEST_ASSERT_EQUAL_UINT32(0, cameraLatencyPercentile(&stats, 0.99f));  // Capped at max
+
+  // Exact powers of two are bucket bounds; 17 is in the bucket ending at 2^(17/4) = 19.03
+  memset(&stats, 0, sizeof(stats));
+  for (int i = 0; i < 9; i++) cameraLatencyRecord(&stats, 16);
+  cameraLatencyRecord(&stats, 17);
+  cameraLatencyRecord(&stats, 500);
+  TEST_ASSERT_EQUAL_UINT32(16, cameraLatencyPercentile(&stats, 0.5f));
+  TEST_ASSERT_EQUAL_UINT32(20, cameraLatencyPercentile(&stats, 10.0f / 11));
+  TEST_ASSERT_EQUAL_UINT32(500, cameraLatencyPercentile(&stats, 0.99f));
+  TEST_ASSERT_EQUAL_UINT32(11, stats.count);
+  TEST_ASSERT_EQUAL_UINT64(9 * 16 + 17 + 500, stats.total_ms);
+
+  // Above the last bound (~65 s) the top bucket reports the maximum seen
+  memset(&stats, 0, sizeof(stats));
+  cameraLatencyRecord(&stats, 100000);
+  cameraLatencyRecord(&stats, 200000);
+  TEST_ASSERT_EQUAL_UINT32(200000, cameraLatencyPercentile(&stats, 0.5f));
+
+  // Uniform 1..1000 ms
+  memset(&stats, 0, sizeof(stats));
+  for (uint32_t v = 1; v <= 1000; v++) cameraLatencyRecord(&stats, v);
+  TEST_ASSERT_GREATER_OR_EQUAL_UINT32(500, cameraLatencyPercentile(&stats, 0.5f));
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(595, cameraLatencyPercentile(&stats, 0.5f));
+  TEST_ASSERT_GREATER_OR_EQUAL_UINT32(990, cameraLatencyPercentile(&stats, 0.99f));
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(1000, cameraLatencyPercentile(&stats, 0.99f));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_snapshot_idle);
+  RUN_TEST(test_snapshot_preempts_stream);
+  RUN_TEST(test_priority_order);
+  RUN_TEST(test_restore_first_displaced_mode_once);
+  RUN_TEST(test_no_restore_without_active_stream);
+  RUN_TEST(test_latency_bucket_bounds);
+  return UNITY_END();
+}
@@ -0,0 +1,213 @@
+// Native encoder on synthetic frames with known answers: YUYV decoded back to pixels
+// by the reference decoder (colour, 4:2:0 chroma placement) and the fused image stats
+#include <unity.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "jpeg_encoder.h"
+#include "../jpeg_ref_decode.h"
+
+// YUYV frame with luma from f(x, y) and neutral chroma
+static uint8_t *yuyvFrame(int width, int height, uint8_t (*luma)(int x, int y)) {
+  uint8_t *px = (uint8_t *)malloc((size_t)width * height * 2);
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      uint8_t *p = px + ((size_t)y * width + x) * 2;
+      p[0] = luma(x, y);
+      p[1] = 128;
+    }
+  }
+  return px;
+}
+
+static void encodeStats(const uint8_t *yuyv, int width, int height, JpegImageStats *stats) {
+  uint8_t *jpg;
+  size_t len;
+  TEST_ASSERT_TRUE(jpegEncodeYuyv(yuyv, width, height, 75, &jpg, &len, stats));
+  free(jpg);
+}
+
+static uint8_t flat100(int, int) { return 100; }
+static uint8_t topDarkBottomBlown(int, int y) { return y < 32 ? 0 : 255; }
+// 4x4 cells: a 1-pixel checker would give the same Laplacian at every sampled pixel
+static uint8_t checker(int x, int y) { return (((x >> 2) ^ (y >> 2)) & 1) ? 192 : 64; }
+// checker() through a 3x3 box blur (edges clamped)
+static uint8_t blurredChecker(int x, int y) {
+  int sum = 0;
+  for (int dy = -1; dy <= 1; dy++) {
+    for (int dx = -1; dx <= 1; dx++) {
+      int sx = x + dx < 0 ? 0 : (x + dx > 63 ? 63 : x + dx);
+      int sy = y + dy < 0 ? 0 : (y + dy > 63 ? 63 : y + dy);
+      sum += checker(sx, sy);
+    }
+  }
+  return (uint8_t)((sum + 4) / 9);
+}
+
+// YUYV with every byte from a function: luma per pixel, U/V per horizontal pair
+struct YuyvPattern {
+  int (*y)(int x, int row);
+  int (*u)(int pair, int row);
+  int (*v)(int pair, int row);
+};
+
+static uint8_t *yuyvPattern(int width, int height, const YuyvPattern *p) {
+  uint8_t *px = (uint8_t *)malloc((size_t)width * height * 2);
+  for (int row = 0; row < height; row++) {
+    for (int pair = 0; pair < width / 2; pair++) {
+      uint8_t *q = px + ((size_t)row * width + pair * 2) * 2;
+      q[0] = (uint8_t)p->y(pair * 2, row);
+      q[1] = (uint8_t)p->u(pair, row);
+      q[2] = (uint8_t)p->y(pair * 2 + 1, row);
+      q[3] = (uint8_t)p->v(pair, row);
+    }
+  }
+  return px;
+}
+
+// Encode, decode with the reference decoder and compare every reconstructed sample
+// of the three planes with what the pattern puts there: luma as is, chroma at
+// (pair, row pair) as the mean of the two rows. Returns the largest error seen.
+static int checkDecoded(int width, int height, int quality, const YuyvPattern *p, int tolerance) {
+  uint8_t *px = yuyvPattern(width, height, p);
+  uint8_t *jpg;
+  size_t len;
+  TEST_ASSERT_TRUE(jpegEncodeYuyv(px, width, height, quality, &jpg, &len));
+  free(px);
+  RefDecode d;
+  refDecode(jpg, len, &d);
+  free(jpg);
+  TEST_ASSERT_EQUAL_INT(width, d.width);
+  TEST_ASSERT_EQUAL_INT(height, d.height);
+  // 4:2:0: luma 2x2, one block each of Cb and Cr per MCU
+  TEST_ASSERT_EQUAL_INT(2, d.h[0]);
+  TEST_ASSERT_EQUAL_INT(2, d.v[0]);
+  TEST_ASSERT_EQUAL_INT(1, d.h[1] * d.v[1]);
+  TEST_ASSERT_EQUAL_INT(1, d.h[2] * d.v[2]);
+
+  int worst = 0;
+  for (int c = 0; c < 3; c++) {
+    int pw, ph;
+    uint8_t *plane = refPlane(&d, c, &pw, &ph);
+    int w = c ? width / 2 : width, h = c ? height / 2 : height;
+    for (int y = 0; y < h; y++) {
+      for (int x = 0; x < w; x++) {
+        int want;
+        if (c == 0) {
+          want = p->y(x, y);
+        } else {
+          int (*f)(int, int) = c == 1 ? p->u : p->v;
+          want = (f(x, 2 * y) + f(x, 2 * y + 1) + 1) / 2;
+        }
+        int err = abs(plane[y * pw + x] - want);
+        if (err > worst) worst = err;
+        if (err > tolerance) {
+          char msg[80];
+          snprintf(msg, sizeof(msg), "component %d at (%d, %d): %d, expected %d", c, x, y, plane[y * pw + x], want);
+          TEST_FAIL_MESSAGE(msg);
+        }
+      }
+    }
+    free(plane);
+  }
+  free(d.coef);
+  return worst;
+}
+
+static int lumaFlat(int, int) { return 180; }
+static int uFlat(int, int) { return 60; }
+static int vFlat(int, int) { return 200; }
+// Steep enough that a chroma sample one pair or one row pair off is outside tolerance
+static int lumaRamp(int x, int y) { return 16 + 3 * x + 3 * y; }
+static int uRamp(int pair, int row) { return 20 + 6 * pair + 3 * row; }
+static int vRamp(int pair, int row) { return 230 - 5 * pair - 3 * row; }
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static void test_flat_colour(void) {
+  // U -> Cb and V -> Cr, not swapped, and no level shift on any component
+  const YuyvPattern flat = {lumaFlat, uFlat, vFlat};
+  TEST_ASSERT_LESS_OR_EQUAL(1, checkDecoded(48, 32, 90, &flat, 1));
+  // Frame size off the MCU grid: padded edges must not leak into the picture
+  TEST_ASSERT_LESS_OR_EQUAL(1, checkDecoded(38, 22, 90, &flat, 1));
+}
+
+static void test_gradient_chroma_placement(void) {
+  // Luma at each pixel and chroma at each (pair, row pair) of a frame where every
+  // sample differs from its neighbours, on and off the MCU grid
+  const YuyvPattern ramp = {lumaRamp, uRamp, vRamp};
+  int on_grid = checkDecoded(32, 32, 90, &ramp, 3);
+  int off_grid = checkDecoded(30, 26, 90, &ramp, 3);
+  char msg[64];
+  snprintf(msg, sizeof(msg), "largest reconstruction error %d (off the MCU grid %d)", on_grid, off_grid);
+  TEST_MESSAGE(msg);
+}
+
+static void test_flat_frame(void) {
+  uint8_t *px = yuyvFrame(64, 48, flat100);
+  JpegImageStats stats;
+  encodeStats(px, 64, 48, &stats);
+  TEST_ASSERT_EQUAL_UINT32(32 * 24, stats.samples);  // Every second row and column
+  TEST_ASSERT_EQUAL_UINT32(stats.samples, stats.histogram[100]);
+  TEST_ASSERT_EQUAL_INT(64, stats.width);
+  TEST_ASSERT_EQUAL_INT(48, stats.height);
+  TEST_ASSERT_FLOAT_WITHIN(1e-4, 100.0, stats.mean);
+  TEST_ASSERT_FLOAT_WITHIN(1e-6, 0.0, stats.clipped_low);
+  TEST_ASSERT_FLOAT_WITHIN(1e-6, 0.0, stats.clipped_high);
+  TEST_ASSERT_FLOAT_WITHIN(1e-6, 0.0, stats.sharpness);
+  free(px);
+}
+
+static void test_half_clipped(void) {
+  uint8_t *px = yuyvFrame(64, 64, topDarkBottomBlown);
+  JpegImageStats stats;
+  encodeStats(px, 64, 64, &stats);
+  TEST_ASSERT_FLOAT_WITHIN(1e-6, 0.5, stats.clipped_low);
+  TEST_ASSERT_FLOAT_WITHIN(1e-6, 0.5, stats.clipped_high);
+  TEST_ASSERT_FLOAT_WITHIN(1e-4, 127.5, stats.mean);
+  TEST_ASSERT_EQUAL_UINT32(stats.samples / 2, stats.histogram[0]);
+  TEST_ASSERT_EQUAL_UINT32(stats.samples / 2, stats.histogram[255]);
+  free(px);
+}
+
+static void test_checkerboard_sharper_than_blurred(void) {
+  uint8_t *sharp_px = yuyvFrame(64, 64, checker);
+  uint8_t *blur_px = yuyvFrame(64, 64, blurredChecker);
+  JpegImageStats sharp, blurred;
+  encodeStats(sharp_px, 64, 64, &sharp);
+  encodeStats(blur_px, 64, 64, &blurred);
+  TEST_ASSERT_TRUE(blurred.sharpness > 0);
+  TEST_ASSERT_TRUE(sharp.sharpness > blurred.sharpness * 10);
+  // Same average brightness: the score tracks detail, not exposure
+  TEST_ASSERT_FLOAT_WITHIN(16.0, sharp.mean, blurred.mean);
+  free(sharp_px);
+  free(blur_px);
+}
+
+static void test_rgb565_flat_white(void) {
+  // Same stats from the RGB565 path: full white converts to luma 255
+  uint8_t *px = (uint8_t *)malloc(32 * 32 * 2);
+  memset(px, 0xFF, 32 * 32 * 2);
+  uint8_t *jpg;
+  size_t len;
+  JpegImageStats stats;
+  TEST_ASSERT_TRUE(jpegEncodeRgb565(px, 32, 32, 75, &jpg, &len, &stats));
+  TEST_ASSERT_FLOAT_WITHIN(1e-4, 255.0, stats.mean);
+  TEST_ASSERT_FLOAT_WITHIN(1e-6, 1.0, stats.clipped_high);
+  TEST_ASSERT_FLOAT_WITHIN(1e-6, 0.0, stats.sharpness);
+  free(jpg);
+  free(px);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_flat_colour);
+  RUN_TEST(test_gradient_chroma_placement);
+  RUN_TEST(test_flat_frame);
+  RUN_TEST(test_half_clipped);
+  RUN_TEST(test_checkerboard_sharper_than_blurred);
+  RUN_TEST(test_rgb565_flat_white);
+  return UNITY_END();
+}
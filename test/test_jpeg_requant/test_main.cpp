@@ -0,0 +1,272 @@
+// jpegRequantize() on encoder-generated JPEGs: every output coefficient is checked
+// against a separate reference decode of input and output, plus 16-bit tables,
+// truncations, the q-to-table mapping and a host timing run at UXGA
+#include <unity.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "jpeg_bitstream.h"
+#include "jpeg_requant.h"
+#include "jpeg_validate.h"
+#include "../jpeg_fixture.h"
+#include "../jpeg_ref_decode.h"
+
+// Round-half-away-from-zero c * q_in / q_out: what a decode + re-quantize would give
+static int rescale(int c, int q_in, int q_out) {
+  int n = c * q_in;
+  return n >= 0 ? (n + q_out / 2) / q_out : -((-n + q_out / 2) / q_out);
+}
+
+// Requantize by num/den and check the output, coefficient by coefficient
+static void checkRequant(const Jpeg *src, int num, int den) {
+  uint8_t *out;
+  size_t out_len;
+  TEST_ASSERT_TRUE(jpegRequantize(src->buf, src->len, num, den, &out, &out_len));
+  JpegCheck check;
+  TEST_ASSERT_EQUAL_INT(JPEG_VALID, jpegValidate(out, out_len, 0, 0, &check));
+
+  RefDecode in, res;
+  refDecode(src->buf, src->len, &in);
+  refDecode(out, out_len, &res);
+  TEST_ASSERT_EQUAL_INT(in.width, res.width);
+  TEST_ASSERT_EQUAL_INT(in.height, res.height);
+  TEST_ASSERT_EQUAL_INT(in.blocks, res.blocks);
+  for (int t = 0; t < 2; t++) {
+    for (int i = 0; i < 64; i++) {
+      int q = (in.qt[t][i] * num + den / 2) / den;
+      if (q > 255) q = 255;
+      TEST_ASSERT_EQUAL_UINT16(q, res.qt[t][i]);
+    }
+  }
+
+  int mcu_blocks = 0;
+  for (int c = 0; c < 3; c++) mcu_blocks += in.h[c] * in.v[c];
+  for (int b = 0; b < in.blocks; b++) {
+    int pos = b % mcu_blocks;
+    int c = pos < in.h[0] * in.v[0] ? 0 : (pos < in.h[0] * in.v[0] + in.h[1] * in.v[1] ? 1 : 2);
+    const uint16_t *qi = in.qt[in.tq[c]], *qo = res.qt[res.tq[c]];
+    for (int k = 0; k < 64; k++) {
+      int expected = rescale(in.coef[b * 64 + k], qi[k], qo[k]);
+      if (expected != res.coef[b * 64 + k]) {
+        char msg[96];
+        snprintf(msg, sizeof(msg), "block %d coef %d: %d -> %d, expected %d", b, k, in.coef[b * 64 + k],
+                 res.coef[b * 64 + k], expected);
+        TEST_FAIL_MESSAGE(msg);
+      }
+    }
+  }
+  free(in.coef);
+  free(res.coef);
+  free(out);
+}
+
+// Copy of jpg with its first DQT table rewritten at 16-bit precision
+static Jpeg withWideTable(const Jpeg *src) {
+  size_t dqt = findSegment(src->buf, src->len, 0xDB);
+  TEST_ASSERT_NOT_EQUAL(0, dqt);
+  size_t seg_len = (src->buf[dqt + 2] << 8) | src->buf[dqt + 3];
+  TEST_ASSERT_EQUAL_HEX8(0x00, src->buf[dqt + 4]);  // Table 0, 8-bit
+
+  Jpeg jpg;
+  jpg.len = src->len + 64;
+  jpg.buf = (uint8_t *)malloc(jpg.len);
+  memcpy(jpg.buf, src->buf, dqt);
+  uint8_t *p = jpg.buf + dqt;
+  p[0] = 0xFF;
+  p[1] = 0xDB;
+  p[2] = (uint8_t)((seg_len + 64) >> 8);
+  p[3] = (uint8_t)(seg_len + 64);
+  p[4] = 0x10;  // Pq=1, table 0
+  for (int i = 0; i < 64; i++) {
+    p[5 + 2 * i] = 0;
+    p[6 + 2 * i] = src->buf[dqt + 5 + i];
+  }
+  // Any further tables in the same segment, then the rest of the file
+  memcpy(p + 5 + 128, src->buf + dqt + 5 + 64, src->len - (dqt + 5 + 64));
+  return jpg;
+}
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static void test_identity(void) {
+  Jpeg jpg = encodeSynthetic(320, 240, 64, 90);
+  checkRequant(&jpg, 1, 1);
+  free(jpg.buf);
+}
+
+static void test_coarser(void) {
+  const int sizes[][2] = {{64, 48}, {98, 34}, {320, 240}};
+  const int scales[][2] = {{3, 1}, {30, 12}, {5, 4}, {255, 1}};
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    Jpeg jpg = encodeSynthetic(sizes[i][0], sizes[i][1], 96, 90);
+    for (size_t s = 0; s < sizeof(scales) / sizeof(scales[0]); s++) checkRequant(&jpg, scales[s][0], scales[s][1]);
+    free(jpg.buf);
+  }
+}
+
+static void test_output_shrinks(void) {
+  Jpeg jpg = encodeSynthetic(640, 480, 64, 90);
+  uint8_t *out;
+  size_t out_len;
+  TEST_ASSERT_TRUE(jpegRequantize(jpg.buf, jpg.len, 3, 1, &out, &out_len));
+  TEST_ASSERT_LESS_THAN(jpg.len * 2 / 3, out_len);
+  free(out);
+  free(jpg.buf);
+}
+
+static void test_wide_tables(void) {
+  Jpeg plain = encodeSynthetic(64, 48, 64, 90);
+  Jpeg jpg = withWideTable(&plain);
+  // 16-bit precision, every step <= 255: handled like the 8-bit table
+  checkRequant(&jpg, 2, 1);
+
+  // A step above 255 can't be carried in the 8-bit output: refused, not clamped
+  size_t dqt = findSegment(jpg.buf, jpg.len, 0xDB);
+  jpg.buf[dqt + 5 + 2 * 63] = 0x01;  // Highest-frequency step: 256 + x
+  uint8_t *out = (uint8_t *)1;
+  size_t out_len = 1;
+  TEST_ASSERT_FALSE(jpegRequantize(jpg.buf, jpg.len, 2, 1, &out, &out_len));
+  TEST_ASSERT_NULL(out);
+  TEST_ASSERT_EQUAL_size_t(0, out_len);
+  free(jpg.buf);
+  free(plain.buf);
+}
+
+static void test_bad_arguments(void) {
+  Jpeg jpg = encodeSynthetic(64, 48, 64, 90);
+  uint8_t *out;
+  size_t out_len;
+  TEST_ASSERT_FALSE(jpegRequantize(jpg.buf, jpg.len, 1, 2, &out, &out_len));  // Finer: never
+  TEST_ASSERT_FALSE(jpegRequantize(jpg.buf, jpg.len, 1, 0, &out, &out_len));
+  TEST_ASSERT_FALSE(jpegRequantize(NULL, 0, 2, 1, &out, &out_len));
+
+  // Progressive SOF
+  size_t sof = findSegment(jpg.buf, jpg.len, 0xC0);
+  jpg.buf[sof + 1] = 0xC2;
+  TEST_ASSERT_FALSE(jpegRequantize(jpg.buf, jpg.len, 2, 1, &out, &out_len));
+  TEST_ASSERT_NULL(out);
+  free(jpg.buf);
+}
+
+static void test_truncations(void) {
+  // Every cut either fails or yields a structurally valid JPEG; under the
+  // sanitizers an out-of-bounds read fails the suite
+  Jpeg jpg = encodeSynthetic(64, 48, 64, 90);
+  for (size_t len = 0; len < jpg.len; len++) {
+    uint8_t *cut = (uint8_t *)malloc(len ? len : 1);
+    memcpy(cut, jpg.buf, len);
+    uint8_t *out;
+    size_t out_len;
+    if (jpegRequantize(cut, len, 2, 1, &out, &out_len)) {
+      JpegCheck check;
+      TEST_ASSERT_EQUAL_INT(JPEG_VALID, jpegValidate(out, out_len, 64, 48, &check));
+      free(out);
+    }
+    free(cut);
+  }
+  free(jpg.buf);
+}
+
+// Luma (first) table of a JPEG, file order
+static const uint8_t *lumaTable(const Jpeg *jpg) {
+  size_t dqt = findSegment(jpg->buf, jpg->len, 0xDB);
+  TEST_ASSERT_NOT_EQUAL(0, dqt);
+  TEST_ASSERT_EQUAL_HEX8(0x00, jpg->buf[dqt + 4]);
+  return jpg->buf + dqt + 5;
+}
+
+static void test_quality_scale(void) {
+  TEST_ASSERT_EQUAL_INT(100, jpegQualityScale(50));
+  TEST_ASSERT_EQUAL_INT(50, jpegQualityScale(75));
+  TEST_ASSERT_EQUAL_INT(500, jpegQualityScale(10));
+  TEST_ASSERT_EQUAL_INT(5000, jpegQualityScale(0));    // Clamped to 1
+  TEST_ASSERT_EQUAL_INT(0, jpegQualityScale(200));     // Clamped to 100
+}
+
+static void test_estimate_quality(void) {
+  const int qualities[] = {5, 10, 12, 30, 50, 75, 90};
+  for (size_t i = 0; i < sizeof(qualities) / sizeof(qualities[0]); i++) {
+    Jpeg jpg = encodeSynthetic(64, 48, 16, qualities[i]);
+    int q = jpegEstimateQuality(jpg.buf, jpg.len);
+    TEST_ASSERT_INT_WITHIN_MESSAGE(1, qualities[i], q, "estimate of an encoder table");
+    free(jpg.buf);
+  }
+  TEST_ASSERT_EQUAL_INT(0, jpegEstimateQuality(NULL, 0));
+  const uint8_t no_tables[] = {0xFF, 0xD8, 0xFF, 0xDA, 0x00, 0x02};
+  TEST_ASSERT_EQUAL_INT(0, jpegEstimateQuality(no_tables, sizeof(no_tables)));
+}
+
+// q means the same on every path: a q=90 frame requantized to 30 carries (within
+// rounding) the tables the encoder itself uses at 30, never the other way round
+static void test_requantize_to_quality(void) {
+  Jpeg fine = encodeSynthetic(320, 240, 64, 90);
+  Jpeg direct = encodeSynthetic(320, 240, 64, 30);
+  Jpeg rq;
+  TEST_ASSERT_TRUE(jpegRequantizeToQuality(fine.buf, fine.len, 30, &rq.buf, &rq.len));
+  TEST_ASSERT_INT_WITHIN(1, 30, jpegEstimateQuality(rq.buf, rq.len));
+  TEST_ASSERT_LESS_THAN(fine.len, rq.len);
+
+  // Each step is a rescaled, already rounded q=90 step: off by at most half the ratio
+  const uint8_t *got = lumaTable(&rq), *want = lumaTable(&direct);
+  int ratio = jpegQualityScale(30) / jpegQualityScale(90);
+  for (int i = 0; i < 64; i++) TEST_ASSERT_INT_WITHIN(ratio / 2 + 1, want[i], got[i]);
+  free(rq.buf);
+
+  // Lower or equal requested quality only: q at or above the frame's is refused
+  rq.buf = (uint8_t *)1;
+  TEST_ASSERT_FALSE(jpegRequantizeToQuality(direct.buf, direct.len, 30, &rq.buf, &rq.len));
+  TEST_ASSERT_NULL(rq.buf);
+  TEST_ASSERT_FALSE(jpegRequantizeToQuality(direct.buf, direct.len, 63, &rq.buf, &rq.len));
+  TEST_ASSERT_TRUE(jpegRequantizeToQuality(direct.buf, direct.len, 12, &rq.buf, &rq.len));
+  TEST_ASSERT_INT_WITHIN(1, 12, jpegEstimateQuality(rq.buf, rq.len));
+  free(rq.buf);
+  free(direct.buf);
+  free(fine.buf);
+}
+
+static double nowMs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static void test_timing_uxga(void) {
+  // Host numbers with the sanitizers on: for comparing changes, not the ESP32-S3
+  Jpeg jpg = encodeSynthetic(1600, 1200, 64, 90);
+  const int scales[][2] = {{1, 1}, {2, 1}, {3, 1}};
+  for (size_t s = 0; s < sizeof(scales) / sizeof(scales[0]); s++) {
+    uint8_t *out;
+    size_t out_len = 0;
+    double t0 = nowMs();
+    const int runs = 3;
+    for (int r = 0; r < runs; r++) {
+      TEST_ASSERT_TRUE(jpegRequantize(jpg.buf, jpg.len, scales[s][0], scales[s][1], &out, &out_len));
+      if (r < runs - 1) free(out);
+    }
+    double ms = (nowMs() - t0) / runs;
+    char line[128];
+    snprintf(line, sizeof(line), "UXGA x%d/%d: %u -> %u bytes, %.1f ms (%.1f MB/s in)", scales[s][0],
+             scales[s][1], (unsigned)jpg.len, (unsigned)out_len, ms, jpg.len / 1e3 / ms);
+    TEST_MESSAGE(line);
+    free(out);
+  }
+  free(jpg.buf);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_identity);
+  RUN_TEST(test_coarser);
+  RUN_TEST(test_output_shrinks);
+  RUN_TEST(test_wide_tables);
+  RUN_TEST(test_bad_arguments);
+  RUN_TEST(test_truncations);
+  RUN_TEST(test_quality_scale);
+  RUN_TEST(test_estimate_quality);
+  RUN_TEST(test_requantize_to_quality);
+  RUN_TEST(test_timing_uxga);
+  return UNITY_END();
+}
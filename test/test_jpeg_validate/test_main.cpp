@@ -0,0 +1,276 @@
+// jpegValidate() fuzzed with a corpus built from the software encoder's output:
+// every truncation point, byte mutations, restart markers, trailing garbage and junk.
+// Each result is checked against a byte-at-a-time reference walk, so the word-at-a-time
+// 0xFF search can't drift from the plain algorithm. Run with the native env's
+// sanitizers, an out-of-bounds read fails the suite.
+#include <unity.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "jpeg_validate.h"
+#include "../jpeg_fixture.h"
+
+#define MUTATIONS_PER_FILE  3000
+
+struct CorpusFile {
+  uint8_t *buf;
+  size_t len;
+  uint16_t width;
+  uint16_t height;
+};
+
+static CorpusFile corpus[12];
+static int corpus_count;
+
+static void addEncoded(int width, int height, int quality, bool rgb565) {
+  Jpeg jpg = encodeSynthetic(width, height, 64, quality, rgb565);
+  CorpusFile *f = &corpus[corpus_count++];
+  f->buf = jpg.buf;
+  f->len = jpg.len;
+  f->width = (uint16_t)width;
+  f->height = (uint16_t)height;
+}
+
+// Same image with a DRI segment and an RSTn marker every 64 scan bytes (structure
+// only: the validator doesn't decode the entropy-coded data)
+static void addWithRestarts(const CorpusFile *src) {
+  const uint8_t *sos = NULL;
+  for (size_t i = 2; i + 1 < src->len; i++) {
+    if (src->buf[i] == 0xFF && src->buf[i + 1] == 0xDA) {
+      sos = src->buf + i;
+      break;
+    }
+  }
+  TEST_ASSERT_NOT_NULL(sos);
+  size_t head = sos - src->buf;
+  size_t scan_start = head + 2 + ((sos[2] << 8) | sos[3]);
+  size_t scan_len = src->len - 2 - scan_start;
+
+  CorpusFile *f = &corpus[corpus_count++];
+  f->buf = (uint8_t *)malloc(src->len + 6 + (scan_len / 64 + 1) * 2);
+  size_t n = 0;
+  memcpy(f->buf, src->buf, head);
+  n = head;
+  static const uint8_t DRI[6] = {0xFF, 0xDD, 0x00, 0x04, 0x00, 0x04};
+  memcpy(f->buf + n, DRI, sizeof(DRI));
+  n += sizeof(DRI);
+  memcpy(f->buf + n, sos, scan_start - head);
+  n += scan_start - head;
+  int rst = 0;
+  for (size_t i = 0; i < scan_len; i++) {
+    // Not between 0xFF and its stuffing byte
+    if (i && i % 64 == 0 && src->buf[scan_start + i - 1] != 0xFF) {
+      f->buf[n++] = 0xFF;
+      f->buf[n++] = (uint8_t)(0xD0 + (rst++ & 7));
+    }
+    f->buf[n++] = src->buf[scan_start + i];
+  }
+  f->buf[n++] = 0xFF;
+  f->buf[n++] = 0xD9;
+  f->len = n;
+  f->width = src->width;
+  f->height = src->height;
+}
+
+// Byte-at-a-time walk of the same grammar: the oracle for the differential checks
+static JpegCheckResult referenceValidate(const uint8_t *buf, size_t len, JpegCheck *out) {
+  memset(out, 0, sizeof(*out));
+  if (len < 4 || buf[0] != 0xFF || buf[1] != 0xD8) return JPEG_ERR_NO_SOI;
+  bool have_sof = false;
+  size_t pos = 2;
+  for (;;) {
+    if (pos >= len) return JPEG_ERR_TRUNCATED;
+    if (buf[pos] != 0xFF) return JPEG_ERR_MARKER;
+    while (pos < len && buf[pos] == 0xFF) pos++;
+    if (pos >= len) return JPEG_ERR_TRUNCATED;
+    uint8_t m = buf[pos++];
+    if (m == 0x01) continue;
+    if (m == 0x00 || m == 0xD8 || m == 0xD9 || (m >= 0xD0 && m <= 0xD7)) return JPEG_ERR_MARKER;
+    if (pos + 2 > len) return JPEG_ERR_TRUNCATED;
+    size_t seg_len = ((size_t)buf[pos] << 8) | buf[pos + 1];
+    if (seg_len < 2) return JPEG_ERR_MARKER;
+    if (pos + seg_len > len) return JPEG_ERR_TRUNCATED;
+    if (m >= 0xC0 && m <= 0xCF && m != 0xC4 && m != 0xC8 && m != 0xCC) {
+      if (seg_len < 8) return JPEG_ERR_MARKER;
+      out->height = (uint16_t)((buf[pos + 3] << 8) | buf[pos + 4]);
+      out->width = (uint16_t)((buf[pos + 5] << 8) | buf[pos + 6]);
+      have_sof = true;
+    }
+    pos += seg_len;
+    if (m != 0xDA) continue;
+    if (!have_sof) return JPEG_ERR_NO_SOF;
+    for (;;) {
+      while (pos < len && buf[pos] != 0xFF) pos++;
+      if (pos + 1 >= len) return JPEG_ERR_TRUNCATED;
+      uint8_t next = buf[pos + 1];
+      if (next == 0x00 || (next >= 0xD0 && next <= 0xD7)) {
+        pos += 2;
+      } else if (next == 0xFF) {
+        pos++;
+      } else {
+        break;
+      }
+    }
+    if (buf[pos + 1] == 0xD9) {
+      out->len = pos + 2;
+      out->trailing = len - out->len;
+      return JPEG_VALID;
+    }
+  }
+}
+
+// Validate an exact-size heap copy (so the sanitizer sees any read past len) and
+// compare with the reference
+static JpegCheckResult checkAgainstReference(const uint8_t *data, size_t len) {
+  uint8_t *copy = (uint8_t *)malloc(len ? len : 1);
+  memcpy(copy, data, len);
+  JpegCheck got, want;
+  JpegCheckResult result = jpegValidate(copy, len, 0, 0, &got);
+  JpegCheckResult expected = referenceValidate(copy, len, &want);
+  if (result != expected) {
+    char msg[96];
+    snprintf(msg, sizeof(msg), "len %u: %s, reference says %s", (unsigned)len, jpegCheckName(result),
+             jpegCheckName(expected));
+    free(copy);
+    TEST_FAIL_MESSAGE(msg);
+  }
+  if (result == JPEG_VALID) {
+    TEST_ASSERT_EQUAL_size_t(want.len, got.len);
+    TEST_ASSERT_EQUAL_size_t(len, got.len + got.trailing);
+    TEST_ASSERT_EQUAL_HEX8(0xFF, copy[got.len - 2]);
+    TEST_ASSERT_EQUAL_HEX8(0xD9, copy[got.len - 1]);
+  }
+  free(copy);
+  return result;
+}
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static void test_build_corpus(void) {
+  static const int SIZES[][2] = {{64, 48}, {320, 240}, {98, 34}};
+  for (size_t s = 0; s < sizeof(SIZES) / sizeof(SIZES[0]); s++) {
+    addEncoded(SIZES[s][0], SIZES[s][1], 12, false);
+    addEncoded(SIZES[s][0], SIZES[s][1], 90, true);
+  }
+  int encoded = corpus_count;
+  for (int i = 0; i < encoded; i += 2) addWithRestarts(&corpus[i]);
+  TEST_ASSERT_EQUAL(9, corpus_count);
+
+  int stuffed = 0;
+  for (int i = 0; i < corpus_count; i++) {
+    for (size_t p = 0; p + 1 < corpus[i].len; p++) stuffed += corpus[i].buf[p] == 0xFF && corpus[i].buf[p + 1] == 0;
+  }
+  TEST_ASSERT_GREATER_THAN(0, stuffed);  // The scan search is exercised
+}
+
+static void test_corpus_is_valid(void) {
+  for (int i = 0; i < corpus_count; i++) {
+    const CorpusFile *f = &corpus[i];
+    JpegCheck check;
+    TEST_ASSERT_EQUAL_INT(JPEG_VALID, jpegValidate(f->buf, f->len, f->width, f->height, &check));
+    TEST_ASSERT_EQUAL_size_t(f->len, check.len);
+    TEST_ASSERT_EQUAL_size_t(0, check.trailing);
+    TEST_ASSERT_EQUAL_UINT16(f->width, check.width);
+    TEST_ASSERT_EQUAL_UINT16(f->height, check.height);
+    TEST_ASSERT_EQUAL_INT(JPEG_ERR_DIMENSIONS, jpegValidate(f->buf, f->len, f->width + 16, 0, &check));
+    TEST_ASSERT_EQUAL_INT(JPEG_ERR_DIMENSIONS, jpegValidate(f->buf, f->len, 0, f->height - 2, &check));
+  }
+}
+
+static void test_every_truncation_fails(void) {
+  for (int i = 0; i < corpus_count; i++) {
+    for (size_t len = 0; len < corpus[i].len; len++) {
+      JpegCheckResult result = checkAgainstReference(corpus[i].buf, len);
+      TEST_ASSERT_TRUE(result != JPEG_VALID);
+      if (len >= 4) TEST_ASSERT_EQUAL_INT(JPEG_ERR_TRUNCATED, result);
+    }
+  }
+}
+
+static void test_trailing_bytes_are_trimmed(void) {
+  for (int i = 0; i < corpus_count; i++) {
+    const CorpusFile *f = &corpus[i];
+    for (size_t pad = 1; pad <= 600; pad += 37) {
+      uint8_t *buf = (uint8_t *)malloc(f->len + pad);
+      memcpy(buf, f->buf, f->len);
+      for (size_t k = 0; k < pad; k++) buf[f->len + k] = (uint8_t)(k & 1 ? 0xFF : nextRandom(256));
+      JpegCheck check;
+      TEST_ASSERT_EQUAL_INT(JPEG_VALID, jpegValidate(buf, f->len + pad, f->width, f->height, &check));
+      TEST_ASSERT_EQUAL_size_t(f->len, check.len);
+      TEST_ASSERT_EQUAL_size_t(pad, check.trailing);
+      free(buf);
+    }
+  }
+}
+
+static void test_mutations_match_reference(void) {
+  int results[JPEG_CHECK_COUNT] = {};
+  for (int i = 0; i < corpus_count; i++) {
+    const CorpusFile *f = &corpus[i];
+    uint8_t *buf = (uint8_t *)malloc(f->len);
+    for (int m = 0; m < MUTATIONS_PER_FILE; m++) {
+      memcpy(buf, f->buf, f->len);
+      int edits = 1 + nextRandom(4);
+      for (int e = 0; e < edits; e++) {
+        size_t at = nextRandom((uint32_t)f->len);
+        switch (nextRandom(4)) {
+          case 0: buf[at] = (uint8_t)nextRandom(256); break;
+          case 1: buf[at] = 0xFF; break;                              // Marker-looking bytes
+          case 2: buf[at] = (uint8_t)(0xD0 + nextRandom(10)); break;  // RSTn, SOI, EOI
+          default: buf[at] ^= (uint8_t)(1 << nextRandom(8)); break;
+        }
+      }
+      results[checkAgainstReference(buf, f->len)]++;
+    }
+    free(buf);
+  }
+
+  char line[160];
+  snprintf(line, sizeof(line), "%d mutations: valid %d, bad_marker %d, no_sof %d, truncated %d, no_soi %d",
+           corpus_count * MUTATIONS_PER_FILE, results[JPEG_VALID], results[JPEG_ERR_MARKER],
+           results[JPEG_ERR_NO_SOF], results[JPEG_ERR_TRUNCATED], results[JPEG_ERR_NO_SOI]);
+  TEST_MESSAGE(line);
+  TEST_ASSERT_GREATER_THAN(0, results[JPEG_ERR_MARKER]);
+  TEST_ASSERT_GREATER_THAN(0, results[JPEG_ERR_TRUNCATED]);
+}
+
+static void test_random_junk(void) {
+  uint8_t buf[512];
+  for (int n = 0; n < 20000; n++) {
+    size_t len = nextRandom(sizeof(buf) + 1);
+    for (size_t k = 0; k < len; k++) buf[k] = (uint8_t)nextRandom(256);
+    if (len >= 2 && n & 1) {
+      buf[0] = 0xFF;  // Half of them get past the SOI check
+      buf[1] = 0xD8;
+    }
+    checkAgainstReference(buf, len);
+  }
+}
+
+static void test_structural_errors(void) {
+  JpegCheck check;
+  static const uint8_t EOI_FIRST[] = {0xFF, 0xD8, 0xFF, 0xD9};
+  TEST_ASSERT_EQUAL_INT(JPEG_ERR_MARKER, jpegValidate(EOI_FIRST, sizeof(EOI_FIRST), 0, 0, &check));
+  static const uint8_t SCAN_WITHOUT_SOF[] = {0xFF, 0xD8, 0xFF, 0xDA, 0x00, 0x02, 0x12, 0x34, 0xFF, 0xD9};
+  TEST_ASSERT_EQUAL_INT(JPEG_ERR_NO_SOF, jpegValidate(SCAN_WITHOUT_SOF, sizeof(SCAN_WITHOUT_SOF), 0, 0, &check));
+  static const uint8_t SHORT_SEGMENT[] = {0xFF, 0xD8, 0xFF, 0xE0, 0x00, 0x01, 0x00, 0x00};
+  TEST_ASSERT_EQUAL_INT(JPEG_ERR_MARKER, jpegValidate(SHORT_SEGMENT, sizeof(SHORT_SEGMENT), 0, 0, &check));
+  static const uint8_t NOT_A_MARKER[] = {0xFF, 0xD8, 0x12, 0x34};
+  TEST_ASSERT_EQUAL_INT(JPEG_ERR_MARKER, jpegValidate(NOT_A_MARKER, sizeof(NOT_A_MARKER), 0, 0, &check));
+  TEST_ASSERT_EQUAL_INT(JPEG_ERR_NO_SOI, jpegValidate(NULL, 0, 0, 0, &check));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_build_corpus);
+  RUN_TEST(test_corpus_is_valid);
+  RUN_TEST(test_every_truncation_fails);
+  RUN_TEST(test_trailing_bytes_are_trimmed);
+  RUN_TEST(test_mutations_match_reference);
+  RUN_TEST(test_random_junk);
+  RUN_TEST(test_structural_errors);
+  for (int i = 0; i < corpus_count; i++) free(corpus[i].buf);
+  return UNITY_END();
+}
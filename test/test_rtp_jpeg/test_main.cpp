@@ -0,0 +1,238 @@
+// RFC 2435 packetization of encoder-generated JPEGs: payload headers, fragment
+// offsets and reassembly, restart headers, and the frames the parser must refuse
+#include <unity.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include "rtp_jpeg.h"
+#include "../jpeg_fixture.h"
+
+#define PAYLOAD_MAX  (1400 - 12)  // RTP_MAX_PACKET minus the RTP header, as rtsp_server sends
+
+// Copy of jpg with a DRI segment in front of the SOS (structure only)
+static Jpeg withRestartInterval(const Jpeg *src, uint16_t interval) {
+  size_t sos = findSegment(src->buf, src->len, 0xDA);
+  TEST_ASSERT_NOT_EQUAL(0, sos);
+  Jpeg jpg;
+  jpg.len = src->len + 6;
+  jpg.buf = (uint8_t *)malloc(jpg.len);
+  memcpy(jpg.buf, src->buf, sos);
+  const uint8_t dri[6] = {0xFF, 0xDD, 0x00, 0x04, (uint8_t)(interval >> 8), (uint8_t)interval};
+  memcpy(jpg.buf + sos, dri, sizeof(dri));
+  memcpy(jpg.buf + sos + 6, src->buf + sos, src->len - sos);
+  return jpg;
+}
+
+// Fragment info's scan into PAYLOAD_MAX packets, check each payload header the way
+// a receiver parses it (RFC 2435 3.1), and reassemble the scan data
+static int packetizeAndCheck(const RtpJpegInfo *info) {
+  uint8_t pkt[PAYLOAD_MAX];
+  uint8_t *scan = (uint8_t *)malloc(info->scan_len);
+  size_t offset = 0;
+  int packets = 0;
+  while (offset < info->scan_len) {
+    size_t before = offset;
+    size_t len = rtpJpegFragment(info, &offset, pkt, sizeof(pkt));
+    TEST_ASSERT_GREATER_THAN(0, len);
+    TEST_ASSERT_LESS_OR_EQUAL(sizeof(pkt), len);
+    packets++;
+
+    const uint8_t *p = pkt;
+    TEST_ASSERT_EQUAL_HEX8(0, p[0]);  // Type-specific 0: not interlaced
+    TEST_ASSERT_EQUAL_UINT32(before, ((uint32_t)p[1] << 16) | (p[2] << 8) | p[3]);
+    TEST_ASSERT_EQUAL_UINT8(info->type, p[4]);
+    TEST_ASSERT_EQUAL_UINT8(255, p[5]);
+    TEST_ASSERT_EQUAL_UINT8(info->width / 8, p[6]);
+    TEST_ASSERT_EQUAL_UINT8(info->height / 8, p[7]);
+    p += RTP_JPEG_HEADER_LEN;
+    if (info->type & 64) {
+      TEST_ASSERT_EQUAL_UINT16(info->restart_interval, (p[0] << 8) | p[1]);
+      TEST_ASSERT_EQUAL_HEX8(0xFF, p[2]);  // F=1, L=1, count 0x3FFF
+      TEST_ASSERT_EQUAL_HEX8(0xFF, p[3]);
+      p += RTP_JPEG_RESTART_LEN;
+    }
+    if (before == 0) {
+      TEST_ASSERT_EQUAL_HEX8(0, p[0]);    // MBZ
+      TEST_ASSERT_EQUAL_HEX8(0, p[1]);    // 8-bit tables
+      TEST_ASSERT_EQUAL_UINT16(128, (p[2] << 8) | p[3]);
+      TEST_ASSERT_EQUAL_MEMORY(info->qtables, p + RTP_JPEG_QTABLE_LEN, 128);
+      p += RTP_JPEG_QTABLE_LEN + 128;
+    }
+
+    size_t data_len = len - (p - pkt);
+    TEST_ASSERT_EQUAL_size_t(offset - before, data_len);
+    // Every fragment but the last fills the packet
+    if (offset < info->scan_len) TEST_ASSERT_EQUAL_size_t(sizeof(pkt), len);
+    memcpy(scan + before, p, data_len);
+  }
+  TEST_ASSERT_EQUAL_size_t(info->scan_len, offset);
+  TEST_ASSERT_EQUAL_MEMORY(info->scan, scan, info->scan_len);
+  free(scan);
+  return packets;
+}
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static void test_parse_encoder_output(void) {
+  Jpeg jpg = encodeSynthetic(320, 240, 64, 80);
+  uint8_t qtables[128];
+  RtpJpegInfo info;
+  TEST_ASSERT_TRUE(rtpJpegParse(jpg.buf, jpg.len, &info, qtables));
+  TEST_ASSERT_EQUAL_UINT8(1, info.type);  // The encoder writes 4:2:0
+  TEST_ASSERT_EQUAL_UINT16(320, info.width);
+  TEST_ASSERT_EQUAL_UINT16(240, info.height);
+  TEST_ASSERT_EQUAL_UINT16(0, info.restart_interval);
+  TEST_ASSERT_EQUAL_UINT8(128, info.qtable_len);
+
+  // Tables are the DQT contents, luma first
+  size_t dqt = findSegment(jpg.buf, jpg.len, 0xDB);
+  TEST_ASSERT_NOT_EQUAL(0, dqt);
+  TEST_ASSERT_EQUAL_HEX8(0x00, jpg.buf[dqt + 4]);
+  TEST_ASSERT_EQUAL_MEMORY(jpg.buf + dqt + 5, info.qtables, 64);
+
+  // Scan: right after the SOS header up to, not including, EOI
+  size_t sos = findSegment(jpg.buf, jpg.len, 0xDA);
+  size_t scan_start = sos + 2 + ((jpg.buf[sos + 2] << 8) | jpg.buf[sos + 3]);
+  TEST_ASSERT_TRUE(info.scan == jpg.buf + scan_start);
+  TEST_ASSERT_EQUAL_size_t(jpg.len - 2 - scan_start, info.scan_len);
+  free(jpg.buf);
+}
+
+static void test_fragments(void) {
+  const int sizes[][2] = {{64, 48}, {320, 240}, {800, 600}};
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    Jpeg jpg = encodeSynthetic(sizes[i][0], sizes[i][1], 64, 80);
+    uint8_t qtables[128];
+    RtpJpegInfo info;
+    TEST_ASSERT_TRUE(rtpJpegParse(jpg.buf, jpg.len, &info, qtables));
+    int packets = packetizeAndCheck(&info);
+    // First packet carries 8 + 132 header bytes, the rest 8
+    size_t first = PAYLOAD_MAX - RTP_JPEG_HEADER_LEN - RTP_JPEG_QTABLE_LEN - 128;
+    size_t rest = PAYLOAD_MAX - RTP_JPEG_HEADER_LEN;
+    int expected = info.scan_len <= first ? 1 : 1 + (int)((info.scan_len - first + rest - 1) / rest);
+    TEST_ASSERT_EQUAL_INT(expected, packets);
+    free(jpg.buf);
+  }
+}
+
+static void test_offset_beyond_16_bits(void) {
+  // Fragment offsets are 24-bit: the high byte has to be right past 64 KB
+  Jpeg jpg = encodeSynthetic(1024, 768, 256, 95);
+  uint8_t qtables[128];
+  RtpJpegInfo info;
+  TEST_ASSERT_TRUE(rtpJpegParse(jpg.buf, jpg.len, &info, qtables));
+  TEST_ASSERT_GREATER_THAN(0x10000, info.scan_len);
+  packetizeAndCheck(&info);
+  free(jpg.buf);
+}
+
+static void test_restart_header(void) {
+  Jpeg plain = encodeSynthetic(320, 240, 64, 80);
+  Jpeg jpg = withRestartInterval(&plain, 0x0123);
+  uint8_t qtables[128];
+  RtpJpegInfo info;
+  TEST_ASSERT_TRUE(rtpJpegParse(jpg.buf, jpg.len, &info, qtables));
+  TEST_ASSERT_EQUAL_UINT8(64 + 1, info.type);
+  TEST_ASSERT_EQUAL_UINT16(0x0123, info.restart_interval);
+  TEST_ASSERT_GREATER_THAN(1, packetizeAndCheck(&info));
+  free(jpg.buf);
+  free(plain.buf);
+}
+
+static void test_422_and_trailing_padding(void) {
+  Jpeg jpg = encodeSynthetic(320, 240, 64, 80);
+  size_t sof = findSegment(jpg.buf, jpg.len, 0xC0);
+  TEST_ASSERT_NOT_EQUAL(0, sof);
+  jpg.buf[sof + 4 + 7] = 0x21;  // Luma sampling 2x1, as OV2640 hardware JPEG
+  // Hardware frames are padded past EOI
+  uint8_t *padded = (uint8_t *)malloc(jpg.len + 100);
+  memcpy(padded, jpg.buf, jpg.len);
+  memset(padded + jpg.len, 0, 100);
+
+  uint8_t qtables[128];
+  RtpJpegInfo info;
+  TEST_ASSERT_TRUE(rtpJpegParse(padded, jpg.len + 100, &info, qtables));
+  TEST_ASSERT_EQUAL_UINT8(0, info.type);
+  TEST_ASSERT_TRUE(info.scan + info.scan_len == padded + jpg.len - 2);
+  free(padded);
+  free(jpg.buf);
+}
+
+static void test_rejected(void) {
+  Jpeg jpg = encodeSynthetic(64, 48, 64, 80);
+  uint8_t *buf = (uint8_t *)malloc(jpg.len);
+  uint8_t qtables[128];
+  RtpJpegInfo info;
+  size_t dqt = findSegment(jpg.buf, jpg.len, 0xDB);
+  size_t sof = findSegment(jpg.buf, jpg.len, 0xC0);
+
+  // 16-bit quantization table
+  memcpy(buf, jpg.buf, jpg.len);
+  buf[dqt + 4] = 0x10;
+  TEST_ASSERT_FALSE(rtpJpegParse(buf, jpg.len, &info, qtables));
+
+  // Progressive
+  memcpy(buf, jpg.buf, jpg.len);
+  buf[sof + 1] = 0xC2;
+  TEST_ASSERT_FALSE(rtpJpegParse(buf, jpg.len, &info, qtables));
+
+  // Chroma subsampled too (not 4:2:x)
+  memcpy(buf, jpg.buf, jpg.len);
+  buf[sof + 4 + 10] = 0x22;
+  TEST_ASSERT_FALSE(rtpJpegParse(buf, jpg.len, &info, qtables));
+
+  // Wider than 2040: width/8 doesn't fit the header byte
+  memcpy(buf, jpg.buf, jpg.len);
+  buf[sof + 4 + 3] = 0x08;
+  buf[sof + 4 + 4] = 0x00;
+  TEST_ASSERT_FALSE(rtpJpegParse(buf, jpg.len, &info, qtables));
+
+  // Table referenced by SOF never defined
+  memcpy(buf, jpg.buf, jpg.len);
+  buf[sof + 4 + 8] = 2;
+  TEST_ASSERT_FALSE(rtpJpegParse(buf, jpg.len, &info, qtables));
+
+  // Every truncation: no EOI (or no scan) must fail, never read past the end
+  for (size_t len = 0; len < jpg.len - 1; len++) {
+    uint8_t *cut = (uint8_t *)malloc(len ? len : 1);
+    memcpy(cut, jpg.buf, len);
+    // The encoder stuffs every 0xFF in the scan, so no cut ends on an FF D9 pair
+    TEST_ASSERT_FALSE(rtpJpegParse(cut, len, &info, qtables));
+    free(cut);
+  }
+  free(buf);
+  free(jpg.buf);
+}
+
+static void test_fragment_limits(void) {
+  Jpeg jpg = encodeSynthetic(64, 48, 64, 80);
+  uint8_t qtables[128];
+  RtpJpegInfo info;
+  TEST_ASSERT_TRUE(rtpJpegParse(jpg.buf, jpg.len, &info, qtables));
+  uint8_t pkt[PAYLOAD_MAX];
+  size_t offset = 0;
+  // No room for a single scan byte after the headers
+  TEST_ASSERT_EQUAL_size_t(0, rtpJpegFragment(&info, &offset, pkt, RTP_JPEG_HEADER_LEN + RTP_JPEG_QTABLE_LEN + 128));
+  TEST_ASSERT_EQUAL_size_t(0, offset);
+  // One byte per packet still makes progress
+  TEST_ASSERT_EQUAL_size_t(RTP_JPEG_HEADER_LEN + RTP_JPEG_QTABLE_LEN + 128 + 1,
+                           rtpJpegFragment(&info, &offset, pkt, RTP_JPEG_HEADER_LEN + RTP_JPEG_QTABLE_LEN + 129));
+  TEST_ASSERT_EQUAL_size_t(1, offset);
+  // Past the end: nothing
+  offset = info.scan_len;
+  TEST_ASSERT_EQUAL_size_t(0, rtpJpegFragment(&info, &offset, pkt, sizeof(pkt)));
+  free(jpg.buf);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_parse_encoder_output);
+  RUN_TEST(test_fragments);
+  RUN_TEST(test_offset_beyond_16_bits);
+  RUN_TEST(test_restart_header);
+  RUN_TEST(test_422_and_trailing_padding);
+  RUN_TEST(test_rejected);
+  RUN_TEST(test_fragment_limits);
+  return UNITY_END();
+}
@@ -0,0 +1,255 @@
+// Sensor probe against a simulated SCCB bus: one OV2640 wired to one board's pins, XCLK
+// only ever driven on a profile whose SCCB pair idles high
+#include <unity.h>
+
+#include <string.h>
+#include "sensor_probe.h"
+
+// A sensor on the SDA/SCL pair of one profile; begin() on another pair finds nothing.
+// Only the wired pair (and other_bus_profile's) reads as a pulled-up idle bus.
+struct FakeBus {
+  int wired_profile;       // -1 = no sensor at all
+  uint8_t addr;            // Address it acknowledges
+  uint8_t regs[2][256];    // [bank][reg]: DSP bank 0, sensor bank 1
+  uint8_t bank;
+  int fail_begin_profile;  // begin() fails for this one (pins unusable), -1 = none
+  int other_bus_profile;   // Pull-ups but no camera on this one (another I2C bus), -1 = none
+
+  const BoardProfile *open;
+  int checked[8];          // Profile indices in bus_present() order
+  int check_count;
+  int begun[8];            // Profile indices in begin() order: XCLK driven on their pin
+  int begin_count;
+  int end_count;
+  int reg_reads;
+};
+
+static FakeBus fake;
+
+static int profileIndex(const BoardProfile *profile) {
+  return (int)(profile - BOARD_PROFILES);
+}
+
+static bool fakeBusPresent(void *ctx, const BoardProfile *profile) {
+  FakeBus *bus = (FakeBus *)ctx;
+  TEST_ASSERT_NULL(bus->open);  // Checked with nothing driven
+  int i = profileIndex(profile);
+  bus->checked[bus->check_count++] = i;
+  return i == bus->wired_profile || i == bus->other_bus_profile;
+}
+
+static bool fakeBegin(void *ctx, const BoardProfile *profile) {
+  FakeBus *bus = (FakeBus *)ctx;
+  TEST_ASSERT_NULL(bus->open);  // end() before the next begin()
+  // XCLK only on a pair that idles high: never onto another board's sensor outputs
+  TEST_ASSERT_TRUE(profileIndex(profile) == bus->wired_profile || profileIndex(profile) == bus->other_bus_profile);
+  if (profileIndex(profile) == bus->fail_begin_profile) return false;
+  bus->begun[bus->begin_count++] = profileIndex(profile);
+  bus->open = profile;
+  bus->bank = 0;  // Power-up default
+  return true;
+}
+
+static bool sensorHere(FakeBus *bus, uint8_t addr) {
+  TEST_ASSERT_NOT_NULL(bus->open);
+  return bus->wired_profile >= 0 && profileIndex(bus->open) == bus->wired_profile && addr == bus->addr;
+}
+
+static bool fakePing(void *ctx, uint8_t addr) {
+  return sensorHere((FakeBus *)ctx, addr);
+}
+
+static bool fakeRead(void *ctx, uint8_t addr, uint8_t reg, uint8_t *value) {
+  FakeBus *bus = (FakeBus *)ctx;
+  bus->reg_reads++;
+  if (!sensorHere(bus, addr)) return false;
+  *value = bus->regs[bus->bank][reg];
+  return true;
+}
+
+static bool fakeWrite(void *ctx, uint8_t addr, uint8_t reg, uint8_t value) {
+  FakeBus *bus = (FakeBus *)ctx;
+  if (!sensorHere(bus, addr)) return false;
+  if (reg == OV2640_REG_BANK_SEL) {
+    bus->bank = value & 1;
+  } else {
+    bus->regs[bus->bank][reg] = value;
+  }
+  return true;
+}
+
+static void fakeEnd(void *ctx) {
+  FakeBus *bus = (FakeBus *)ctx;
+  TEST_ASSERT_NOT_NULL(bus->open);
+  bus->open = NULL;
+  bus->end_count++;
+}
+
+static const SccbBus BUS = {&fake, fakeBusPresent, fakeBegin, fakePing, fakeRead, fakeWrite, fakeEnd};
+
+// An OV2640 rev 2 (PID 0x2642) on profile_index at 0x30. The DSP bank reads
+// something else at the ID addresses, so a probe that skips the bank select fails.
+static void wireOv2640(int profile_index) {
+  fake.wired_profile = profile_index;
+  fake.addr = OV2640_SCCB_ADDR;
+  fake.regs[1][OV2640_REG_MIDH] = 0x7F;
+  fake.regs[1][OV2640_REG_MIDL] = 0xA2;
+  fake.regs[1][OV2640_REG_PIDH] = 0x26;
+  fake.regs[1][OV2640_REG_PIDL] = 0x42;
+  memset(fake.regs[0], 0x55, sizeof(fake.regs[0]));
+}
+
+void setUp(void) {
+  memset(&fake, 0, sizeof(fake));
+  fake.wired_profile = -1;
+  fake.fail_begin_profile = -1;
+  fake.other_bus_profile = -1;
+}
+
+void tearDown(void) {
+  TEST_ASSERT_NULL(fake.open);
+  TEST_ASSERT_EQUAL_INT(fake.begin_count, fake.end_count);
+}
+
+static void test_ov2640_at_0x30(void) {
+  wireOv2640(0);
+  SensorProbeResult result;
+  TEST_ASSERT_TRUE(sensorProbe(&BUS, BOARD_PROFILES, BOARD_PROFILE_COUNT, 0, &result));
+  TEST_ASSERT_EQUAL_INT(0, result.profile_index);
+  TEST_ASSERT_EQUAL_HEX8(0x30, result.addr);
+  TEST_ASSERT_EQUAL_HEX16(0x2642, result.pid);
+  TEST_ASSERT_EQUAL_INT(1, fake.begin_count);  // Stopped at the first match
+}
+
+static void test_sensor_at_another_address(void) {
+  wireOv2640(0);
+  fake.addr = 0x3C;  // OV5640 / OV3660 address
+  SensorProbeResult result;
+  TEST_ASSERT_FALSE(sensorProbe(&BUS, BOARD_PROFILES, BOARD_PROFILE_COUNT, 0, &result));
+  TEST_ASSERT_EQUAL_INT(BOARD_PROFILE_COUNT, fake.check_count);
+  TEST_ASSERT_EQUAL_INT(1, fake.begin_count);  // Only the pair with a bus on it
+}
+
+static void test_wrong_product_id(void) {
+  wireOv2640(1);
+  fake.regs[1][OV2640_REG_PIDH] = 0x36;  // OV3660 answering at 0x30
+  uint16_t pid = 0xBEEF;
+  TEST_ASSERT_FALSE(sensorProbeProfile(&BUS, &BOARD_PROFILES[1], &pid));
+  TEST_ASSERT_EQUAL_HEX16(0xBEEF, pid);  // Untouched on failure
+
+  SensorProbeResult result;
+  TEST_ASSERT_FALSE(sensorProbe(&BUS, BOARD_PROFILES, BOARD_PROFILE_COUNT, 0, &result));
+  TEST_ASSERT_EQUAL_INT(2, fake.begin_count);
+}
+
+static void test_wrong_manufacturer(void) {
+  wireOv2640(0);
+  fake.regs[1][OV2640_REG_MIDL] = 0x00;
+  TEST_ASSERT_FALSE(sensorProbeProfile(&BUS, &BOARD_PROFILES[0], NULL));
+}
+
+static void test_no_ack(void) {
+  // Pull-ups on one pair but nothing answering there
+  fake.other_bus_profile = 2;
+  SensorProbeResult result;
+  TEST_ASSERT_FALSE(sensorProbe(&BUS, BOARD_PROFILES, BOARD_PROFILE_COUNT, 0, &result));
+  TEST_ASSERT_EQUAL_INT(1, fake.begin_count);
+  TEST_ASSERT_EQUAL_INT(0, fake.reg_reads);  // No register traffic without an ACK
+}
+
+static void test_no_bus_no_xclk(void) {
+  // No camera anywhere: every pair checked, XCLK never driven
+  SensorProbeResult result;
+  TEST_ASSERT_FALSE(sensorProbe(&BUS, BOARD_PROFILES, BOARD_PROFILE_COUNT, 0, &result));
+  TEST_ASSERT_EQUAL_INT(BOARD_PROFILE_COUNT, fake.check_count);
+  TEST_ASSERT_EQUAL_INT(0, fake.begin_count);
+}
+
+static void test_xiao_gets_no_xclk_on_gpio15(void) {
+  // XIAO ESP32S3 Sense: profile 0 would put XCLK on GPIO 15, the XIAO sensor's D0
+  // output. Its SCCB pair (4/5) is unconnected there, so profile 0 stops at the check.
+  const BoardProfile *xiao = &BOARD_PROFILES[1];
+  TEST_ASSERT_EQUAL_INT(BOARD_PROFILES[0].pin_xclk, xiao->pin_d0);
+  wireOv2640(1);
+  SensorProbeResult result;
+  TEST_ASSERT_TRUE(sensorProbe(&BUS, BOARD_PROFILES, BOARD_PROFILE_COUNT, 0, &result));
+  TEST_ASSERT_EQUAL_INT(1, result.profile_index);
+  TEST_ASSERT_EQUAL_INT(2, fake.check_count);
+  TEST_ASSERT_EQUAL_INT(0, fake.checked[0]);
+  TEST_ASSERT_EQUAL_INT(1, fake.begin_count);
+  TEST_ASSERT_EQUAL_INT(1, fake.begun[0]);
+}
+
+static void test_profile_fallback_order(void) {
+  // No cached profile: table order until the board that answers
+  wireOv2640(2);
+  SensorProbeResult result;
+  TEST_ASSERT_TRUE(sensorProbe(&BUS, BOARD_PROFILES, BOARD_PROFILE_COUNT, 0, &result));
+  TEST_ASSERT_EQUAL_INT(2, result.profile_index);
+  TEST_ASSERT_EQUAL_INT(3, fake.check_count);
+  for (int i = 0; i < 3; i++) TEST_ASSERT_EQUAL_INT(i, fake.checked[i]);
+  TEST_ASSERT_EQUAL_INT(1, fake.begin_count);
+}
+
+static void test_probe_starts_at_cached_profile(void) {
+  // Cached profile 3 no longer answers (module moved): wraps around to 0, then 1
+  wireOv2640(1);
+  SensorProbeResult result;
+  TEST_ASSERT_TRUE(sensorProbe(&BUS, BOARD_PROFILES, BOARD_PROFILE_COUNT, 3, &result));
+  TEST_ASSERT_EQUAL_INT(1, result.profile_index);
+  TEST_ASSERT_EQUAL_INT(3, fake.check_count);
+  TEST_ASSERT_EQUAL_INT(3, fake.checked[0]);
+  TEST_ASSERT_EQUAL_INT(0, fake.checked[1]);
+  TEST_ASSERT_EQUAL_INT(1, fake.checked[2]);
+}
+
+static void test_out_of_range_start_and_unusable_pins(void) {
+  wireOv2640(1);
+  fake.other_bus_profile = 0;
+  fake.fail_begin_profile = 0;
+  SensorProbeResult result;
+  TEST_ASSERT_TRUE(sensorProbe(&BUS, BOARD_PROFILES, BOARD_PROFILE_COUNT, 17, &result));
+  TEST_ASSERT_EQUAL_INT(1, result.profile_index);
+  TEST_ASSERT_EQUAL_INT(1, fake.begin_count);  // Profile 0 tried first but begin() failed
+}
+
+static void test_profile_lookup(void) {
+  TEST_ASSERT_EQUAL_INT(0, boardProfileFind(BOARD_PROFILES, BOARD_PROFILE_COUNT, "goouuu-s3-cam"));
+  TEST_ASSERT_EQUAL_INT(3, boardProfileFind(BOARD_PROFILES, BOARD_PROFILE_COUNT, "dfrobot-firebeetle2"));
+  TEST_ASSERT_EQUAL_INT(-1, boardProfileFind(BOARD_PROFILES, BOARD_PROFILE_COUNT, "esp32-cam-ai-thinker"));
+  TEST_ASSERT_EQUAL_INT(-1, boardProfileFind(BOARD_PROFILES, BOARD_PROFILE_COUNT, NULL));
+}
+
+static void test_profile_pins(void) {
+  for (int p = 0; p < BOARD_PROFILE_COUNT; p++) {
+    const BoardProfile *b = &BOARD_PROFILES[p];
+    const int8_t pins[] = {b->pin_pwdn, b->pin_reset, b->pin_xclk, b->pin_sccb_sda, b->pin_sccb_scl,
+                           b->pin_d7, b->pin_d6, b->pin_d5, b->pin_d4, b->pin_d3, b->pin_d2, b->pin_d1,
+                           b->pin_d0, b->pin_vsync, b->pin_href, b->pin_pclk};
+    bool used[49] = {};
+    for (size_t i = 0; i < sizeof(pins); i++) {
+      if (pins[i] < 0) continue;
+      TEST_ASSERT_LESS_OR_EQUAL(48, pins[i]);
+      TEST_ASSERT_FALSE_MESSAGE(pins[i] >= 26 && pins[i] <= 37, b->name);  // Flash / octal PSRAM
+      TEST_ASSERT_FALSE_MESSAGE(used[pins[i]], b->name);
+      used[pins[i]] = true;
+    }
+  }
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_ov2640_at_0x30);
+  RUN_TEST(test_sensor_at_another_address);
+  RUN_TEST(test_wrong_product_id);
+  RUN_TEST(test_wrong_manufacturer);
+  RUN_TEST(test_no_ack);
+  RUN_TEST(test_no_bus_no_xclk);
+  RUN_TEST(test_xiao_gets_no_xclk_on_gpio15);
+  RUN_TEST(test_profile_fallback_order);
+  RUN_TEST(test_probe_starts_at_cached_profile);
+  RUN_TEST(test_out_of_range_start_and_unusable_pins);
+  RUN_TEST(test_profile_lookup);
+  RUN_TEST(test_profile_pins);
+  return UNITY_END();
+}
@@ -0,0 +1,165 @@
+// WebSocket pacing on a simulated clock: slow readers get fresh frames, never a backlog
+#include <unity.h>
+
+#include <string.h>
+#include "stream_pacing.h"
+
+#define MS 1000LL
+
+// The frame cache as the handler sees it: the latest frame and when it was published
+struct SimCache {
+  uint32_t seq;
+  int64_t published_us;
+  uint32_t captures;
+};
+
+// One WebSocket client against the cache, with an optional MJPEG viewer publishing
+// frames in the background. Times are what the device and client spend per frame.
+struct SimLink {
+  int64_t capture_us;      // Capture + encode of a frame nobody else produced
+  int64_t transfer_us;     // Send until the client has the whole message
+  int64_t display_us;      // Client: receive -> next "next" (a slow reader)
+  int64_t background_us;   // MJPEG viewer's frame period, 0 = no other viewer
+};
+
+struct SimResult {
+  WsSession session;
+  int64_t max_age_us;      // Client receive time - frame publish time, worst frame
+  int64_t elapsed_us;
+  bool order_ok;           // Every frame newer than the previous one
+};
+
+static void publish(SimCache *cache, int64_t now_us) {
+  cache->seq++;
+  cache->published_us = now_us;
+}
+
+// Background frames published up to now_us
+static void runBackground(SimCache *cache, const SimLink *link, int64_t *next_bg_us, int64_t now_us) {
+  if (!link->background_us) return;
+  while (*next_bg_us <= now_us) {
+    publish(cache, *next_bg_us);
+    *next_bg_us += link->background_us;
+  }
+}
+
+static SimResult simulate(const SimLink *link, int frames) {
+  SimCache cache = {};
+  SimResult r = {};
+  r.order_ok = true;
+  int64_t now = 0, next_bg = 0;
+  for (int i = 0; i < frames; i++) {
+    // "next" arrives: the handler's decision
+    runBackground(&cache, link, &next_bg, now);
+    if (cache.seq == 0 ||
+        !streamFrameReusable(cache.seq, cache.published_us, r.session.last_seq, now, WS_FRAME_MAX_AGE_MS)) {
+      now += link->capture_us;
+      runBackground(&cache, link, &next_bg, now);
+      publish(&cache, now);
+      cache.captures++;
+    }
+    uint32_t seq = cache.seq;
+    int64_t published = cache.published_us;
+    if (r.session.frames && seq <= r.session.last_seq) r.order_ok = false;
+    wsSessionSent(&r.session, seq);
+
+    // Exactly one frame in flight: the client asks again only after this one arrived
+    now += link->transfer_us;
+    if (now - published > r.max_age_us) r.max_age_us = now - published;
+    now += link->display_us;
+  }
+  r.elapsed_us = now;
+  return r;
+}
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static void test_reuse_window(void) {
+  int64_t t = 5000 * MS;
+  TEST_ASSERT_TRUE(streamFrameReusable(7, t, 6, t + WS_FRAME_MAX_AGE_MS * MS, WS_FRAME_MAX_AGE_MS));
+  TEST_ASSERT_FALSE(streamFrameReusable(7, t, 6, t + WS_FRAME_MAX_AGE_MS * MS + 1, WS_FRAME_MAX_AGE_MS));
+  TEST_ASSERT_FALSE(streamFrameReusable(7, t, 7, t, WS_FRAME_MAX_AGE_MS));  // Already sent here
+  TEST_ASSERT_TRUE(streamFrameReusable(7, t, 0, t, WS_FRAME_MAX_AGE_MS));   // New connection
+}
+
+static void test_slow_reader_gets_fresh_frames(void) {
+  // MJPEG viewer at 25 fps, WebSocket client showing each frame for 0..2000 ms: the
+  // age of what it receives is bounded by the reuse window plus the transfer,
+  // whatever the delay; the frames in between are skipped, not queued
+  const int64_t delays[] = {0, 100 * MS, 500 * MS, 2000 * MS};
+  for (size_t i = 0; i < sizeof(delays) / sizeof(delays[0]); i++) {
+    SimLink link = {60 * MS, 30 * MS, delays[i], 40 * MS};
+    SimResult r = simulate(&link, 50);
+    TEST_ASSERT_TRUE(r.order_ok);
+    TEST_ASSERT_EQUAL_UINT32(50, r.session.frames);
+    TEST_ASSERT_LESS_OR_EQUAL(WS_FRAME_MAX_AGE_MS * MS + link.transfer_us, r.max_age_us);
+    // Everything the viewer produced while this client was busy showing a frame
+    if (delays[i] >= 500 * MS) TEST_ASSERT_GREATER_OR_EQUAL(50 * 10, r.session.skipped);
+  }
+}
+
+static void test_lone_slow_reader_captures_on_demand(void) {
+  // No other viewer: each request finds the frame it already has (or one older than
+  // the window) and captures a new one, so nothing is skipped and the age is just the
+  // transfer time
+  SimLink link = {60 * MS, 30 * MS, 500 * MS, 0};
+  SimResult r = simulate(&link, 20);
+  TEST_ASSERT_TRUE(r.order_ok);
+  TEST_ASSERT_EQUAL_UINT32(0, r.session.skipped);
+  TEST_ASSERT_EQUAL_INT64(link.transfer_us, r.max_age_us);
+  TEST_ASSERT_EQUAL_INT64(20 * (link.capture_us + link.transfer_us + link.display_us), r.elapsed_us);
+}
+
+static void test_fast_reader_never_gets_a_frame_twice(void) {
+  // Asking again right away, well inside the window: the cached frame is the one it
+  // just got, so a new one is captured rather than resent
+  SimLink link = {60 * MS, 5 * MS, 0, 0};
+  SimResult r = simulate(&link, 20);
+  TEST_ASSERT_TRUE(r.order_ok);
+  TEST_ASSERT_EQUAL_UINT32(20, r.session.last_seq);
+  TEST_ASSERT_EQUAL_UINT32(0, r.session.skipped);
+}
+
+static void test_session_accounting(void) {
+  WsSession s = {};
+  wsSessionSent(&s, 41);  // First frame of a connection skips nothing
+  wsSessionSent(&s, 42);
+  wsSessionSent(&s, 45);
+  TEST_ASSERT_EQUAL_UINT32(3, s.frames);
+  TEST_ASSERT_EQUAL_UINT32(2, s.skipped);
+  TEST_ASSERT_EQUAL_UINT32(45, s.last_seq);
+  s.last_seq = 0xFFFFFFFF;
+  wsSessionSent(&s, 1);   // Across the wrap: frame 0 skipped
+  TEST_ASSERT_EQUAL_UINT32(3, s.skipped);
+}
+
+static void test_frame_request(void) {
+  const uint8_t next[] = "next";
+  TEST_ASSERT_TRUE(wsIsFrameRequest(true, next, 4));
+  TEST_ASSERT_TRUE(wsIsFrameRequest(true, (const uint8_t *)"next\n", 5));
+  TEST_ASSERT_FALSE(wsIsFrameRequest(false, next, 4));  // Binary
+  TEST_ASSERT_FALSE(wsIsFrameRequest(true, next, 3));
+  TEST_ASSERT_FALSE(wsIsFrameRequest(true, (const uint8_t *)"stop", 4));
+  TEST_ASSERT_FALSE(wsIsFrameRequest(true, NULL, 0));
+}
+
+static void test_frame_header(void) {
+  uint8_t hdr[WS_FRAME_HEADER_LEN];
+  wsFrameHeader(hdr, 0x01020304, 0xA0B0C0D0, 800, 600);
+  const uint8_t expected[WS_FRAME_HEADER_LEN] = {'F', 'R', 1, 16, 0x04, 0x03, 0x02, 0x01,
+                                                 0xD0, 0xC0, 0xB0, 0xA0, 0x20, 0x03, 0x58, 0x02};
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, hdr, WS_FRAME_HEADER_LEN);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_reuse_window);
+  RUN_TEST(test_slow_reader_gets_fresh_frames);
+  RUN_TEST(test_lone_slow_reader_captures_on_demand);
+  RUN_TEST(test_fast_reader_never_gets_a_frame_twice);
+  RUN_TEST(test_session_accounting);
+  RUN_TEST(test_frame_request);
+  RUN_TEST(test_frame_header);
+  return UNITY_END();
+}
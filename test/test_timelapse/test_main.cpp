@@ -0,0 +1,249 @@
+// Time-lapse schedule on a simulated ms clock, PSRAM staging store and tar format
+#include <unity.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include "timelapse.h"
+
+static TimelapseSchedule tl;
+static TimelapseStore store;
+static int freed_frames;
+static size_t freed_bytes;
+
+static void countingFree(uint8_t *buf, size_t len) {
+  freed_frames++;
+  freed_bytes += len;
+  free(buf);
+}
+
+static void startRun(uint32_t interval_ms, uint32_t duration_ms, uint64_t now_ms) {
+  TimelapseConfig config = {};
+  config.interval_ms = interval_ms;
+  config.duration_ms = duration_ms;
+  timelapseStart(&tl, &config, now_ms);
+}
+
+static TimelapseFrame *stage(size_t len, uint64_t taken_ms) {
+  uint8_t *buf = (uint8_t *)malloc(len);
+  memset(buf, 0xAB, len);
+  TimelapseFrame *frame = timelapseStoreAdd(&store, buf, len, taken_ms, taken_ms, 0);
+  if (!frame) free(buf);
+  return frame;
+}
+
+void setUp(void) {
+  memset(&tl, 0, sizeof(tl));
+  freed_frames = 0;
+  freed_bytes = 0;
+  timelapseStoreInit(&store, 10000, countingFree);
+}
+
+void tearDown(void) {
+  timelapseStoreDiscard(&store, UINT32_MAX);
+}
+
+static void test_slots_on_interval(void) {
+  uint64_t due = 0;
+  startRun(1000, 0, 5000);
+  TEST_ASSERT_TRUE(timelapseDue(&tl, 5000, &due));  // Slot 0 at start
+  TEST_ASSERT_EQUAL_UINT64(5000, due);
+  TEST_ASSERT_FALSE(timelapseDue(&tl, 5999, &due));
+  TEST_ASSERT_TRUE(timelapseNextDue(&tl, &due));
+  TEST_ASSERT_EQUAL_UINT64(6000, due);
+
+  // A shot checked late keeps its slot time: the series doesn't drift
+  TEST_ASSERT_TRUE(timelapseDue(&tl, 6400, &due));
+  TEST_ASSERT_EQUAL_UINT64(6000, due);
+  timelapseShotTaken(&tl, due, 6400);
+  TEST_ASSERT_TRUE(timelapseDue(&tl, 7000, &due));
+  TEST_ASSERT_EQUAL_UINT64(7000, due);
+  timelapseShotTaken(&tl, due, 7010);
+  TEST_ASSERT_EQUAL_UINT32(2, tl.taken);
+  TEST_ASSERT_EQUAL_UINT32(0, tl.missed);
+  TEST_ASSERT_EQUAL_UINT32(400, tl.late_max_ms);
+  TEST_ASSERT_EQUAL_UINT64(410, tl.late_total_ms);
+}
+
+static void test_overrun_skips_passed_slots(void) {
+  uint64_t due = 0;
+  startRun(1000, 0, 0);
+  TEST_ASSERT_TRUE(timelapseDue(&tl, 0, &due));
+
+  // A shot (or camera reinit) busy for 3.5 s: slots 1 and 2 passed, slot 3 is taken
+  TEST_ASSERT_TRUE(timelapseDue(&tl, 3500, &due));
+  TEST_ASSERT_EQUAL_UINT64(3000, due);
+  TEST_ASSERT_EQUAL_UINT32(2, tl.missed);
+  TEST_ASSERT_FALSE(timelapseDue(&tl, 3900, &due));  // No burst of catch-up shots
+  TEST_ASSERT_TRUE(timelapseDue(&tl, 4000, &due));
+  TEST_ASSERT_EQUAL_UINT64(4000, due);
+  TEST_ASSERT_EQUAL_UINT32(2, tl.missed);
+
+  timelapseShotFailed(&tl);
+  TEST_ASSERT_EQUAL_UINT32(1, tl.failed);
+}
+
+static void test_run_ends_after_duration(void) {
+  uint64_t due = 0;
+  startRun(3000, 10000, 1000);  // Slots at 0, 3, 6 and 9 s
+  for (uint64_t slot = 0; slot < 4; slot++) {
+    TEST_ASSERT_TRUE(tl.running);
+    TEST_ASSERT_TRUE(timelapseDue(&tl, 1000 + slot * 3000, &due));
+    TEST_ASSERT_EQUAL_UINT64(1000 + slot * 3000, due);
+  }
+  TEST_ASSERT_FALSE(tl.running);
+  TEST_ASSERT_FALSE(timelapseNextDue(&tl, &due));
+  TEST_ASSERT_FALSE(timelapseDue(&tl, 20000, &due));
+  TEST_ASSERT_EQUAL_UINT32(0, tl.missed);
+}
+
+static void test_overrun_past_the_end(void) {
+  uint64_t due = 0;
+  startRun(3000, 10000, 0);
+  TEST_ASSERT_TRUE(timelapseDue(&tl, 0, &due));
+  // Stalled beyond the last slot: the remaining three are missed and the run ends
+  TEST_ASSERT_FALSE(timelapseDue(&tl, 13000, &due));
+  TEST_ASSERT_FALSE(tl.running);
+  TEST_ASSERT_EQUAL_UINT32(3, tl.missed);
+}
+
+static void test_stop_and_wall_clock(void) {
+  uint64_t due = 0;
+  TimelapseConfig config = {};
+  config.interval_ms = 1000;
+  config.epoch_ms = 1760000000000ULL;
+  timelapseStart(&tl, &config, 500);
+  TEST_ASSERT_EQUAL_UINT64(1760000000250ULL, timelapseWallMs(&tl, 750));
+  timelapseStop(&tl);
+  TEST_ASSERT_FALSE(timelapseDue(&tl, 1500, &due));
+
+  config.epoch_ms = 0;
+  timelapseStart(&tl, &config, 500);
+  TEST_ASSERT_EQUAL_UINT64(0, timelapseWallMs(&tl, 750));
+}
+
+static void test_eviction_by_budget(void) {
+  TEST_ASSERT_NOT_NULL(stage(4000, 1));
+  TEST_ASSERT_NOT_NULL(stage(4000, 2));
+  TEST_ASSERT_NOT_NULL(stage(4000, 3));  // 12000 > 10000: the oldest goes
+  TEST_ASSERT_EQUAL_UINT32(1, store.evicted);
+  TEST_ASSERT_EQUAL(2, store.count);
+  TEST_ASSERT_EQUAL_size_t(8000, store.bytes);
+  TEST_ASSERT_EQUAL_UINT32(2, timelapseStoreFirstSeq(&store));
+  TEST_ASSERT_EQUAL_UINT32(3, timelapseStoreLastSeq(&store));
+  TEST_ASSERT_EQUAL(1, freed_frames);
+
+  // Larger than the whole budget: refused, nothing evicted, buffer stays with the caller
+  TEST_ASSERT_NULL(stage(10001, 4));
+  TEST_ASSERT_EQUAL(2, store.count);
+  TEST_ASSERT_EQUAL_UINT32(1, store.evicted);
+}
+
+static void test_eviction_by_frame_cap(void) {
+  timelapseStoreInit(&store, 1 << 20, countingFree);
+  for (int i = 0; i < TIMELAPSE_MAX_FRAMES + 3; i++) TEST_ASSERT_NOT_NULL(stage(16, i));
+  TEST_ASSERT_EQUAL(TIMELAPSE_MAX_FRAMES, store.count);
+  TEST_ASSERT_EQUAL_UINT32(3, store.evicted);
+  TEST_ASSERT_EQUAL_UINT32(4, timelapseStoreFirstSeq(&store));
+  TEST_ASSERT_EQUAL_UINT32(TIMELAPSE_MAX_FRAMES + 3, timelapseStoreLastSeq(&store));
+  TEST_ASSERT_EQUAL_size_t(16 * TIMELAPSE_MAX_FRAMES, store.bytes);
+}
+
+static void test_download_after_and_clear(void) {
+  for (int i = 0; i < 5; i++) stage(100, i);
+
+  // ?after=2 starts at seq 3, in order
+  uint32_t seq = 2;
+  int sent = 0;
+  TimelapseFrame *frame;
+  while ((frame = timelapseStoreAcquire(&store, seq)) != NULL) {
+    TEST_ASSERT_EQUAL_UINT32(seq + 1, frame->seq);
+    seq = frame->seq;
+    sent++;
+    timelapseStoreRelease(&store, frame);
+  }
+  TEST_ASSERT_EQUAL(3, sent);
+  TEST_ASSERT_EQUAL(0, freed_frames);
+
+  // ?clear=1 drops what was sent, frames staged during the download survive
+  stage(100, 6);
+  TEST_ASSERT_EQUAL_UINT32(5, timelapseStoreDiscard(&store, seq));
+  TEST_ASSERT_EQUAL(1, store.count);
+  TEST_ASSERT_EQUAL_UINT32(6, timelapseStoreFirstSeq(&store));
+  TEST_ASSERT_EQUAL(5, freed_frames);
+  TEST_ASSERT_EQUAL_UINT32(0, timelapseStoreDiscard(&store, seq));
+}
+
+static void test_frame_in_download_outlives_eviction(void) {
+  stage(4000, 1);
+  TimelapseFrame *sending = timelapseStoreAcquire(&store, 0);
+  TEST_ASSERT_NOT_NULL(sending);
+  stage(4000, 2);
+  stage(4000, 3);  // Evicts seq 1 from the store
+  TEST_ASSERT_EQUAL(0, freed_frames);
+  TEST_ASSERT_EQUAL_UINT8(0xAB, sending->buf[3999]);
+  timelapseStoreRelease(&store, sending);
+  TEST_ASSERT_EQUAL(1, freed_frames);
+  TEST_ASSERT_EQUAL_size_t(4000, freed_bytes);
+}
+
+static void test_frame_names(void) {
+  TimelapseFrame frame = {};
+  char name[64];
+  frame.seq = 7;
+  frame.taken_ms = 123456;
+  timelapseFrameName(&frame, name, sizeof(name));
+  TEST_ASSERT_EQUAL_STRING("000007_123456ms.jpg", name);
+  frame.wall_ms = 1760767230114ULL;  // 2025-10-18 06:00:30.114 UTC
+  timelapseFrameName(&frame, name, sizeof(name));
+  TEST_ASSERT_EQUAL_STRING("000007_20251018-060030.114.jpg", name);
+}
+
+static unsigned octalField(const uint8_t *field, size_t width) {
+  unsigned value = 0;
+  for (size_t i = 0; i < width && field[i] >= '0' && field[i] <= '7'; i++) value = value * 8 + (field[i] - '0');
+  return value;
+}
+
+static void test_tar_header(void) {
+  uint8_t block[TIMELAPSE_TAR_BLOCK];
+  timelapseTarHeader(block, "000001_20251018-060000.000.jpg", 70000, 1760767200);
+  TEST_ASSERT_EQUAL_STRING("000001_20251018-060000.000.jpg", (const char *)block);
+  TEST_ASSERT_EQUAL_UINT32(0644, octalField(block + 100, 8));
+  TEST_ASSERT_EQUAL_UINT32(70000, octalField(block + 124, 12));
+  TEST_ASSERT_EQUAL_UINT32(1760767200, octalField(block + 136, 12));
+  TEST_ASSERT_EQUAL_UINT8('0', block[156]);
+  TEST_ASSERT_EQUAL_MEMORY("ustar\0" "00", block + 257, 8);
+
+  // Checksum: six octal digits, NUL, space; the byte sum with the field as spaces
+  TEST_ASSERT_EQUAL_UINT8(0, block[154]);
+  TEST_ASSERT_EQUAL_UINT8(' ', block[155]);
+  unsigned stored = octalField(block + 148, 6);
+  unsigned sum = 0;
+  for (int i = 0; i < TIMELAPSE_TAR_BLOCK; i++) sum += (i >= 148 && i < 156) ? ' ' : block[i];
+  TEST_ASSERT_EQUAL_UINT32(sum, stored);
+}
+
+static void test_tar_padding(void) {
+  TEST_ASSERT_EQUAL_size_t(0, timelapseTarPadding(0));
+  TEST_ASSERT_EQUAL_size_t(511, timelapseTarPadding(1));
+  TEST_ASSERT_EQUAL_size_t(0, timelapseTarPadding(512));
+  TEST_ASSERT_EQUAL_size_t(512 - 70000 % 512, timelapseTarPadding(70000));
+  TEST_ASSERT_EQUAL_size_t(1, timelapseTarPadding(1023));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_slots_on_interval);
+  RUN_TEST(test_overrun_skips_passed_slots);
+  RUN_TEST(test_run_ends_after_duration);
+  RUN_TEST(test_overrun_past_the_end);
+  RUN_TEST(test_stop_and_wall_clock);
+  RUN_TEST(test_eviction_by_budget);
+  RUN_TEST(test_eviction_by_frame_cap);
+  RUN_TEST(test_download_after_and_clear);
+  RUN_TEST(test_frame_in_download_outlives_eviction);
+  RUN_TEST(test_frame_names);
+  RUN_TEST(test_tar_header);
+  RUN_TEST(test_tar_padding);
+  return UNITY_END();
+}
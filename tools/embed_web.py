@@ -0,0 +1,64 @@
+"""
+Pre-build step: gzip web/index.html into include/index_html_gz.h
+
+Runs automatically from platformio.ini (extra_scripts = pre:tools/embed_web.py)
+and can also be run by hand: python tools/embed_web.py
+
+The header holds the compressed page as a constexpr byte array plus a strong
+ETag derived from its content, so index_handler can serve it with
+Content-Encoding: gzip and answer If-None-Match with 304.
+"""
+import gzip
+import hashlib
+import os
+
+try:
+    Import("env")  # noqa: F821 - provided by PlatformIO/SCons
+    PROJECT_DIR = env["PROJECT_DIR"]  # noqa: F821
+except NameError:
+    PROJECT_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+SOURCE = os.path.join(PROJECT_DIR, "web", "index.html")
+TARGET = os.path.join(PROJECT_DIR, "include", "index_html_gz.h")
+
+
+def render(html):
+    # mtime=0 keeps the output (and therefore the ETag) reproducible
+    gz = gzip.compress(html, compresslevel=9, mtime=0)
+    etag = '"%s"' % hashlib.sha256(gz).hexdigest()[:16]
+
+    lines = [
+        "// Generated by tools/embed_web.py from web/index.html - do not edit",
+        "#ifndef INDEX_HTML_GZ_H",
+        "#define INDEX_HTML_GZ_H",
+        "",
+        "#include <stddef.h>",
+        "#include <stdint.h>",
+        "",
+        "// %d bytes uncompressed" % len(html),
+        "constexpr size_t INDEX_HTML_GZ_LEN = %d;" % len(gz),
+        "constexpr char INDEX_HTML_GZ_ETAG[] = %s;" % ('"\\"%s\\""' % etag.strip('"')),
+        "constexpr uint8_t INDEX_HTML_GZ[] = {",
+    ]
+    for i in range(0, len(gz), 16):
+        lines.append("  " + ", ".join("0x%02x" % b for b in gz[i:i + 16]) + ",")
+    lines += ["};", "", "#endif", ""]
+    return "\n".join(lines), len(html), len(gz), etag
+
+
+def main():
+    with open(SOURCE, "rb") as f:
+        html = f.read()
+    header, raw_len, gz_len, etag = render(html)
+
+    # Only touch the header when the page changed, to avoid needless rebuilds
+    if os.path.exists(TARGET):
+        with open(TARGET, "r") as f:
+            if f.read() == header:
+                return
+    with open(TARGET, "w") as f:
+        f.write(header)
+    print("embed_web: web/index.html %d -> %d bytes gzip, ETag %s" % (raw_len, gz_len, etag))
+
+
+main()
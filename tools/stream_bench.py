@@ -0,0 +1,166 @@
+"""
+Host-side MJPEG transport benchmark: raw single-write parts vs chunked parts
+
+    python tools/stream_bench.py 192.168.1.xxx [--res qvga] [--frames 200]
+
+Sets the resolution with /capture?res=..., then reads the same number of frames
+from :81/stream (one send per part, no chunked encoding) and :81/stream?chunked=1
+(boundary, headers and JPEG as three HTTP chunks) and prints fps, bytes on the wire
+per frame and TCP data segments per frame. Segments come from the kernel's TCP_INFO
+(tcpi_data_segs_in, Linux only; counted before GRO merges them); elsewhere that
+column is left empty. Nothing else should be streaming while this runs.
+"""
+import argparse
+import socket
+import struct
+import sys
+import time
+import urllib.request
+
+STREAM_PORT = 81
+WARMUP_FRAMES = 5  # Mode switch and AEC settling after the first request
+TCPI_DATA_SEGS_IN = 152  # Offset of tcpi_data_segs_in in struct tcp_info (Linux >= 4.6)
+
+
+def data_segs_in(sock):
+    if not sys.platform.startswith("linux"):
+        return None
+    try:
+        info = sock.getsockopt(socket.IPPROTO_TCP, socket.TCP_INFO, 256)
+    except OSError:
+        return None
+    if len(info) < TCPI_DATA_SEGS_IN + 4:
+        return None
+    return struct.unpack_from("I", info, TCPI_DATA_SEGS_IN)[0]
+
+
+class Reader:
+    """Buffered socket reader that undoes chunked transfer encoding if present"""
+
+    def __init__(self, sock):
+        self.sock = sock
+        self.buf = b""
+        self.wire_bytes = 0
+        self.chunked = False
+        self.chunk_left = 0
+
+    def _fill(self):
+        data = self.sock.recv(65536)
+        if not data:
+            raise EOFError("stream closed")
+        self.wire_bytes += len(data)
+        return data
+
+    def _raw_until(self, sep):
+        while sep not in self.buf:
+            self.buf += self._fill()
+        line, self.buf = self.buf.split(sep, 1)
+        return line
+
+    def _raw_exact(self, n):
+        while len(self.buf) < n:
+            self.buf += self._fill()
+        data, self.buf = self.buf[:n], self.buf[n:]
+        return data
+
+    def read_headers(self):
+        head = self._raw_until(b"\r\n\r\n").decode("latin-1")
+        lines = head.split("\r\n")
+        headers = {}
+        for line in lines[1:]:
+            key, _, value = line.partition(":")
+            headers[key.strip().lower()] = value.strip()
+        self.chunked = headers.get("transfer-encoding", "").lower() == "chunked"
+        return lines[0], headers
+
+    def read(self, n):
+        if not self.chunked:
+            return self._raw_exact(n)
+        out = b""
+        while len(out) < n:
+            if self.chunk_left == 0:
+                size = int(self._raw_until(b"\r\n").split(b";")[0], 16)
+                if size == 0:
+                    raise EOFError("last chunk")
+                self.chunk_left = size
+            take = min(self.chunk_left, n - len(out))
+            out += self._raw_exact(take)
+            self.chunk_left -= take
+            if self.chunk_left == 0:
+                self._raw_exact(2)  # CRLF after the chunk data
+        return out
+
+    def read_line(self):
+        line = b""
+        while not line.endswith(b"\r\n"):
+            line += self.read(1)
+        return line[:-2]
+
+
+def read_part(reader):
+    """Skip to the next boundary, read the part headers and the JPEG; returns its size"""
+    while reader.read_line() != b"--frame":
+        pass
+    length = None
+    while True:
+        line = reader.read_line()
+        if not line:
+            break
+        key, _, value = line.decode("latin-1").partition(":")
+        if key.strip().lower() == "content-length":
+            length = int(value)
+    if length is None:
+        raise ValueError("part without Content-Length")
+    jpeg = reader.read(length)
+    if jpeg[:2] != b"\xff\xd8":
+        raise ValueError("part is not a JPEG")
+    return length
+
+
+def run(host, path, frames):
+    sock = socket.create_connection((host, STREAM_PORT), timeout=10)
+    sock.sendall(("GET %s HTTP/1.1\r\nHost: %s\r\n\r\n" % (path, host)).encode())
+    reader = Reader(sock)
+    status, _ = reader.read_headers()
+    if " 200" not in status:
+        raise RuntimeError("%s: %s" % (path, status))
+
+    for _ in range(WARMUP_FRAMES):
+        read_part(reader)
+    wire_start = reader.wire_bytes - len(reader.buf)
+    segs_start = data_segs_in(sock)
+    start = time.monotonic()
+    jpeg_bytes = 0
+    for _ in range(frames):
+        jpeg_bytes += read_part(reader)
+    elapsed = time.monotonic() - start
+    wire = reader.wire_bytes - len(reader.buf) - wire_start
+    segs_end = data_segs_in(sock)
+    sock.close()
+
+    return {
+        "fps": frames / elapsed,
+        "jpeg": jpeg_bytes / frames,
+        "wire": wire / frames,
+        "segs": None if segs_start is None else (segs_end - segs_start) / frames,
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("host")
+    parser.add_argument("--res", default="qvga", help="frame size set before streaming (default qvga)")
+    parser.add_argument("--frames", type=int, default=200)
+    args = parser.parse_args()
+
+    urllib.request.urlopen("http://%s/capture?res=%s" % (args.host, args.res), timeout=15).read()
+
+    print("%-10s %8s %10s %10s %10s" % ("transport", "fps", "jpeg B", "wire B", "segs/frame"))
+    for name, path in (("raw", "/stream"), ("chunked", "/stream?chunked=1")):
+        r = run(args.host, path, args.frames)
+        segs = "-" if r["segs"] is None else "%.2f" % r["segs"]
+        print("%-10s %8.2f %10.0f %10.0f %10s" % (name, r["fps"], r["jpeg"], r["wire"], segs))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,179 @@
+"""
+Host-side WebSocket stream latency: per-frame age with a slow (delayed-ack) client
+
+    python tools/ws_latency.py 192.168.1.xxx [--res qvga] [--frames 100] [--delays 0,100,500]
+
+Connects to ws://<host>:81/ws and, for each delay, requests --frames frames, waiting
+that many ms after each frame before sending the next "next" (a client that is slow
+to display). Prints, per delay, fps, the request-to-frame time and the frame age:
+the host receive time minus the capture timestamp in the frame header. The device
+clock (ms since boot) isn't synchronised with the host, so ages are relative to the
+freshest frame of the whole run (0 = as fresh as the best frame seen). With the
+one-frame-in-flight protocol the age should stay flat as the delay grows, while
+skipped frames (sequence gaps) rise; a growing age means frames are queueing.
+--csv writes one row per frame. Nothing else should be streaming while this runs.
+"""
+import argparse
+import base64
+import os
+import socket
+import struct
+import time
+import urllib.request
+
+STREAM_PORT = 81
+WARMUP_FRAMES = 5  # Mode switch and AEC settling after the first request
+FRAME_HEADER = struct.Struct("<2sBBIIHH")  # 'FR', version, header length, seq, ts_ms, w, h
+
+
+class WebSocket:
+    """Minimal RFC 6455 client: masked text out, (fragmented) binary messages in"""
+
+    def __init__(self, host, port, path):
+        self.sock = socket.create_connection((host, port), timeout=10)
+        self.sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        key = base64.b64encode(os.urandom(16)).decode()
+        self.sock.sendall((
+            "GET %s HTTP/1.1\r\nHost: %s\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+            "Sec-WebSocket-Key: %s\r\nSec-WebSocket-Version: 13\r\n\r\n" % (path, host, key)).encode())
+        self.buf = b""
+        head = self._until(b"\r\n\r\n").decode("latin-1")
+        if " 101" not in head.split("\r\n")[0]:
+            raise RuntimeError("%s: %s" % (path, head.split("\r\n")[0]))
+
+    def _fill(self):
+        data = self.sock.recv(65536)
+        if not data:
+            raise EOFError("connection closed")
+        self.buf += data
+
+    def _until(self, sep):
+        while sep not in self.buf:
+            self._fill()
+        head, self.buf = self.buf.split(sep, 1)
+        return head
+
+    def _exact(self, n):
+        while len(self.buf) < n:
+            self._fill()
+        data, self.buf = self.buf[:n], self.buf[n:]
+        return data
+
+    def send(self, opcode, payload):
+        mask = os.urandom(4)
+        masked = bytes(b ^ mask[i & 3] for i, b in enumerate(payload))
+        if len(payload) < 126:
+            head = struct.pack("!BB", 0x80 | opcode, 0x80 | len(payload))
+        else:
+            head = struct.pack("!BBH", 0x80 | opcode, 0x80 | 126, len(payload))
+        self.sock.sendall(head + mask + masked)
+
+    def recv_message(self):
+        """Next complete data message; answers pings. Returns the payload."""
+        message = b""
+        while True:
+            b0, b1 = self._exact(2)
+            length = b1 & 0x7F
+            if length == 126:
+                length = struct.unpack("!H", self._exact(2))[0]
+            elif length == 127:
+                length = struct.unpack("!Q", self._exact(8))[0]
+            payload = self._exact(length)  # Server frames are never masked
+            opcode = b0 & 0x0F
+            if opcode == 0x8:
+                raise EOFError("server closed the WebSocket")
+            if opcode == 0x9:
+                self.send(0xA, payload)
+                continue
+            if opcode == 0xA:
+                continue
+            message += payload
+            if b0 & 0x80:
+                return message
+
+    def close(self):
+        try:
+            self.send(0x8, b"")
+        except OSError:
+            pass
+        self.sock.close()
+
+
+def request_frame(ws):
+    """Send "next" and read the answer; returns (request time, receive time, seq, ts_ms, size)"""
+    sent = time.monotonic()
+    ws.send(0x1, b"next")
+    msg = ws.recv_message()
+    received = time.monotonic()
+    magic, version, header_len, seq, ts_ms, width, height = FRAME_HEADER.unpack_from(msg)
+    if magic != b"FR" or version != 1:
+        raise ValueError("unexpected frame header %r" % msg[:FRAME_HEADER.size])
+    if msg[header_len:header_len + 2] != b"\xff\xd8":
+        raise ValueError("frame %u is not a JPEG" % seq)
+    return sent, received, seq, ts_ms, len(msg) - header_len
+
+
+def run(ws, frames, delay_ms):
+    for _ in range(WARMUP_FRAMES):
+        request_frame(ws)
+    rows = []
+    start = time.monotonic()
+    for _ in range(frames):
+        rows.append(request_frame(ws))
+        if delay_ms:
+            time.sleep(delay_ms / 1000.0)
+    elapsed = time.monotonic() - start
+    return rows, elapsed
+
+
+def percentile(values, q):
+    ordered = sorted(values)
+    return ordered[min(len(ordered) - 1, int(q * len(ordered)))]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("host")
+    parser.add_argument("--res", default="qvga", help="frame size set before streaming (default qvga)")
+    parser.add_argument("--frames", type=int, default=100, help="frames per delay (default 100)")
+    parser.add_argument("--delays", default="0,100,500", help="ms to wait before each ack (default 0,100,500)")
+    parser.add_argument("--csv", help="write one row per frame to this file")
+    args = parser.parse_args()
+    delays = [int(d) for d in args.delays.split(",")]
+
+    urllib.request.urlopen("http://%s/capture?res=%s" % (args.host, args.res), timeout=15).read()
+
+    ws = WebSocket(args.host, STREAM_PORT, "/ws")
+    results = []
+    try:
+        for delay in delays:
+            rows, elapsed = run(ws, args.frames, delay)
+            results.append((delay, rows, elapsed))
+    finally:
+        ws.close()
+
+    # Clock offset: the smallest receive-minus-capture difference over all frames
+    base = min(received * 1000.0 - ts_ms for _, rows, _ in results for _, received, _, ts_ms, _ in rows)
+
+    print("%8s %7s %9s %9s %9s %9s %9s %8s" % (
+        "delay ms", "fps", "req p50", "req p95", "age p50", "age p95", "age max", "skipped"))
+    for delay, rows, elapsed in results:
+        req = [(received - sent) * 1000.0 for sent, received, _, _, _ in rows]
+        age = [received * 1000.0 - ts_ms - base for _, received, _, ts_ms, _ in rows]
+        seqs = [seq for _, _, seq, _, _ in rows]
+        skipped = sum(max(0, b - a - 1) for a, b in zip(seqs, seqs[1:]))
+        print("%8d %7.2f %9.1f %9.1f %9.1f %9.1f %9.1f %8d" % (
+            delay, len(rows) / elapsed, percentile(req, 0.5), percentile(req, 0.95),
+            percentile(age, 0.5), percentile(age, 0.95), max(age), skipped))
+
+    if args.csv:
+        with open(args.csv, "w") as f:
+            f.write("delay_ms,seq,bytes,request_ms,age_ms\n")
+            for delay, rows, _ in results:
+                for sent, received, seq, ts_ms, size in rows:
+                    f.write("%d,%u,%d,%.1f,%.1f\n" % (
+                        delay, seq, size, (received - sent) * 1000.0, received * 1000.0 - ts_ms - base))
+
+
+if __name__ == "__main__":
+    main()